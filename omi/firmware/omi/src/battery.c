@@ -5,13 +5,14 @@
 #include <zephyr/dt-bindings/gpio/nordic-nrf-gpio.h>
 #include <zephyr/drivers/adc.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
 #include <hal/nrf_saadc.h>
 #include "lib/dk2/lib/battery/battery.h"
+#include "lib/dk2/battery_estimator.h"
+#include "lib/dk2/power.h"
 
 LOG_MODULE_REGISTER(battery, CONFIG_LOG_DEFAULT_LEVEL);
 
-#define BATTERY_STATES_COUNT 16
-
 #define ADC_TOTAL_SAMPLES 20
 // +1 for the calibration sample
 int16_t sample_buffer[ADC_TOTAL_SAMPLES + 1];
@@ -22,6 +23,21 @@ int16_t sample_buffer[ADC_TOTAL_SAMPLES + 1];
 #define ADC_ACQUISITION_TIME ADC_ACQ_TIME(ADC_ACQ_TIME_MICROSECONDS, 10)
 #define ADC_1ST_CHANNEL_ID 0
 #define ADC_1ST_CHANNEL_INPUT NRF_SAADC_INPUT_AIN0
+// The offset drifts with temperature, not from one reading to the next
+#define ADC_CALIBRATION_INTERVAL_MS 600000
+// Charger status and VBUS have to settle this long before a change counts
+#define CHARGER_DEBOUNCE_MS 100
+
+// VBUS status of the USB regulator. Its interrupt only wakes the debounce when
+// no USB stack or nrfx USBREG driver has claimed the vector; otherwise VBUS is
+// only sampled along with the charger status line.
+#if defined(NRF_USBREGULATOR)
+#define CHARGER_VBUS_SENSE
+#include <hal/nrf_usbreg.h>
+#if !defined(CONFIG_USB_NRFX) && !defined(CONFIG_UDC_NRF) && !defined(CONFIG_NRFX_USBREG)
+#define CHARGER_VBUS_IRQ
+#endif
+#endif
 
 static const struct device *const adc_dev = DEVICE_DT_GET(DT_NODELABEL(adc));
 static const struct gpio_dt_spec power_pin = GPIO_DT_SPEC_GET_OR(DT_NODELABEL(power_pin), gpios, {0});
@@ -29,29 +45,18 @@ static const struct gpio_dt_spec bat_read_pin = GPIO_DT_SPEC_GET_OR(DT_NODELABEL
 static const struct gpio_dt_spec bat_chg_pin = GPIO_DT_SPEC_GET_OR(DT_NODELABEL(bat_chg_pin), gpios, {0});
 
 static struct gpio_callback bat_chg_cb;
+static atomic_t charger_state = ATOMIC_INIT(CHARGER_UNPLUGGED);
+static charger_handler charger_cb;
 
 static K_MUTEX_DEFINE(battery_mut);
+static int64_t adc_calibrated_ms = -1;
 
-// 150mAh LiPo battery discharge profile
-typedef struct {
-    uint16_t millivolts;
-    uint8_t percentage;
-} BatteryState;
-
-BatteryState battery_states[BATTERY_STATES_COUNT] = {
-    {4200, 100},
-    {4160, 99},
-    {4090, 91},
-    {4030, 78},
-    {3890, 63},
-    {3830, 53},
-    {3680, 36},
-    {3660, 35},
-    {3480, 14},
-    {3420, 11},
-    {3400, 1}, // Threshold for <1%
-    {0000, 0}  // Below safe level
-};
+// Latest estimate, read without touching the ADC
+static battery_estimator_t battery_estimator;
+static struct k_spinlock battery_level_lock;
+static uint16_t battery_level_millivolt;
+static uint8_t battery_level_percentage;
+static bool battery_level_valid;
 
 extern bool is_charging;
 
@@ -81,15 +86,76 @@ struct adc_sequence sequence = {
     .resolution = ADC_RESOLUTION,
 };
 
+static const char *const charger_state_names[] = {
+    [CHARGER_UNPLUGGED] = "unplugged",
+    [CHARGER_CHARGING] = "charging",
+    [CHARGER_COMPLETE] = "complete",
+};
+
+static charger_state_t charger_read(void)
+{
+    // The charger pulls its status low while charging
+    bool charging = gpio_pin_get(bat_chg_pin.port, bat_chg_pin.pin) == 0;
+    bool powered = charging;
+#ifdef CHARGER_VBUS_SENSE
+    powered |= (nrf_usbreg_status_get(NRF_USBREGULATOR) & NRF_USBREG_STATUS_VBUSDETECT_MASK) != 0;
+#endif
+    // Without VBUS sensing a full battery on the charger looks unplugged
+    if (charging) {
+        return CHARGER_CHARGING;
+    }
+    return powered ? CHARGER_COMPLETE : CHARGER_UNPLUGGED;
+}
+
+static void charger_apply(charger_state_t state)
+{
+    is_charging = state == CHARGER_CHARGING;
+    power_set_input(POWER_INPUT_CHARGING, state != CHARGER_UNPLUGGED);
+    if (charger_cb) {
+        charger_cb(state);
+    }
+}
+
+// Runs in the system timer interrupt once the inputs stopped bouncing
+static void charger_debounce_expired(struct k_timer *timer)
+{
+    charger_state_t state = charger_read();
+    if (atomic_set(&charger_state, state) != state) {
+        LOG_INF("Charger %s", charger_state_names[state]);
+        charger_apply(state);
+    }
+}
+
+static K_TIMER_DEFINE(charger_debounce_timer, charger_debounce_expired, NULL);
+
 static void battery_charging_callback(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
 {
-    if(gpio_pin_get(bat_chg_pin.port, bat_chg_pin.pin) == 0) {
-        is_charging = true;
-    } else {
-        is_charging = false;
+    // Every edge pushes the decision back
+    k_timer_start(&charger_debounce_timer, K_MSEC(CHARGER_DEBOUNCE_MS), K_NO_WAIT);
+}
+
+#ifdef CHARGER_VBUS_IRQ
+static void charger_vbus_isr(const void *arg)
+{
+    nrf_usbreg_event_clear(NRF_USBREGULATOR, NRF_USBREG_EVENT_USBDETECTED);
+    nrf_usbreg_event_clear(NRF_USBREGULATOR, NRF_USBREG_EVENT_USBREMOVED);
+    k_timer_start(&charger_debounce_timer, K_MSEC(CHARGER_DEBOUNCE_MS), K_NO_WAIT);
+}
+#endif
+
+void battery_set_charger_callback(charger_handler handler)
+{
+    charger_cb = handler;
+    if (handler) {
+        handler(atomic_get(&charger_state));
     }
 }
 
+charger_state_t battery_get_charger_state(void)
+{
+    return atomic_get(&charger_state);
+}
+
 int battery_get_millivolt(uint16_t *battery_millivolt)
 {
     int err;
@@ -116,18 +182,13 @@ int battery_get_millivolt(uint16_t *battery_millivolt)
         return -ENODEV;
     }
 
-    err = adc_channel_setup(adc_dev, &m_1st_channel_cfg);
-    if (err) {
-        LOG_ERR("ADC channel setup failed (error %d)", err);
-        gpio_pin_configure_dt(&bat_read_pin, GPIO_INPUT); // Restore pin state
-        k_mutex_unlock(&battery_mut);
-        return err;
+    // The driver runs the offset calibration before sampling, the first sample after it is discarded
+    int64_t now = k_uptime_get();
+    sequence.calibrate = adc_calibrated_ms < 0 || now - adc_calibrated_ms >= ADC_CALIBRATION_INTERVAL_MS;
+    if (sequence.calibrate) {
+        adc_calibrated_ms = now;
     }
 
-    // Trigger offset calibration. The first sample after this will be affected.
-    NRF_SAADC_S->TASKS_CALIBRATEOFFSET = 1;
-    k_busy_wait(100); // Short delay for calibration, if needed.
-
     err = adc_read(adc_dev, &sequence);
     if (err) {
         LOG_WRN("ADC read failed (error %d)", err);
@@ -136,7 +197,7 @@ int battery_get_millivolt(uint16_t *battery_millivolt)
         return err;
     }
 
-    // Average valid samples, discarding the first one (post-calibration)
+    // Average valid samples, discarding the first one
     int32_t sum_adc_raw = 0;
     for (int i = 0; i < ADC_TOTAL_SAMPLES; i++) {
         sum_adc_raw += sample_buffer[i + 1];
@@ -177,34 +238,46 @@ int battery_get_millivolt(uint16_t *battery_millivolt)
 
 int battery_get_percentage(uint8_t *battery_percentage, uint16_t battery_millivolt)
 {
-    // Use the battery discharge profile to determine percentage
-    if (battery_millivolt >= battery_states[0].millivolts) {
-        *battery_percentage = battery_states[0].percentage;
-        return 0;
-    }
+    *battery_percentage = (uint8_t)(battery_ocv_percent(battery_millivolt) + 0.5f);
+    return 0;
+}
 
-    if (battery_millivolt <= battery_states[BATTERY_STATES_COUNT-1].millivolts) {
-        *battery_percentage = battery_states[BATTERY_STATES_COUNT-1].percentage;
-        return 0;
+int battery_update(uint32_t load_ua, bool *changed)
+{
+    uint16_t millivolt;
+    int err = battery_get_millivolt(&millivolt);
+    if (err) {
+        return err;
     }
 
-    // Find the appropriate range in the battery profile
-    for (int i = 0; i < BATTERY_STATES_COUNT - 1; i++) {
-        if (battery_millivolt <= battery_states[i].millivolts &&
-            battery_millivolt > battery_states[i+1].millivolts) {
+    *changed = battery_estimator_update(&battery_estimator, millivolt, load_ua, is_charging, k_uptime_get());
 
-            // Linear interpolation between the two closest points
-            uint16_t voltage_range = battery_states[i].millivolts - battery_states[i+1].millivolts;
-            uint8_t percentage_range = battery_states[i].percentage - battery_states[i+1].percentage;
-            uint16_t voltage_diff = battery_states[i].millivolts - battery_millivolt;
+    k_spinlock_key_t key = k_spin_lock(&battery_level_lock);
+    battery_level_millivolt = millivolt;
+    battery_level_percentage = battery_estimator_percent(&battery_estimator);
+    battery_level_valid = true;
+    k_spin_unlock(&battery_level_lock, key);
 
-            *battery_percentage = battery_states[i].percentage -
-                                 (voltage_diff * percentage_range) / voltage_range;
-            break;
-        }
+    LOG_DBG("Battery at %u mV under %u uA, %u%%", millivolt, load_ua, battery_level_percentage);
+    return 0;
+}
+
+int battery_get_level(uint8_t *battery_percentage, uint16_t *battery_millivolt)
+{
+    k_spinlock_key_t key = k_spin_lock(&battery_level_lock);
+    bool valid = battery_level_valid;
+    *battery_percentage = battery_level_percentage;
+    if (battery_millivolt) {
+        *battery_millivolt = battery_level_millivolt;
     }
+    k_spin_unlock(&battery_level_lock, key);
 
-    return 0;
+    return valid ? 0 : -ENODATA;
+}
+
+uint32_t battery_update_interval_ms(uint32_t load_ua)
+{
+    return battery_estimator_interval_ms(&battery_estimator, load_ua);
 }
 
 int battery_charge_start()
@@ -237,6 +310,7 @@ int battery_init()
     if (err < 0)
     {
         LOG_ERR("Failed to configure enable pin (%d)", err);
+        k_mutex_unlock(&battery_mut);
         return err;
     }
 
@@ -244,17 +318,43 @@ int battery_init()
     if (err < 0)
     {
         LOG_ERR("Failed to configure enable pin (%d)", err);
+        k_mutex_unlock(&battery_mut);
         return err;
     }
-    battery_charging_callback(NULL, NULL, 0);
+    atomic_set(&charger_state, charger_read());
+    charger_apply(atomic_get(&charger_state));
     err = gpio_pin_interrupt_configure_dt(&bat_chg_pin, GPIO_INT_EDGE_BOTH);
     if (err < 0) {
         LOG_ERR("Failed to configure interrupt for bat_chg_pin (%d)", err);
+        k_mutex_unlock(&battery_mut);
         return err;
     }
     gpio_init_callback(&bat_chg_cb, battery_charging_callback, BIT(bat_chg_pin.pin));
     gpio_add_callback(bat_chg_pin.port, &bat_chg_cb);
 
+#ifdef CHARGER_VBUS_IRQ
+    nrf_usbreg_event_clear(NRF_USBREGULATOR, NRF_USBREG_EVENT_USBDETECTED);
+    nrf_usbreg_event_clear(NRF_USBREGULATOR, NRF_USBREG_EVENT_USBREMOVED);
+    nrf_usbreg_int_enable(NRF_USBREGULATOR, NRF_USBREG_INT_USBDETECTED | NRF_USBREG_INT_USBREMOVED);
+    IRQ_CONNECT(USBREGULATOR_IRQn, 3, charger_vbus_isr, NULL, 0);
+    irq_enable(USBREGULATOR_IRQn);
+#endif
+
+    // The channel keeps its configuration between readings
+    if (!device_is_ready(adc_dev)) {
+        LOG_ERR("ADC device %s is not ready", adc_dev->name);
+        k_mutex_unlock(&battery_mut);
+        return -ENODEV;
+    }
+    err = adc_channel_setup(adc_dev, &m_1st_channel_cfg);
+    if (err) {
+        LOG_ERR("ADC channel setup failed (error %d)", err);
+        k_mutex_unlock(&battery_mut);
+        return err;
+    }
+
+    battery_estimator_init(&battery_estimator, CONFIG_OMI_BATTERY_CAPACITY_MAH, CONFIG_OMI_BATTERY_RESISTANCE_MOHM);
+
     k_mutex_unlock(&battery_mut);
     return 0;
 }
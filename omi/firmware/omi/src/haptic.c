@@ -1,5 +1,7 @@
+#include <string.h>
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/pwm.h>
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/logging/log.h>
@@ -10,22 +12,121 @@ LOG_MODULE_REGISTER(haptic, CONFIG_LOG_DEFAULT_LEVEL);
 
 #define MAX_HAPTIC_DURATION 5000
 
+#if DT_NODE_HAS_STATUS(DT_NODELABEL(haptic_pwm), okay) && defined(CONFIG_PWM)
+#define HAPTIC_USE_PWM 1
+static const struct pwm_dt_spec haptic_pwm = PWM_DT_SPEC_GET(DT_NODELABEL(haptic_pwm));
+#else
 static const struct gpio_dt_spec haptic_pin =
     GPIO_DT_SPEC_GET_OR(DT_NODELABEL(motor_pin), gpios, {0});
+#endif
 
-// Haptic Off Work Item
-static struct k_work_delayable haptic_off_work;
+// The engine is shared with BLE and button callers. Steps are taken by the step
+// work and by the caller that starts a sequence, so the motor follows a
+// preemption at once, even from a busy system work queue. The spinlock only
+// covers the engine; the driver calls, which may wait on the PWM, run under a
+// mutex that keeps the steps in order between the two.
+static struct k_spinlock haptic_lock;
+static K_MUTEX_DEFINE(haptic_step_lock);
+static haptic_engine_t haptic_engine;
+static struct k_work_delayable haptic_step_work;
 
-// Work handler to turn off haptic motor
-static void haptic_off_work_handler(struct k_work *work)
+static void haptic_drive(uint8_t intensity)
 {
-    haptic_off();
-    LOG_INF("Haptic turned off by work handler");
+#ifdef HAPTIC_USE_PWM
+    int err = pwm_set_pulse_dt(&haptic_pwm, (uint32_t)((uint64_t)haptic_pwm.period * intensity / UINT8_MAX));
+#else
+    // Without PWM any intensity is full drive
+    int err = gpio_pin_set_dt(&haptic_pin, intensity > 0);
+#endif
+    if (err) {
+        LOG_ERR("Failed to drive haptic motor (err %d)", err);
+    }
+}
+
+static void haptic_step(void)
+{
+    haptic_step_t step;
+
+    k_mutex_lock(&haptic_step_lock, K_FOREVER);
+    k_spinlock_key_t key = k_spin_lock(&haptic_lock);
+    bool playing = haptic_engine_next(&haptic_engine, &step);
+    k_spin_unlock(&haptic_lock, key);
+
+    if (playing) {
+        haptic_drive(step.intensity);
+        k_work_reschedule(&haptic_step_work, K_MSEC(step.duration_ms));
+    } else {
+        haptic_drive(0);
+    }
+    k_mutex_unlock(&haptic_step_lock);
+}
+
+static void haptic_step_work_handler(struct k_work *work)
+{
+    haptic_step();
+}
+
+// Built-in patterns
+static const haptic_step_t short_steps[] = {{255, 100}};
+static const haptic_step_t medium_steps[] = {{255, 300}};
+static const haptic_step_t long_steps[] = {{255, 500}};
+static const haptic_step_t double_steps[] = {
+    {255, 80},
+    {0, 120},
+    {255, 80},
+};
+static const haptic_step_t notification_steps[] = {
+    {255, 40},
+    {0, 100},
+    {255, 40},
+    {0, 100},
+    {255, 200},
+};
+static const haptic_step_t ramp_up_steps[] = {
+    {64, 80},
+    {128, 80},
+    {192, 80},
+    {255, 120},
+};
+static const haptic_step_t heartbeat_steps[] = {
+    {255, 60},
+    {0, 80},
+    {160, 60},
+    {0, 500},
+    {255, 60},
+    {0, 80},
+    {160, 60},
+};
+
+const haptic_pattern_t haptic_patterns[HAPTIC_PATTERN_COUNT] = {
+    [HAPTIC_PATTERN_SHORT] = {short_steps, ARRAY_SIZE(short_steps)},
+    [HAPTIC_PATTERN_MEDIUM] = {medium_steps, ARRAY_SIZE(medium_steps)},
+    [HAPTIC_PATTERN_LONG] = {long_steps, ARRAY_SIZE(long_steps)},
+    [HAPTIC_PATTERN_DOUBLE] = {double_steps, ARRAY_SIZE(double_steps)},
+    [HAPTIC_PATTERN_NOTIFICATION] = {notification_steps, ARRAY_SIZE(notification_steps)},
+    [HAPTIC_PATTERN_RAMP_UP] = {ramp_up_steps, ARRAY_SIZE(ramp_up_steps)},
+    [HAPTIC_PATTERN_HEARTBEAT] = {heartbeat_steps, ARRAY_SIZE(heartbeat_steps)},
+};
+
+static int haptic_submit(const haptic_sequence_t *sequence)
+{
+    k_spinlock_key_t key = k_spin_lock(&haptic_lock);
+    int ret = haptic_engine_submit(&haptic_engine, sequence);
+    k_spin_unlock(&haptic_lock, key);
+
+    if (ret > 0) {
+        haptic_step();
+    }
+
+    if (ret < 0) {
+        LOG_WRN("Haptic queue full, dropped a priority %u request", sequence->priority);
+        return ret;
+    }
+    return 0;
 }
 
 
 // BLE Service definitions
-static void haptic_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value);
 static ssize_t haptic_write_handler(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
 
 // Define a unique UUID for the Haptic Service
@@ -33,6 +134,12 @@ static struct bt_uuid_128 haptic_service_uuid = BT_UUID_INIT_128(BT_UUID_128_ENC
 static struct bt_uuid_128 haptic_char_uuid = BT_UUID_INIT_128(BT_UUID_128_ENCODE(0xCAB1AB96, 0x2EA5, 0x4F4D, 0xBB56, 0x874B72CFC984));
 
 // Define the Haptic GATT Service structure
+//
+// Writes to the characteristic:
+//   [value]                          1..5, legacy single byte, the built-in patterns 0..4 at high priority
+//   [0x10, id, priority]             play built-in pattern id
+//   [0x11, priority, (level, time)…] play up to HAPTIC_MAX_STEPS steps, level 0..255 and time in 10 ms units
+//   [0x12]                           stop and clear the queue
 static struct bt_gatt_attr haptic_attrs[] = {
     BT_GATT_PRIMARY_SERVICE(&haptic_service_uuid),
     BT_GATT_CHARACTERISTIC(&haptic_char_uuid.uuid,
@@ -43,6 +150,22 @@ static struct bt_gatt_attr haptic_attrs[] = {
 
 static struct bt_gatt_service haptic_service = BT_GATT_SERVICE(haptic_attrs);
 
+#define HAPTIC_CMD_PLAY_ID 0x10
+#define HAPTIC_CMD_PLAY_STEPS 0x11
+#define HAPTIC_CMD_STOP 0x12
+
+static ssize_t haptic_write_result(int err, uint16_t len)
+{
+    switch (err) {
+        case 0:
+            return len;
+        case -ENOBUFS:
+            return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+        default:
+            return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+}
+
 // Haptic Write Handler
 static ssize_t haptic_write_handler(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
 {
@@ -51,26 +174,43 @@ static ssize_t haptic_write_handler(struct bt_conn *conn, const struct bt_gatt_a
         return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
     }
 
-    uint8_t value = ((uint8_t*)buf)[0];
-    LOG_INF("Haptic write received: value %d", value);
+    const uint8_t *data = buf;
+    LOG_INF("Haptic write received: command %d, length %d", data[0], len);
 
-    // Map received value to haptic duration
-    // 1 -> 100ms, 2 -> 300ms, 3 -> 500ms
-    switch (value) {
-        case 1:
-            play_haptic_milli(100);
-            break;
-        case 2:
-            play_haptic_milli(300);
-            break;
-        case 3:
-            play_haptic_milli(500);
-            break;
-        default:
-            LOG_WRN("Haptic write: Invalid value %d", value);
+    switch (data[0]) {
+        case HAPTIC_CMD_PLAY_ID:
+            if (len != 3) {
+                return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+            }
+            if (data[1] >= HAPTIC_PATTERN_COUNT || data[2] > HAPTIC_PRIORITY_HIGH) {
+                return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+            }
+            return haptic_write_result(play_haptic_pattern(&haptic_patterns[data[1]], data[2]), len);
+        case HAPTIC_CMD_PLAY_STEPS: {
+            if (len < 2 || data[1] > HAPTIC_PRIORITY_HIGH) {
+                return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+            }
+            haptic_sequence_t sequence;
+            int err = haptic_sequence_from_blob(&sequence, &data[2], len - 2, data[1]);
+            if (err) {
+                return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+            }
+            return haptic_write_result(haptic_submit(&sequence), len);
+        }
+        case HAPTIC_CMD_STOP:
+            haptic_off();
             return len;
+        default:
+            break;
+    }
+
+    // Map received value to a built-in pattern
+    // 1 -> 100ms, 2 -> 300ms, 3 -> 500ms, 4 -> double pulse, 5 -> notification pattern
+    if (len == 1 && data[0] >= 1 && data[0] <= HAPTIC_PATTERN_NOTIFICATION + 1) {
+        return haptic_write_result(play_haptic_pattern(&haptic_patterns[data[0] - 1], HAPTIC_PRIORITY_HIGH), len);
     }
 
+    LOG_WRN("Haptic write: Invalid value %d", data[0]);
     return len;
 }
 
@@ -78,13 +218,26 @@ static ssize_t haptic_write_handler(struct bt_conn *conn, const struct bt_gatt_a
 
 int haptic_init(void)
 {
+#ifdef HAPTIC_USE_PWM
+    if (!pwm_is_ready_dt(&haptic_pwm)) {
+        LOG_ERR("Haptic PWM device %s is not ready", haptic_pwm.dev->name);
+        return -ENODEV;
+    }
+#else
     if (!gpio_is_ready_dt(&haptic_pin)) {
         LOG_ERR("Haptic GPIO device %s is not ready", haptic_pin.port->name);
         return -ENODEV;
     }
 
-    // Initialize the delayable work item
-    k_work_init_delayable(&haptic_off_work, haptic_off_work_handler);
+    int err = gpio_pin_configure_dt(&haptic_pin, GPIO_OUTPUT_INACTIVE);
+    if (err) {
+        LOG_ERR("Failed to configure haptic pin for output (err %d)", err);
+        return err;
+    }
+#endif
+
+    haptic_engine_init(&haptic_engine);
+    k_work_init_delayable(&haptic_step_work, haptic_step_work_handler);
 
     LOG_INF("Haptic system initialized");
     return 0;
@@ -92,38 +245,30 @@ int haptic_init(void)
 
 void play_haptic_milli(uint32_t duration)
 {
-    if (!gpio_is_ready_dt(&haptic_pin)) {
-        LOG_ERR("Haptic GPIO device not ready");
-        return;
-    }
-
-    // Cancel any pending off work before proceeding
-    k_work_cancel_delayable(&haptic_off_work);
-
-    if (duration == 0) {
-        // If duration is 0, ensure the pin is off and we are done.
-        gpio_pin_set_dt(&haptic_pin, 0);
-        LOG_INF("Haptic explicitly stopped (duration 0)");
-        return;
-    }
-
-    // Configure GPIO pin just before turning it on
-    int err = gpio_pin_configure_dt(&haptic_pin, GPIO_OUTPUT);
-    if (err) {
-        LOG_ERR("Failed to configure haptic pin for output (err %d)", err);
-        return;
-    }
-
-
     if (duration > MAX_HAPTIC_DURATION) {
         LOG_WRN("Requested haptic duration %u exceeds max %d, capping.", duration, MAX_HAPTIC_DURATION);
         duration = MAX_HAPTIC_DURATION;
     }
 
+    // A single buzz interrupts anything below it
+    haptic_sequence_t sequence = {
+        .steps = {{.intensity = UINT8_MAX, .duration_ms = duration}},
+        .count = duration > 0 ? 1 : 0,
+        .priority = HAPTIC_PRIORITY_HIGH,
+    };
     LOG_INF("Playing haptic for %u ms", duration);
-    gpio_pin_set_dt(&haptic_pin, 1);
-    // Schedule the work item to turn the haptic off after the duration
-    k_work_schedule(&haptic_off_work, K_MSEC(duration));
+    haptic_submit(&sequence);
+}
+
+int play_haptic_pattern(const haptic_pattern_t *pattern, haptic_priority_t priority)
+{
+    if (pattern->count > HAPTIC_MAX_STEPS) {
+        return -EINVAL;
+    }
+
+    haptic_sequence_t sequence = {.count = pattern->count, .priority = priority};
+    memcpy(sequence.steps, pattern->steps, pattern->count * sizeof(haptic_step_t));
+    return haptic_submit(&sequence);
 }
 
 void register_haptic_service(void)
@@ -138,6 +283,12 @@ void register_haptic_service(void)
 
 void haptic_off()
 {
-    gpio_pin_set_dt(&haptic_pin, 0);
-}
+    k_mutex_lock(&haptic_step_lock, K_FOREVER);
+    k_spinlock_key_t key = k_spin_lock(&haptic_lock);
+    haptic_engine_stop(&haptic_engine);
+    k_spin_unlock(&haptic_lock, key);
 
+    k_work_cancel_delayable(&haptic_step_work);
+    haptic_drive(0);
+    k_mutex_unlock(&haptic_step_lock);
+}
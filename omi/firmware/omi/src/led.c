@@ -1,7 +1,9 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/atomic.h>
 #include "lib/dk2/led.h"
 #include "lib/dk2/utils.h"
+#include "lib/dk2/energy.h"
 
 LOG_MODULE_REGISTER(led, CONFIG_LOG_DEFAULT_LEVEL);
 
@@ -10,8 +12,43 @@ const struct gpio_dt_spec led_red = GPIO_DT_SPEC_GET_OR(DT_NODELABEL(led_red), g
 const struct gpio_dt_spec led_green = GPIO_DT_SPEC_GET_OR(DT_NODELABEL(led_green), gpios, {0});
 const struct gpio_dt_spec led_blue = GPIO_DT_SPEC_GET_OR(DT_NODELABEL(led_blue), gpios, {0});
 
+// LED_ mask of the LEDs lit, for the energy ledger
+static atomic_t leds_lit = ATOMIC_INIT(0);
+
+static void led_set(const struct gpio_dt_spec *led, uint8_t mask, bool on)
+{
+    gpio_pin_set_dt(led, on);
+    atomic_val_t lit = on ? atomic_or(&leds_lit, mask) | mask : atomic_and(&leds_lit, ~mask) & ~mask;
+    energy_set_active(ENERGY_LED, lit != 0);
+}
+
+// Patterns, driven from a work item that wakes up only for blink edges
+static struct k_spinlock led_lock;
+static led_engine_t led_engine;
+
+static void led_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(led_work, led_work_handler);
+
+static void led_work_handler(struct k_work *work)
+{
+    uint32_t next_ms;
+    k_spinlock_key_t key = k_spin_lock(&led_lock);
+    uint8_t lit = led_engine_eval(&led_engine, k_uptime_get_32(), &next_ms);
+    k_spin_unlock(&led_lock, key);
+
+    led_set(&led_red, LED_RED, lit & LED_RED);
+    led_set(&led_green, LED_GREEN, lit & LED_GREEN);
+    led_set(&led_blue, LED_BLUE, lit & LED_BLUE);
+
+    if (next_ms != LED_NEVER)
+    {
+        k_work_reschedule(&led_work, K_MSEC(next_ms));
+    }
+}
+
 int led_start()
 {
+    led_engine_init(&led_engine);
     ASSERT_TRUE(gpio_is_ready_dt(&led_red));
     ASSERT_OK(gpio_pin_configure_dt(&led_red, GPIO_OUTPUT_INACTIVE));
     ASSERT_TRUE(gpio_is_ready_dt(&led_green));
@@ -24,15 +61,27 @@ int led_start()
 
 void set_led_red(bool on)
 {
-    gpio_pin_set_dt(&led_red, on);
+    led_set(&led_red, LED_RED, on);
 }
 
 void set_led_green(bool on)
 {
-    gpio_pin_set_dt(&led_green, on);
+    led_set(&led_green, LED_GREEN, on);
 }
 
 void set_led_blue(bool on)
 {
-    gpio_pin_set_dt(&led_blue, on);
+    led_set(&led_blue, LED_BLUE, on);
+}
+
+void led_set_pattern(led_layer_t layer, const led_pattern_t *pattern)
+{
+    k_spinlock_key_t key = k_spin_lock(&led_lock);
+    bool changed = led_engine_set(&led_engine, layer, pattern, k_uptime_get_32());
+    k_spin_unlock(&led_lock, key);
+
+    if (changed)
+    {
+        k_work_reschedule(&led_work, K_NO_WAIT);
+    }
 }
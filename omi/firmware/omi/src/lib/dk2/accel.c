@@ -2,16 +2,171 @@
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/gatt.h>
-#include <zephyr/drivers/sensor.h>
+#include <zephyr/drivers/i2c.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 #include "accel.h"
+#include "device_clock.h"
+#include "imu_fifo.h"
+#include "motion.h"
 
 LOG_MODULE_REGISTER(accel, CONFIG_LOG_DEFAULT_LEVEL);
 
-// Accelerometer data
-static struct sensors mega_sensor;
-static struct device *lsm6dsl_dev;
+extern struct bt_conn *current_connection;
+
+//
+// Sensor
+//
+
+// The omi board describes its LSM6DS3TR-C as an lsm6dso, the devkit as an lsm6dsl.
+// Both parts answer 0x6A and share the LSM6DSL register map, driven here directly
+// because the sensor driver has no FIFO support.
+#if DT_HAS_COMPAT_STATUS_OKAY(st_lsm6dso)
+#define ACCEL_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(st_lsm6dso)
+#else
+#define ACCEL_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(st_lsm6dsl)
+#endif
+
+static const struct i2c_dt_spec accel_i2c = I2C_DT_SPEC_GET(ACCEL_NODE);
+static const struct gpio_dt_spec accel_irq = GPIO_DT_SPEC_GET_OR(ACCEL_NODE, irq_gpios, {0});
+#if DT_NODE_EXISTS(DT_NODELABEL(lsm6dso_en_pin))
+static const struct gpio_dt_spec accel_gpio_pin = GPIO_DT_SPEC_GET(DT_NODELABEL(lsm6dso_en_pin), gpios);
+#else
+static const struct gpio_dt_spec accel_gpio_pin = {.port = DEVICE_DT_GET(DT_NODELABEL(gpio1)), .pin = 8, .dt_flags = GPIO_INT_DISABLE};
+#endif
+
+#define REG_FIFO_CTRL1 0x06     // FTH[7:0], watermark in words
+#define REG_FIFO_CTRL2 0x07     // FTH[10:8]
+#define REG_FIFO_CTRL3 0x08     // DEC_FIFO_GYRO[5:3], DEC_FIFO_XL[2:0]
+#define REG_FIFO_CTRL5 0x0A     // ODR_FIFO[6:3], FIFO_MODE[2:0]
+#define REG_INT1_CTRL 0x0D
+#define REG_WHO_AM_I 0x0F
+#define REG_CTRL1_XL 0x10       // ODR_XL[7:4], FS_XL[3:2]
+#define REG_CTRL2_G 0x11        // ODR_G[7:4], FS_G[3:2]
+#define REG_CTRL3_C 0x12
+#define REG_CTRL6_C 0x15
+#define REG_FIFO_STATUS1 0x3A   // DIFF_FIFO[7:0], then STATUS2..4
+#define REG_FIFO_DATA_OUT_L 0x3E
+#define REG_TAP_CFG 0x58
+#define REG_WAKE_UP_THS 0x5B    // WK_THS[5:0], FS_XL / 64 per step
+#define REG_WAKE_UP_DUR 0x5C    // WAKE_DUR[6:5], samples above the threshold
+#define REG_MD1_CFG 0x5E
+
+#define WHO_AM_I_VALUE 0x6A
+#define FIFO_DEC_NONE 0x01
+#define FIFO_MODE_BYPASS 0x00
+#define FIFO_MODE_CONTINUOUS 0x06
+#define INT1_FTH BIT(3)
+#define CTRL3_C_BDU BIT(6)
+#define CTRL3_C_IF_INC BIT(2)
+#define CTRL3_C_SW_RESET BIT(0)
+#define CTRL6_C_XL_HM_MODE BIT(4) // High performance off, low power below 52 Hz
+#define TAP_CFG_INTERRUPTS_ENABLE BIT(7)
+#define TAP_CFG_LIR BIT(0)
+#define MD1_CFG_INT1_WU BIT(5)
+#define ODR_26HZ 0x02
+#define FIFO_STATUS2_OVER_RUN BIT(6)
+#define FS_XL_4G (0x02 << 2)
+#define FS_G_500DPS (0x01 << 2)
+#define ACCEL_RANGE_G 4
+#define GYRO_RANGE_DPS 500
+#define ACCEL_LSB_PER_G (32768 / ACCEL_RANGE_G)
+#define FIFO_CAPACITY_WORDS 2048
+// Wake-up threshold steps of FS_XL / 64, 2 is 125 mg at 4 g
+#define ACCEL_WAKE_THRESHOLD 2
+
+#if CONFIG_OMI_ACCEL_ODR_HZ == 26
+#define ACCEL_ODR_CODE 0x02
+#elif CONFIG_OMI_ACCEL_ODR_HZ == 52
+#define ACCEL_ODR_CODE 0x03
+#elif CONFIG_OMI_ACCEL_ODR_HZ == 104
+#define ACCEL_ODR_CODE 0x04
+#else
+#error "CONFIG_OMI_ACCEL_ODR_HZ must be 26, 52 or 104"
+#endif
+
+#ifdef CONFIG_OMI_ACCEL_GYRO
+#define ACCEL_GYRO true
+#else
+#define ACCEL_GYRO false
+#endif
+
+#define ACCEL_PERIOD_US (1000000 / CONFIG_OMI_ACCEL_ODR_HZ)
+#define ACCEL_PATTERN_WORDS IMU_FIFO_PATTERN_WORDS(ACCEL_GYRO)
+#define ACCEL_WATERMARK_WORDS (CONFIG_OMI_ACCEL_ODR_HZ * CONFIG_OMI_ACCEL_BATCH_MS / 1000 * ACCEL_PATTERN_WORDS)
+// Samples read per pass, a drain bigger than this takes several
+#define ACCEL_DRAIN_SAMPLES 64
+
+BUILD_ASSERT(ACCEL_WATERMARK_WORDS >= ACCEL_PATTERN_WORDS, "The batch must hold a sample");
+BUILD_ASSERT(ACCEL_WATERMARK_WORDS <= FIFO_CAPACITY_WORDS / 2, "The batch must leave room to drain before the FIFO overruns");
+
+static int accel_write(uint8_t reg, uint8_t value)
+{
+    return i2c_reg_write_byte_dt(&accel_i2c, reg, value);
+}
+
+static int accel_write_all(const uint8_t (*config)[2], size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        int err = accel_write(config[i][0], config[i][1]);
+        if (err)
+        {
+            return err;
+        }
+    }
+    return 0;
+}
+
+static int accel_reset(void)
+{
+    uint8_t id;
+    int err = i2c_reg_read_byte_dt(&accel_i2c, REG_WHO_AM_I, &id);
+    if (err)
+    {
+        return err;
+    }
+    if (id != WHO_AM_I_VALUE)
+    {
+        LOG_ERR("Unexpected IMU id 0x%02x", id);
+        return -ENODEV;
+    }
+
+    err = accel_write(REG_CTRL3_C, CTRL3_C_SW_RESET);
+    if (err)
+    {
+        return err;
+    }
+    k_msleep(1);
+    return 0;
+}
+
+static int accel_configure(void)
+{
+    int err = accel_reset();
+    if (err)
+    {
+        return err;
+    }
+
+    // Batch both at the sensor rate, the pattern is then gyro X, Y, Z, accel X, Y, Z
+    const uint8_t config[][2] = {
+        {REG_CTRL3_C, CTRL3_C_BDU | CTRL3_C_IF_INC},
+        {REG_CTRL1_XL, (ACCEL_ODR_CODE << 4) | FS_XL_4G},
+        {REG_CTRL2_G, ACCEL_GYRO ? (ACCEL_ODR_CODE << 4) | FS_G_500DPS : 0},
+        {REG_FIFO_CTRL1, ACCEL_WATERMARK_WORDS & 0xFF},
+        {REG_FIFO_CTRL2, (ACCEL_WATERMARK_WORDS >> 8) & 0x07},
+        {REG_FIFO_CTRL3, (ACCEL_GYRO ? FIFO_DEC_NONE << 3 : 0) | FIFO_DEC_NONE},
+        {REG_FIFO_CTRL5, (ACCEL_ODR_CODE << 3) | FIFO_MODE_CONTINUOUS},
+        {REG_INT1_CTRL, INT1_FTH},
+    };
+    return accel_write_all(config, ARRAY_SIZE(config));
+}
+
+//
+// Service
+//
 
 // Arbitrary uuid, feel free to change
 static struct bt_uuid_128 accel_uuid = BT_UUID_INIT_128(BT_UUID_128_ENCODE(0x32403790,0x0000,0x1000,0x7450,0xBF445E5829A2));
@@ -20,6 +175,10 @@ static struct bt_uuid_128 accel_uuid_x = BT_UUID_INIT_128(BT_UUID_128_ENCODE(0x3
 static void accel_ccc_config_changed_handler(const struct bt_gatt_attr *attr, uint16_t value);
 static ssize_t accel_data_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
 
+// - Motion data (UUID 32403791-0000-1000-7450-BF445E5829A2) (read/notify)
+//   notify: batches of raw samples, see imu_pack in imu_fifo.h. Accelerometer
+//   LSB = ACCEL_RANGE_G / 32768 g, gyroscope LSB = GYRO_RANGE_DPS / 32768 dps.
+//   read: [axes (3 or 6), rate (le16 Hz), accelerometer range (g), gyroscope range (le16 dps)]
 static struct bt_gatt_attr accel_service_attr[] = {
     BT_GATT_PRIMARY_SERVICE(&accel_uuid),//primary description
     BT_GATT_CHARACTERISTIC(&accel_uuid_x.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_READ, accel_data_read_characteristic, NULL, NULL),//data type
@@ -30,40 +189,14 @@ static struct bt_gatt_service accel_service = BT_GATT_SERVICE(accel_service_attr
 static ssize_t accel_data_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
 {
     LOG_INF("Acceleration data read characteristic");
-    int axis_mode = 6; //3 for accel, 6 for (also) gyro
-    return bt_gatt_attr_read(conn, attr, buf, len, offset, &axis_mode, sizeof(axis_mode));
-}
-
-#define ACCEL_REFRESH_INTERVAL 1000 // 1.0 seconds
-
-void broadcast_accel(struct k_work *work_item);
-K_WORK_DELAYABLE_DEFINE(accel_work, broadcast_accel);
-
-void broadcast_accel(struct k_work *work_item) {
-    struct bt_conn *current_connection = NULL; // This will need to be passed in
-
-    sensor_sample_fetch_chan(lsm6dsl_dev, SENSOR_CHAN_ACCEL_XYZ);
-    sensor_channel_get(lsm6dsl_dev, SENSOR_CHAN_ACCEL_X, &mega_sensor.a_x);
-    sensor_channel_get(lsm6dsl_dev, SENSOR_CHAN_ACCEL_Y, &mega_sensor.a_y);
-    sensor_channel_get(lsm6dsl_dev, SENSOR_CHAN_ACCEL_Z, &mega_sensor.a_z);
-
-    sensor_sample_fetch_chan(lsm6dsl_dev, SENSOR_CHAN_GYRO_XYZ);
-    sensor_channel_get(lsm6dsl_dev, SENSOR_CHAN_GYRO_X, &mega_sensor.g_x);
-    sensor_channel_get(lsm6dsl_dev, SENSOR_CHAN_GYRO_Y, &mega_sensor.g_y);
-    sensor_channel_get(lsm6dsl_dev, SENSOR_CHAN_GYRO_Z, &mega_sensor.g_z);
-
-    // Only time mega sensor is changed is through here (hopefully), so no chance of race condition
-    int err = bt_gatt_notify(current_connection, &accel_service.attrs[1], &mega_sensor, sizeof(mega_sensor));
-    if (err)
-    {
-        LOG_ERR("Error updating Accelerometer data");
-    }
-    k_work_reschedule(&accel_work, K_MSEC(ACCEL_REFRESH_INTERVAL));
+    uint8_t value[6];
+    value[0] = ACCEL_GYRO ? 6 : 3;
+    sys_put_le16(CONFIG_OMI_ACCEL_ODR_HZ, &value[1]);
+    value[3] = ACCEL_RANGE_G;
+    sys_put_le16(GYRO_RANGE_DPS, &value[4]);
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
 }
 
-struct gpio_dt_spec accel_gpio_pin = {.port = DEVICE_DT_GET(DT_NODELABEL(gpio1)), .pin=8, .dt_flags = GPIO_INT_DISABLE};
-
-// Use d4,d5
 static void accel_ccc_config_changed_handler(const struct bt_gatt_attr *attr, uint16_t value)
 {
     if (value == BT_GATT_CCC_NOTIFY)
@@ -80,57 +213,143 @@ static void accel_ccc_config_changed_handler(const struct bt_gatt_attr *attr, ui
     }
 }
 
-int accel_start(void)
+//
+// FIFO drain
+//
+
+static imu_fifo_decoder_t accel_decoder;
+static uint8_t accel_fifo_data[ACCEL_DRAIN_SAMPLES * IMU_FIFO_PATTERN_WORDS(true) * 2];
+static imu_sample_t accel_samples[ACCEL_DRAIN_SAMPLES + 1];
+static uint8_t accel_packet[244]; // Largest notification at CONFIG_BT_L2CAP_TX_MTU 247
+static uint8_t accel_packet_seq;
+static struct gpio_callback accel_irq_cb;
+
+static void accel_send(const imu_sample_t *samples, size_t count, int64_t first_us)
 {
-    struct sensor_value odr_attr;
-    lsm6dsl_dev = DEVICE_DT_GET_ONE(st_lsm6dsl);
-    k_msleep(50);
-    if (lsm6dsl_dev == NULL)
+    struct bt_conn *conn = current_connection;
+    if (!conn || !bt_gatt_is_subscribed(conn, &accel_service.attrs[1], BT_GATT_CCC_NOTIFY))
     {
-        LOG_ERR("Could not get LSM6DSL device");
-        return 0;
+        return;
     }
-    if (!device_is_ready(lsm6dsl_dev))
+
+    size_t payload = MIN(bt_gatt_get_mtu(conn) - 3, sizeof(accel_packet));
+    size_t sent = 0;
+    while (sent < count)
     {
-        LOG_ERR("LSM6DSL: not ready");
-        return 0;
+        size_t packed;
+        size_t len = imu_pack(accel_packet, payload, accel_packet_seq++, ACCEL_GYRO, ACCEL_PERIOD_US,
+                              (uint32_t)(first_us + (int64_t)sent * ACCEL_PERIOD_US), &samples[sent], count - sent, &packed);
+        if (len == 0)
+        {
+            return;
+        }
+        int err = bt_gatt_notify(conn, &accel_service.attrs[1], accel_packet, len);
+        if (err)
+        {
+            LOG_WRN("Motion notification failed: %d", err);
+            return;
+        }
+        sent += packed;
     }
-    odr_attr.val1 = 10;
-    odr_attr.val2 = 0;
+}
 
-    if (gpio_is_ready_dt(&accel_gpio_pin))
+static void accel_drain(struct k_work *work_item)
+{
+    uint8_t status[4];
+    int err = i2c_burst_read_dt(&accel_i2c, REG_FIFO_STATUS1, status, sizeof(status));
+    int64_t now_us = device_clock_us();
+    if (err)
     {
-        LOG_PRINTK("Speaker Pin ready\n");
+        LOG_ERR("FIFO status read failed: %d", err);
+        return;
     }
-    else
+
+    uint16_t unread = status[0] | ((status[1] & 0x07) << 8);
+    uint16_t pattern = status[2] | ((status[3] & 0x03) << 8);
+    if (status[1] & FIFO_STATUS2_OVER_RUN)
     {
-        LOG_PRINTK("Error setting up speaker Pin\n");
-        return -1;
+        LOG_WRN("Motion FIFO overrun, oldest samples lost");
     }
-    if (gpio_pin_configure_dt(&accel_gpio_pin, GPIO_OUTPUT_INACTIVE) < 0)
+
+    uint16_t words = MIN(unread, ACCEL_DRAIN_SAMPLES * ACCEL_PATTERN_WORDS);
+    if (words == 0)
     {
-        LOG_PRINTK("Error setting up Haptic Pin\n");
-        return -1;
+        return;
     }
-    gpio_pin_set_dt(&accel_gpio_pin, 1);
-    if (sensor_attr_set(lsm6dsl_dev, SENSOR_CHAN_ACCEL_XYZ,
-        SENSOR_ATTR_SAMPLING_FREQUENCY, &odr_attr) < 0)
+    err = i2c_burst_read_dt(&accel_i2c, REG_FIFO_DATA_OUT_L, accel_fifo_data, words * 2);
+    if (err)
+    {
+        LOG_ERR("FIFO read failed: %d", err);
+        return;
+    }
+
+    size_t count = imu_fifo_decode(&accel_decoder, pattern, accel_fifo_data, words, accel_samples);
+#ifdef CONFIG_OMI_MOTION_DETECTION
+    motion_process(accel_samples, count);
+#endif
+    if (count > 0)
+    {
+        // The newest sample in the FIFO was written within a period of the status read,
+        // the last decoded one is as many samples older as were left behind
+        int64_t last_us = now_us - (int64_t)((unread - words) / ACCEL_PATTERN_WORDS) * ACCEL_PERIOD_US;
+        accel_send(accel_samples, count, last_us - (int64_t)(count - 1) * ACCEL_PERIOD_US);
+    }
+
+    // The watermark interrupt is a level, still raised if this pass didn't get below it
+    if (unread > words || gpio_pin_get_dt(&accel_irq) > 0)
+    {
+        k_work_submit(work_item);
+    }
+}
+
+K_WORK_DEFINE(accel_work, accel_drain);
+
+static void accel_irq_handler(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+    k_work_submit(&accel_work);
+}
+
+//
+// Interface
+//
+
+int accel_start(void)
+{
+    if (!device_is_ready(accel_i2c.bus))
     {
-        LOG_ERR("Cannot set sampling frequency for Accelerometer.");
+        LOG_ERR("IMU bus not ready");
         return 0;
     }
-    if (sensor_attr_set(lsm6dsl_dev, SENSOR_CHAN_GYRO_XYZ,
-        SENSOR_ATTR_SAMPLING_FREQUENCY, &odr_attr) < 0) {
-        LOG_ERR("Cannot set sampling frequency for gyro.");
+    if (!gpio_is_ready_dt(&accel_gpio_pin) || gpio_pin_configure_dt(&accel_gpio_pin, GPIO_OUTPUT_INACTIVE) < 0)
+    {
+        LOG_ERR("Error setting up the IMU power pin");
         return 0;
     }
-    if (sensor_sample_fetch(lsm6dsl_dev) < 0)
+    gpio_pin_set_dt(&accel_gpio_pin, 1);
+    k_msleep(50); // Boot time after power up
+
+    int err = accel_configure();
+    if (err)
     {
-        LOG_ERR("Sensor sample update error");
+        LOG_ERR("IMU configuration failed: %d", err);
         return 0;
     }
+    imu_fifo_decoder_init(&accel_decoder, ACCEL_GYRO);
+#ifdef CONFIG_OMI_MOTION_DETECTION
+    motion_init(CONFIG_OMI_ACCEL_ODR_HZ, ACCEL_LSB_PER_G);
+#endif
 
-    LOG_INF("Accelerometer is ready for use \n");
+    if (!accel_irq.port || !gpio_is_ready_dt(&accel_irq))
+    {
+        LOG_ERR("No IMU interrupt pin");
+        return 0;
+    }
+    gpio_pin_configure_dt(&accel_irq, GPIO_INPUT);
+    gpio_init_callback(&accel_irq_cb, accel_irq_handler, BIT(accel_irq.pin));
+    gpio_add_callback(accel_irq.port, &accel_irq_cb);
+    gpio_pin_interrupt_configure_dt(&accel_irq, GPIO_INT_EDGE_TO_ACTIVE);
+
+    LOG_INF("Accelerometer batching %d Hz, %d words per interrupt", CONFIG_OMI_ACCEL_ODR_HZ, ACCEL_WATERMARK_WORDS);
 
     return 1;
 }
@@ -142,5 +361,51 @@ void register_accel_service(struct bt_conn *conn)
 
 void accel_off(void)
 {
+    if (accel_irq.port)
+    {
+        gpio_pin_interrupt_configure_dt(&accel_irq, GPIO_INT_DISABLE);
+    }
+    accel_write(REG_FIFO_CTRL5, FIFO_MODE_BYPASS);
     gpio_pin_set_dt(&accel_gpio_pin, 0);
 }
+
+int accel_arm_wakeup(void)
+{
+    if (!accel_irq.port || !device_is_ready(accel_i2c.bus))
+    {
+        return -ENODEV;
+    }
+    gpio_pin_interrupt_configure_dt(&accel_irq, GPIO_INT_DISABLE);
+    if (!gpio_is_ready_dt(&accel_gpio_pin) || gpio_pin_configure_dt(&accel_gpio_pin, GPIO_OUTPUT_ACTIVE) < 0)
+    {
+        return -EIO;
+    }
+    k_msleep(50); // Boot time, in case the power states had it off
+
+    int err = accel_reset();
+    if (err)
+    {
+        return err;
+    }
+
+    // Accelerometer alone at 26 Hz low power, INT1 latched on the first sample
+    // moving more than the threshold from the ones before
+    const uint8_t config[][2] = {
+        {REG_CTRL3_C, CTRL3_C_BDU | CTRL3_C_IF_INC},
+        {REG_CTRL6_C, CTRL6_C_XL_HM_MODE},
+        {REG_CTRL1_XL, (ODR_26HZ << 4) | FS_XL_4G},
+        {REG_WAKE_UP_DUR, 0},
+        {REG_WAKE_UP_THS, ACCEL_WAKE_THRESHOLD},
+        {REG_TAP_CFG, TAP_CFG_INTERRUPTS_ENABLE | TAP_CFG_LIR},
+        {REG_MD1_CFG, MD1_CFG_INT1_WU},
+    };
+    err = accel_write_all(config, ARRAY_SIZE(config));
+    if (err)
+    {
+        return err;
+    }
+
+    // System off wakes up on a level, the latch holds it until the next boot resets the part
+    gpio_pin_configure_dt(&accel_irq, GPIO_INPUT);
+    return gpio_pin_interrupt_configure_dt(&accel_irq, GPIO_INT_LEVEL_ACTIVE);
+}
@@ -2,25 +2,25 @@
 #define ACCEL_H
 
 #include <zephyr/kernel.h>
-#include <zephyr/drivers/sensor.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/logging/log.h>
 
-// Struct to hold sensor data
-struct sensors {
-    struct sensor_value a_x;
-    struct sensor_value a_y;
-    struct sensor_value a_z;
-    struct sensor_value g_x;
-    struct sensor_value g_y;
-    struct sensor_value g_z;
-};
+// Motion data from the IMU FIFO, batched CONFIG_OMI_ACCEL_BATCH_MS at a time
+// and notified as int16 samples (see imu_fifo.h)
 
 // Public functions
 int accel_start(void);
 void accel_off(void);
+/**
+ * @brief Leave the IMU powered in its wake-up mode, for system off to wake up on motion
+ *
+ * Stops batching. Only to be followed by sys_poweroff.
+ *
+ * @return 0 if armed, negative errno otherwise
+ */
+int accel_arm_wakeup(void);
 void register_accel_service(struct bt_conn *conn);
 
 #endif /* ACCEL_H */
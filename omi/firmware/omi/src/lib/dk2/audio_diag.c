@@ -0,0 +1,23 @@
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include "audio_diag.h"
+
+static atomic_t audio_diag_counters[AUDIO_DIAG_COUNT];
+
+void audio_diag_add(audio_diag_counter_t counter, uint32_t value)
+{
+    atomic_add(&audio_diag_counters[counter], value);
+}
+
+uint32_t audio_diag_get(audio_diag_counter_t counter)
+{
+    return atomic_get(&audio_diag_counters[counter]);
+}
+
+void audio_diag_reset(void)
+{
+    for (int i = 0; i < AUDIO_DIAG_COUNT; i++)
+    {
+        atomic_clear(&audio_diag_counters[i]);
+    }
+}
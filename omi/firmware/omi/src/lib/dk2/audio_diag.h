@@ -0,0 +1,37 @@
+#ifndef AUDIO_DIAG_H
+#define AUDIO_DIAG_H
+#include <zephyr/kernel.h>
+
+// Where audio is lost between the PDM and the BLE link. Every stage counts its
+// own losses, the audio diagnostics characteristic reports them all.
+
+typedef enum
+{
+    AUDIO_DIAG_MIC_BLOCKS,            // Blocks read from the DMIC driver
+    AUDIO_DIAG_MIC_UNDERRUNS,         // dmic_read returned no block within its timeout
+    AUDIO_DIAG_MIC_OVERRUNS,          // Every slab block was in use, the driver drops captures meanwhile
+    AUDIO_DIAG_CODEC_OVERRUNS,        // The codec input ring was full when a block arrived
+    AUDIO_DIAG_CODEC_DROPPED_SAMPLES, // Samples discarded by those overruns, per the overrun policy
+    AUDIO_DIAG_TX_DROPS,              // Encoded frames that didn't fit the BLE tx queue
+    AUDIO_DIAG_MIC_CLIPPED_SAMPLES,   // Captured samples at full scale, with CONFIG_OMI_AUDIO_STATS
+    AUDIO_DIAG_COUNT,
+} audio_diag_counter_t;
+
+/**
+ * @brief Add to a diagnostics counter
+ *
+ * Safe from any thread.
+ */
+void audio_diag_add(audio_diag_counter_t counter, uint32_t value);
+
+/**
+ * @brief Read a diagnostics counter
+ */
+uint32_t audio_diag_get(audio_diag_counter_t counter);
+
+/**
+ * @brief Zero all diagnostics counters
+ */
+void audio_diag_reset(void);
+
+#endif
@@ -0,0 +1,236 @@
+#include <math.h>
+#include <zephyr/logging/log.h>
+#include "audio_frontend.h"
+#include "q15.h"
+#ifdef CONFIG_OMI_AUDIO_STATS
+#include "audio_stats.h"
+#endif
+
+#ifdef CONFIG_OMI_AUDIO_FRONTEND
+
+LOG_MODULE_REGISTER(audio_frontend, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define FRONTEND_SAMPLE_RATE 16000
+
+//
+// Q15 helpers, the same packed-pair layout as CMSIS-DSP so the M33 runs two taps per SMLALD
+//
+
+static inline uint32_t pack_q15(int16_t low, int16_t high)
+{
+    return (uint16_t)low | ((uint32_t)(uint16_t)high << 16);
+}
+
+// acc + low(a) * low(b) + high(a) * high(b)
+static inline int64_t mac_dual_q15(uint32_t a, uint32_t b, int64_t acc)
+{
+#if Q15_SIMD
+    return __smlald(a, b, acc);
+#else
+    return acc + (int32_t)(int16_t)a * (int16_t)b + (int32_t)(int16_t)(a >> 16) * (int16_t)(b >> 16);
+#endif
+}
+
+static inline int16_t float_to_q15(float value)
+{
+    return sat_q15(lroundf(value * 32768.0f));
+}
+
+//
+// DC blocker
+//
+
+// y[n] = x[n] - x[n-1] + R * y[n-1], R = 0.995 puts the corner around 13 Hz
+#define DC_POLE_Q15 32604
+// Fractional bits kept in the feedback path, otherwise the pole truncates into a limit cycle
+#define DC_FRAC_BITS 12
+
+static int16_t dc_x1;
+static int32_t dc_y1;
+
+static void dc_block(int16_t *samples, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        int16_t x = samples[i];
+        int32_t y = ((int32_t)(x - dc_x1) << DC_FRAC_BITS) + (int32_t)(((int64_t)dc_y1 * DC_POLE_Q15) >> 15);
+        dc_x1 = x;
+        dc_y1 = y;
+        samples[i] = sat_q15(y >> DC_FRAC_BITS);
+    }
+}
+
+//
+// High-pass biquad, direct form I
+//
+
+// Butterworth coefficients are above 1.0, so they are stored halved and the
+// accumulator is shifted back by one bit (CMSIS-DSP postShift = 1)
+#define HPF_POST_SHIFT 1
+
+static int16_t hpf_b0;
+static uint32_t hpf_b12; // b1 | b2
+static uint32_t hpf_a12; // -a1 | -a2
+static uint32_t hpf_x;   // x[n-1] | x[n-2]
+static uint32_t hpf_y;   // y[n-1] | y[n-2]
+static int32_t hpf_error; // Bits dropped from the last output, fed back into the next one
+
+static void hpf_design(uint32_t cutoff_hz)
+{
+    // RBJ cookbook high-pass, Q = 1/sqrt(2)
+    float w0 = 2.0f * 3.14159265f * cutoff_hz / FRONTEND_SAMPLE_RATE;
+    float cos_w0 = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * 0.70710678f);
+    float a0 = 1.0f + alpha;
+    float scale = 1.0f / (a0 * (1 << HPF_POST_SHIFT));
+
+    // b1 = -2 * b0 exactly, so the quantized filter still has no gain at DC
+    hpf_b0 = float_to_q15((1.0f + cos_w0) / 2.0f * scale);
+    hpf_b12 = pack_q15(-2 * hpf_b0, hpf_b0);
+    hpf_a12 = pack_q15(float_to_q15(2.0f * cos_w0 * scale), float_to_q15(-(1.0f - alpha) * scale));
+}
+
+static void hpf_process(int16_t *samples, size_t count)
+{
+    uint32_t x_state = hpf_x;
+    uint32_t y_state = hpf_y;
+    int32_t error = hpf_error;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int16_t x = samples[i];
+        int64_t acc = (int32_t)hpf_b0 * x;
+        acc = mac_dual_q15(hpf_b12, x_state, acc);
+        acc = mac_dual_q15(hpf_a12, y_state, acc);
+        // First-order error feedback. With the poles this close to z = 1, plain
+        // truncation leaves the output stuck at a constant of up to a few hundred LSB.
+        acc += error;
+        int32_t y_wide = (int32_t)(acc >> (15 - HPF_POST_SHIFT));
+        error = (int32_t)(acc - ((int64_t)y_wide << (15 - HPF_POST_SHIFT)));
+        int16_t y = sat_q15(y_wide);
+
+        x_state = pack_q15(x, (int16_t)x_state);
+        y_state = pack_q15(y, (int16_t)y_state);
+        samples[i] = y;
+    }
+
+    hpf_x = x_state;
+    hpf_y = y_state;
+    hpf_error = error;
+}
+
+//
+// AGC and limiter
+//
+
+#define AGC_UNITY 4096      // Q12
+#define AGC_MIN_GAIN (AGC_UNITY / 16)
+#define AGC_CEILING 29204   // -1 dBFS
+#define AGC_ATTACK_MS 20
+#define AGC_RELEASE_MS 800
+
+static uint32_t agc_gain = AGC_UNITY;
+
+#ifdef CONFIG_OMI_AUDIO_AGC
+
+// Move towards target by count / (time_ms of samples), so the speed doesn't depend on the block length
+static uint32_t agc_step(uint32_t gain, uint32_t target, size_t count, uint32_t time_ms)
+{
+    uint32_t span = time_ms * (FRONTEND_SAMPLE_RATE / 1000);
+    if (count >= span)
+    {
+        return target;
+    }
+    int64_t delta = ((int64_t)target - gain) * (int64_t)count / span;
+    return gain + delta;
+}
+
+static void agc_process(int16_t *samples, size_t count)
+{
+    uint32_t level_sum = 0;
+    uint32_t peak = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t magnitude = samples[i] < 0 ? -(int32_t)samples[i] : samples[i];
+        level_sum += magnitude;
+        peak = MAX(peak, magnitude);
+    }
+    uint32_t level = level_sum / count;
+
+    // Below the noise gate the gain is held, so pauses don't pump the room noise up.
+    // Loud noise without voice in it is held too where the voice detector runs.
+    uint32_t next = agc_gain;
+    bool adapt = level >= CONFIG_OMI_AUDIO_AGC_NOISE_GATE;
+#ifdef CONFIG_OMI_AUDIO_STATS
+    adapt = adapt && audio_stats_voice_active();
+#endif
+    if (adapt)
+    {
+        uint32_t desired = CLAMP((uint32_t)CONFIG_OMI_AUDIO_AGC_TARGET_LEVEL * AGC_UNITY / level, AGC_MIN_GAIN,
+                                 (uint32_t)CONFIG_OMI_AUDIO_AGC_MAX_GAIN * AGC_UNITY);
+        next = agc_step(agc_gain, desired, count, desired < agc_gain ? AGC_ATTACK_MS : AGC_RELEASE_MS);
+    }
+
+    // Limiter: the whole block is known up front, so no sample of it may end above the ceiling.
+    // Starting the ramp at the cap too keeps every intermediate gain below it.
+    uint32_t start = agc_gain;
+    if (peak > 0)
+    {
+        uint32_t cap = AGC_CEILING * AGC_UNITY / peak;
+        next = MIN(next, cap);
+        start = MIN(start, cap);
+    }
+
+    // Per-sample gain ramp in Q24, so short ramps don't truncate to zero
+    int32_t ramp = ((int32_t)next - (int32_t)start) * AGC_UNITY / (int32_t)count;
+    int32_t gain_q24 = (int32_t)start * AGC_UNITY;
+    for (size_t i = 0; i < count; i++)
+    {
+        gain_q24 += ramp;
+        samples[i] = sat_q15(((int64_t)samples[i] * gain_q24) >> 24);
+    }
+
+    agc_gain = next;
+}
+
+#endif
+
+//
+// Interface
+//
+
+int audio_frontend_init(void)
+{
+    hpf_design(CONFIG_OMI_AUDIO_HPF_CUTOFF_HZ);
+    hpf_x = 0;
+    hpf_y = 0;
+    hpf_error = 0;
+    dc_x1 = 0;
+    dc_y1 = 0;
+    agc_gain = AGC_UNITY;
+
+    LOG_INF("Audio front-end: high-pass %d Hz, AGC %s", CONFIG_OMI_AUDIO_HPF_CUTOFF_HZ,
+            IS_ENABLED(CONFIG_OMI_AUDIO_AGC) ? "on" : "off");
+    return 0;
+}
+
+void audio_frontend_process(int16_t *samples, size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    dc_block(samples, count);
+    hpf_process(samples, count);
+#ifdef CONFIG_OMI_AUDIO_AGC
+    agc_process(samples, count);
+#endif
+}
+
+uint16_t audio_frontend_get_gain(void)
+{
+    return MIN(agc_gain, UINT16_MAX);
+}
+
+#endif
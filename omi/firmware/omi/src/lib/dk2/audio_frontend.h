@@ -0,0 +1,35 @@
+#ifndef AUDIO_FRONTEND_H
+#define AUDIO_FRONTEND_H
+#include <zephyr/kernel.h>
+
+/**
+ * @brief Initialize the microphone front-end
+ *
+ * Computes the high-pass coefficients for CONFIG_OMI_AUDIO_HPF_CUTOFF_HZ and
+ * resets the filter and AGC state. Called again from the microphone's restart
+ * callback in src/main.c after every capture gap.
+ *
+ * @return 0 if successful, negative errno code if error
+ */
+int audio_frontend_init(void);
+
+/**
+ * @brief Condition a block of 16 kHz mono PCM in place
+ *
+ * DC blocker, biquad high-pass and, with CONFIG_OMI_AUDIO_AGC, an AGC and
+ * limiter that adapt once per block. The limiter looks at the whole block
+ * before applying gain, so the output never clips.
+ *
+ * @param samples PCM samples, overwritten with the result
+ * @param count Number of samples
+ */
+void audio_frontend_process(int16_t *samples, size_t count);
+
+/**
+ * @brief Get the gain currently applied by the AGC
+ *
+ * @return Gain in Q12 (4096 is unity)
+ */
+uint16_t audio_frontend_get_gain(void);
+
+#endif
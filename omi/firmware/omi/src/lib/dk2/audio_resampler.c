@@ -0,0 +1,40 @@
+#include <zephyr/logging/log.h>
+#include "config.h"
+#include "audio_resampler.h"
+#include "lib/opus-1.2.1/opus_types.h"
+#include "lib/opus-1.2.1/resampler_structs.h"
+
+LOG_MODULE_REGISTER(audio_resampler, CONFIG_LOG_DEFAULT_LEVEL);
+
+// From the SILK layer of the Opus library (resampler.c). SigProc_FIX.h, where they are
+// declared, drags in the library's private build configuration.
+opus_int silk_resampler_init(silk_resampler_state_struct *S, opus_int32 Fs_Hz_in, opus_int32 Fs_Hz_out, opus_int forEnc);
+opus_int silk_resampler(silk_resampler_state_struct *S, opus_int16 out[], const opus_int16 in[], opus_int32 inLen);
+
+#define MIC_SAMPLES_PER_MS (MIC_SAMPLE_RATE / 1000)
+
+static silk_resampler_state_struct resampler_state;
+
+int audio_resampler_init(void)
+{
+    // The encoder-side tables only go down to 8-16 kHz, upsampling needs the decoder-side ones
+    int for_encoder = CODEC_SAMPLE_RATE < MIC_SAMPLE_RATE;
+    if (silk_resampler_init(&resampler_state, MIC_SAMPLE_RATE, CODEC_SAMPLE_RATE, for_encoder) != 0)
+    {
+        LOG_ERR("Resampling %d to %d Hz is not supported", MIC_SAMPLE_RATE, CODEC_SAMPLE_RATE);
+        return -ENOTSUP;
+    }
+    LOG_INF("Resampling %d to %d Hz", MIC_SAMPLE_RATE, CODEC_SAMPLE_RATE);
+    return 0;
+}
+
+int audio_resampler_process(const int16_t *input, size_t samples, int16_t *output)
+{
+    // The SILK resampler works on whole milliseconds, at least one per call
+    if (samples == 0 || samples % MIC_SAMPLES_PER_MS != 0 || samples > AUDIO_RESAMPLER_MAX_INPUT)
+    {
+        return -EINVAL;
+    }
+    silk_resampler(&resampler_state, output, input, samples);
+    return AUDIO_RESAMPLER_OUTPUT_SAMPLES(samples);
+}
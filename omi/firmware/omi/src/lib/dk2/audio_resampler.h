@@ -0,0 +1,35 @@
+#ifndef AUDIO_RESAMPLER_H
+#define AUDIO_RESAMPLER_H
+#include <zephyr/kernel.h>
+#include "config.h"
+
+// Converts microphone PCM (MIC_SAMPLE_RATE) to the codec rate (CODEC_SAMPLE_RATE).
+// Only built when the two differ, see CONFIG_OMI_CODEC_SAMPLE_RATE.
+
+// Largest input accepted by one audio_resampler_process call
+#define AUDIO_RESAMPLER_MAX_INPUT (MIC_SAMPLE_RATE / 100) // 10ms
+
+// Output samples for a whole number of input milliseconds
+#define AUDIO_RESAMPLER_OUTPUT_SAMPLES(samples) ((samples) / (MIC_SAMPLE_RATE / 1000) * (CODEC_SAMPLE_RATE / 1000))
+
+/**
+ * @brief Initialize the resampler
+ *
+ * Clears the filter history. Call again to restart after a capture gap.
+ *
+ * @return 0 if successful, negative errno code if error
+ */
+int audio_resampler_init(void);
+
+/**
+ * @brief Resample a block of microphone PCM
+ *
+ * @param input Microphone samples
+ * @param samples Number of input samples, whole milliseconds up to AUDIO_RESAMPLER_MAX_INPUT
+ * @param output Receives AUDIO_RESAMPLER_OUTPUT_SAMPLES(samples) codec-rate samples
+ *
+ * @return Number of output samples, -EINVAL if samples is not a whole number of milliseconds
+ */
+int audio_resampler_process(const int16_t *input, size_t samples, int16_t *output);
+
+#endif
@@ -0,0 +1,306 @@
+#include <math.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "audio_diag.h"
+#include "audio_stats.h"
+
+LOG_MODULE_REGISTER(audio_stats, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define STATS_SAMPLE_RATE 16000
+#define STATS_FRAME (STATS_SAMPLE_RATE / 100) // 10ms
+#define STATS_INTERVAL_FRAMES (CONFIG_OMI_AUDIO_STATS_INTERVAL_MS / 10)
+#define STATS_CLIP_LEVEL INT16_MAX
+
+BUILD_ASSERT(CONFIG_OMI_AUDIO_STATS_INTERVAL_MS % 10 == 0, "The interval must be whole frames");
+
+static uint64_t isqrt64(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ull << 62;
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+//
+// Spectrum, a Hann-windowed FFT over the last 8ms of every frame
+//
+
+#define FFT_LOG2 7
+#define FFT_SIZE (1 << FFT_LOG2) // 125 Hz bins
+
+BUILD_ASSERT(FFT_SIZE <= STATS_FRAME, "The FFT window must fit in a frame");
+
+// First bin of every band, plus the end of the last one
+static const uint8_t band_edges[AUDIO_STATS_BANDS + 1] = {1, 2, 4, 6, 10, 16, 24, 40, FFT_SIZE / 2};
+
+static int16_t fft_window[FFT_SIZE];  // Q15
+static int16_t fft_cos[FFT_SIZE / 2]; // Q15 twiddles
+static int16_t fft_sin[FFT_SIZE / 2];
+// Unscaled: the input is 16 bits and the FFT grows it by at most FFT_LOG2 bits
+static int32_t fft_re[FFT_SIZE];
+static int32_t fft_im[FFT_SIZE];
+
+static void fft_design(void)
+{
+    for (int n = 0; n < FFT_SIZE; n++)
+    {
+        float phase = 2.0f * 3.14159265f * n / FFT_SIZE;
+        fft_window[n] = MIN(lroundf((0.5f - 0.5f * cosf(phase)) * 32768.0f), INT16_MAX);
+        if (n < FFT_SIZE / 2)
+        {
+            fft_cos[n] = MIN(lroundf(cosf(phase) * 32768.0f), INT16_MAX);
+            fft_sin[n] = MIN(lroundf(sinf(phase) * 32768.0f), INT16_MAX);
+        }
+    }
+}
+
+static uint32_t bit_reverse(uint32_t index)
+{
+    uint32_t reversed = 0;
+    for (int i = 0; i < FFT_LOG2; i++)
+    {
+        reversed = (reversed << 1) | (index & 1);
+        index >>= 1;
+    }
+    return reversed;
+}
+
+// Radix-2 decimation in time, samples in natural order
+static void fft_process(const int16_t *samples)
+{
+    for (int n = 0; n < FFT_SIZE; n++)
+    {
+        uint32_t r = bit_reverse(n);
+        fft_re[r] = ((int32_t)samples[n] * fft_window[n]) >> 15;
+        fft_im[r] = 0;
+    }
+
+    for (int size = 2; size <= FFT_SIZE; size <<= 1)
+    {
+        int half = size / 2;
+        int stride = FFT_SIZE / size;
+        for (int start = 0; start < FFT_SIZE; start += size)
+        {
+            for (int j = 0; j < half; j++)
+            {
+                int a = start + j;
+                int b = a + half;
+                int32_t wr = fft_cos[j * stride];
+                int32_t wi = -fft_sin[j * stride];
+                int32_t tr = ((int64_t)fft_re[b] * wr - (int64_t)fft_im[b] * wi) >> 15;
+                int32_t ti = ((int64_t)fft_re[b] * wi + (int64_t)fft_im[b] * wr) >> 15;
+                fft_re[b] = fft_re[a] - tr;
+                fft_im[b] = fft_im[a] - ti;
+                fft_re[a] += tr;
+                fft_im[a] += ti;
+            }
+        }
+    }
+}
+
+// Mean-square of the frame's signal in every band. Parseval with both halves of the
+// spectrum and the Hann window's 3/8 mean square: 2 * |X|^2 * 8/3 / N^2.
+static void fft_band_powers(const int16_t *samples, uint64_t *powers)
+{
+    fft_process(samples);
+    for (int band = 0; band < AUDIO_STATS_BANDS; band++)
+    {
+        uint64_t sum = 0;
+        for (int k = band_edges[band]; k < band_edges[band + 1]; k++)
+        {
+            sum += (uint64_t)((int64_t)fft_re[k] * fft_re[k]) + (uint64_t)((int64_t)fft_im[k] * fft_im[k]);
+        }
+        powers[band] = sum * 16 / (3 * FFT_SIZE * FFT_SIZE);
+    }
+}
+
+//
+// Voice activity, speech-band power against a tracked noise floor
+//
+
+#define VAD_FIRST_BAND 1 // 250 Hz
+#define VAD_LAST_BAND 5  // 3000 Hz
+#define VAD_MARGIN 8     // 9 dB above the floor
+#define VAD_MIN_POWER (40 * 40)
+#define VAD_HANGOVER_FRAMES 30 // Bridges the gaps between words
+#define VAD_FLOOR_RISE_SHIFT 8 // Up by 1/256 a frame, about 1.7 dB/s
+#define VAD_FLOOR_FALL_SHIFT 2 // Down by a quarter of the difference
+
+static uint64_t vad_floor;
+static bool vad_floor_valid;
+static int vad_hangover;
+
+static bool vad_update(const uint64_t *powers)
+{
+    uint64_t speech = 0;
+    for (int band = VAD_FIRST_BAND; band <= VAD_LAST_BAND; band++)
+    {
+        speech += powers[band];
+    }
+
+    if (!vad_floor_valid)
+    {
+        vad_floor = speech;
+        vad_floor_valid = true;
+    }
+
+    if (speech > VAD_MIN_POWER && speech > vad_floor * VAD_MARGIN)
+    {
+        vad_hangover = VAD_HANGOVER_FRAMES;
+    }
+    else if (vad_hangover > 0)
+    {
+        vad_hangover--;
+    }
+
+    // Tracks the minimum, so speech only nudges it while pauses pull it down quickly
+    if (speech < vad_floor)
+    {
+        vad_floor -= (vad_floor - speech) >> VAD_FLOOR_FALL_SHIFT;
+    }
+    else
+    {
+        vad_floor += (vad_floor >> VAD_FLOOR_RISE_SHIFT) + 1;
+    }
+
+    return vad_hangover > 0;
+}
+
+//
+// Interface
+//
+
+static audio_stats_callback stats_callback = NULL;
+
+static int16_t frame[STATS_FRAME];
+static size_t frame_fill;
+
+// Current interval
+static uint64_t interval_square_sum;
+static uint64_t interval_band_sum[AUDIO_STATS_BANDS];
+static uint16_t interval_peak;
+static uint32_t interval_clipped;
+static bool interval_voice;
+static int interval_frames;
+
+static void interval_reset(void)
+{
+    interval_square_sum = 0;
+    memset(interval_band_sum, 0, sizeof(interval_band_sum));
+    interval_peak = 0;
+    interval_clipped = 0;
+    interval_voice = false;
+    interval_frames = 0;
+}
+
+void audio_stats_set_callback(audio_stats_callback callback)
+{
+    stats_callback = callback;
+}
+
+int audio_stats_init(void)
+{
+    fft_design();
+    frame_fill = 0;
+    vad_floor_valid = false;
+    vad_hangover = 0;
+    interval_reset();
+    return 0;
+}
+
+static void interval_report(void)
+{
+    audio_stats_t stats = {
+        .rms = MIN(isqrt64(interval_square_sum / (STATS_INTERVAL_FRAMES * STATS_FRAME)), UINT16_MAX),
+        .peak = interval_peak,
+        .clipped = MIN(interval_clipped, UINT16_MAX),
+        .voice = interval_voice,
+    };
+    for (int band = 0; band < AUDIO_STATS_BANDS; band++)
+    {
+        stats.bands[band] = MIN(isqrt64(interval_band_sum[band] / STATS_INTERVAL_FRAMES), UINT16_MAX);
+    }
+
+    if (stats_callback)
+    {
+        stats_callback(&stats);
+    }
+    interval_reset();
+}
+
+static void frame_process(void)
+{
+    uint64_t square_sum = 0;
+    uint32_t peak = 0;
+    uint32_t clipped = 0;
+    for (int i = 0; i < STATS_FRAME; i++)
+    {
+        int32_t sample = frame[i];
+        uint32_t magnitude = sample < 0 ? -sample : sample;
+        square_sum += (uint32_t)(sample * sample);
+        peak = MAX(peak, magnitude);
+        clipped += magnitude >= STATS_CLIP_LEVEL;
+    }
+
+    uint64_t powers[AUDIO_STATS_BANDS];
+    fft_band_powers(&frame[STATS_FRAME - FFT_SIZE], powers);
+    bool voice = vad_update(powers);
+
+    if (clipped)
+    {
+        audio_diag_add(AUDIO_DIAG_MIC_CLIPPED_SAMPLES, clipped);
+    }
+
+    interval_square_sum += square_sum;
+    for (int band = 0; band < AUDIO_STATS_BANDS; band++)
+    {
+        interval_band_sum[band] += powers[band];
+    }
+    interval_peak = MAX(interval_peak, MIN(peak, INT16_MAX));
+    interval_clipped += clipped;
+    interval_voice |= voice;
+    if (++interval_frames == STATS_INTERVAL_FRAMES)
+    {
+        interval_report();
+    }
+}
+
+void audio_stats_process(const int16_t *samples, size_t count)
+{
+    while (count > 0)
+    {
+        size_t take = MIN(count, STATS_FRAME - frame_fill);
+        memcpy(&frame[frame_fill], samples, take * sizeof(int16_t));
+        frame_fill += take;
+        samples += take;
+        count -= take;
+
+        if (frame_fill == STATS_FRAME)
+        {
+            frame_process();
+            frame_fill = 0;
+        }
+    }
+}
+
+bool audio_stats_voice_active(void)
+{
+    return vad_hangover > 0;
+}
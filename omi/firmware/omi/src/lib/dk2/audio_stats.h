@@ -0,0 +1,50 @@
+#ifndef AUDIO_STATS_H
+#define AUDIO_STATS_H
+#include <zephyr/kernel.h>
+
+// Level and spectrum of the captured audio (CONFIG_OMI_AUDIO_STATS)
+//
+// Measured in 10ms frames, so the app can draw a level meter and skip idle
+// stream stretches without decoding them. The same frames drive a voice
+// activity detector the AGC uses to decide when to adapt.
+
+#define AUDIO_STATS_BANDS 8
+
+// Levels are RMS amplitudes in Q15 (32767 is a full-scale square wave). The
+// bands split the signal power, so their squares add up to about rms squared.
+typedef struct
+{
+    uint16_t rms;
+    uint16_t peak;                     // Largest sample magnitude
+    uint16_t clipped;                  // Samples at full scale
+    uint16_t bands[AUDIO_STATS_BANDS]; // 125-250, 250-500, 500-750, 750-1250, 1250-2000, 2000-3000, 3000-5000, 5000-8000 Hz
+    bool voice;                        // Voice activity in any of the frames
+} audio_stats_t;
+
+// Called with the aggregate of every CONFIG_OMI_AUDIO_STATS_INTERVAL_MS, from the microphone thread
+typedef void (*audio_stats_callback)(const audio_stats_t *stats);
+void audio_stats_set_callback(audio_stats_callback callback);
+
+/**
+ * @brief Reset the measurements and the voice detector's noise floor
+ *
+ * @return 0 if successful, negative errno code if error
+ */
+int audio_stats_init(void);
+
+/**
+ * @brief Measure a block of 16 kHz mono microphone PCM
+ *
+ * Blocks don't have to be whole frames, the remainder carries over to the next call.
+ *
+ * @param samples PCM samples, not modified
+ * @param count Number of samples
+ */
+void audio_stats_process(const int16_t *samples, size_t count);
+
+/**
+ * @brief Whether the last frame (or its hangover) held voice
+ */
+bool audio_stats_voice_active(void);
+
+#endif
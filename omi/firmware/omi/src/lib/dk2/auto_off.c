@@ -0,0 +1,96 @@
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+#include "auto_off.h"
+#include "idle_policy.h"
+#include "power.h"
+#include "resume_state.h"
+
+LOG_MODULE_REGISTER(auto_off, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define AUTO_OFF_TIMEOUT_MS (CONFIG_OMI_AUTO_OFF_MINUTES * 60U * 1000U)
+
+static struct k_spinlock auto_off_lock;
+static idle_policy_t auto_off_policy;
+static bool auto_off_started;
+
+static void auto_off_check(struct k_work *work_item);
+static K_WORK_DELAYABLE_DEFINE(auto_off_work, auto_off_check);
+
+// Under auto_off_lock. Activity only moves the deadline later, so it leaves the
+// work as it is and the work finds the new deadline when it runs.
+static void auto_off_schedule(void)
+{
+    if (!auto_off_started)
+    {
+        return;
+    }
+    int64_t remaining = idle_policy_remaining_ms(&auto_off_policy, k_uptime_get());
+    if (remaining < 0)
+    {
+        k_work_cancel_delayable(&auto_off_work);
+    }
+    else
+    {
+        k_work_reschedule(&auto_off_work, K_MSEC(remaining));
+    }
+}
+
+static void auto_off_check(struct k_work *work_item)
+{
+    k_spinlock_key_t key = k_spin_lock(&auto_off_lock);
+    int64_t remaining = idle_policy_remaining_ms(&auto_off_policy, k_uptime_get());
+    if (remaining > 0)
+    {
+        k_work_reschedule(&auto_off_work, K_MSEC(remaining));
+    }
+    k_spin_unlock(&auto_off_lock, key);
+    if (remaining != 0)
+    {
+        return;
+    }
+
+    LOG_INF("Idle for %d minutes, turning off", CONFIG_OMI_AUTO_OFF_MINUTES);
+    resume_state_save();
+    power_auto_off();
+}
+
+void auto_off_start(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&auto_off_lock);
+    auto_off_started = true;
+    auto_off_schedule();
+    k_spin_unlock(&auto_off_lock, key);
+}
+
+void auto_off_activity(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&auto_off_lock);
+    idle_policy_activity(&auto_off_policy, k_uptime_get());
+    k_spin_unlock(&auto_off_lock, key);
+}
+
+void auto_off_set_moving(bool moving)
+{
+    k_spinlock_key_t key = k_spin_lock(&auto_off_lock);
+    idle_policy_set_moving(&auto_off_policy, moving, k_uptime_get());
+    auto_off_schedule();
+    k_spin_unlock(&auto_off_lock, key);
+}
+
+void auto_off_set_charging(bool charging)
+{
+    k_spinlock_key_t key = k_spin_lock(&auto_off_lock);
+    idle_policy_set_blocked(&auto_off_policy, charging, k_uptime_get());
+    auto_off_schedule();
+    k_spin_unlock(&auto_off_lock, key);
+}
+
+// Ahead of the drivers, whose callbacks may report motion or the charger before auto_off_start
+static int auto_off_init(void)
+{
+    idle_policy_init(&auto_off_policy, AUTO_OFF_TIMEOUT_MS, k_uptime_get());
+    return 0;
+}
+
+SYS_INIT(auto_off_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,43 @@
+#ifndef AUTO_OFF_H
+#define AUTO_OFF_H
+#include <zephyr/kernel.h>
+
+// Turns an unused device off (CONFIG_OMI_AUTO_OFF)
+//
+// Counts CONFIG_OMI_AUTO_OFF_MINUTES down while the device lies still with
+// no voice and no button presses, never on the charger, then saves the resume
+// snapshot (resume_state.h) and powers off with motion and sound as wake
+// sources. Without the Kconfig option the hooks compile to nothing.
+
+#ifdef CONFIG_OMI_AUTO_OFF
+
+/**
+ * @brief Start the countdown, events before only update the state
+ */
+void auto_off_start(void);
+
+/**
+ * @brief Voice or a button press, safe from any context and cheap enough for every audio block
+ */
+void auto_off_activity(void);
+
+/**
+ * @brief Worn or carried, safe from any context
+ */
+void auto_off_set_moving(bool moving);
+
+/**
+ * @brief On the charger, safe from any context
+ */
+void auto_off_set_charging(bool charging);
+
+#else
+
+static inline void auto_off_start(void) {}
+static inline void auto_off_activity(void) {}
+static inline void auto_off_set_moving(bool moving) {}
+static inline void auto_off_set_charging(bool charging) {}
+
+#endif
+
+#endif
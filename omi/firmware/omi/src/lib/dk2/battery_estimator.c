@@ -0,0 +1,163 @@
+#include <zephyr/kernel.h>
+#include "battery_estimator.h"
+
+// Uncertainty the load model adds per hour, in %²
+#define PROCESS_NOISE_PER_HOUR 4.0f
+// While charging the current is unknown, the charge can rise at up to ~1 %/min
+#define CHARGING_PROCESS_NOISE_PER_HOUR 900.0f
+// Of a single reading once mapped to a charge, in %², the curve is flat mid-range
+#define MEASUREMENT_NOISE 36.0f
+
+#define MS_PER_HOUR 3600000.0f
+
+// 150mAh LiPo battery discharge profile, open circuit voltage
+typedef struct
+{
+    uint16_t millivolts;
+    uint8_t percentage;
+} battery_ocv_point_t;
+
+static const battery_ocv_point_t ocv_curve[] = {
+    {4200, 100},
+    {4160, 99},
+    {4090, 91},
+    {4030, 78},
+    {3890, 63},
+    {3830, 53},
+    {3680, 36},
+    {3660, 35},
+    {3480, 14},
+    {3420, 11},
+    {3400, 1},
+    {3300, 0},
+};
+
+float battery_ocv_percent(uint16_t millivolt)
+{
+    if (millivolt >= ocv_curve[0].millivolts)
+    {
+        return ocv_curve[0].percentage;
+    }
+    if (millivolt <= ocv_curve[ARRAY_SIZE(ocv_curve) - 1].millivolts)
+    {
+        return ocv_curve[ARRAY_SIZE(ocv_curve) - 1].percentage;
+    }
+
+    // First point at or below the voltage, the curve is descending
+    size_t low = 1;
+    size_t high = ARRAY_SIZE(ocv_curve) - 1;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        if (ocv_curve[mid].millivolts <= millivolt)
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+
+    const battery_ocv_point_t *above = &ocv_curve[low - 1];
+    const battery_ocv_point_t *below = &ocv_curve[low];
+    return below->percentage + (float)(above->percentage - below->percentage) * (millivolt - below->millivolts) /
+                                   (above->millivolts - below->millivolts);
+}
+
+void battery_estimator_init(battery_estimator_t *estimator, uint16_t capacity_mah, uint16_t resistance_mohm)
+{
+    estimator->capacity_mah = capacity_mah;
+    estimator->resistance_mohm = resistance_mohm;
+    estimator->percent = 0;
+    estimator->variance = 0;
+    estimator->last_ms = -1;
+    estimator->charging = false;
+    estimator->reported = 0;
+}
+
+static uint8_t round_percent(float percent)
+{
+    return (uint8_t)CLAMP(percent + 0.5f, 0.0f, 100.0f);
+}
+
+bool battery_estimator_update(battery_estimator_t *estimator, uint16_t millivolt, uint32_t load_ua, bool charging,
+                              int64_t now_ms)
+{
+    // Under load the terminals sit below the open circuit voltage. The charge
+    // current is unknown, charging readings are taken as they are.
+    float ocv = millivolt;
+    if (!charging)
+    {
+        ocv += (float)load_ua * estimator->resistance_mohm / 1000000.0f;
+    }
+    float measured = battery_ocv_percent((uint16_t)MIN(ocv, UINT16_MAX));
+
+    uint8_t previous = estimator->reported;
+    bool plugged = charging != estimator->charging;
+    estimator->charging = charging;
+
+    if (estimator->last_ms < 0)
+    {
+        estimator->percent = measured;
+        estimator->variance = MEASUREMENT_NOISE;
+        estimator->last_ms = now_ms;
+        estimator->reported = round_percent(measured);
+        return true;
+    }
+
+    // Predict
+    float hours = (now_ms - estimator->last_ms) / MS_PER_HOUR;
+    estimator->last_ms = now_ms;
+    if (charging)
+    {
+        estimator->variance += CHARGING_PROCESS_NOISE_PER_HOUR * hours;
+    }
+    else
+    {
+        float used_mah = load_ua / 1000.0f * hours;
+        estimator->percent -= 100.0f * used_mah / estimator->capacity_mah;
+        estimator->variance += PROCESS_NOISE_PER_HOUR * hours;
+    }
+
+    // Correct
+    float gain = estimator->variance / (estimator->variance + MEASUREMENT_NOISE);
+    estimator->percent = CLAMP(estimator->percent + gain * (measured - estimator->percent), 0.0f, 100.0f);
+    estimator->variance *= 1.0f - gain;
+
+    uint8_t percent = round_percent(estimator->percent);
+    if (plugged)
+    {
+        estimator->reported = percent;
+    }
+    else if (charging)
+    {
+        estimator->reported = MAX(estimator->reported, percent);
+    }
+    else
+    {
+        estimator->reported = MIN(estimator->reported, percent);
+    }
+    return estimator->reported != previous;
+}
+
+uint8_t battery_estimator_percent(const battery_estimator_t *estimator)
+{
+    return estimator->reported;
+}
+
+uint32_t battery_estimator_interval_ms(const battery_estimator_t *estimator, uint32_t load_ua)
+{
+    if (estimator->last_ms < 0 || estimator->charging || estimator->reported < BATTERY_LOW_PERCENT)
+    {
+        return BATTERY_INTERVAL_MIN_MS;
+    }
+    if (load_ua == 0)
+    {
+        return BATTERY_INTERVAL_MAX_MS;
+    }
+
+    // One percent of the capacity is capacity_mah * 36 s at 1 mA
+    uint64_t percent_ms = (uint64_t)estimator->capacity_mah * 36000000ULL / load_ua;
+    return CLAMP(percent_ms / 2, BATTERY_INTERVAL_MIN_MS, BATTERY_INTERVAL_MAX_MS);
+}
@@ -0,0 +1,66 @@
+#ifndef BATTERY_ESTIMATOR_H
+#define BATTERY_ESTIMATOR_H
+#include <zephyr/kernel.h>
+
+// Battery state of charge from Coulomb counting corrected by the voltage
+//
+// Between readings the charge drops by the load current the firmware estimates
+// from what is running. Each reading is corrected for the drop across the cell's
+// internal resistance under that load, mapped to a charge through the open circuit
+// voltage curve, and blended in with a scalar Kalman filter. The percentage readers
+// see only moves in the direction of charging or discharging, so noise never
+// makes it jump back and forth.
+
+#define BATTERY_INTERVAL_MIN_MS 15000
+#define BATTERY_INTERVAL_MAX_MS 300000
+#define BATTERY_LOW_PERCENT 15 // Sampled at the shortest interval below this
+
+typedef struct
+{
+    uint16_t capacity_mah;
+    uint16_t resistance_mohm;
+
+    float percent;  // Estimated charge, 0 to 100
+    float variance; // Of percent, in %²
+    int64_t last_ms; // Time of the last reading, -1 before the first
+    bool charging;
+    uint8_t reported;
+} battery_estimator_t;
+
+/**
+ * @brief Charge of a cell at rest at the given voltage, from the discharge profile
+ *
+ * @return 0 to 100, interpolated between the profile points
+ */
+float battery_ocv_percent(uint16_t millivolt);
+
+void battery_estimator_init(battery_estimator_t *estimator, uint16_t capacity_mah, uint16_t resistance_mohm);
+
+/**
+ * @brief Feed a battery voltage reading
+ *
+ * @param millivolt Voltage at the terminals
+ * @param load_ua Current the firmware is drawing, since the last reading and now
+ * @param charging Charger state; the charge current is unknown, so there is no coulomb count and the
+ *                 estimate follows the readings, which are taken without load compensation
+ * @param now_ms Uptime of the reading
+ *
+ * @return true if the reported percentage changed
+ */
+bool battery_estimator_update(battery_estimator_t *estimator, uint16_t millivolt, uint32_t load_ua, bool charging,
+                              int64_t now_ms);
+
+/**
+ * @brief Percentage to report, valid after the first update
+ */
+uint8_t battery_estimator_percent(const battery_estimator_t *estimator);
+
+/**
+ * @brief Time until the next reading is worth taking
+ *
+ * About half the time the load takes to use up one percent, shortest while
+ * charging or low.
+ */
+uint32_t battery_estimator_interval_ms(const battery_estimator_t *estimator, uint32_t load_ua);
+
+#endif
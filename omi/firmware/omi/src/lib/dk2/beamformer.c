@@ -0,0 +1,200 @@
+#include <math.h>
+#include <string.h>
+#include <zephyr/logging/log.h>
+#include "beamformer.h"
+#include "nlms.h"
+#include "q15.h"
+
+#ifdef CONFIG_OMI_MIC_BEAMFORMER
+
+LOG_MODULE_REGISTER(beamformer, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define BEAMFORMER_SAMPLE_RATE 16000
+#define SPEED_OF_SOUND_MM_S 343000.0f
+
+//
+// Steering, a cubic Lagrange fractional delay per microphone
+//
+
+#define FD_TAPS 4
+// The interpolator is most accurate around the middle of its taps, so both
+// channels are delayed by this much plus or minus half the inter-mic delay
+#define FD_BULK_DELAY 1.5f
+
+typedef struct
+{
+    int16_t left[FD_TAPS];
+    int16_t right[FD_TAPS];
+} steering_t;
+
+// The latest requested angle waits under steering_lock for the start of the
+// next block, so a block is never filtered with half old and half new taps
+static struct k_spinlock steering_lock;
+static int steering_pending_angle;
+static bool steering_pending = false;
+static volatile int beam_angle = CONFIG_OMI_MIC_BEAM_ANGLE;
+
+// Only touched by beamformer_process
+static steering_t steering;
+
+static int16_t history_left[FD_TAPS];
+static int16_t history_right[FD_TAPS];
+
+static void lagrange_taps(float delay, int16_t *taps)
+{
+    for (int k = 0; k < FD_TAPS; k++)
+    {
+        float h = 1.0f;
+        for (int j = 0; j < FD_TAPS; j++)
+        {
+            if (j != k)
+            {
+                h *= (delay - j) / (float)(k - j);
+            }
+        }
+        taps[k] = sat_q15(lroundf(h * 32768.0f));
+    }
+}
+
+static void steering_compute(int angle_deg, steering_t *steering)
+{
+    // A source at +angle reaches the left microphone first, so the left channel waits longer
+    float half_delay = (CONFIG_OMI_MIC_SPACING_MM / 2.0f) * sinf(angle_deg * 3.14159265f / 180.0f) /
+                       SPEED_OF_SOUND_MM_S * BEAMFORMER_SAMPLE_RATE;
+    lagrange_taps(FD_BULK_DELAY + half_delay, steering->left);
+    lagrange_taps(FD_BULK_DELAY - half_delay, steering->right);
+}
+
+static int16_t fractional_delay(int16_t *history, const int16_t *taps, int16_t sample)
+{
+    history[3] = history[2];
+    history[2] = history[1];
+    history[1] = history[0];
+    history[0] = sample;
+
+    // The taps sum to one and their magnitudes to about 1.3, so this can't overflow
+    int32_t acc = 0;
+    for (int k = 0; k < FD_TAPS; k++)
+    {
+        acc += (int32_t)taps[k] * history[k];
+    }
+    return sat_q15(acc >> 15);
+}
+
+//
+// Adaptive sidelobe canceller
+//
+
+#ifdef CONFIG_OMI_MIC_BEAMFORMER_ADAPTIVE
+
+// The difference of the steered channels holds no beam-direction signal. An
+// NLMS filter removes from the sum whatever it can predict from that difference,
+// which minimizes output power with the beam direction fixed, i.e. MVDR.
+#define GSC_TAPS 16
+#define GSC_DELAY (GSC_TAPS / 2) // Lets the filter use taps on both sides of the sum sample
+#define GSC_MU_Q15 1638          // 0.05
+#define GSC_EPSILON (GSC_TAPS * 64 * 64)
+#define GSC_WEIGHT_LIMIT (8 << 24)
+// Only adapt while the difference branch carries at least 1/64 (-18 dB) of the
+// sum's power. Below that the beam direction dominates, and adapting on
+// microphone mismatch would cancel the wearer's own voice.
+#define GSC_GATE_SHIFT 6
+
+static int16_t gsc_history[2 * GSC_TAPS];
+static int32_t gsc_weights[GSC_TAPS];
+static nlms_t gsc_filter;
+static int16_t gsc_s[GSC_DELAY + 1];
+static int64_t gsc_power_s = 0;
+static int64_t gsc_power_u = 0;
+
+static void gsc_reset(void)
+{
+    nlms_init(&gsc_filter, gsc_history, gsc_weights, GSC_TAPS, GSC_MU_Q15, GSC_EPSILON, GSC_WEIGHT_LIMIT);
+    memset(gsc_s, 0, sizeof(gsc_s));
+    gsc_power_s = 0;
+    gsc_power_u = 0;
+}
+
+static int16_t gsc_process(int16_t s, int16_t u)
+{
+    memmove(&gsc_s[1], &gsc_s[0], GSC_DELAY * sizeof(int16_t));
+    gsc_s[0] = s;
+
+    gsc_power_s += (((int32_t)s * s) - gsc_power_s) >> 6;
+    gsc_power_u += (((int32_t)u * u) - gsc_power_u) >> 6;
+    bool adapt = (gsc_power_u << GSC_GATE_SHIFT) > gsc_power_s;
+
+    return nlms_process(&gsc_filter, u, gsc_s[GSC_DELAY], adapt);
+}
+
+#endif
+
+//
+// Interface
+//
+
+int beamformer_set_direction(int angle_deg)
+{
+    if (angle_deg < BEAMFORMER_ANGLE_MIN || angle_deg > BEAMFORMER_ANGLE_MAX)
+    {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&steering_lock);
+    steering_pending_angle = angle_deg;
+    steering_pending = true;
+    beam_angle = angle_deg;
+    k_spin_unlock(&steering_lock, key);
+
+    LOG_INF("Beam steered to %d degrees", angle_deg);
+    return 0;
+}
+
+int beamformer_get_direction(void)
+{
+    return beam_angle;
+}
+
+int beamformer_init(void)
+{
+    memset(history_left, 0, sizeof(history_left));
+    memset(history_right, 0, sizeof(history_right));
+#ifdef CONFIG_OMI_MIC_BEAMFORMER_ADAPTIVE
+    gsc_reset();
+#endif
+    return beamformer_set_direction(CONFIG_OMI_MIC_BEAM_ANGLE);
+}
+
+void beamformer_process(const int16_t *interleaved, int16_t *output, size_t frames)
+{
+    k_spinlock_key_t key = k_spin_lock(&steering_lock);
+    bool changed = steering_pending;
+    int angle_deg = steering_pending_angle;
+    steering_pending = false;
+    k_spin_unlock(&steering_lock, key);
+
+    if (changed)
+    {
+        steering_compute(angle_deg, &steering);
+#ifdef CONFIG_OMI_MIC_BEAMFORMER_ADAPTIVE
+        gsc_reset();
+#endif
+    }
+
+    // output may alias interleaved: frame i is read before output[i] is written, and i <= 2 * i
+    for (size_t i = 0; i < frames; i++)
+    {
+        int16_t left = fractional_delay(history_left, steering.left, interleaved[2 * i]);
+        int16_t right = fractional_delay(history_right, steering.right, interleaved[2 * i + 1]);
+
+        int16_t sum = ((int32_t)left + right) >> 1;
+#ifdef CONFIG_OMI_MIC_BEAMFORMER_ADAPTIVE
+        int16_t difference = ((int32_t)left - right) >> 1;
+        output[i] = gsc_process(sum, difference);
+#else
+        output[i] = sum;
+#endif
+    }
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef BEAMFORMER_H
+#define BEAMFORMER_H
+#include <zephyr/kernel.h>
+
+// Dual-microphone beamformer (CONFIG_OMI_MIC_BEAMFORMER)
+//
+// Steers a fractional-delay delay-and-sum beam between the left and right PDM
+// microphones. With CONFIG_OMI_MIC_BEAMFORMER_ADAPTIVE a generalized sidelobe
+// canceller, the time-domain form of MVDR, also nulls the strongest interferer
+// that doesn't come from the beam direction.
+
+#define BEAMFORMER_ANGLE_MIN -90
+#define BEAMFORMER_ANGLE_MAX 90
+
+/**
+ * @brief Initialize the beamformer
+ *
+ * Steers to CONFIG_OMI_MIC_BEAM_ANGLE and clears the delay lines and adaptive filter.
+ *
+ * @return 0 if successful, negative errno code if error
+ */
+int beamformer_init(void);
+
+/**
+ * @brief Steer the beam
+ *
+ * Safe from any thread. Takes effect at the start of the next beamformer_process
+ * call, and of several calls during one block the last wins. The adaptive
+ * filter restarts, it was converged for the old direction.
+ *
+ * @param angle_deg Degrees from broadside, positive towards the left microphone
+ *
+ * @return 0 if successful, -EINVAL if the angle is out of range
+ */
+int beamformer_set_direction(int angle_deg);
+
+/**
+ * @brief Get the current beam direction
+ *
+ * @return Degrees from broadside, positive towards the left microphone
+ */
+int beamformer_get_direction(void);
+
+/**
+ * @brief Combine a block of interleaved left/right PCM into one channel
+ *
+ * @param interleaved Stereo frames, left first
+ * @param output Mono output, may be the same buffer as interleaved
+ * @param frames Number of stereo frames
+ */
+void beamformer_process(const int16_t *interleaved, int16_t *output, size_t frames);
+
+#endif
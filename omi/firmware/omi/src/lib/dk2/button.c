@@ -10,16 +10,18 @@
 #include <zephyr/pm/device_runtime.h>
 #include <zephyr/drivers/gpio.h>
 #include "button.h"
+#include "button_fsm.h"
+#include "power.h"
 #include "transport.h"
 #include "speaker.h"
 #include "led.h"
 #include "mic.h"
 #include "sdcard.h"
+#include "accel.h"
+#include "auto_off.h"
 
 LOG_MODULE_REGISTER(button, CONFIG_LOG_DEFAULT_LEVEL);
 
-extern bool is_off;
-
 static void button_ccc_config_changed_handler(const struct bt_gatt_attr *attr, uint16_t value);
 static ssize_t button_data_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
 
@@ -53,27 +55,7 @@ static void button_ccc_config_changed_handler(const struct bt_gatt_attr *attr, u
 static const struct device *const buttons = DEVICE_DT_GET(DT_ALIAS(buttons));
 static const struct gpio_dt_spec usr_btn = GPIO_DT_SPEC_GET_OR(DT_NODELABEL(usr_btn), gpios, {0});
 
-static bool was_pressed = false;
-
-static void buttons_input_cb(struct input_event *evt, void *user_data)
-{
-	ARG_UNUSED(user_data);
-    if (evt->code == INPUT_KEY_ENTER) {
-        was_pressed = (evt->value == 1);
-        LOG_INF("Button %s via input subsystem", was_pressed ? "pressed" : "released");
-    }
-}
-
-INPUT_CALLBACK_DEFINE(buttons, buttons_input_cb, NULL);
-
-
-// No longer using GPIO callback as we're using the input subsystem
-#define BUTTON_CHECK_INTERVAL 40 // 0.04 seconds, 25 Hz
-
-void check_button_level(struct k_work *work_item);
-
-K_WORK_DELAYABLE_DEFINE(button_work, check_button_level);
-
+// Values of the button characteristic
 #define DEFAULT_STATE 0
 #define SINGLE_TAP 1
 #define DOUBLE_TAP 2
@@ -81,19 +63,10 @@ K_WORK_DELAYABLE_DEFINE(button_work, check_button_level);
 #define BUTTON_PRESS 4
 #define BUTTON_RELEASE 5
 
-// 4 is button down, 5 is button up
 static FSM_STATE_T current_button_state = IDLE;
-static uint32_t inc_count_1 = 0;
-static uint32_t inc_count_0 = 0;
 
 static int final_button_state[2] = {0,0};
-const static int threshold = 10;
 
-static void reset_count() 
-{
-    inc_count_0 = 0;
-    inc_count_1 = 0;
-}
 static inline void notify_press() 
 {
     final_button_state[0] = BUTTON_PRESS;
@@ -149,124 +122,100 @@ static inline void notify_long_tap()
     }
 }
 
-#define BUTTON_PRESSED     1
-#define BUTTON_RELEASED    0
+//
+// Gestures, decoded from the input events on the system workqueue
+//
 
-#define TAP_THRESHOLD      300  // 300 ms for single tap
-#define DOUBLE_TAP_WINDOW  600  // 600 ms maximum for double-tap
-#define LONG_PRESS_TIME    1000 // 1000 ms for long press
-
-typedef enum {
-    BUTTON_EVENT_NONE,
-    BUTTON_EVENT_SINGLE_TAP,
-    BUTTON_EVENT_DOUBLE_TAP,
-    BUTTON_EVENT_LONG_PRESS,
-    BUTTON_EVENT_RELEASE
-} ButtonEvent;
+typedef struct
+{
+    bool pressed;
+    int64_t time_ms;
+} button_edge_t;
 
-static uint32_t current_time = 0;
-static uint32_t btn_press_start_time;
-static uint32_t btn_release_time;
-static uint32_t btn_last_tap_time;
-static bool btn_is_pressed;
+K_MSGQ_DEFINE(button_edges, sizeof(button_edge_t), 8, 4);
 
-static u_int8_t btn_last_event = BUTTON_EVENT_NONE;
+static button_fsm_t button_fsm = {.state = BUTTON_FSM_IDLE, .deadline_ms = -1};
+static atomic_t button_active = ATOMIC_INIT(0);
 
-void check_button_level(struct k_work *work_item) 
+static void button_gesture(button_gesture_t gesture)
 {
-    current_time = current_time + 1;
-    
-    u_int8_t btn_state = was_pressed ? BUTTON_PRESSED : BUTTON_RELEASED;
-
-    ButtonEvent event = BUTTON_EVENT_NONE;
-
-    // Debouncing pressed state
-    if (btn_state == BUTTON_PRESSED && !btn_is_pressed) {
-        btn_is_pressed = true;
-        btn_press_start_time = current_time;
-    } else if (btn_state == BUTTON_RELEASED && btn_is_pressed) {
-        btn_is_pressed = false;
-        btn_release_time = current_time;
-
-        // Check for double tap
-        uint32_t press_duration = (btn_release_time - btn_press_start_time)*BUTTON_CHECK_INTERVAL;
-        if (press_duration < TAP_THRESHOLD) {
-            if (btn_last_tap_time > 0 && (current_time - btn_last_tap_time)*BUTTON_CHECK_INTERVAL < DOUBLE_TAP_WINDOW) {
-                event = BUTTON_EVENT_DOUBLE_TAP;
-                btn_last_tap_time = 0; // Reset double-tap / single-tap detection
-            } else {
-                btn_last_tap_time = current_time;
-            }
-        }
-    } 
-
-    // Check for single tap
-    if (btn_state == BUTTON_RELEASED && !btn_is_pressed) {
-        uint32_t press_duration = (btn_release_time - btn_press_start_time)*BUTTON_CHECK_INTERVAL;
-        if (press_duration < TAP_THRESHOLD && btn_last_tap_time > 0 && (current_time - btn_press_start_time)*BUTTON_CHECK_INTERVAL > TAP_THRESHOLD) {
-            event = BUTTON_EVENT_SINGLE_TAP;
-            btn_last_tap_time = 0;
-        } else if ((current_time - btn_press_start_time)*BUTTON_CHECK_INTERVAL > TAP_THRESHOLD) {
-            event = BUTTON_EVENT_RELEASE;
-        }
-    }
-
-    // Check for long press
-    if (btn_is_pressed && (current_time - btn_press_start_time)*BUTTON_CHECK_INTERVAL >= LONG_PRESS_TIME) {
-        event = BUTTON_EVENT_LONG_PRESS;
+    if (gesture != BUTTON_GESTURE_NONE)
+    {
+        auto_off_activity();
     }
 
-    // Single tap
-    if (event == BUTTON_EVENT_SINGLE_TAP)
+    switch (gesture)
     {
+    case BUTTON_GESTURE_SINGLE_TAP:
         LOG_INF("single tap detected\n");
-        btn_last_event = event;
         notify_tap();
 
-        // // Enter the low power mode
-        is_off = true;
-        transport_off();
-        turnoff_all();
-    }
-
-    // Double tap
-    if (event == BUTTON_EVENT_DOUBLE_TAP)
-    {
+        // Enter the low power mode
+        power_off();
+        break;
+    case BUTTON_GESTURE_DOUBLE_TAP:
         LOG_INF("double tap detected\n");
-        btn_last_event = event;
         notify_double_tap();
-    }
-
-    // Long press, one time event
-    if (event == BUTTON_EVENT_LONG_PRESS && btn_last_event != BUTTON_EVENT_LONG_PRESS)
-    {
+        break;
+    case BUTTON_GESTURE_LONG_PRESS:
         LOG_INF("long press detected\n");
-        btn_last_event = event;
         notify_long_tap();
+        break;
+    case BUTTON_GESTURE_RELEASE:
+        LOG_PRINTK("release detected\n");
+        notify_unpress();
+        current_button_state = GRACE;
+        break;
+    default:
+        break;
     }
+}
 
-    // Releases, one time event
-    if (event == BUTTON_EVENT_RELEASE && btn_last_event != BUTTON_EVENT_RELEASE)
+// Runs for every edge and for the FSM's deadline, nothing is scheduled while the button is idle
+static void button_fsm_run(struct k_work *work_item)
+{
+    button_edge_t edge;
+    while (k_msgq_get(&button_edges, &edge, K_NO_WAIT) == 0)
     {
-        LOG_PRINTK("release detected\n");
-        btn_last_event = event;
-        notify_unpress();
+        // A timeout that fell due before the edge came first
+        int64_t deadline = button_fsm_deadline(&button_fsm);
+        if (deadline >= 0 && deadline <= edge.time_ms)
+        {
+            button_gesture(button_fsm_timeout(&button_fsm, deadline));
+        }
+        button_gesture(button_fsm_input(&button_fsm, edge.pressed, edge.time_ms));
+    }
 
-        // Reset
-        current_time = 0;
-        btn_press_start_time = 0;
-        btn_release_time = 0;
-        btn_last_tap_time = 0;
+    button_gesture(button_fsm_timeout(&button_fsm, k_uptime_get()));
+    int64_t deadline = button_fsm_deadline(&button_fsm);
+    if (deadline >= 0)
+    {
+        k_work_reschedule(k_work_delayable_from_work(work_item), K_TIMEOUT_ABS_MS(deadline));
     }
-    if (event == BUTTON_EVENT_RELEASE)
+}
+
+K_WORK_DELAYABLE_DEFINE(button_work, button_fsm_run);
+
+static void buttons_input_cb(struct input_event *evt, void *user_data)
+{
+	ARG_UNUSED(user_data);
+    if (evt->code != INPUT_KEY_ENTER || !atomic_get(&button_active))
     {
-        current_button_state = GRACE;
+        return;
     }
 
-    k_work_reschedule(&button_work, K_MSEC(BUTTON_CHECK_INTERVAL));
-    return 0;
+    // Timed here, the workqueue may run late
+    button_edge_t edge = {.pressed = evt->value == 1, .time_ms = k_uptime_get()};
+    LOG_INF("Button %s via input subsystem", edge.pressed ? "pressed" : "released");
+    if (k_msgq_put(&button_edges, &edge, K_NO_WAIT))
+    {
+        LOG_WRN("Button edge dropped");
+    }
+    k_work_reschedule(&button_work, K_NO_WAIT);
 }
 
+INPUT_CALLBACK_DEFINE(buttons, buttons_input_cb, NULL);
+
 static ssize_t button_data_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset) 
 {
     LOG_INF("button_data_read_characteristic");
@@ -296,7 +245,7 @@ int button_init()
 
 void activate_button_work() 
 {
-     k_work_schedule(&button_work, K_MSEC(BUTTON_CHECK_INTERVAL));
+    atomic_set(&button_active, 1);
 }
 
 void register_button_service() 
@@ -309,7 +258,7 @@ FSM_STATE_T get_current_button_state()
     return current_button_state;
 }
 
-void turnoff_all()
+void turnoff_all(bool wake_on_activity)
 {
     int rc;
     
@@ -326,9 +275,11 @@ void turnoff_all()
     speaker_off();
 #endif
 
-    // Turn off accelerometer if enabled
+    // Turn off accelerometer if enabled, or leave it watching for motion
 #ifdef CONFIG_OMI_ENABLE_ACCELEROMETER
-    accel_off();
+    if (!wake_on_activity || accel_arm_wakeup() != 0) {
+        accel_off();
+    }
 #endif
 
     // Play haptic feedback if enabled
@@ -369,6 +320,10 @@ void turnoff_all()
         return;
     }
     
+    if (wake_on_activity && mic_arm_wakeup() == 0) {
+        LOG_INF("Microphone activity wakes the system");
+    }
+
     LOG_INF("Entering system off; press usr_btn to restart");
     
     // Power off the system using sys_poweroff
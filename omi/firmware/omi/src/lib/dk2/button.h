@@ -12,7 +12,8 @@ typedef enum {
 int button_init();
 void activate_button_work();
 void register_button_service();
-void turnoff_all();
+// System off, the button wakes it up and with wake_on_activity also motion and sound
+void turnoff_all(bool wake_on_activity);
 FSM_STATE_T get_current_button_state();
 
 void force_button_state(FSM_STATE_T state);
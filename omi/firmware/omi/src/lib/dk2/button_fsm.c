@@ -0,0 +1,91 @@
+#include <zephyr/kernel.h>
+#include "button_fsm.h"
+
+void button_fsm_init(button_fsm_t *fsm)
+{
+    fsm->state = BUTTON_FSM_IDLE;
+    fsm->press_ms = 0;
+    fsm->deadline_ms = -1;
+}
+
+static void fsm_enter(button_fsm_t *fsm, button_fsm_state_t state, int64_t deadline_ms)
+{
+    fsm->state = state;
+    fsm->deadline_ms = deadline_ms;
+}
+
+button_gesture_t button_fsm_input(button_fsm_t *fsm, bool pressed, int64_t now_ms)
+{
+    switch (fsm->state)
+    {
+    case BUTTON_FSM_IDLE:
+        if (pressed)
+        {
+            fsm->press_ms = now_ms;
+            fsm_enter(fsm, BUTTON_FSM_PRESSED, now_ms + BUTTON_LONG_PRESS_MS);
+        }
+        break;
+    case BUTTON_FSM_PRESSED:
+        if (!pressed)
+        {
+            if (now_ms - fsm->press_ms < BUTTON_TAP_MS)
+            {
+                fsm_enter(fsm, BUTTON_FSM_TAPPED, now_ms + BUTTON_DOUBLE_TAP_GAP_MS);
+                break;
+            }
+            fsm_enter(fsm, BUTTON_FSM_IDLE, -1);
+            return BUTTON_GESTURE_RELEASE;
+        }
+        break;
+    case BUTTON_FSM_TAPPED:
+        if (pressed)
+        {
+            fsm->press_ms = now_ms;
+            fsm_enter(fsm, BUTTON_FSM_SECOND_PRESS, now_ms + BUTTON_LONG_PRESS_MS);
+        }
+        break;
+    case BUTTON_FSM_SECOND_PRESS:
+        if (!pressed)
+        {
+            fsm_enter(fsm, BUTTON_FSM_IDLE, -1);
+            return BUTTON_GESTURE_DOUBLE_TAP;
+        }
+        break;
+    case BUTTON_FSM_HELD:
+        if (!pressed)
+        {
+            fsm_enter(fsm, BUTTON_FSM_IDLE, -1);
+            return BUTTON_GESTURE_RELEASE;
+        }
+        break;
+    }
+    return BUTTON_GESTURE_NONE;
+}
+
+button_gesture_t button_fsm_timeout(button_fsm_t *fsm, int64_t now_ms)
+{
+    if (fsm->deadline_ms < 0 || now_ms < fsm->deadline_ms)
+    {
+        return BUTTON_GESTURE_NONE;
+    }
+
+    switch (fsm->state)
+    {
+    case BUTTON_FSM_PRESSED:
+    case BUTTON_FSM_SECOND_PRESS:
+        // A tap followed by a long press is a long press
+        fsm_enter(fsm, BUTTON_FSM_HELD, -1);
+        return BUTTON_GESTURE_LONG_PRESS;
+    case BUTTON_FSM_TAPPED:
+        fsm_enter(fsm, BUTTON_FSM_IDLE, -1);
+        return BUTTON_GESTURE_SINGLE_TAP;
+    default:
+        fsm->deadline_ms = -1;
+        return BUTTON_GESTURE_NONE;
+    }
+}
+
+int64_t button_fsm_deadline(const button_fsm_t *fsm)
+{
+    return fsm->deadline_ms;
+}
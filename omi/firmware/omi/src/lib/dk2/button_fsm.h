@@ -0,0 +1,65 @@
+#ifndef BUTTON_FSM_H
+#define BUTTON_FSM_H
+#include <zephyr/kernel.h>
+
+// Tap, double tap and long press decoding from button edges
+//
+// Driven by the press and release times and by a single deadline, so an idle
+// button costs no wakeups. A tap is a press shorter than BUTTON_TAP_MS, it
+// becomes a double tap if the next press starts within BUTTON_DOUBLE_TAP_GAP_MS
+// of its release.
+
+#define BUTTON_TAP_MS 300
+#define BUTTON_DOUBLE_TAP_GAP_MS 300
+#define BUTTON_LONG_PRESS_MS 1000
+
+typedef enum
+{
+    BUTTON_GESTURE_NONE,
+    BUTTON_GESTURE_SINGLE_TAP,
+    BUTTON_GESTURE_DOUBLE_TAP,
+    BUTTON_GESTURE_LONG_PRESS, // Still held
+    BUTTON_GESTURE_RELEASE,    // End of a press that wasn't a tap
+} button_gesture_t;
+
+typedef enum
+{
+    BUTTON_FSM_IDLE,
+    BUTTON_FSM_PRESSED,       // First press, tap or long press
+    BUTTON_FSM_TAPPED,        // Released after a tap, single or double
+    BUTTON_FSM_SECOND_PRESS,  // Second press of a double tap
+    BUTTON_FSM_HELD,          // Past a tap, released as a long press or a plain release
+} button_fsm_state_t;
+
+typedef struct
+{
+    button_fsm_state_t state;
+    int64_t press_ms;
+    int64_t deadline_ms; // -1 without a pending timeout
+} button_fsm_t;
+
+void button_fsm_init(button_fsm_t *fsm);
+
+/**
+ * @brief Feed a button edge
+ *
+ * @param pressed New button level
+ * @param now_ms Uptime of the edge
+ *
+ * @return The gesture the edge completed, if any
+ */
+button_gesture_t button_fsm_input(button_fsm_t *fsm, bool pressed, int64_t now_ms);
+
+/**
+ * @brief Run the pending timeout, call at or after button_fsm_deadline
+ *
+ * @return The gesture the timeout completed, if any
+ */
+button_gesture_t button_fsm_timeout(button_fsm_t *fsm, int64_t now_ms);
+
+/**
+ * @brief Uptime the next timeout is due at, -1 if none
+ */
+int64_t button_fsm_deadline(const button_fsm_t *fsm);
+
+#endif
@@ -1,10 +1,14 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/sys/ring_buffer.h>
-#include "codec.h"
+#include <zephyr/sys/atomic.h>
 #include "config.h"
+#include "codec.h"
 #include "utils.h"
-#ifdef CODEC_OPUS
-#include "lib/opus-1.2.1/opus.h"
+#include "latency_probe.h"
+#include "energy.h"
+#include "audio_diag.h"
+#if CODEC_SAMPLE_RATE != MIC_SAMPLE_RATE
+#include "audio_resampler.h"
 #endif
 
 LOG_MODULE_REGISTER(codec, CONFIG_LOG_DEFAULT_LEVEL);
@@ -20,25 +24,204 @@ void set_codec_callback(codec_callback callback)
     _callback = callback;
 }
 
+//
+// Backends
+//
+
+static const codec_backend_t *const codec_backends[] = {
+#if CODEC_OPUS
+    &codec_opus_backend,
+#endif
+#if CODEC_MULAW
+    &codec_mulaw_backend,
+#endif
+#if CODEC_ADPCM
+    &codec_adpcm_backend,
+#endif
+#if CODEC_LC3
+    &codec_lc3_backend,
+#endif
+};
+
+// Owned by the codec thread
+static const codec_backend_t *codec_active = NULL;
+// Requested by codec_select, picked up at the next frame boundary
+static atomic_ptr_t codec_requested = ATOMIC_PTR_INIT(NULL);
+
+static const codec_backend_t *codec_find(uint8_t id)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(codec_backends); i++)
+    {
+        if (codec_backends[i]->id == id)
+        {
+            return codec_backends[i];
+        }
+    }
+    return NULL;
+}
+
+int codec_select(uint8_t id)
+{
+    const codec_backend_t *backend = codec_find(id);
+    if (backend == NULL)
+    {
+        LOG_WRN("Codec %u is not part of this build", id);
+        return -ENOTSUP;
+    }
+    atomic_ptr_set(&codec_requested, (void *)backend);
+    return 0;
+}
+
+uint8_t codec_get_id(void)
+{
+    const codec_backend_t *backend = atomic_ptr_get(&codec_requested);
+    return backend ? backend->id : CODEC_DEFAULT_ID;
+}
+
 //
 // Input
 //
 
 uint8_t codec_ring_buffer_data[AUDIO_BUFFER_SAMPLES * 2]; // 2 bytes per sample
 struct ring_buf codec_ring_buf;
-int codec_receive_pcm(int16_t *data, size_t len) //this gets called after mic data is finished 
-{   
-   
-    int written = ring_buf_put(&codec_ring_buf, (uint8_t *)data, len * 2);
-    if (written != len * 2)
+// Wakes the codec thread once a full frame is buffered, so it never polls
+static K_SEM_DEFINE(codec_data_sem, 0, 1);
+// Dropping the oldest audio makes the mic thread a second reader of the ring
+static struct k_spinlock codec_ring_lock;
+
+// Capture times: samples ever written to and taken from the ring (discards
+// included), and the capture time just past the newest sample. A frame's time
+// counts back from there, which assumes the ring holds gapless audio; only
+// frames queued ahead of a dropped block come out late by the gap.
+// Under codec_ring_lock.
+static uint32_t codec_written_samples = 0;
+static uint32_t codec_read_samples = 0;
+static int64_t codec_written_end_us = 0;
+
+#ifdef CONFIG_OMI_AUDIO_OVERRUN_DROP_OLDEST
+static atomic_t codec_overrun_policy = ATOMIC_INIT(CODEC_OVERRUN_DROP_OLDEST);
+#else
+static atomic_t codec_overrun_policy = ATOMIC_INIT(CODEC_OVERRUN_DROP_NEWEST);
+#endif
+
+int codec_set_overrun_policy(codec_overrun_policy_t policy)
+{
+    if (policy != CODEC_OVERRUN_DROP_NEWEST && policy != CODEC_OVERRUN_DROP_OLDEST)
     {
-        LOG_ERR("Failed to write %d bytes to codec ring buffer", len * 2);
-        return -1;
+        return -EINVAL;
     }
-
+    atomic_set(&codec_overrun_policy, policy);
+    LOG_INF("Codec overrun policy: drop %s", policy == CODEC_OVERRUN_DROP_OLDEST ? "oldest" : "newest");
     return 0;
 }
 
+codec_overrun_policy_t codec_get_overrun_policy(void)
+{
+    return atomic_get(&codec_overrun_policy);
+}
+
+#if CODEC_SAMPLE_RATE != MIC_SAMPLE_RATE
+static int16_t codec_resampled[AUDIO_RESAMPLER_OUTPUT_SAMPLES(AUDIO_RESAMPLER_MAX_INPUT)];
+
+// len must be whole milliseconds, codec_receive_pcm checks that before touching the ring
+static void codec_put_resampled(const int16_t *data, size_t len)
+{
+    for (size_t offset = 0; offset < len; offset += AUDIO_RESAMPLER_MAX_INPUT)
+    {
+        int count = audio_resampler_process(&data[offset], MIN(len - offset, AUDIO_RESAMPLER_MAX_INPUT), codec_resampled);
+        ring_buf_put(&codec_ring_buf, (uint8_t *)codec_resampled, count * 2);
+    }
+}
+#endif
+
+int codec_receive_pcm(int16_t *data, size_t len, int64_t capture_us) //this gets called after mic data is finished
+{
+#if CODEC_SAMPLE_RATE != MIC_SAMPLE_RATE
+    if (len % (MIC_SAMPLE_RATE / 1000) != 0)
+    {
+        LOG_ERR("Can't resample a block of %u samples", len);
+        return -EINVAL;
+    }
+    // The ring holds codec-rate audio, so space and drops are counted after resampling
+    size_t samples = AUDIO_RESAMPLER_OUTPUT_SAMPLES(len);
+#else
+    size_t samples = len;
+#endif
+    uint32_t bytes = samples * 2;
+    uint32_t discard = 0;
+    int err = 0;
+
+    // Whole blocks only, a partial write would leave the ring misaligned with the block that follows
+    if (ring_buf_space_get(&codec_ring_buf) < bytes)
+    {
+        audio_diag_add(AUDIO_DIAG_CODEC_OVERRUNS, 1);
+        err = -ENOBUFS;
+
+        if (atomic_get(&codec_overrun_policy) == CODEC_OVERRUN_DROP_NEWEST || bytes > sizeof(codec_ring_buffer_data))
+        {
+            audio_diag_add(AUDIO_DIAG_CODEC_DROPPED_SAMPLES, samples);
+            LOG_DBG("Codec ring full, dropped %u new samples", samples);
+            return err;
+        }
+
+        k_spinlock_key_t key = k_spin_lock(&codec_ring_lock);
+        discard = bytes - ring_buf_space_get(&codec_ring_buf);
+        discard = ring_buf_get(&codec_ring_buf, NULL, ROUND_UP(discard, 2));
+        codec_read_samples += discard / 2;
+        k_spin_unlock(&codec_ring_lock, key);
+
+        audio_diag_add(AUDIO_DIAG_CODEC_DROPPED_SAMPLES, discard / 2);
+        LOG_DBG("Codec ring full, dropped %u old samples", discard / 2);
+    }
+
+#if CODEC_SAMPLE_RATE != MIC_SAMPLE_RATE
+    codec_put_resampled(data, len);
+#else
+    ring_buf_put(&codec_ring_buf, (uint8_t *)data, bytes);
+#endif
+    k_spinlock_key_t key = k_spin_lock(&codec_ring_lock);
+    codec_written_samples += samples;
+    codec_written_end_us = capture_us + (int64_t)len * 1000000 / MIC_SAMPLE_RATE;
+    k_spin_unlock(&codec_ring_lock, key);
+    // The probe tracks what is in the ring, so discarded samples never count as captured
+    latency_probe_captured(samples - discard / 2);
+
+    if (ring_buf_size_get(&codec_ring_buf) >= CODEC_PACKAGE_SAMPLES * 2)
+    {
+        k_sem_give(&codec_data_sem);
+    }
+
+    return err;
+}
+
+//
+// Packet loss feedback
+//
+
+// Loss reported by the app, applied by the codec thread between frames
+static atomic_t codec_reported_loss = ATOMIC_INIT(0);
+static int codec_applied_loss = -1;
+
+void codec_set_packet_loss(uint8_t percent)
+{
+    atomic_set(&codec_reported_loss, MIN(percent, 100));
+}
+
+static void codec_apply_packet_loss()
+{
+    int loss = atomic_get(&codec_reported_loss);
+    if (loss == codec_applied_loss)
+    {
+        return;
+    }
+    codec_applied_loss = loss;
+
+    if (codec_active->set_packet_loss)
+    {
+        codec_active->set_packet_loss(loss);
+    }
+}
+
 //
 // Thread
 //
@@ -47,44 +230,69 @@ int16_t codec_input_samples[CODEC_PACKAGE_SAMPLES];
 uint8_t codec_output_bytes[CODEC_OUTPUT_MAX_BYTES];
 K_THREAD_STACK_DEFINE(codec_stack, 32000);
 static struct k_thread codec_thread;
-uint16_t execute_codec();
 
-#if CODEC_OPUS
-#if (CONFIG_OPUS_MODE == CONFIG_OPUS_MODE_CELT)
-#define OPUS_ENCODER_SIZE 7180
-#endif
-#if (CONFIG_OPUS_MODE == CONFIG_OPUS_MODE_HYBRID)
-#define OPUS_ENCODER_SIZE 10916
-#endif
-__ALIGN(4)
-static uint8_t m_opus_encoder[OPUS_ENCODER_SIZE];
-static OpusEncoder *const m_opus_state = (OpusEncoder *)m_opus_encoder;
-#endif
+static void codec_switch_backend()
+{
+    const codec_backend_t *requested = atomic_ptr_get(&codec_requested);
+    if (requested == codec_active)
+    {
+        return;
+    }
+
+    int err = requested->init();
+    if (err)
+    {
+        LOG_ERR("Failed to initialize %s codec: %d", requested->name, err);
+        atomic_ptr_set(&codec_requested, (void *)codec_active);
+        return;
+    }
+
+    LOG_INF("Codec switched to %s (id %u)", requested->name, requested->id);
+    codec_active = requested;
+    codec_applied_loss = -1; // Apply the current loss report to the fresh encoder
+}
 
 void codec_entry()
 {
 
-    uint16_t output_size;
+    int output_size;
     while (1)
     {
+        codec_switch_backend();
+        uint32_t frame_bytes = codec_active->frame_samples * 2;
 
-        // Check if we have enough data
-        if (ring_buf_size_get(&codec_ring_buf) < CODEC_PACKAGE_SAMPLES * 2)
+        // Check if we have enough data, block until the mic delivers more.
+        // While the mic is stopped this thread stays asleep.
+        if (ring_buf_size_get(&codec_ring_buf) < frame_bytes)
         {
-            // LOG_PRINTK("waiting on data....\n");
-            k_sleep(K_MSEC(10));
+            k_sem_take(&codec_data_sem, K_FOREVER);
             continue;
         }
         // Read package
-        ring_buf_get(&codec_ring_buf, (uint8_t *)codec_input_samples, CODEC_PACKAGE_SAMPLES * 2);
+        k_spinlock_key_t key = k_spin_lock(&codec_ring_lock);
+        ring_buf_get(&codec_ring_buf, (uint8_t *)codec_input_samples, frame_bytes);
+        int32_t newer_samples = codec_written_samples - codec_read_samples;
+        int64_t capture_us = codec_written_end_us - (int64_t)newer_samples * 1000000 / CODEC_SAMPLE_RATE;
+        codec_read_samples += codec_active->frame_samples;
+        k_spin_unlock(&codec_ring_lock, key);
+        latency_probe_encoding(codec_active->frame_samples);
+
+        codec_apply_packet_loss();
 
         // Run Codec
-        output_size = execute_codec();
+        uint32_t encode_start = k_cycle_get_32();
+        output_size = codec_active->encode(codec_input_samples, codec_output_bytes, sizeof(codec_output_bytes));
+        energy_add_us(ENERGY_CODEC, k_cyc_to_us_floor32(k_cycle_get_32() - encode_start));
+        if (output_size < 0)
+        {
+            LOG_WRN("%s encoding failed: %d", codec_active->name, output_size);
+            continue;
+        }
 
         // Notify
         if (_callback)
         {
-            _callback(codec_output_bytes, output_size);
+            _callback(codec_output_bytes, output_size, capture_us);
         }
 
         // Yield
@@ -94,20 +302,21 @@ void codec_entry()
 
 int codec_start()
 {
+    const codec_backend_t *backend = codec_find(CODEC_DEFAULT_ID);
+    if (backend == NULL)
+    {
+        LOG_ERR("Default codec %d is not enabled", CODEC_DEFAULT_ID);
+        return -ENOTSUP;
+    }
 
-// OPUS
-#if CODEC_OPUS
-    ASSERT_TRUE(opus_encoder_get_size(1) == sizeof(m_opus_encoder));
-    ASSERT_TRUE(opus_encoder_init(m_opus_state, 16000, 1, CODEC_OPUS_APPLICATION) == OPUS_OK);
-    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_BITRATE(CODEC_OPUS_BITRATE)) == OPUS_OK);
-    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_VBR(CODEC_OPUS_VBR)) == OPUS_OK);
-    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_VBR_CONSTRAINT(0)) == OPUS_OK);
-    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_COMPLEXITY(CODEC_OPUS_COMPLEXITY)) == OPUS_OK);
-    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE)) == OPUS_OK);
-    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_LSB_DEPTH(16)) == OPUS_OK);
-    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_DTX(0)) == OPUS_OK);
-    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_INBAND_FEC(0)) == OPUS_OK);
-    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_PACKET_LOSS_PERC(0)) == OPUS_OK);
+    int err = backend->init();
+    ASSERT_OK(err);
+    codec_active = backend;
+    atomic_ptr_set(&codec_requested, (void *)backend);
+    LOG_INF("Codec %s (id %u)", backend->name, backend->id);
+#if CODEC_SAMPLE_RATE != MIC_SAMPLE_RATE
+    err = audio_resampler_init();
+    ASSERT_OK(err);
 #endif
 
     // Thread
@@ -117,23 +326,3 @@ int codec_start()
     // Success
     return 0;
 }
-
-//
-// Opus codec
-//
-
-#if CODEC_OPUS
-
-uint16_t execute_codec()
-{
-    opus_int32 size = opus_encode(m_opus_state, codec_input_samples, CODEC_PACKAGE_SAMPLES, codec_output_bytes, sizeof(codec_output_bytes));
-    if (size < 0)
-    {
-        LOG_WRN("Opus encoding failed: %d", size);
-        return 0;
-    }
-    LOG_DBG("Opus encoding success: %i", size);
-    return size;
-}
-
-#endif
@@ -2,13 +2,96 @@
 #define CODEC_H
 #include <zephyr/kernel.h>
 
-// Callback
-typedef void (*codec_callback)(uint8_t *data, size_t len);
+// Callback, with the device_clock_us time the frame's first sample was captured at
+typedef void (*codec_callback)(uint8_t *data, size_t len, int64_t capture_us);
 void set_codec_callback(codec_callback callback);
 
+// Backends
+
+typedef struct
+{
+    uint8_t id;             // Value reported on the audio codec characteristic
+    const char *name;
+    uint16_t frame_samples; // PCM samples consumed by one encode call
+    int (*init)(void);
+    // Returns the number of bytes written to output, negative errno on failure
+    int (*encode)(const int16_t *input, uint8_t *output, size_t output_size);
+    // Optional, see codec_set_packet_loss
+    void (*set_packet_loss)(uint8_t percent);
+} codec_backend_t;
+
+#if CODEC_OPUS
+extern const codec_backend_t codec_opus_backend;
+#endif
+#if CODEC_MULAW
+extern const codec_backend_t codec_mulaw_backend;
+#endif
+#if CODEC_ADPCM
+extern const codec_backend_t codec_adpcm_backend;
+#endif
+#if CODEC_LC3
+extern const codec_backend_t codec_lc3_backend;
+#endif
+
 // Integration
 
-int codec_receive_pcm(int16_t *data, size_t len);
+// What codec_receive_pcm gives up when its input ring is full
+typedef enum
+{
+    CODEC_OVERRUN_DROP_NEWEST = 0, // Reject the incoming block, the backlog is kept
+    CODEC_OVERRUN_DROP_OLDEST = 1, // Discard the oldest buffered audio, latency stays bounded
+} codec_overrun_policy_t;
+
+/**
+ * @brief Queue captured PCM for encoding
+ *
+ * Converted from MIC_SAMPLE_RATE to CODEC_SAMPLE_RATE on the way in if they differ.
+ *
+ * @param data Microphone samples, whole milliseconds
+ * @param len Number of samples
+ * @param capture_us device_clock_us time the first sample was captured at
+ *
+ * @return 0 if successful, -ENOBUFS if the ring was full and the block (or, with
+ *         CODEC_OVERRUN_DROP_OLDEST, older audio) was dropped, -EINVAL if the
+ *         block can't be resampled
+ */
+int codec_receive_pcm(int16_t *data, size_t len, int64_t capture_us);
+
+/**
+ * @brief Choose what to drop when the encoder falls behind the microphone
+ *
+ * @return 0 if successful, -EINVAL for an unknown policy
+ */
+int codec_set_overrun_policy(codec_overrun_policy_t policy);
+codec_overrun_policy_t codec_get_overrun_policy(void);
+
+/**
+ * @brief Report the packet loss observed by the receiver
+ *
+ * Applied before the next encoded frame. With the hybrid Opus profile this
+ * also switches in-band FEC on and off.
+ *
+ * @param percent Lost packets in percent (0-100)
+ */
+void codec_set_packet_loss(uint8_t percent);
+
+/**
+ * @brief Switch to another compiled-in codec
+ *
+ * The switch happens on the codec thread at the next frame boundary.
+ *
+ * @param id Codec id, one of the CODEC_ID_* values
+ *
+ * @return 0 if successful, -ENOTSUP if the codec is not part of this build
+ */
+int codec_select(uint8_t id);
+
+/**
+ * @brief Get the id of the selected codec
+ *
+ * @return The CODEC_ID_* value of the codec the stream is (or is about to be) encoded with
+ */
+uint8_t codec_get_id(void);
 
 /**
  * @brief Initialize the Codec
@@ -19,4 +102,4 @@ int codec_receive_pcm(int16_t *data, size_t len);
  */
 int codec_start();
 
-#endif
\ No newline at end of file
+#endif
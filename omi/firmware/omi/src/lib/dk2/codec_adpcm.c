@@ -0,0 +1,110 @@
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include "config.h"
+#include "codec.h"
+
+#if CODEC_ADPCM
+
+// IMA ADPCM, 4 bits per sample.
+// Every frame starts with the encoder state so it decodes on its own after a lost packet:
+//   [0..1] predictor (int16, little endian)
+//   [2]    step index
+//   [3]    reserved
+//   [4..]  samples, two per byte, low nibble first
+
+static const int8_t adpcm_index_table[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8};
+
+static const int16_t adpcm_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static int32_t adpcm_predictor;
+static int8_t adpcm_index;
+
+static uint8_t adpcm_encode_sample(int16_t sample)
+{
+    int32_t step = adpcm_step_table[adpcm_index];
+    int32_t diff = sample - adpcm_predictor;
+    uint8_t nibble = 0;
+    if (diff < 0)
+    {
+        nibble = 8;
+        diff = -diff;
+    }
+
+    // Quantize and reconstruct exactly like the decoder will
+    int32_t delta = step >> 3;
+    if (diff >= step)
+    {
+        nibble |= 4;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        nibble |= 2;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        nibble |= 1;
+        delta += step;
+    }
+
+    adpcm_predictor += (nibble & 8) ? -delta : delta;
+    adpcm_predictor = CLAMP(adpcm_predictor, INT16_MIN, INT16_MAX);
+    adpcm_index = CLAMP(adpcm_index + adpcm_index_table[nibble], 0, 88);
+    return nibble;
+}
+
+static int codec_adpcm_init(void)
+{
+    adpcm_predictor = 0;
+    adpcm_index = 0;
+    return 0;
+}
+
+static int codec_adpcm_encode(const int16_t *input, uint8_t *output, size_t output_size)
+{
+    size_t size = CODEC_ADPCM_HEADER_SIZE + CODEC_ADPCM_FRAME_SAMPLES / 2;
+    if (output_size < size)
+    {
+        return -ENOMEM;
+    }
+
+    sys_put_le16((uint16_t)(int16_t)adpcm_predictor, &output[0]);
+    output[2] = adpcm_index;
+    output[3] = 0;
+
+    uint8_t *data = &output[CODEC_ADPCM_HEADER_SIZE];
+    for (size_t i = 0; i < CODEC_ADPCM_FRAME_SAMPLES; i += 2)
+    {
+        uint8_t low = adpcm_encode_sample(input[i]);
+        uint8_t high = adpcm_encode_sample(input[i + 1]);
+        *data++ = low | (high << 4);
+    }
+    return size;
+}
+
+const codec_backend_t codec_adpcm_backend = {
+    .id = CODEC_ID_ADPCM16,
+    .name = "adpcm",
+    .frame_samples = CODEC_ADPCM_FRAME_SAMPLES,
+    .init = codec_adpcm_init,
+    .encode = codec_adpcm_encode,
+    .set_packet_loss = NULL,
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include <zephyr/logging/log.h>
+#include "config.h"
+#include "codec.h"
+
+#if CODEC_LC3
+#include <lc3.h>
+
+LOG_MODULE_REGISTER(codec_lc3, CONFIG_LOG_DEFAULT_LEVEL);
+
+static LC3_ENCODER_MEM_T(CODEC_LC3_FRAME_US, CODEC_SAMPLE_RATE) m_lc3_encoder_mem;
+static lc3_encoder_t m_lc3_encoder;
+static int m_lc3_frame_bytes;
+
+static int codec_lc3_init(void)
+{
+    m_lc3_encoder = lc3_setup_encoder(CODEC_LC3_FRAME_US, CODEC_SAMPLE_RATE, 0, &m_lc3_encoder_mem);
+    if (m_lc3_encoder == NULL)
+    {
+        LOG_ERR("Failed to set up the LC3 encoder");
+        return -EINVAL;
+    }
+    m_lc3_frame_bytes = lc3_frame_bytes(CODEC_LC3_FRAME_US, CODEC_LC3_BITRATE);
+    if (m_lc3_frame_bytes < 0)
+    {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int codec_lc3_encode(const int16_t *input, uint8_t *output, size_t output_size)
+{
+    if (output_size < m_lc3_frame_bytes)
+    {
+        return -ENOMEM;
+    }
+    if (lc3_encode(m_lc3_encoder, LC3_PCM_FORMAT_S16, input, 1, m_lc3_frame_bytes, output) != 0)
+    {
+        return -EIO;
+    }
+    return m_lc3_frame_bytes;
+}
+
+const codec_backend_t codec_lc3_backend = {
+    .id = CODEC_ID_LC3,
+    .name = "lc3",
+    .frame_samples = CODEC_LC3_FRAME_SAMPLES,
+    .init = codec_lc3_init,
+    .encode = codec_lc3_encode,
+    .set_packet_loss = NULL,
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include <zephyr/kernel.h>
+#include "config.h"
+#include "codec.h"
+
+#if CODEC_MULAW
+
+// G.711 mu-law, one byte per sample, no state
+
+#define MULAW_BIAS 0x84
+#define MULAW_CLIP 32635
+
+static uint8_t mulaw_encode_sample(int16_t sample)
+{
+    uint8_t sign = 0;
+    int32_t value = sample;
+    if (value < 0)
+    {
+        value = -value;
+        sign = 0x80;
+    }
+    if (value > MULAW_CLIP)
+    {
+        value = MULAW_CLIP;
+    }
+    value += MULAW_BIAS;
+
+    // Segment is the position of the highest set bit above bit 7
+    uint8_t exponent = 7;
+    for (int32_t mask = 0x4000; (value & mask) == 0 && exponent > 0; mask >>= 1)
+    {
+        exponent--;
+    }
+    uint8_t mantissa = (value >> (exponent + 3)) & 0x0F;
+    return ~(sign | (exponent << 4) | mantissa);
+}
+
+static int codec_mulaw_init(void)
+{
+    return 0;
+}
+
+static int codec_mulaw_encode(const int16_t *input, uint8_t *output, size_t output_size)
+{
+    if (output_size < CODEC_MULAW_FRAME_SAMPLES)
+    {
+        return -ENOMEM;
+    }
+    for (size_t i = 0; i < CODEC_MULAW_FRAME_SAMPLES; i++)
+    {
+        output[i] = mulaw_encode_sample(input[i]);
+    }
+    return CODEC_MULAW_FRAME_SAMPLES;
+}
+
+const codec_backend_t codec_mulaw_backend = {
+    .id = CODEC_ID_MULAW16,
+    .name = "mulaw",
+    .frame_samples = CODEC_MULAW_FRAME_SAMPLES,
+    .init = codec_mulaw_init,
+    .encode = codec_mulaw_encode,
+    .set_packet_loss = NULL,
+};
+
+#endif
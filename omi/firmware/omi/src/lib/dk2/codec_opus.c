@@ -0,0 +1,78 @@
+#include <zephyr/logging/log.h>
+#include "config.h"
+#include "codec.h"
+#include "utils.h"
+
+#if CODEC_OPUS
+#include "lib/opus-1.2.1/opus.h"
+
+LOG_MODULE_REGISTER(codec_opus, CONFIG_LOG_DEFAULT_LEVEL);
+
+// Upper bounds of opus_encoder_get_size(1), checked at init.
+// CONFIG_OPUS_MODE_* are only defined inside the opus library, so test the Kconfig symbol here.
+#ifdef CONFIG_OMI_CODEC_OPUS_HYBRID
+#define OPUS_ENCODER_SIZE 16000
+#else
+#define OPUS_ENCODER_SIZE 7200
+#endif
+__ALIGN(4)
+static uint8_t m_opus_encoder[OPUS_ENCODER_SIZE];
+static OpusEncoder *const m_opus_state = (OpusEncoder *)m_opus_encoder;
+static bool codec_fec_enabled = false;
+
+static int codec_opus_init(void)
+{
+    ASSERT_TRUE(opus_encoder_get_size(1) <= sizeof(m_opus_encoder));
+    ASSERT_TRUE(opus_encoder_init(m_opus_state, CODEC_SAMPLE_RATE, 1, CODEC_OPUS_APPLICATION) == OPUS_OK);
+    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_BITRATE(CODEC_OPUS_BITRATE)) == OPUS_OK);
+    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_VBR(CODEC_OPUS_VBR)) == OPUS_OK);
+    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_VBR_CONSTRAINT(0)) == OPUS_OK);
+    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_COMPLEXITY(CODEC_OPUS_COMPLEXITY)) == OPUS_OK);
+    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE)) == OPUS_OK);
+    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_LSB_DEPTH(16)) == OPUS_OK);
+    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_DTX(0)) == OPUS_OK);
+    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_INBAND_FEC(0)) == OPUS_OK);
+    ASSERT_TRUE(opus_encoder_ctl(m_opus_state, OPUS_SET_PACKET_LOSS_PERC(0)) == OPUS_OK);
+    codec_fec_enabled = false;
+    return 0;
+}
+
+static int codec_opus_encode(const int16_t *input, uint8_t *output, size_t output_size)
+{
+    opus_int32 size = opus_encode(m_opus_state, input, CODEC_OPUS_FRAME_SAMPLES, output, output_size);
+    if (size < 0)
+    {
+        return -EIO;
+    }
+    LOG_DBG("Opus encoding success: %i", size);
+    return size;
+}
+
+static void codec_opus_set_packet_loss(uint8_t loss)
+{
+#ifdef CONFIG_OMI_CODEC_OPUS_HYBRID
+    // Hysteresis, so a link hovering around the threshold doesn't toggle LBRR every report
+    if (!codec_fec_enabled && loss >= CONFIG_OMI_CODEC_FEC_LOSS_THRESHOLD)
+    {
+        codec_fec_enabled = true;
+    }
+    else if (codec_fec_enabled && loss < CONFIG_OMI_CODEC_FEC_LOSS_THRESHOLD / 2)
+    {
+        codec_fec_enabled = false;
+    }
+    opus_encoder_ctl(m_opus_state, OPUS_SET_INBAND_FEC(codec_fec_enabled ? 1 : 0));
+#endif
+    opus_encoder_ctl(m_opus_state, OPUS_SET_PACKET_LOSS_PERC(MIN(loss, CODEC_OPUS_MAX_LOSS_PERC)));
+    LOG_INF("Packet loss %d%%, in-band FEC %s", loss, codec_fec_enabled ? "on" : "off");
+}
+
+const codec_backend_t codec_opus_backend = {
+    .id = CODEC_ID_OPUS,
+    .name = "opus",
+    .frame_samples = CODEC_OPUS_FRAME_SAMPLES,
+    .init = codec_opus_init,
+    .encode = codec_opus_encode,
+    .set_packet_loss = codec_opus_set_packet_loss,
+};
+
+#endif
@@ -3,7 +3,7 @@
 // #define SAMPLE_RATE 16000
 #define MIC_GAIN 64
 #define MIC_IRC_PRIORITY 7
-#define MIC_BUFFER_SAMPLES 1600    // 100ms
+#define MIC_BUFFER_SAMPLES 1600    // 100ms, nrfx PDM driver in dk2/mic.c only. omi/src/mic.c uses CONFIG_OMI_MIC_BLOCK_MS
 #define AUDIO_BUFFER_SAMPLES 16000 // 1s
 #define NETWORK_RING_BUF_SIZE 32 // number of frames * CODEC_OUTPUT_MAX_BYTES
 #define MINIMAL_PACKET_SIZE 100    // Less than that doesn't make sence to send anything at all
@@ -17,24 +17,91 @@
 // Codecs
 #ifdef CONFIG_OMI_CODEC_OPUS
 #define CODEC_OPUS 1
+#endif
+#ifdef CONFIG_OMI_CODEC_MULAW
+#define CODEC_MULAW 1
+#endif
+#ifdef CONFIG_OMI_CODEC_ADPCM
+#define CODEC_ADPCM 1
+#endif
+#ifdef CONFIG_OMI_CODEC_LC3
+#define CODEC_LC3 1
+#endif
+#if !defined(CODEC_OPUS) && !defined(CODEC_MULAW) && !defined(CODEC_ADPCM) && !defined(CODEC_LC3)
+#error "Enable at least one CONFIG_OMI_CODEC_* in the project .conf file"
+#endif
+
+// Sample rates. Capture is fixed, the codecs run at whatever rate the resampler converts to
+#define MIC_SAMPLE_RATE 16000 // MAX_SAMPLE_RATE in omi/src/mic.c
+#if defined(CONFIG_OMI_CODEC_SAMPLE_RATE_8K)
+#define CODEC_SAMPLE_RATE 8000
+#elif defined(CONFIG_OMI_CODEC_SAMPLE_RATE_12K)
+#define CODEC_SAMPLE_RATE 12000
+#elif defined(CONFIG_OMI_CODEC_SAMPLE_RATE_24K)
+#define CODEC_SAMPLE_RATE 24000
 #else
-#error "Enable CONFIG_OMI_CODEC_OPUS in the project .conf file"
+#define CODEC_SAMPLE_RATE 16000
 #endif
+#define CODEC_SAMPLES_10MS (CODEC_SAMPLE_RATE / 100)
+
+// Largest frame of any codec, sizes the codec input and the transport queue.
+// Never below 160 bytes, a narrowband Opus frame can still peak well above its average.
+#define CODEC_PACKAGE_SAMPLES (CODEC_SAMPLES_10MS * 2)
+#define CODEC_OUTPUT_MAX_BYTES (CODEC_SAMPLE_RATE > 16000 ? CODEC_PACKAGE_SAMPLES / 2 : 160)
 
 #if CODEC_OPUS
-#define CODEC_PACKAGE_SAMPLES 160*2
-#define CODEC_OUTPUT_MAX_BYTES CODEC_PACKAGE_SAMPLES / 2
+#define CODEC_OPUS_FRAME_SAMPLES (CODEC_SAMPLES_10MS * 2) // 20ms
+#ifdef CONFIG_OMI_CODEC_OPUS_HYBRID
+#define CODEC_OPUS_APPLICATION OPUS_APPLICATION_VOIP // SILK is needed for LBRR (in-band FEC)
+#else
 #define CODEC_OPUS_APPLICATION OPUS_APPLICATION_RESTRICTED_LOWDELAY
-#define CODEC_OPUS_BITRATE 32000
+#endif
+#if CODEC_SAMPLE_RATE > 16000
+#define CODEC_OPUS_BITRATE 40000
+#else
+#define CODEC_OPUS_BITRATE (CODEC_SAMPLE_RATE * 2) // 16, 24 or 32 kbps
+#endif
 #define CODEC_OPUS_VBR 1 // Or 1
 #define CODEC_OPUS_COMPLEXITY 3
+#define CODEC_OPUS_MAX_LOSS_PERC 30 // Cap for OPUS_SET_PACKET_LOSS_PERC, higher only burns bitrate
 #endif
+#ifdef CONFIG_OMI_CODEC_OPUS_HYBRID
+#define CONFIG_OPUS_MODE CONFIG_OPUS_MODE_HYBRID
+#else
 #define CONFIG_OPUS_MODE CONFIG_OPUS_MODE_CELT
+#endif
+
+#if CODEC_MULAW
+#define CODEC_MULAW_FRAME_SAMPLES CODEC_SAMPLES_10MS // 10ms, one byte per sample
+#endif
+
+#if CODEC_ADPCM
+#define CODEC_ADPCM_FRAME_SAMPLES CODEC_SAMPLES_10MS // 10ms, 4 byte header + 4 bits per sample
+#define CODEC_ADPCM_HEADER_SIZE 4
+#endif
+
+#if CODEC_LC3
+#define CODEC_LC3_FRAME_US 10000
+#define CODEC_LC3_FRAME_SAMPLES CODEC_SAMPLES_10MS // 10ms
+#define CODEC_LC3_BITRATE 32000     // 40 bytes per frame
+#endif
 
-// Codec IDs
+// Codec IDs, as read from the audio codec characteristic. The app in this tree
+// only decodes 1, 20 and 21; the others need an app update.
 
-#ifdef CODEC_OPUS
-#define CODEC_ID 21
+#define CODEC_ID_MULAW16 10
+#define CODEC_ID_OPUS 21
+#define CODEC_ID_ADPCM16 30
+#define CODEC_ID_LC3 40
+
+#if defined(CONFIG_OMI_CODEC_DEFAULT_MULAW)
+#define CODEC_DEFAULT_ID CODEC_ID_MULAW16
+#elif defined(CONFIG_OMI_CODEC_DEFAULT_ADPCM)
+#define CODEC_DEFAULT_ID CODEC_ID_ADPCM16
+#elif defined(CONFIG_OMI_CODEC_DEFAULT_LC3)
+#define CODEC_DEFAULT_ID CODEC_ID_LC3
+#else
+#define CODEC_DEFAULT_ID CODEC_ID_OPUS
 #endif
 
 // Logs
@@ -0,0 +1,65 @@
+#include <zephyr/kernel.h>
+#include "device_clock.h"
+
+// The device clock runs from the 32 kHz crystal and the PDM clock from the
+// HFXO, both within 50 ppm. The timeline may move later by this much more.
+#define CAPTURE_DRIFT_PPM 200
+// A pickup this far behind the timeline isn't scheduling, blocks went missing
+#define CAPTURE_RESYNC_US 500000
+
+int64_t device_clock_us(void)
+{
+    return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+//
+// Capture timeline
+//
+
+void capture_timeline_reset(capture_timeline_t *timeline)
+{
+    timeline->valid = false;
+}
+
+int64_t capture_timeline_update(capture_timeline_t *timeline, int64_t completed_us, uint32_t duration_us)
+{
+    int64_t expected_us = timeline->next_us + duration_us;
+    int64_t end_us;
+    if (!timeline->valid || completed_us < expected_us || completed_us - expected_us > CAPTURE_RESYNC_US)
+    {
+        end_us = completed_us;
+    }
+    else
+    {
+        end_us = MIN(completed_us, expected_us + (int64_t)duration_us * CAPTURE_DRIFT_PPM / 1000000);
+    }
+
+    timeline->next_us = end_us;
+    timeline->valid = true;
+    return end_us - duration_us;
+}
+
+//
+// Clock sync
+//
+
+static struct k_spinlock sync_lock;
+static device_clock_sync_t sync_latest;
+static bool sync_valid = false;
+
+void device_clock_set_sync(const device_clock_sync_t *sync)
+{
+    k_spinlock_key_t key = k_spin_lock(&sync_lock);
+    sync_latest = *sync;
+    sync_valid = true;
+    k_spin_unlock(&sync_lock, key);
+}
+
+int device_clock_get_sync(device_clock_sync_t *sync)
+{
+    k_spinlock_key_t key = k_spin_lock(&sync_lock);
+    bool valid = sync_valid;
+    *sync = sync_latest;
+    k_spin_unlock(&sync_lock, key);
+    return valid ? 0 : -ENODATA;
+}
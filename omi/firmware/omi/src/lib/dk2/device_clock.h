@@ -0,0 +1,72 @@
+#ifndef DEVICE_CLOCK_H
+#define DEVICE_CLOCK_H
+#include <zephyr/kernel.h>
+
+// Device timebase for audio timestamps and the clock sync with the app.
+// Microseconds since boot, monotonic, never adjusted: the app maps it onto
+// its own clock with the offset it measures.
+
+/**
+ * @brief Current device time in microseconds
+ */
+int64_t device_clock_us(void);
+
+//
+// Capture timeline
+//
+
+// Blocks are picked up some time after their DMA completion, depending on
+// the scheduler. The sample clock is steady, so the earliest pickups are the
+// closest to the truth: the timeline advances by the block duration and only
+// ever moves earlier to match a pickup, plus a small allowance for drift
+// between the sample clock and the device clock.
+typedef struct
+{
+    int64_t next_us; // Estimated capture time of the next block's first sample
+    bool valid;
+} capture_timeline_t;
+
+/**
+ * @brief Forget the timeline, the next block starts it over
+ *
+ * Call whenever the sample clock stopped or blocks may have been lost.
+ */
+void capture_timeline_reset(capture_timeline_t *timeline);
+
+/**
+ * @brief Place the next block on the timeline
+ *
+ * @param completed_us Device time the block was picked up, at or after its DMA completion
+ * @param duration_us Duration of the block
+ *
+ * @return Capture time of the block's first sample
+ */
+int64_t capture_timeline_update(capture_timeline_t *timeline, int64_t completed_us, uint32_t duration_us);
+
+//
+// Clock sync
+//
+
+// The app runs an NTP-like exchange against device_clock_us and reports the result back
+typedef struct
+{
+    int64_t offset_us; // App clock minus device clock
+    uint32_t delay_us; // Round trip of the exchange the offset came from
+    int64_t device_us; // Device time the exchange ran at
+} device_clock_sync_t;
+
+/**
+ * @brief Store the latest clock sync result
+ *
+ * Kept across reconnects, so the app can measure the drift since the last sync.
+ */
+void device_clock_set_sync(const device_clock_sync_t *sync);
+
+/**
+ * @brief Get the latest clock sync result
+ *
+ * @return 0 if successful, -ENODATA if the app never synced since boot
+ */
+int device_clock_get_sync(device_clock_sync_t *sync);
+
+#endif
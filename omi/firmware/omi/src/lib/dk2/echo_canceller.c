@@ -0,0 +1,212 @@
+#include <math.h>
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "config.h"
+#include "device_clock.h"
+#include "echo_canceller.h"
+#include "nlms.h"
+
+LOG_MODULE_REGISTER(echo_canceller, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define ECHO_UPSAMPLE (MIC_SAMPLE_RATE / ECHO_REFERENCE_RATE)
+#define ECHO_CHUNK (ECHO_REFERENCE_RATE / 50)                   // 20ms of reference per pass
+#define ECHO_LOOKBACK_TICKS (2 * ECHO_REFERENCE_RATE / 1000)    // Covers microphone timestamps that are a little late
+#define ECHO_RESYNC_TICKS (4 * ECHO_REFERENCE_RATE / 1000)      // Timestamp jitter beyond this realigns the reference
+#define ECHO_TAIL_TICKS (200 * ECHO_REFERENCE_RATE / 1000)      // Reverberation, keep working this long after the speaker stops
+#define ECHO_ACTIVE_POWER (32 * 32)                             // Mean reference power that counts as playing
+#define ECHO_TICK_NONE INT64_MIN
+
+BUILD_ASSERT(MIC_SAMPLE_RATE == ECHO_UPSAMPLE * ECHO_REFERENCE_RATE, "Microphone rate must be a multiple of the speaker rate");
+
+int64_t echo_clock_now(void)
+{
+    return device_clock_us() * ECHO_REFERENCE_RATE / 1000000;
+}
+
+//
+// Reference timeline, written by the speaker thread and read by the microphone thread
+//
+
+#define REF_LENGTH 4096 // 512ms, a power of two
+#define REF_MASK (REF_LENGTH - 1)
+
+static int16_t ref_timeline[REF_LENGTH];
+static int64_t ref_end = 0; // Tick after the latest written sample
+static struct k_spinlock ref_lock;
+
+void echo_reference_write(const int16_t *pcm, size_t count, int64_t tick)
+{
+    k_spinlock_key_t key = k_spin_lock(&ref_lock);
+
+    // Nothing was played in between, unless the timeline has wrapped since
+    for (int64_t t = MAX(ref_end, tick - REF_LENGTH); t < tick; t++)
+    {
+        ref_timeline[t & REF_MASK] = 0;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        ref_timeline[(tick + i) & REF_MASK] = pcm[i];
+    }
+    ref_end = MAX(ref_end, tick + (int64_t)count);
+
+    k_spin_unlock(&ref_lock, key);
+}
+
+// Copies the reference for [tick, tick + count), returns its summed power
+static int64_t echo_reference_read(int16_t *out, size_t count, int64_t tick)
+{
+    int64_t power = 0;
+    k_spinlock_key_t key = k_spin_lock(&ref_lock);
+    for (size_t i = 0; i < count; i++)
+    {
+        int64_t t = tick + i;
+        out[i] = (t < ref_end && t >= ref_end - REF_LENGTH) ? ref_timeline[t & REF_MASK] : 0;
+        power += (int32_t)out[i] * out[i];
+    }
+    k_spin_unlock(&ref_lock, key);
+    return power;
+}
+
+//
+// NLMS canceller
+//
+
+#ifndef CONFIG_OMI_ECHO_CANCELLER_DUCKING_ONLY
+
+#define NLMS_TAPS CONFIG_OMI_ECHO_CANCELLER_TAPS
+#define NLMS_MU_Q15 8192 // 0.25, converges in a few hundred ms and rides out short double talk
+#define NLMS_EPSILON (NLMS_TAPS * 32 * 32)
+#define NLMS_WEIGHT_LIMIT (8 << 24)
+
+static int16_t nlms_history[2 * NLMS_TAPS];
+static int32_t nlms_weights[NLMS_TAPS]; // The echo path at 16 kHz
+static nlms_t nlms;
+
+#endif
+
+//
+// Ducking
+//
+
+#define DUCK_UNITY 32767
+
+static int32_t duck_gain = DUCK_UNITY;  // Q15, applied now
+static int32_t duck_depth = DUCK_UNITY; // Q15, gain while ducked
+#ifndef CONFIG_OMI_ECHO_CANCELLER_DUCKING_ONLY
+static int64_t duck_erle_q8 = 0;        // Mic to residual power ratio the canceller has to reach, Q8
+#define DUCK_RESIDUAL_POWER (100 * 100) // Mean residual power worth ducking at all
+#endif
+
+// Ramps the gain towards target over the chunk, so the ducking never clicks
+static void duck_apply(int16_t *samples, size_t count, int32_t target)
+{
+    if (duck_gain == target && target == DUCK_UNITY)
+    {
+        return;
+    }
+    int32_t step = (target - duck_gain) / (int32_t)count;
+    for (size_t i = 0; i < count; i++)
+    {
+        duck_gain += step;
+        samples[i] = ((int32_t)samples[i] * duck_gain) >> 15;
+    }
+    duck_gain = target;
+}
+
+//
+// Interface
+//
+
+static int64_t echo_next_tick = ECHO_TICK_NONE; // Reference tick that lines up with the next microphone sample
+static int64_t echo_active_until = ECHO_TICK_NONE;
+static bool echo_idle = true;
+static int16_t echo_ref[ECHO_CHUNK];
+
+int echo_canceller_init(void)
+{
+    echo_next_tick = ECHO_TICK_NONE;
+    echo_active_until = ECHO_TICK_NONE;
+    echo_idle = true;
+    duck_gain = DUCK_UNITY;
+    duck_depth = lroundf(32767.0f * powf(10.0f, -CONFIG_OMI_ECHO_DUCKING_DB / 20.0f));
+#ifndef CONFIG_OMI_ECHO_CANCELLER_DUCKING_ONLY
+    duck_erle_q8 = llroundf(256.0f * powf(10.0f, CONFIG_OMI_ECHO_DUCKING_ERLE_DB / 10.0f));
+    nlms_init(&nlms, nlms_history, nlms_weights, NLMS_TAPS, NLMS_MU_Q15, NLMS_EPSILON, NLMS_WEIGHT_LIMIT);
+#endif
+    return 0;
+}
+
+// One chunk: samples holds 2 * count microphone samples for count reference samples
+static void echo_process_chunk(int16_t *samples, size_t count, bool playing)
+{
+    size_t mic_count = count * ECHO_UPSAMPLE;
+#ifdef CONFIG_OMI_ECHO_CANCELLER_DUCKING_ONLY
+    ARG_UNUSED(playing);
+    duck_apply(samples, mic_count, duck_depth);
+#else
+    int64_t mic_power = 0;
+    int64_t error_power = 0;
+    for (size_t i = 0; i < mic_count; i++)
+    {
+        // The I2S output holds every speaker sample, so repeating them matches it better than interpolating
+        int16_t d = samples[i];
+        int16_t e = nlms_process(&nlms, echo_ref[i / ECHO_UPSAMPLE], d, playing);
+        mic_power += (int32_t)d * d;
+        error_power += (int32_t)e * e;
+        samples[i] = e;
+    }
+
+    if (error_power > 4 * mic_power && error_power > DUCK_RESIDUAL_POWER * (int64_t)mic_count)
+    {
+        // Adding echo rather than removing it, the path changed under the filter
+        LOG_WRN("Echo canceller diverged, restarting");
+        nlms_clear_weights(&nlms);
+    }
+
+    // Fallback while the canceller hasn't converged or near-end speech hides the echo
+    bool duck = error_power > DUCK_RESIDUAL_POWER * (int64_t)mic_count && (mic_power << 8) < error_power * duck_erle_q8;
+    duck_apply(samples, mic_count, duck ? duck_depth : DUCK_UNITY);
+#endif
+}
+
+void echo_canceller_process(int16_t *samples, size_t count, int64_t tick)
+{
+    int64_t start = tick - ECHO_LOOKBACK_TICKS;
+    if (echo_next_tick == ECHO_TICK_NONE || llabs(start - echo_next_tick) > ECHO_RESYNC_TICKS)
+    {
+        echo_next_tick = start;
+#ifndef CONFIG_OMI_ECHO_CANCELLER_DUCKING_ONLY
+        nlms_clear_history(&nlms);
+#endif
+    }
+
+    for (size_t offset = 0; offset < count; offset += ECHO_CHUNK * ECHO_UPSAMPLE)
+    {
+        size_t ref_count = MIN(count - offset, ECHO_CHUNK * ECHO_UPSAMPLE) / ECHO_UPSAMPLE;
+        int64_t power = echo_reference_read(echo_ref, ref_count, echo_next_tick);
+        echo_next_tick += ref_count;
+
+        bool playing = power > ECHO_ACTIVE_POWER * (int64_t)ref_count;
+        if (playing)
+        {
+            echo_active_until = echo_next_tick + ECHO_TAIL_TICKS;
+        }
+        if (echo_next_tick > echo_active_until)
+        {
+            // Speaker quiet for a while: only finish undoing the ducking
+            duck_apply(&samples[offset], ref_count * ECHO_UPSAMPLE, DUCK_UNITY);
+            echo_idle = true;
+            continue;
+        }
+#ifndef CONFIG_OMI_ECHO_CANCELLER_DUCKING_ONLY
+        if (echo_idle)
+        {
+            // The history stopped when the speaker went quiet, it no longer lines up
+            nlms_clear_history(&nlms);
+        }
+#endif
+        echo_idle = false;
+        echo_process_chunk(&samples[offset], ref_count, playing);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef ECHO_CANCELLER_H
+#define ECHO_CANCELLER_H
+#include <zephyr/kernel.h>
+
+// Acoustic echo canceller (CONFIG_OMI_ECHO_CANCELLER)
+//
+// The speaker taps every block it queues into a reference timeline, stamped with
+// the time it will be played. The microphone path looks up the reference for the
+// time it captured a block and subtracts the echo an NLMS filter predicts from it.
+// Where that doesn't remove enough, the microphone is ducked while the speaker plays.
+//
+// Times are ticks of the echo clock, device_clock_us counted in speaker samples.
+
+#define ECHO_REFERENCE_RATE 8000 // SAMPLE_FREQUENCY in speaker.c
+
+/**
+ * @brief Current time on the echo clock
+ */
+int64_t echo_clock_now(void);
+
+/**
+ * @brief Record what the speaker is going to play
+ *
+ * Called by the speaker for every block it queues. Safe against a concurrent
+ * echo_canceller_process.
+ *
+ * @param pcm Mono samples at ECHO_REFERENCE_RATE
+ * @param count Number of samples
+ * @param tick Echo clock time at which the first sample is played
+ */
+void echo_reference_write(const int16_t *pcm, size_t count, int64_t tick);
+
+/**
+ * @brief Reset the canceller state
+ *
+ * The learned echo path is cleared too, call it when the acoustics changed.
+ *
+ * @return 0 if successful, negative errno code if error
+ */
+int echo_canceller_init(void);
+
+/**
+ * @brief Remove the speaker echo from a block of 16 kHz mono microphone PCM in place
+ *
+ * Costs nothing while the speaker has been silent for a while.
+ *
+ * @param samples PCM samples, overwritten with the result
+ * @param count Number of samples, even
+ * @param tick Echo clock time at which the first sample was captured
+ */
+void echo_canceller_process(int16_t *samples, size_t count, int64_t tick);
+
+#endif
@@ -0,0 +1,129 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/drivers/clock_control/nrf_clock_control.h>
+#include <zephyr/bluetooth/gap.h>
+#include "energy.h"
+#include "device_clock.h"
+
+LOG_MODULE_REGISTER(energy, CONFIG_LOG_DEFAULT_LEVEL);
+
+// Airtime of a notification: the payload plus preamble, access address, LL header,
+// MIC, CRC, L2CAP and ATT headers, then the two inter-frame spaces around the
+// empty acknowledgement of about 10 bytes.
+#define ENERGY_RADIO_OVERHEAD_BYTES 22
+#define ENERGY_RADIO_ACK_BYTES 10
+#define ENERGY_RADIO_IFS_US 150
+
+static const uint32_t energy_current_ua[ENERGY_SUBSYSTEM_COUNT] = {
+    [ENERGY_PDM] = CONFIG_OMI_ENERGY_PDM_UA,
+    [ENERGY_HFXO] = CONFIG_OMI_ENERGY_HFXO_UA,
+    [ENERGY_CODEC] = CONFIG_OMI_ENERGY_CODEC_UA,
+    [ENERGY_RADIO] = CONFIG_OMI_ENERGY_RADIO_UA,
+    [ENERGY_SD] = CONFIG_OMI_ENERGY_SD_UA,
+    [ENERGY_LED] = CONFIG_OMI_ENERGY_LED_UA,
+};
+
+static struct k_spinlock energy_lock;
+static energy_ledger_t energy_ledger;
+
+// Requests for the HFXO from this core, the PDM driver's among them. The network
+// core's radio requests it on its own and doesn't show here.
+static void energy_hfxo_monitor(struct onoff_manager *mgr, struct onoff_monitor *mon, uint32_t state, int res)
+{
+    energy_set_active(ENERGY_HFXO, state == ONOFF_STATE_TO_ON || state == ONOFF_STATE_ON);
+}
+
+static struct onoff_monitor energy_hfxo_mon = {
+    .callback = energy_hfxo_monitor,
+};
+
+static int energy_init(void)
+{
+    energy_ledger_init(&energy_ledger, device_clock_us());
+
+    struct onoff_manager *hf = z_nrf_clock_control_get_onoff(CLOCK_CONTROL_NRF_SUBSYS_HF);
+    int err = onoff_monitor_register(hf, &energy_hfxo_mon);
+    if (err)
+    {
+        LOG_ERR("Failed to monitor the HFXO (err %d)", err);
+    }
+    return 0;
+}
+
+SYS_INIT(energy_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+void energy_set_active(energy_subsystem_t sub, bool active)
+{
+    k_spinlock_key_t key = k_spin_lock(&energy_lock);
+    energy_ledger_set_active(&energy_ledger, sub, active, device_clock_us());
+    k_spin_unlock(&energy_lock, key);
+}
+
+void energy_add_us(energy_subsystem_t sub, uint32_t active_us)
+{
+    k_spinlock_key_t key = k_spin_lock(&energy_lock);
+    energy_ledger_add(&energy_ledger, sub, active_us);
+    k_spin_unlock(&energy_lock, key);
+}
+
+void energy_radio_tx(size_t bytes, uint8_t phy)
+{
+    // Coded at S8, the slowest, when unknown
+    uint32_t us_per_byte = phy == BT_GAP_LE_PHY_2M ? 4 : phy == BT_GAP_LE_PHY_1M ? 8 : 64;
+    uint32_t air_bytes = bytes + ENERGY_RADIO_OVERHEAD_BYTES + ENERGY_RADIO_ACK_BYTES;
+    energy_add_us(ENERGY_RADIO, air_bytes * us_per_byte + 2 * ENERGY_RADIO_IFS_US);
+}
+
+size_t energy_pack(uint8_t *buf, size_t size)
+{
+    k_spinlock_key_t key = k_spin_lock(&energy_lock);
+    size_t packed = energy_ledger_pack(&energy_ledger, energy_current_ua, device_clock_us(), buf, size);
+    k_spin_unlock(&energy_lock, key);
+    return packed;
+}
+
+void energy_reset(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&energy_lock);
+    energy_ledger_reset(&energy_ledger, device_clock_us());
+    k_spin_unlock(&energy_lock, key);
+}
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+
+static int cmd_energy_show(const struct shell *sh, size_t argc, char **argv)
+{
+    energy_ledger_t snapshot;
+    k_spinlock_key_t key = k_spin_lock(&energy_lock);
+    snapshot = energy_ledger;
+    k_spin_unlock(&energy_lock, key);
+
+    int64_t now_us = device_clock_us();
+    uint32_t total_uah = 0;
+    shell_print(sh, "Over %u s:", (uint32_t)((now_us - snapshot.reset_us) / 1000000));
+    for (int i = 0; i < ENERGY_SUBSYSTEM_COUNT; i++)
+    {
+        uint32_t charge_uah = energy_ledger_charge_uah(&snapshot, i, energy_current_ua[i], now_us);
+        total_uah += charge_uah;
+        shell_print(sh, "%-6s %10u ms %8u events %8u uAh", energy_subsystem_name(i),
+                    (uint32_t)(energy_ledger_active_us(&snapshot, i, now_us) / 1000), snapshot.events[i], charge_uah);
+    }
+    shell_print(sh, "total  %u uAh", total_uah);
+    return 0;
+}
+
+static int cmd_energy_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    energy_reset();
+    shell_print(sh, "Energy ledger reset");
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_energy_cmds,
+                               SHELL_CMD(show, NULL, "Active time and charge per subsystem", cmd_energy_show),
+                               SHELL_CMD(reset, NULL, "Zero the ledger", cmd_energy_reset),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(energy, &sub_energy_cmds, "Energy accounting", NULL);
+#endif
@@ -0,0 +1,47 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+#include <zephyr/kernel.h>
+#include "energy_ledger.h"
+
+// Energy accounting (CONFIG_OMI_ENERGY_LEDGER)
+//
+// The drivers report when their subsystem is active, the ledger adds it up and
+// prices it with the CONFIG_OMI_ENERGY_*_UA currents. Read over the energy
+// characteristic or with the "energy" shell command. Without the Kconfig option
+// the hooks compile to nothing.
+
+#ifdef CONFIG_OMI_ENERGY_LEDGER
+
+/**
+ * @brief Switch a subsystem on or off in the ledger, safe from any context
+ */
+void energy_set_active(energy_subsystem_t sub, bool active);
+
+/**
+ * @brief Count one busy period of a subsystem, safe from any context
+ */
+void energy_add_us(energy_subsystem_t sub, uint32_t active_us);
+
+/**
+ * @brief Account a notification of the given size as radio airtime
+ *
+ * @param phy BT_GAP_LE_PHY_ the connection transmits on
+ */
+void energy_radio_tx(size_t bytes, uint8_t phy);
+
+/**
+ * @brief Pack the ledger as energy_ledger_pack does
+ */
+size_t energy_pack(uint8_t *buf, size_t size);
+
+void energy_reset(void);
+
+#else
+
+static inline void energy_set_active(energy_subsystem_t sub, bool active) {}
+static inline void energy_add_us(energy_subsystem_t sub, uint32_t active_us) {}
+static inline void energy_radio_tx(size_t bytes, uint8_t phy) {}
+
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include "energy_ledger.h"
+
+static const char *const subsystem_names[ENERGY_SUBSYSTEM_COUNT] = {
+    [ENERGY_PDM] = "pdm",
+    [ENERGY_HFXO] = "hfxo",
+    [ENERGY_CODEC] = "codec",
+    [ENERGY_RADIO] = "radio",
+    [ENERGY_SD] = "sd",
+    [ENERGY_LED] = "led",
+};
+
+void energy_ledger_reset(energy_ledger_t *ledger, int64_t now_us)
+{
+    for (int i = 0; i < ENERGY_SUBSYSTEM_COUNT; i++)
+    {
+        ledger->active_us[i] = 0;
+        ledger->events[i] = 0;
+        if (ledger->since_us[i] >= 0)
+        {
+            ledger->since_us[i] = now_us;
+        }
+    }
+    ledger->reset_us = now_us;
+}
+
+void energy_ledger_init(energy_ledger_t *ledger, int64_t now_us)
+{
+    for (int i = 0; i < ENERGY_SUBSYSTEM_COUNT; i++)
+    {
+        ledger->since_us[i] = -1;
+    }
+    energy_ledger_reset(ledger, now_us);
+}
+
+void energy_ledger_set_active(energy_ledger_t *ledger, energy_subsystem_t sub, bool active, int64_t now_us)
+{
+    if (sub >= ENERGY_SUBSYSTEM_COUNT)
+    {
+        return;
+    }
+    bool was_active = ledger->since_us[sub] >= 0;
+    if (active == was_active)
+    {
+        return;
+    }
+    if (active)
+    {
+        ledger->since_us[sub] = now_us;
+        ledger->events[sub]++;
+    }
+    else
+    {
+        if (now_us > ledger->since_us[sub])
+        {
+            ledger->active_us[sub] += now_us - ledger->since_us[sub];
+        }
+        ledger->since_us[sub] = -1;
+    }
+}
+
+void energy_ledger_add(energy_ledger_t *ledger, energy_subsystem_t sub, uint32_t active_us)
+{
+    if (sub >= ENERGY_SUBSYSTEM_COUNT)
+    {
+        return;
+    }
+    ledger->active_us[sub] += active_us;
+    ledger->events[sub]++;
+}
+
+uint64_t energy_ledger_active_us(const energy_ledger_t *ledger, energy_subsystem_t sub, int64_t now_us)
+{
+    if (sub >= ENERGY_SUBSYSTEM_COUNT)
+    {
+        return 0;
+    }
+    uint64_t active_us = ledger->active_us[sub];
+    if (ledger->since_us[sub] >= 0 && now_us > ledger->since_us[sub])
+    {
+        active_us += now_us - ledger->since_us[sub];
+    }
+    return active_us;
+}
+
+uint32_t energy_ledger_charge_uah(const energy_ledger_t *ledger, energy_subsystem_t sub, uint32_t current_ua,
+                                  int64_t now_us)
+{
+    // Whole seconds and the rest apart, so the product can't overflow
+    uint64_t active_us = energy_ledger_active_us(ledger, sub, now_us);
+    uint64_t seconds = active_us / 1000000;
+    uint64_t rest_us = active_us % 1000000;
+    uint64_t charge = (seconds * current_ua + rest_us * current_ua / 1000000) / 3600;
+    return charge > UINT32_MAX ? UINT32_MAX : (uint32_t)charge;
+}
+
+size_t energy_ledger_pack(const energy_ledger_t *ledger, const uint32_t current_ua[ENERGY_SUBSYSTEM_COUNT],
+                          int64_t now_us, uint8_t *buf, size_t size)
+{
+    if (size < ENERGY_LEDGER_PACKED_SIZE)
+    {
+        return 0;
+    }
+    int64_t elapsed_us = now_us > ledger->reset_us ? now_us - ledger->reset_us : 0;
+    sys_put_le32((uint32_t)(elapsed_us / 1000000), buf);
+    uint8_t *p = buf + 4;
+    for (int i = 0; i < ENERGY_SUBSYSTEM_COUNT; i++)
+    {
+        uint64_t active_ms = energy_ledger_active_us(ledger, i, now_us) / 1000;
+        sys_put_le32(active_ms > UINT32_MAX ? UINT32_MAX : (uint32_t)active_ms, p);
+        sys_put_le32(ledger->events[i], p + 4);
+        sys_put_le32(energy_ledger_charge_uah(ledger, i, current_ua[i], now_us), p + 8);
+        p += 12;
+    }
+    return ENERGY_LEDGER_PACKED_SIZE;
+}
+
+const char *energy_subsystem_name(energy_subsystem_t sub)
+{
+    return sub < ENERGY_SUBSYSTEM_COUNT ? subsystem_names[sub] : "unknown";
+}
@@ -0,0 +1,80 @@
+#ifndef ENERGY_LEDGER_H
+#define ENERGY_LEDGER_H
+#include <zephyr/kernel.h>
+
+// Energy ledger
+//
+// Accumulates how long every power-hungry subsystem was active, and turns that
+// into charge with a per-subsystem active current. Subsystems with a clear
+// on/off state are switched with energy_ledger_set_active, short busy periods
+// (an encoded frame, a radio packet) are added with their duration.
+// No locking, the caller serializes access.
+
+typedef enum
+{
+    ENERGY_PDM,   // Microphone powered and capturing
+    ENERGY_HFXO,  // High frequency crystal running for the audio clock
+    ENERGY_CODEC, // Encoder busy
+    ENERGY_RADIO, // Estimated airtime of the notifications sent
+    ENERGY_SD,    // SD card powered
+    ENERGY_LED,   // Any status LED lit
+    ENERGY_SUBSYSTEM_COUNT,
+} energy_subsystem_t;
+
+typedef struct
+{
+    uint64_t active_us[ENERGY_SUBSYSTEM_COUNT];
+    uint32_t events[ENERGY_SUBSYSTEM_COUNT]; // Activations, frames or packets
+    int64_t since_us[ENERGY_SUBSYSTEM_COUNT]; // Start of the open active period, -1 when inactive
+    int64_t reset_us;
+} energy_ledger_t;
+
+// Packed size: elapsed seconds, then active ms, events and charge in uAh for every subsystem
+#define ENERGY_LEDGER_PACKED_SIZE (4 + ENERGY_SUBSYSTEM_COUNT * 12)
+
+/**
+ * @brief Clear all totals, subsystems active now stay active from now_us on
+ */
+void energy_ledger_reset(energy_ledger_t *ledger, int64_t now_us);
+
+void energy_ledger_init(energy_ledger_t *ledger, int64_t now_us);
+
+/**
+ * @brief Switch a subsystem on or off
+ *
+ * Repeating the current state is harmless, an activation is only counted on a change.
+ */
+void energy_ledger_set_active(energy_ledger_t *ledger, energy_subsystem_t sub, bool active, int64_t now_us);
+
+/**
+ * @brief Count one busy period of a known duration
+ */
+void energy_ledger_add(energy_ledger_t *ledger, energy_subsystem_t sub, uint32_t active_us);
+
+/**
+ * @brief Active time so far, including a period still open at now_us
+ */
+uint64_t energy_ledger_active_us(const energy_ledger_t *ledger, energy_subsystem_t sub, int64_t now_us);
+
+/**
+ * @brief Charge a subsystem used since the last reset, in microamp-hours
+ *
+ * @param current_ua What the subsystem draws while active
+ */
+uint32_t energy_ledger_charge_uah(const energy_ledger_t *ledger, energy_subsystem_t sub, uint32_t current_ua,
+                                  int64_t now_us);
+
+/**
+ * @brief Pack the ledger for the diagnostics characteristic
+ *
+ * [elapsed s (le32)], then per subsystem [active ms (le32), events (le32), charge uAh (le32)].
+ *
+ * @param current_ua Active current of every subsystem
+ * @return Bytes written, 0 if the buffer is too small
+ */
+size_t energy_ledger_pack(const energy_ledger_t *ledger, const uint32_t current_ua[ENERGY_SUBSYSTEM_COUNT],
+                          int64_t now_us, uint8_t *buf, size_t size);
+
+const char *energy_subsystem_name(energy_subsystem_t sub);
+
+#endif
@@ -3,11 +3,12 @@
 
 #include <stdint.h>
 #include <zephyr/bluetooth/conn.h>
+#include "haptic_pattern.h"
 
 /**
  * @brief Initialize the haptic driver.
  *
- * Configures the GPIO pin for the haptic motor.
+ * Uses the haptic_pwm channel when the board has one, the motor GPIO otherwise.
  *
  * @return 0 on success, negative error code otherwise.
  */
@@ -16,13 +17,48 @@ int haptic_init(void);
 /**
  * @brief Play a haptic effect for a specified duration.
  *
- * Activates the haptic motor for the given duration in milliseconds.
- * The duration is capped by MAX_HAPTIC_DURATION.
+ * Activates the haptic motor at full intensity for the given duration in
+ * milliseconds, interrupting any pattern. The duration is capped by
+ * MAX_HAPTIC_DURATION.
  *
  * @param duration Duration in milliseconds.
  */
 void play_haptic_milli(uint32_t duration);
 
+typedef struct
+{
+    const haptic_step_t *steps;
+    uint8_t count;
+} haptic_pattern_t;
+
+// Built-in patterns, also played by id over BLE
+typedef enum
+{
+    HAPTIC_PATTERN_SHORT = 0,     // 100 ms
+    HAPTIC_PATTERN_MEDIUM = 1,    // 300 ms
+    HAPTIC_PATTERN_LONG = 2,      // 500 ms
+    HAPTIC_PATTERN_DOUBLE = 3,
+    HAPTIC_PATTERN_NOTIFICATION = 4,
+    HAPTIC_PATTERN_RAMP_UP = 5,
+    HAPTIC_PATTERN_HEARTBEAT = 6,
+    HAPTIC_PATTERN_COUNT,
+} haptic_pattern_id_t;
+
+extern const haptic_pattern_t haptic_patterns[HAPTIC_PATTERN_COUNT];
+
+/**
+ * @brief Play a sequence of (intensity, duration) steps.
+ *
+ * Runs from the system work queue, so this returns right away. A higher
+ * priority request interrupts the one in progress, others are queued behind it.
+ *
+ * @param pattern Pattern to play, copied, at most HAPTIC_MAX_STEPS steps.
+ * @param priority haptic_priority_t of the request.
+ *
+ * @return 0 if playing or queued, -EINVAL for a pattern too long, -ENOBUFS if the queue is full.
+ */
+int play_haptic_pattern(const haptic_pattern_t *pattern, haptic_priority_t priority);
+
 /**
  * @brief Register the Haptic BLE service.
  *
@@ -30,6 +66,9 @@ void play_haptic_milli(uint32_t duration);
  */
 void register_haptic_service(void);
 
+/**
+ * @brief Stop the motor and drop every queued pattern.
+ */
 void haptic_off();
 
 #endif // HAPTIC_H_
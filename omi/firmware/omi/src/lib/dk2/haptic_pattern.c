@@ -0,0 +1,89 @@
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include "haptic_pattern.h"
+
+int haptic_sequence_from_blob(haptic_sequence_t *sequence, const uint8_t *blob, size_t len, uint8_t priority)
+{
+    if (len == 0 || len % 2 || len / 2 > HAPTIC_MAX_STEPS)
+    {
+        return -EINVAL;
+    }
+
+    sequence->count = len / 2;
+    sequence->priority = priority;
+    for (uint8_t i = 0; i < sequence->count; i++)
+    {
+        sequence->steps[i].intensity = blob[2 * i];
+        sequence->steps[i].duration_ms = blob[2 * i + 1] * HAPTIC_BLOB_UNIT_MS;
+    }
+    return 0;
+}
+
+void haptic_engine_init(haptic_engine_t *engine)
+{
+    memset(engine, 0, sizeof(*engine));
+}
+
+static void engine_start(haptic_engine_t *engine, const haptic_sequence_t *sequence)
+{
+    engine->current = *sequence;
+    engine->step = 0;
+    engine->playing = true;
+}
+
+int haptic_engine_submit(haptic_engine_t *engine, const haptic_sequence_t *sequence)
+{
+    if (!engine->playing || sequence->priority > engine->current.priority)
+    {
+        engine_start(engine, sequence);
+        return 1;
+    }
+
+    // Behind everything at its priority or higher, ahead of anything lower
+    uint8_t at = engine->queued;
+    while (at > 0 && engine->queue[at - 1].priority < sequence->priority)
+    {
+        at--;
+    }
+    if (engine->queued == HAPTIC_QUEUE_DEPTH)
+    {
+        if (at == HAPTIC_QUEUE_DEPTH)
+        {
+            return -ENOBUFS;
+        }
+        // The lowest waiting request makes room
+        engine->queued--;
+    }
+    memmove(&engine->queue[at + 1], &engine->queue[at], (engine->queued - at) * sizeof(haptic_sequence_t));
+    engine->queue[at] = *sequence;
+    engine->queued++;
+    return 0;
+}
+
+bool haptic_engine_next(haptic_engine_t *engine, haptic_step_t *step)
+{
+    while (engine->playing)
+    {
+        if (engine->step < engine->current.count)
+        {
+            *step = engine->current.steps[engine->step++];
+            return true;
+        }
+
+        engine->playing = false;
+        if (engine->queued > 0)
+        {
+            engine_start(engine, &engine->queue[0]);
+            engine->queued--;
+            memmove(&engine->queue[0], &engine->queue[1], engine->queued * sizeof(haptic_sequence_t));
+        }
+    }
+    return false;
+}
+
+void haptic_engine_stop(haptic_engine_t *engine)
+{
+    engine->playing = false;
+    engine->queued = 0;
+}
@@ -0,0 +1,77 @@
+#ifndef HAPTIC_PATTERN_H
+#define HAPTIC_PATTERN_H
+#include <zephyr/kernel.h>
+
+// Haptic sequences and their priority queue (CONFIG_OMI_ENABLE_HAPTIC)
+//
+// A sequence is a list of (intensity, duration) steps. The one playing is
+// preempted by a higher priority request, requests of the same or lower
+// priority wait their turn. The engine only tracks state, src/haptic.c steps
+// it from a work item and drives the motor.
+
+#define HAPTIC_MAX_STEPS 16
+#define HAPTIC_QUEUE_DEPTH 4
+#define HAPTIC_BLOB_UNIT_MS 10 // Duration unit of the steps in a blob
+
+typedef enum
+{
+    HAPTIC_PRIORITY_LOW = 0,    // Ambient cues, first to wait
+    HAPTIC_PRIORITY_NORMAL = 1, // Notifications
+    HAPTIC_PRIORITY_HIGH = 2,   // Direct feedback to the wearer, e.g. button presses
+} haptic_priority_t;
+
+typedef struct
+{
+    uint8_t intensity; // 0 off to 255 full drive
+    uint16_t duration_ms;
+} haptic_step_t;
+
+typedef struct
+{
+    haptic_step_t steps[HAPTIC_MAX_STEPS];
+    uint8_t count;
+    uint8_t priority;
+} haptic_sequence_t;
+
+typedef struct
+{
+    haptic_sequence_t current;
+    bool playing;
+    uint8_t step; // Next step of current
+    haptic_sequence_t queue[HAPTIC_QUEUE_DEPTH];
+    uint8_t queued;
+} haptic_engine_t;
+
+/**
+ * @brief Parse a compact sequence, (intensity, duration in HAPTIC_BLOB_UNIT_MS) byte pairs
+ *
+ * @return 0 if successful, -EINVAL for an odd, empty or too long blob
+ */
+int haptic_sequence_from_blob(haptic_sequence_t *sequence, const uint8_t *blob, size_t len, uint8_t priority);
+
+void haptic_engine_init(haptic_engine_t *engine);
+
+/**
+ * @brief Request a sequence
+ *
+ * @return 1 if it preempted the sequence playing or the engine was idle, the caller
+ *         restarts the stepping; 0 if it was queued; -ENOBUFS if the queue was full
+ *         of requests at its priority or higher
+ */
+int haptic_engine_submit(haptic_engine_t *engine, const haptic_sequence_t *sequence);
+
+/**
+ * @brief Take the next step to drive
+ *
+ * Moves on to the next queued sequence when the current one is done.
+ *
+ * @return false when there is nothing left to play, the motor goes off
+ */
+bool haptic_engine_next(haptic_engine_t *engine, haptic_step_t *step);
+
+/**
+ * @brief Drop the sequence playing and everything queued
+ */
+void haptic_engine_stop(haptic_engine_t *engine);
+
+#endif
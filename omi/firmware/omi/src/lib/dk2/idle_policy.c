@@ -0,0 +1,43 @@
+#include <zephyr/kernel.h>
+#include "idle_policy.h"
+
+void idle_policy_init(idle_policy_t *policy, uint32_t timeout_ms, int64_t now_ms)
+{
+    policy->timeout_ms = timeout_ms;
+    policy->idle_since_ms = now_ms;
+    policy->moving = false;
+    policy->blocked = false;
+}
+
+void idle_policy_activity(idle_policy_t *policy, int64_t now_ms)
+{
+    policy->idle_since_ms = MAX(policy->idle_since_ms, now_ms);
+}
+
+void idle_policy_set_moving(idle_policy_t *policy, bool moving, int64_t now_ms)
+{
+    if (policy->moving && !moving)
+    {
+        idle_policy_activity(policy, now_ms);
+    }
+    policy->moving = moving;
+}
+
+void idle_policy_set_blocked(idle_policy_t *policy, bool blocked, int64_t now_ms)
+{
+    if (policy->blocked && !blocked)
+    {
+        idle_policy_activity(policy, now_ms);
+    }
+    policy->blocked = blocked;
+}
+
+int64_t idle_policy_remaining_ms(const idle_policy_t *policy, int64_t now_ms)
+{
+    if (policy->moving || policy->blocked)
+    {
+        return -1;
+    }
+    int64_t due_ms = policy->idle_since_ms + policy->timeout_ms;
+    return due_ms > now_ms ? due_ms - now_ms : 0;
+}
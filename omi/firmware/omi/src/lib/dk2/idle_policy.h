@@ -0,0 +1,47 @@
+#ifndef IDLE_POLICY_H
+#define IDLE_POLICY_H
+#include <zephyr/kernel.h>
+
+// When an unused device turns itself off (CONFIG_OMI_AUTO_OFF)
+//
+// The countdown runs while the device lies still and hears no voice, and
+// starts over with every voice or button event. Motion and a block (the
+// charger) hold it for as long as they last. src/lib/dk2/auto_off.c feeds the
+// events and acts on the result.
+
+typedef struct
+{
+    uint32_t timeout_ms;
+    int64_t idle_since_ms; // Last activity, or the end of the last motion or block
+    bool moving;
+    bool blocked;
+} idle_policy_t;
+
+/**
+ * @brief Start idle at now_ms, not moving and not blocked
+ */
+void idle_policy_init(idle_policy_t *policy, uint32_t timeout_ms, int64_t now_ms);
+
+/**
+ * @brief Voice or a button press, restarts the countdown
+ */
+void idle_policy_activity(idle_policy_t *policy, int64_t now_ms);
+
+/**
+ * @brief Whether the device is moved, the countdown starts when it stops
+ */
+void idle_policy_set_moving(idle_policy_t *policy, bool moving, int64_t now_ms);
+
+/**
+ * @brief Hold the countdown while blocked, it starts over once released
+ */
+void idle_policy_set_blocked(idle_policy_t *policy, bool blocked, int64_t now_ms);
+
+/**
+ * @brief Time left until the device should turn off
+ *
+ * @return ms left, 0 once due, -1 while moving or blocked
+ */
+int64_t idle_policy_remaining_ms(const idle_policy_t *policy, int64_t now_ms);
+
+#endif
@@ -0,0 +1,106 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include "imu_fifo.h"
+
+void imu_fifo_decoder_init(imu_fifo_decoder_t *decoder, bool gyro)
+{
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->gyro = gyro;
+    decoder->synced = true;
+}
+
+//
+// Decoding
+//
+
+// Pattern positions hold gyro X, Y, Z then accel X, Y, Z, or accel X, Y, Z alone
+static void decoder_emit(const imu_fifo_decoder_t *decoder, imu_sample_t *sample)
+{
+    const int16_t *accel = decoder->gyro ? &decoder->words[3] : &decoder->words[0];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        sample->accel[axis] = accel[axis];
+        sample->gyro[axis] = decoder->gyro ? decoder->words[axis] : 0;
+    }
+}
+
+size_t imu_fifo_decode(imu_fifo_decoder_t *decoder, uint16_t pattern, const uint8_t *data, size_t words,
+                       imu_sample_t *samples)
+{
+    const uint16_t pattern_words = IMU_FIFO_PATTERN_WORDS(decoder->gyro);
+    size_t count = 0;
+
+    // Out of step after an overrun or a lost read: the partial sample is
+    // unusable, and so is the one the FIFO resumes in the middle of
+    pattern %= pattern_words;
+    if (pattern != decoder->position)
+    {
+        if (decoder->position != 0 && decoder->synced)
+        {
+            decoder->dropped++;
+        }
+        decoder->position = pattern;
+        decoder->synced = pattern == 0;
+    }
+
+    for (size_t i = 0; i < words; i++)
+    {
+        decoder->words[decoder->position] = (int16_t)sys_get_le16(&data[2 * i]);
+        if (++decoder->position < pattern_words)
+        {
+            continue;
+        }
+
+        decoder->position = 0;
+        if (!decoder->synced)
+        {
+            decoder->dropped++;
+            decoder->synced = true;
+            continue;
+        }
+        decoder_emit(decoder, &samples[count++]);
+    }
+    return count;
+}
+
+//
+// Packing
+//
+
+size_t imu_pack(uint8_t *packet, size_t size, uint8_t seq, bool gyro, uint16_t period_us, uint32_t first_us,
+                const imu_sample_t *samples, size_t count, size_t *packed)
+{
+    const size_t sample_size = IMU_SAMPLE_SIZE(gyro);
+    size_t fit = size > IMU_PACKET_HEADER_SIZE ? (size - IMU_PACKET_HEADER_SIZE) / sample_size : 0;
+    size_t take = MIN(fit, count);
+    *packed = take;
+    if (take == 0)
+    {
+        return 0;
+    }
+
+    packet[0] = seq;
+    packet[1] = gyro ? IMU_PACKET_GYRO : 0;
+    sys_put_le16(period_us, &packet[2]);
+    sys_put_le32(first_us, &packet[4]);
+
+    uint8_t *out = &packet[IMU_PACKET_HEADER_SIZE];
+    for (size_t i = 0; i < take; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            sys_put_le16(samples[i].accel[axis], out);
+            out += 2;
+        }
+        if (gyro)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                sys_put_le16(samples[i].gyro[axis], out);
+                out += 2;
+            }
+        }
+    }
+    return out - packet;
+}
@@ -0,0 +1,75 @@
+#ifndef IMU_FIFO_H
+#define IMU_FIFO_H
+#include <zephyr/kernel.h>
+
+// Decoding and packing of the LSM6DSL / LSM6DS3TR-C FIFO (CONFIG_OMI_ENABLE_ACCELEROMETER)
+//
+// The FIFO holds 16-bit words in a fixed pattern, the gyroscope's X, Y, Z
+// ahead of the accelerometer's when both are batched. It carries no tags, so
+// the decoder follows the pattern position the sensor reports with every drain.
+
+typedef struct
+{
+    int16_t accel[3];
+    int16_t gyro[3]; // Zero when only the accelerometer is batched
+} imu_sample_t;
+
+typedef struct
+{
+    bool gyro;            // Gyroscope words in the pattern
+    uint16_t position;    // Pattern index of the next word
+    bool synced;          // The current pattern started at its first word
+    int16_t words[6];     // Current pattern, filled up to position
+    uint32_t dropped;     // Partial samples thrown away to resync
+} imu_fifo_decoder_t;
+
+// Words in one sample's pattern
+#define IMU_FIFO_PATTERN_WORDS(gyro) ((gyro) ? 6 : 3)
+
+void imu_fifo_decoder_init(imu_fifo_decoder_t *decoder, bool gyro);
+
+/**
+ * @brief Decode a burst read from the FIFO
+ *
+ * A sample split over two drains is completed on the next call.
+ *
+ * @param pattern FIFO_PATTERN at the start of the read, the pattern index of the first word
+ * @param data Little-endian FIFO words
+ * @param words Number of words
+ * @param samples Output, room for words / 3 + 1 samples
+ *
+ * @return Number of complete samples
+ */
+size_t imu_fifo_decode(imu_fifo_decoder_t *decoder, uint16_t pattern, const uint8_t *data, size_t words,
+                       imu_sample_t *samples);
+
+//
+// Notification packets
+//
+
+// [seq, flags, sample period (le16 us), first sample time (le32 device us),
+//  then per sample accel X, Y, Z and, with IMU_PACKET_GYRO, gyro X, Y, Z (le16 raw)]
+#define IMU_PACKET_HEADER_SIZE 8
+#define IMU_PACKET_GYRO 0x01
+
+#define IMU_SAMPLE_SIZE(gyro) ((gyro) ? 12 : 6)
+
+/**
+ * @brief Pack as many samples as fit into one notification
+ *
+ * @param packet Output buffer
+ * @param size Payload size of the notification
+ * @param seq Packet counter, the app detects lost packets from its gaps
+ * @param gyro Include the gyroscope axes
+ * @param period_us Time between samples
+ * @param first_us Device time of samples[0]
+ * @param samples Samples to send
+ * @param count Number of samples
+ * @param packed Output, number of samples taken
+ *
+ * @return Packet length in bytes, 0 if not even one sample fits
+ */
+size_t imu_pack(uint8_t *packet, size_t size, uint8_t seq, bool gyro, uint16_t period_us, uint32_t first_us,
+                const imu_sample_t *samples, size_t count, size_t *packed);
+
+#endif
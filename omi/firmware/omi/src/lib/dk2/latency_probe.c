@@ -0,0 +1,125 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "config.h"
+#include "latency_probe.h"
+
+LOG_MODULE_REGISTER(latency_probe, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define LATENCY_PROBE_SAMPLE_RATE CODEC_SAMPLE_RATE // The probe counts samples in the codec ring
+#define LATENCY_PROBE_REPORT_MS 5000
+
+typedef struct
+{
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t count;
+} latency_stat_t;
+
+static void stat_reset(latency_stat_t *stat)
+{
+    stat->min_us = UINT32_MAX;
+    stat->max_us = 0;
+    stat->sum_us = 0;
+    stat->count = 0;
+}
+
+static void stat_add(latency_stat_t *stat, uint32_t us)
+{
+    stat->min_us = MIN(stat->min_us, us);
+    stat->max_us = MAX(stat->max_us, us);
+    stat->sum_us += us;
+    stat->count++;
+}
+
+static void stat_log(const char *stage, const latency_stat_t *stat)
+{
+    if (stat->count == 0)
+    {
+        return;
+    }
+    LOG_INF("%s latency: min %u us, avg %u us, max %u us (%u frames)", stage, stat->min_us,
+            (uint32_t)(stat->sum_us / stat->count), stat->max_us, stat->count);
+}
+
+//
+// Capture
+//
+
+// Written by the mic thread, read by the codec thread
+static struct k_spinlock capture_lock;
+static uint32_t captured_samples = 0;
+static uint32_t captured_cycles = 0;
+
+void latency_probe_captured(size_t samples)
+{
+    k_spinlock_key_t key = k_spin_lock(&capture_lock);
+    captured_samples += samples;
+    captured_cycles = k_cycle_get_32();
+    k_spin_unlock(&capture_lock, key);
+}
+
+//
+// Codec
+//
+
+// Owned by the codec thread
+static uint32_t consumed_samples = 0;
+static uint32_t pending_cycles = 0;
+static latency_stat_t buffered_stat = {.min_us = UINT32_MAX};
+
+void latency_probe_encoding(size_t samples)
+{
+    consumed_samples += samples;
+
+    k_spinlock_key_t key = k_spin_lock(&capture_lock);
+    // Samples captured after the end of this frame, the mic clock is the sample rate
+    uint32_t newer_samples = captured_samples - consumed_samples;
+    uint32_t last_dma_cycles = captured_cycles;
+    k_spin_unlock(&capture_lock, key);
+
+    uint32_t newer_cycles = (uint64_t)newer_samples * sys_clock_hw_cycles_per_sec() / LATENCY_PROBE_SAMPLE_RATE;
+    pending_cycles = last_dma_cycles - newer_cycles;
+    stat_add(&buffered_stat, k_cyc_to_us_floor32(k_cycle_get_32() - pending_cycles));
+}
+
+//
+// Transport
+//
+
+// One entry per frame in the transport tx queue, so both drop the same frames
+K_MSGQ_DEFINE(latency_queue, sizeof(uint32_t), NETWORK_RING_BUF_SIZE, 4);
+static latency_stat_t total_stat = {.min_us = UINT32_MAX};
+static int64_t last_report_ms = 0;
+
+void latency_probe_queued(void)
+{
+    if (k_msgq_put(&latency_queue, &pending_cycles, K_NO_WAIT) != 0)
+    {
+        LOG_WRN("Latency queue out of sync with the tx queue");
+    }
+}
+
+void latency_probe_sent(bool delivered)
+{
+    uint32_t cycles;
+    if (k_msgq_get(&latency_queue, &cycles, K_NO_WAIT) != 0)
+    {
+        return;
+    }
+    if (delivered)
+    {
+        stat_add(&total_stat, k_cyc_to_us_floor32(k_cycle_get_32() - cycles));
+    }
+
+    int64_t now = k_uptime_get();
+    if (now - last_report_ms >= LATENCY_PROBE_REPORT_MS)
+    {
+        // The buffered stat is written by the codec thread, a torn read only skews one report
+        stat_log("Capture to codec", &buffered_stat);
+        stat_log("Capture to notify", &total_stat);
+        stat_reset(&buffered_stat);
+        stat_reset(&total_stat);
+        last_report_ms = now;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+#include <zephyr/kernel.h>
+
+// Audio latency probe (CONFIG_OMI_AUDIO_LATENCY_PROBE)
+//
+// Measures, for the last sample of every codec frame, the time from the PDM DMA
+// completion that delivered it to the GATT notify that carried its packet.
+// The stages are called in pipeline order; without the Kconfig option they compile to nothing.
+
+#ifdef CONFIG_OMI_AUDIO_LATENCY_PROBE
+
+/**
+ * @brief A capture block was accepted by the codec input
+ *
+ * Called right after the DMA completion, from the thread that read the block.
+ *
+ * @param samples Samples accepted into the codec ring buffer
+ */
+void latency_probe_captured(size_t samples);
+
+/**
+ * @brief The codec thread took one frame out of its ring buffer
+ *
+ * @param samples Samples in the frame
+ */
+void latency_probe_encoding(size_t samples);
+
+/**
+ * @brief The frame passed to the last latency_probe_encoding was queued for transmission
+ */
+void latency_probe_queued(void);
+
+/**
+ * @brief The oldest queued frame left the transmit queue
+ *
+ * @param delivered True if all of its notifications were accepted by the stack
+ */
+void latency_probe_sent(bool delivered);
+
+#else
+
+static inline void latency_probe_captured(size_t samples) {}
+static inline void latency_probe_encoding(size_t samples) {}
+static inline void latency_probe_queued(void) {}
+static inline void latency_probe_sent(bool delivered) {}
+
+#endif
+
+#endif
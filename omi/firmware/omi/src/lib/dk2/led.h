@@ -3,6 +3,7 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/gpio.h>
+#include "led_pattern.h"
 
 extern const struct gpio_dt_spec led_red;
 extern const struct gpio_dt_spec led_green;
@@ -20,4 +21,13 @@ void set_led_red(bool on);
 void set_led_green(bool on);
 void set_led_blue(bool on);
 
+/**
+ * @brief Show a pattern on one of the LED layers, NULL to clear the layer
+ *
+ * Safe from any context. The pattern is kept by reference and must stay valid.
+ * The set_led_ functions drive the pins directly and are meant for sequences
+ * that run while no layer is set, at boot and on the way to system off.
+ */
+void led_set_pattern(led_layer_t layer, const led_pattern_t *pattern);
+
 #endif
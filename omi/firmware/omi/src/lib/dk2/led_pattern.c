@@ -0,0 +1,59 @@
+#include <zephyr/kernel.h>
+#include "led_pattern.h"
+
+void led_engine_init(led_engine_t *engine)
+{
+    for (int i = 0; i < LED_LAYER_COUNT; i++)
+    {
+        engine->pattern[i] = NULL;
+        engine->start_ms[i] = 0;
+    }
+}
+
+bool led_engine_set(led_engine_t *engine, led_layer_t layer, const led_pattern_t *pattern, uint32_t now_ms)
+{
+    if (layer >= LED_LAYER_COUNT || engine->pattern[layer] == pattern)
+    {
+        return false;
+    }
+    engine->pattern[layer] = pattern;
+    engine->start_ms[layer] = now_ms;
+    return true;
+}
+
+uint8_t led_engine_eval(const led_engine_t *engine, uint32_t now_ms, uint32_t *next_ms)
+{
+    uint8_t claimed = 0;
+    uint8_t lit = 0;
+    *next_ms = LED_NEVER;
+
+    for (int layer = LED_LAYER_COUNT - 1; layer >= 0; layer--)
+    {
+        const led_pattern_t *pattern = engine->pattern[layer];
+        if (pattern == NULL)
+        {
+            continue;
+        }
+        uint8_t own = pattern->claim & ~claimed;
+        if (own == 0)
+        {
+            // Hidden, its blinking wakes nobody up
+            continue;
+        }
+        claimed |= own;
+
+        bool on = true;
+        if (pattern->off_ms > 0)
+        {
+            uint32_t period = pattern->on_ms + pattern->off_ms;
+            uint32_t phase = (now_ms - engine->start_ms[layer]) % period;
+            on = phase < pattern->on_ms;
+            *next_ms = MIN(*next_ms, on ? pattern->on_ms - phase : period - phase);
+        }
+        if (on)
+        {
+            lit |= pattern->color & own;
+        }
+    }
+    return lit;
+}
@@ -0,0 +1,62 @@
+#ifndef LED_PATTERN_H
+#define LED_PATTERN_H
+#include <zephyr/kernel.h>
+
+// Status LED patterns in priority layers
+//
+// Every layer shows a steady or blinking pattern on the LEDs it claims. A higher
+// layer hides the lower ones only on the LEDs it claims itself, so charging can
+// show in green next to the connection in red or blue. The engine works out what
+// is lit and when that changes next; src/led.c drives the pins from a work item
+// that only wakes up for blink edges.
+
+#define LED_RED (1U << 0)
+#define LED_GREEN (1U << 1)
+#define LED_BLUE (1U << 2)
+#define LED_ALL (LED_RED | LED_GREEN | LED_BLUE)
+
+#define LED_NEVER UINT32_MAX
+
+typedef enum
+{
+    LED_LAYER_CONNECTION, // Advertising or connected
+    LED_LAYER_CHARGING,
+    LED_LAYER_ERROR,      // Something failed and the device can't work
+    LED_LAYER_COUNT,
+} led_layer_t;
+
+typedef struct
+{
+    uint8_t claim;   // LED_ mask the layer drives, the others show the layers below
+    uint8_t color;   // LED_ mask lit in the on phase
+    uint16_t on_ms;
+    uint16_t off_ms; // 0 for steady
+} led_pattern_t;
+
+typedef struct
+{
+    const led_pattern_t *pattern[LED_LAYER_COUNT];
+    uint32_t start_ms[LED_LAYER_COUNT];
+} led_engine_t;
+
+void led_engine_init(led_engine_t *engine);
+
+/**
+ * @brief Show a pattern on a layer, NULL to clear it
+ *
+ * Blinking starts with the on phase. Setting the pattern a layer already shows
+ * keeps its phase, so state updates that change nothing don't restart a blink.
+ *
+ * @return True if the layer changed
+ */
+bool led_engine_set(led_engine_t *engine, led_layer_t layer, const led_pattern_t *pattern, uint32_t now_ms);
+
+/**
+ * @brief LEDs lit at now_ms
+ *
+ * @param next_ms Set to the ms until the result changes, LED_NEVER if it only changes with the layers
+ * @return LED_ mask of the LEDs to light
+ */
+uint8_t led_engine_eval(const led_engine_t *engine, uint32_t now_ms, uint32_t *next_ms);
+
+#endif
@@ -14,11 +14,23 @@
  * limitations under the License.
  */
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #ifndef __BATTERY_H__
 #define __BATTERY_H__
 
+typedef enum {
+    CHARGER_UNPLUGGED,
+    CHARGER_CHARGING,
+    CHARGER_COMPLETE, // Still on external power, the battery is full
+} charger_state_t;
+
+/**
+ * @brief Called on every debounced charger change, from the debounce timer (interrupt context).
+ */
+typedef void (*charger_handler)(charger_state_t state);
+
 /**
  * @brief Set battery charging to fast charge (100mA).
  *
@@ -69,6 +81,47 @@ int battery_get_millivolt(uint16_t *battery_millivolt);
  */
 int battery_get_percentage(uint8_t *battery_percentage, uint16_t battery_millivolt);
 
+/**
+ * @brief Reads the battery voltage and updates the state of charge estimate.
+ *
+ * @param[in] load_ua Current the firmware has been drawing since the last update, in microamps.
+ *
+ * @param[out] changed Set when the reported percentage changed.
+ *
+ * @retval 0 if successful. Negative errno number on error.
+ */
+int battery_update(uint32_t load_ua, bool *changed);
+
+/**
+ * @brief Latest estimate from battery_update, without reading the ADC.
+ *
+ * @param[out] battery_percentage Pointer to where battery percentage is stored.
+ *
+ * @param[out] battery_millivolt Pointer to where the last voltage reading is stored, or NULL.
+ *
+ * @retval 0 if successful. -ENODATA before the first update.
+ */
+int battery_get_level(uint8_t *battery_percentage, uint16_t *battery_millivolt);
+
+/**
+ * @brief Time until the next battery_update is worth running.
+ *
+ * @param[in] load_ua Current the firmware is drawing, in microamps.
+ *
+ * @retval Milliseconds, shorter while charging, on a low battery or under a heavy load.
+ */
+uint32_t battery_update_interval_ms(uint32_t load_ua);
+
+/**
+ * @brief Set the charger handler, called once right away with the current state.
+ */
+void battery_set_charger_callback(charger_handler handler);
+
+/**
+ * @brief Debounced charger state.
+ */
+charger_state_t battery_get_charger_state(void);
+
 /**
  * @brief Initialize the battery charging circuit.
  *
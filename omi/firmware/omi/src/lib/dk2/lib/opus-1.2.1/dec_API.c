@@ -115,10 +115,12 @@ opus_int silk_Decode(                                   /* O    Returns error co
         }
     }
 
+#if (DECODER_NUM_CHANNELS > 1)
     /* If Mono -> Stereo transition in bitstream: init state of second channel */
     if( decControl->nChannelsInternal > psDec->nChannelsInternal ) {
         ret += silk_init_decoder( &channel_state[ 1 ] );
     }
+#endif
 
     stereo_to_mono = decControl->nChannelsInternal == 1 && psDec->nChannelsInternal == 2 &&
                      ( decControl->internalSampleRate == 1000*channel_state[ 0 ].fs_kHz );
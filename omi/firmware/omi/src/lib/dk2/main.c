@@ -17,18 +17,18 @@
 #define WAKEUP_DETECT (1U << 16)
 LOG_MODULE_REGISTER(main, CONFIG_LOG_DEFAULT_LEVEL);
 
-static void codec_handler(uint8_t *data, size_t len)
+static void codec_handler(uint8_t *data, size_t len, int64_t capture_us)
 {
-    int err = broadcast_audio_packets(data, len);
+    int err = broadcast_audio_packets(data, len, capture_us);
     if (err)
     {
         LOG_ERR("Failed to broadcast audio packets: %d", err);
     }
 }
 
-static void mic_handler(int16_t *buffer)
+static void mic_handler(int16_t *buffer, size_t samples, int64_t capture_us)
 {
-    int err = codec_receive_pcm(buffer, MIC_BUFFER_SAMPLES);
+    int err = codec_receive_pcm(buffer, samples, capture_us);
     if (err)
     {
         LOG_ERR("Failed to process PCM data: %d", err);
@@ -7,6 +7,7 @@
 #include "nrfx_pdm.h"
 #include "config.h"
 #include "mic.h"
+#include "device_clock.h"
 #include "utils.h"
 
 LOG_MODULE_REGISTER(mic, CONFIG_LOG_DEFAULT_LEVEL);
@@ -53,7 +54,8 @@ static void pdm_irq_handler(nrfx_pdm_evt_t const *event)
         LOG_DBG("Audio buffer requested");
         if (_callback)
         {
-            _callback(event->buffer_released);
+            _callback(event->buffer_released, MIC_BUFFER_SAMPLES,
+                      device_clock_us() - MIC_BUFFER_SAMPLES * 1000000LL / MIC_SAMPLE_RATE);
         }
     }
 }
@@ -1,7 +1,13 @@
 #ifndef MIC_H
 #define MIC_H
 
-typedef void (*mix_handler)(int16_t *);
+// Called with every captured block, the number of mono samples in it and the
+// device_clock_us time its first sample was captured at
+typedef void (*mix_handler)(int16_t *buffer, size_t samples, int64_t capture_us);
+
+// Called on the capture thread before the first block after every start of the
+// capture, the blocks before it belong to an earlier session
+typedef void (*mic_restart_handler)(void);
 
 /**
  * @brief Initialize the Microphone
@@ -12,7 +18,17 @@ typedef void (*mix_handler)(int16_t *);
  */
 int mic_start();
 void set_mic_callback(mix_handler _callback);
+void set_mic_restart_callback(mic_restart_handler callback);
 
 void mic_off();
 void mic_on();
+
+/**
+ * @brief Let the microphone's acoustic activity detection wake the system from off
+ *
+ * Call after mic_off, before sys_poweroff.
+ *
+ * @return 0 if armed, -ENOTSUP without CONFIG_OMI_ENABLE_MIC_AAD
+ */
+int mic_arm_wakeup(void);
 #endif
@@ -0,0 +1,223 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "motion.h"
+
+LOG_MODULE_REGISTER(motion, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define MOTION_WINDOW_MS 2000
+#define MOTION_TABLE_MG 4      // Motion energy of a device lying still, sensor noise and desk vibration
+#define MOTION_WALK_MG 60      // Motion energy of walking, well above gestures and breathing
+#define MOTION_STEP_HYST_MG 40 // Magnitude swing that counts as a step
+#define MOTION_MIN_STEPS 2     // 1-3.5 steps a second
+#define MOTION_MAX_STEPS 7
+#define MOTION_WALK_WINDOWS 2  // Windows of steps before walking
+#define MOTION_STILL_WINDOWS 2 // Windows without steps before walking ends
+#define MOTION_TABLE_WINDOWS 3 // Windows at the noise floor before the device counts as put down
+#define MOTION_REMOVED_WINDOWS (CONFIG_OMI_MOTION_REMOVED_S * 1000 / MOTION_WINDOW_MS)
+
+static uint32_t isqrt32(uint32_t value)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+static motion_callback state_callback = NULL;
+static motion_state_t state = MOTION_UNKNOWN;
+
+// Configuration, thresholds in sensor LSBs
+static uint32_t window_samples;
+static uint64_t table_energy; // Squared
+static uint64_t walk_energy;  // Squared
+static int32_t step_hysteresis;
+
+// Current window
+static uint32_t window_fill;
+static int64_t axis_sum[3];
+static int64_t axis_square_sum[3];
+static uint64_t magnitude_sum;
+static uint32_t steps;
+static bool step_low;
+
+// Previous windows
+static int32_t magnitude_reference;
+static uint32_t walk_windows;
+static uint32_t still_windows;
+static uint32_t table_windows;
+
+void motion_set_callback(motion_callback callback)
+{
+    state_callback = callback;
+}
+
+static void window_reset(void)
+{
+    window_fill = 0;
+    magnitude_sum = 0;
+    steps = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        axis_sum[axis] = 0;
+        axis_square_sum[axis] = 0;
+    }
+}
+
+int motion_init(uint16_t rate_hz, uint16_t lsb_per_g)
+{
+    // Steps need a few samples per cycle
+    if (rate_hz < 4 * MOTION_MAX_STEPS * 1000 / MOTION_WINDOW_MS)
+    {
+        return -EINVAL;
+    }
+
+    window_samples = rate_hz * MOTION_WINDOW_MS / 1000;
+    uint32_t table = MOTION_TABLE_MG * lsb_per_g / 1000;
+    uint32_t walk = MOTION_WALK_MG * lsb_per_g / 1000;
+    table_energy = (uint64_t)table * table;
+    walk_energy = (uint64_t)walk * walk;
+    step_hysteresis = MOTION_STEP_HYST_MG * lsb_per_g / 1000;
+
+    state = MOTION_UNKNOWN;
+    magnitude_reference = lsb_per_g;
+    step_low = false;
+    walk_windows = 0;
+    still_windows = 0;
+    table_windows = 0;
+    window_reset();
+    return 0;
+}
+
+static void state_set(motion_state_t next)
+{
+    if (next == state)
+    {
+        return;
+    }
+    LOG_INF("Motion %s -> %s", motion_state_name(state), motion_state_name(next));
+    state = next;
+    if (state_callback)
+    {
+        state_callback(next);
+    }
+}
+
+static void window_classify(void)
+{
+    // Sum of the axes' variances, in LSB squared
+    uint64_t energy = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // N * sum(x^2) - sum(x)^2 stays exact, the mean in whole LSBs would not
+        int64_t n = window_samples;
+        int64_t variance = (n * axis_square_sum[axis] - axis_sum[axis] * axis_sum[axis]) / (n * n);
+        energy += MAX(variance, 0);
+    }
+    magnitude_reference = magnitude_sum / window_samples;
+
+    if (energy < table_energy)
+    {
+        walk_windows = 0;
+        table_windows++;
+        if (state == MOTION_ON_TABLE && table_windows >= MOTION_REMOVED_WINDOWS)
+        {
+            state_set(MOTION_REMOVED);
+        }
+        else if (state != MOTION_REMOVED && state != MOTION_ON_TABLE && table_windows >= MOTION_TABLE_WINDOWS)
+        {
+            state_set(MOTION_ON_TABLE);
+        }
+        return;
+    }
+    table_windows = 0;
+
+    bool walking = energy >= walk_energy && steps >= MOTION_MIN_STEPS && steps <= MOTION_MAX_STEPS;
+    walk_windows = walking ? walk_windows + 1 : 0;
+    still_windows = walking ? 0 : still_windows + 1;
+
+    // Picked up: worn again straight away, the audio should not wait for the debounce
+    if (state == MOTION_UNKNOWN || state == MOTION_ON_TABLE || state == MOTION_REMOVED)
+    {
+        state_set(MOTION_STILL);
+    }
+    if (walk_windows >= MOTION_WALK_WINDOWS)
+    {
+        state_set(MOTION_WALKING);
+    }
+    else if (state == MOTION_WALKING && still_windows >= MOTION_STILL_WINDOWS)
+    {
+        state_set(MOTION_STILL);
+    }
+}
+
+void motion_process(const imu_sample_t *samples, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t square = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int32_t value = samples[i].accel[axis];
+            axis_sum[axis] += value;
+            axis_square_sum[axis] += value * value;
+            square += (uint32_t)(value * value);
+        }
+
+        // A step lifts the magnitude above the last window's mean after it sank below
+        int32_t magnitude = isqrt32(square);
+        magnitude_sum += magnitude;
+        if (magnitude < magnitude_reference - step_hysteresis)
+        {
+            step_low = true;
+        }
+        else if (step_low && magnitude > magnitude_reference + step_hysteresis)
+        {
+            step_low = false;
+            steps++;
+        }
+
+        if (++window_fill == window_samples)
+        {
+            window_classify();
+            window_reset();
+        }
+    }
+}
+
+motion_state_t motion_get_state(void)
+{
+    return state;
+}
+
+const char *motion_state_name(motion_state_t value)
+{
+    switch (value)
+    {
+    case MOTION_STILL:
+        return "still";
+    case MOTION_WALKING:
+        return "walking";
+    case MOTION_ON_TABLE:
+        return "on table";
+    case MOTION_REMOVED:
+        return "removed";
+    default:
+        return "unknown";
+    }
+}
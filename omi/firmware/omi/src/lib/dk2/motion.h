@@ -0,0 +1,44 @@
+#ifndef MOTION_H
+#define MOTION_H
+#include <zephyr/kernel.h>
+#include "imu_fifo.h"
+
+// Activity from the accelerometer (CONFIG_OMI_MOTION_DETECTION)
+//
+// Every 2s window of samples is reduced to its motion energy (the spread of
+// the three axes around their means) and a step count (crossings of the
+// acceleration magnitude). A body always moves the device a little, so a
+// window at the sensor's noise floor means it was put down.
+
+typedef enum
+{
+    MOTION_UNKNOWN,  // Not a full window yet
+    MOTION_STILL,    // Worn, not walking
+    MOTION_WALKING,  // Worn, steady steps
+    MOTION_ON_TABLE, // Put down, no body motion
+    MOTION_REMOVED,  // Put down for CONFIG_OMI_MOTION_REMOVED_S, treated as off-body
+} motion_state_t;
+
+// Called on every state change, from the thread that feeds the samples
+typedef void (*motion_callback)(motion_state_t state);
+void motion_set_callback(motion_callback callback);
+
+/**
+ * @brief Reset the classifier
+ *
+ * @param rate_hz Accelerometer sample rate
+ * @param lsb_per_g Accelerometer sensitivity
+ *
+ * @return 0 if successful, -EINVAL for a rate too low to count steps
+ */
+int motion_init(uint16_t rate_hz, uint16_t lsb_per_g);
+
+/**
+ * @brief Classify accelerometer samples, the gyroscope axes are ignored
+ */
+void motion_process(const imu_sample_t *samples, size_t count);
+
+motion_state_t motion_get_state(void);
+const char *motion_state_name(motion_state_t state);
+
+#endif
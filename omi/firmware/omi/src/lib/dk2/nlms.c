@@ -0,0 +1,58 @@
+#include <string.h>
+#include "nlms.h"
+#include "q15.h"
+
+void nlms_init(nlms_t *filter, int16_t *history, int32_t *weights, uint16_t taps, int32_t mu_q15,
+               int64_t epsilon, int32_t weight_limit)
+{
+    filter->history = history;
+    filter->weights = weights;
+    filter->taps = taps;
+    filter->mu_q15 = mu_q15;
+    filter->epsilon = epsilon;
+    filter->weight_limit = weight_limit;
+    nlms_clear_history(filter);
+    nlms_clear_weights(filter);
+}
+
+void nlms_clear_history(nlms_t *filter)
+{
+    memset(filter->history, 0, 2 * filter->taps * sizeof(int16_t));
+    filter->pos = 0;
+    filter->energy = 0;
+}
+
+void nlms_clear_weights(nlms_t *filter)
+{
+    memset(filter->weights, 0, filter->taps * sizeof(int32_t));
+}
+
+int16_t nlms_process(nlms_t *filter, int16_t reference, int16_t desired, bool adapt)
+{
+    // Newest reference sample at history[pos], oldest at pos + taps - 1
+    filter->pos = filter->pos == 0 ? filter->taps - 1 : filter->pos - 1;
+    int16_t oldest = filter->history[filter->pos];
+    filter->history[filter->pos] = reference;
+    filter->history[filter->pos + filter->taps] = reference;
+    filter->energy += (int32_t)reference * reference - (int32_t)oldest * oldest;
+    const int16_t *window = &filter->history[filter->pos];
+
+    int64_t acc = 0;
+    for (int k = 0; k < filter->taps; k++)
+    {
+        acc += (int64_t)filter->weights[k] * window[k];
+    }
+    int16_t e = sat_q15(desired - (int32_t)(acc >> 24));
+
+    if (adapt)
+    {
+        // w += mu * e * x / (|x|^2 + eps), the step factor in Q16 so small errors still move the weights
+        int64_t step = (((int64_t)filter->mu_q15 * e) << (9 + 16)) / (filter->energy + filter->epsilon);
+        for (int k = 0; k < filter->taps; k++)
+        {
+            int64_t w = filter->weights[k] + ((step * window[k]) >> 16);
+            filter->weights[k] = CLAMP(w, -filter->weight_limit, filter->weight_limit);
+        }
+    }
+    return e;
+}
@@ -0,0 +1,55 @@
+#ifndef NLMS_H
+#define NLMS_H
+#include <zephyr/kernel.h>
+
+// Fixed-point NLMS adaptive filter
+//
+// Predicts a desired signal from the recent history of a reference and returns
+// what it can't predict. Used by the echo canceller, with the speaker as the
+// reference, and by the beamformer's sidelobe canceller, with the difference
+// of the steered channels as the reference. The caller owns the buffers, so
+// each user sizes its own filter.
+
+typedef struct
+{
+    int16_t *history;      // 2 * taps, doubled so the window at pos is always contiguous
+    int32_t *weights;      // taps, Q24
+    uint16_t taps;
+    uint16_t pos;          // Newest reference sample
+    int64_t energy;        // Sum of the window's squares
+    int32_t mu_q15;
+    int64_t epsilon;       // Regularizes the step while the reference is quiet
+    int32_t weight_limit;  // Q24
+} nlms_t;
+
+/**
+ * @brief Set up a filter with zero weights and an empty history
+ *
+ * @param history 2 * taps samples
+ * @param weights taps weights
+ */
+void nlms_init(nlms_t *filter, int16_t *history, int32_t *weights, uint16_t taps, int32_t mu_q15,
+               int64_t epsilon, int32_t weight_limit);
+
+/**
+ * @brief Forget the reference history, for a gap in the reference, keeps the weights
+ */
+void nlms_clear_history(nlms_t *filter);
+
+/**
+ * @brief Restart adaptation from zero weights
+ */
+void nlms_clear_weights(nlms_t *filter);
+
+/**
+ * @brief Filter one sample
+ *
+ * @param reference Newest reference sample
+ * @param desired Sample to predict
+ * @param adapt Whether to update the weights from this sample's error
+ *
+ * @return desired minus the prediction
+ */
+int16_t nlms_process(nlms_t *filter, int16_t reference, int16_t desired, bool adapt);
+
+#endif
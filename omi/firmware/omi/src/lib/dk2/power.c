@@ -0,0 +1,184 @@
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+#include "power.h"
+#include "mic.h"
+#include "accel.h"
+#include "sdcard.h"
+#include "button.h"
+#include "transport.h"
+#include "energy.h"
+
+LOG_MODULE_REGISTER(power, CONFIG_LOG_DEFAULT_LEVEL);
+
+extern bool is_off;
+
+#ifdef CONFIG_OMI_ENABLE_OFFLINE_STORAGE
+#define POWER_INPUTS_DEFAULT (POWER_INPUT_ON | POWER_INPUT_WORN | POWER_INPUT_STORAGE)
+extern struct k_mutex write_sdcard_mutex;
+static const struct device *const sd_dev = DEVICE_DT_GET(DT_NODELABEL(sdhc0));
+#else
+#define POWER_INPUTS_DEFAULT (POWER_INPUT_ON | POWER_INPUT_WORN)
+#endif
+
+static atomic_t power_inputs = ATOMIC_INIT(POWER_INPUTS_DEFAULT);
+static atomic_t power_started = ATOMIC_INIT(0);
+static atomic_t power_current = ATOMIC_INIT(POWER_ADVERTISING);
+static power_state_handler state_handler;
+
+// What is on, only touched from power_update, which the system workqueue serializes.
+// At boot the microphone, the accelerometer and the SD card are all started.
+static uint32_t power_applied = POWER_NEED_MIC | POWER_NEED_SD | POWER_NEED_ACCEL;
+
+// Switches the peripherals whose need changed
+static void power_apply(uint32_t needs)
+{
+    uint32_t changed = needs ^ power_applied;
+
+    if (changed & POWER_NEED_MIC)
+    {
+        if (needs & POWER_NEED_MIC)
+        {
+            mic_on();
+        }
+        else
+        {
+            mic_off();
+        }
+    }
+
+#ifdef CONFIG_OMI_ENABLE_OFFLINE_STORAGE
+    if (changed & POWER_NEED_SD)
+    {
+        // Not in the middle of a write
+        k_mutex_lock(&write_sdcard_mutex, K_FOREVER);
+        if (needs & POWER_NEED_SD)
+        {
+            pm_device_action_run(sd_dev, PM_DEVICE_ACTION_RESUME);
+            sd_on();
+        }
+        else
+        {
+            sd_off();
+            pm_device_action_run(sd_dev, PM_DEVICE_ACTION_SUSPEND);
+        }
+        k_mutex_unlock(&write_sdcard_mutex);
+    }
+    // Also for the first state, the card was already on from boot
+    energy_set_active(ENERGY_SD, needs & POWER_NEED_SD);
+#endif
+
+#ifdef CONFIG_OMI_ENABLE_ACCELEROMETER
+    if (changed & POWER_NEED_ACCEL)
+    {
+        if (needs & POWER_NEED_ACCEL)
+        {
+            accel_start();
+        }
+        else
+        {
+            accel_off();
+        }
+    }
+#endif
+
+    power_applied = needs;
+}
+
+// Forced at start, to apply the first state whatever it is
+static void power_update(bool force)
+{
+    power_state_t state = power_policy_state(atomic_get(&power_inputs));
+    power_state_t previous = atomic_set(&power_current, state);
+
+    if (state != previous || force)
+    {
+        LOG_INF("Power state %s -> %s", power_state_name(previous), power_state_name(state));
+        power_apply(power_policy_needs(state));
+    }
+
+    if (state_handler)
+    {
+        state_handler(state);
+    }
+}
+
+static void power_work_handler(struct k_work *work)
+{
+    power_update(false);
+}
+
+K_WORK_DEFINE(power_work, power_work_handler);
+
+//
+// Interface
+//
+
+int power_start(void)
+{
+    atomic_set(&power_started, 1);
+    power_update(true);
+    return 0;
+}
+
+void power_set_callback(power_state_handler handler)
+{
+    state_handler = handler;
+}
+
+void power_set_input(uint32_t input, bool set)
+{
+    atomic_val_t old = set ? atomic_or(&power_inputs, input) : atomic_and(&power_inputs, ~input);
+    bool changed = set ? !(old & input) : (old & input);
+    if (changed && atomic_get(&power_started))
+    {
+        k_work_submit(&power_work);
+    }
+}
+
+power_state_t power_get_state(void)
+{
+    return atomic_get(&power_current);
+}
+
+uint32_t power_load_ua(void)
+{
+    uint32_t needs = power_policy_needs(power_get_state());
+    uint32_t load_ua = CONFIG_OMI_BATTERY_LOAD_BASE_UA;
+    if (needs & POWER_NEED_MIC)
+    {
+        load_ua += CONFIG_OMI_BATTERY_LOAD_MIC_UA;
+    }
+    if (needs & POWER_NEED_SD)
+    {
+        load_ua += CONFIG_OMI_BATTERY_LOAD_SD_UA;
+    }
+    if (atomic_get(&power_inputs) & POWER_INPUT_CONNECTED)
+    {
+        load_ua += CONFIG_OMI_BATTERY_LOAD_BLE_UA;
+    }
+    return load_ua;
+}
+
+static void power_shutdown(bool wake_on_activity)
+{
+    atomic_set(&power_started, 0);
+    atomic_and(&power_inputs, ~POWER_INPUT_ON);
+    power_update(false);
+
+    is_off = true;
+    transport_off();
+    turnoff_all(wake_on_activity);
+}
+
+void power_off(void)
+{
+    power_shutdown(false);
+}
+
+void power_auto_off(void)
+{
+    power_shutdown(true);
+}
@@ -0,0 +1,48 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <zephyr/kernel.h>
+#include "power_policy.h"
+
+// Called on the system workqueue after every input change, also when the state stays
+typedef void (*power_state_handler)(power_state_t state);
+
+/**
+ * @brief Apply the power state for the current inputs
+ *
+ * Call once the peripherals it manages are initialized, inputs set before
+ * only take effect from here on.
+ *
+ * @return 0 if successful, negative errno code if error
+ */
+int power_start(void);
+
+void power_set_callback(power_state_handler handler);
+
+/**
+ * @brief Set or clear one of the POWER_INPUT_ inputs
+ *
+ * Safe from any context, the new state is applied from the system workqueue.
+ */
+void power_set_input(uint32_t input, bool set);
+
+power_state_t power_get_state(void);
+
+/**
+ * @brief Current the device draws in its present state, in microamps
+ *
+ * From the per-peripheral estimates in Kconfig, for the battery estimate.
+ */
+uint32_t power_load_ua(void);
+
+/**
+ * @brief Turn the device off, ends in system off
+ */
+void power_off(void);
+
+/**
+ * @brief Turn the idle device off, motion and sound wake it up as well as the button
+ */
+void power_auto_off(void);
+
+#endif
@@ -0,0 +1,59 @@
+#include <zephyr/kernel.h>
+#include "power_policy.h"
+
+static const uint32_t state_needs[POWER_STATE_COUNT] = {
+    [POWER_OFF] = 0,
+    [POWER_ADVERTISING] = POWER_NEED_ACCEL,
+    [POWER_CHARGING] = 0,
+    [POWER_IDLE_CONNECTED] = POWER_NEED_ACCEL,
+    [POWER_STREAMING] = POWER_NEED_MIC | POWER_NEED_ACCEL,
+    [POWER_OFFLINE_RECORDING] = POWER_NEED_MIC | POWER_NEED_SD | POWER_NEED_ACCEL,
+};
+
+static const char *const state_names[POWER_STATE_COUNT] = {
+    [POWER_OFF] = "off",
+    [POWER_ADVERTISING] = "advertising",
+    [POWER_CHARGING] = "charging",
+    [POWER_IDLE_CONNECTED] = "idle connected",
+    [POWER_STREAMING] = "streaming",
+    [POWER_OFFLINE_RECORDING] = "offline recording",
+};
+
+power_state_t power_policy_state(uint32_t inputs)
+{
+    bool connected = inputs & POWER_INPUT_CONNECTED;
+    bool worn = inputs & POWER_INPUT_WORN;
+
+    if (!(inputs & POWER_INPUT_ON))
+    {
+        return POWER_OFF;
+    }
+    if (connected && (inputs & POWER_INPUT_SUBSCRIBED) && worn)
+    {
+        return POWER_STREAMING;
+    }
+    if (connected)
+    {
+        return POWER_IDLE_CONNECTED;
+    }
+    // On the dock nobody is talking to it
+    if (inputs & POWER_INPUT_CHARGING)
+    {
+        return POWER_CHARGING;
+    }
+    if ((inputs & POWER_INPUT_STORAGE) && worn)
+    {
+        return POWER_OFFLINE_RECORDING;
+    }
+    return POWER_ADVERTISING;
+}
+
+uint32_t power_policy_needs(power_state_t state)
+{
+    return state < POWER_STATE_COUNT ? state_needs[state] : 0;
+}
+
+const char *power_state_name(power_state_t state)
+{
+    return state < POWER_STATE_COUNT ? state_names[state] : "unknown";
+}
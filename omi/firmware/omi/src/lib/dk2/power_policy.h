@@ -0,0 +1,46 @@
+#ifndef POWER_POLICY_H
+#define POWER_POLICY_H
+#include <zephyr/kernel.h>
+
+// Device power states and what each one keeps powered
+//
+// The state follows from a handful of inputs the firmware knows about, so it
+// can be recomputed from scratch on every event instead of tracked through
+// transitions. src/lib/dk2/power.c owns the inputs and applies the result.
+
+typedef enum
+{
+    POWER_OFF,               // Turned off by the user, on the way to system off
+    POWER_ADVERTISING,       // Waiting for the app, nothing to record
+    POWER_CHARGING,          // On the charger and not connected
+    POWER_IDLE_CONNECTED,    // Connected, the app doesn't listen to audio
+    POWER_STREAMING,         // Audio to the app
+    POWER_OFFLINE_RECORDING, // Audio to the SD card while the app is away
+    POWER_STATE_COUNT,
+} power_state_t;
+
+// Inputs
+#define POWER_INPUT_ON (1U << 0)         // Not turned off by the user
+#define POWER_INPUT_CONNECTED (1U << 1)
+#define POWER_INPUT_SUBSCRIBED (1U << 2) // The app is subscribed to the audio data
+#define POWER_INPUT_CHARGING (1U << 3)   // On external power, also once the battery is full
+#define POWER_INPUT_WORN (1U << 4)       // Not put down, from motion detection
+#define POWER_INPUT_STORAGE (1U << 5)    // Offline storage is built in
+
+// Peripherals a state keeps on
+#define POWER_NEED_MIC (1U << 0)
+#define POWER_NEED_SD (1U << 1)
+#define POWER_NEED_ACCEL (1U << 2)
+
+power_state_t power_policy_state(uint32_t inputs);
+
+/**
+ * @brief POWER_NEED_ mask of the peripherals the state keeps on
+ *
+ * The radio stays on in every state but POWER_OFF.
+ */
+uint32_t power_policy_needs(power_state_t state);
+
+const char *power_state_name(power_state_t state);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef Q15_H
+#define Q15_H
+#include <zephyr/kernel.h>
+
+// Q15 helpers shared by the audio modules
+
+#if defined(__ARM_FEATURE_SIMD32) && __ARM_FEATURE_SIMD32
+#include <arm_acle.h>
+#define Q15_SIMD 1
+#else
+#define Q15_SIMD 0
+#endif
+
+/**
+ * @brief Saturate to the int16 range
+ */
+static inline int16_t sat_q15(int32_t value)
+{
+#if Q15_SIMD
+    return __ssat(value, 16);
+#else
+    return value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : value;
+#endif
+}
+
+#endif
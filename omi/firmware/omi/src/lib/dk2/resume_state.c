@@ -0,0 +1,100 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/linker/section_tags.h>
+#include <zephyr/sys/crc.h>
+#include <nrfx.h>
+#include "resume_state.h"
+#include "codec.h"
+#include "transport.h"
+#ifdef CONFIG_OMI_MIC_BEAMFORMER
+#include "beamformer.h"
+#endif
+
+LOG_MODULE_REGISTER(resume_state, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define RESUME_MAGIC 0x4F4D4952 // "OMIR"
+
+// Application core RAM, retained per 4 KB section of 64 KB blocks
+#define RESUME_RAM_BASE 0x20000000UL
+#define RESUME_RAM_BLOCK 0x10000UL
+#define RESUME_RAM_SECTION 0x1000UL
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t packet_index;
+    uint8_t codec_id;
+    uint8_t overrun_policy;
+    int8_t beam_deg;
+    uint8_t timestamps;
+    uint32_t crc; // Over everything before it, MCUboot may have used the RAM in between
+} resume_snapshot_t;
+
+static __noinit resume_snapshot_t resume_snapshot;
+
+static uint32_t resume_crc(const resume_snapshot_t *snapshot)
+{
+    return crc32_ieee((const uint8_t *)snapshot, offsetof(resume_snapshot_t, crc));
+}
+
+static void resume_retain(void)
+{
+#if defined(NRF_VMC)
+    // System off powers the RAM down unless its sections are set to retain
+    uintptr_t start = (uintptr_t)&resume_snapshot - RESUME_RAM_BASE;
+    uintptr_t end = start + sizeof(resume_snapshot) - 1;
+    for (uintptr_t addr = start & ~(RESUME_RAM_SECTION - 1); addr <= end; addr += RESUME_RAM_SECTION)
+    {
+        uint32_t section = (addr % RESUME_RAM_BLOCK) / RESUME_RAM_SECTION;
+        NRF_VMC->RAM[addr / RESUME_RAM_BLOCK].POWERSET = BIT(VMC_RAM_POWER_S0RETENTION_Pos + section);
+    }
+#endif
+}
+
+void resume_state_save(void)
+{
+    resume_snapshot_t snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.magic = RESUME_MAGIC;
+    snapshot.codec_id = codec_get_id();
+    snapshot.overrun_policy = codec_get_overrun_policy();
+#ifdef CONFIG_OMI_MIC_BEAMFORMER
+    snapshot.beam_deg = beamformer_get_direction();
+#endif
+    bool timestamps;
+    transport_get_stream_state(&snapshot.packet_index, &timestamps);
+    snapshot.timestamps = timestamps;
+    snapshot.crc = resume_crc(&snapshot);
+
+    resume_snapshot = snapshot;
+    resume_retain();
+}
+
+bool resume_state_pending(void)
+{
+    return resume_snapshot.magic == RESUME_MAGIC && resume_snapshot.crc == resume_crc(&resume_snapshot);
+}
+
+int resume_state_restore(void)
+{
+    if (!resume_state_pending())
+    {
+        return -ENOENT;
+    }
+    resume_snapshot_t snapshot = resume_snapshot;
+    resume_snapshot.magic = 0;
+
+    if (codec_select(snapshot.codec_id))
+    {
+        LOG_WRN("Codec %u not in this build", snapshot.codec_id);
+    }
+    codec_set_overrun_policy(snapshot.overrun_policy);
+#ifdef CONFIG_OMI_MIC_BEAMFORMER
+    beamformer_set_direction(snapshot.beam_deg);
+#endif
+    transport_set_stream_state(snapshot.packet_index, snapshot.timestamps);
+
+    LOG_INF("Resumed from auto-off, codec %u, packet %u", snapshot.codec_id, snapshot.packet_index);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef RESUME_STATE_H
+#define RESUME_STATE_H
+#include <zephyr/kernel.h>
+
+// Settings and counters kept in retained RAM across an auto-off (CONFIG_OMI_AUTO_OFF)
+//
+// The codec, its overrun policy, the beam direction, the audio timestamps
+// setting and the packet counter, so the app finds the device as it left it.
+// Nothing survives a battery swap or a reset other than the wake from system
+// off; without a valid snapshot the device boots as usual.
+
+#ifdef CONFIG_OMI_AUTO_OFF
+
+/**
+ * @brief Snapshot the current settings and keep them through system off
+ *
+ * Call right before entering system off.
+ */
+void resume_state_save(void);
+
+/**
+ * @brief Whether this boot is the wake from an auto-off with a snapshot to restore
+ */
+bool resume_state_pending(void);
+
+/**
+ * @brief Apply the snapshot and drop it
+ *
+ * Call once the codec and the transport are started, before the app connects.
+ *
+ * @return 0 if restored, -ENOENT without a snapshot
+ */
+int resume_state_restore(void);
+
+#else
+
+static inline bool resume_state_pending(void) { return false; }
+static inline int resume_state_restore(void) { return -ENOENT; }
+
+#endif
+
+#endif
@@ -6,35 +6,76 @@
 #include <zephyr/device.h>
 #include <zephyr/drivers/i2s.h>
 #include <zephyr/drivers/gpio.h>
-#include <math.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/logging/log_ctrl.h>
 #include "speaker.h"
+#include "tone.h"
+#ifdef CONFIG_OMI_ECHO_CANCELLER
+#include "echo_canceller.h"
+#endif
+#ifdef CONFIG_OMI_SPEAKER_OPUS
+#include "lib/opus-1.2.1/opus.h"
+#endif
 
 LOG_MODULE_REGISTER(speaker, CONFIG_LOG_DEFAULT_LEVEL);
 
-#define MAX_BLOCK_SIZE   10000 //24000 * 2
-
-#define BLOCK_COUNT 2     
 #define SAMPLE_FREQUENCY 8000
 #define NUMBER_OF_CHANNELS 2
 #define PACKET_SIZE 400
 #define WORD_SIZE 16
 #define NUM_CHANNELS 2
 
-#define PI 3.14159265358979323846
+// One I2S block per 20ms frame, the slab is the playout side of the jitter buffer
+#define STREAM_FRAME_MS 20
+#define STREAM_FRAME_SAMPLES (SAMPLE_FREQUENCY * STREAM_FRAME_MS / 1000)
+#ifdef CONFIG_OMI_SPEAKER_OPUS
+#define STREAM_MAX_PACKET_SIZE 244 // Largest write that fits the 247 byte MTU
+#else
+#define STREAM_MAX_PACKET_SIZE PACKET_SIZE
+#endif
+#define STREAM_PLC_FRAMES 3        // Concealed frames before a stalled stream is ended
+#define STREAM_START_BLOCKS 2      // I2S blocks queued before the transfer starts, so one is always in flight
+#define MAX_BLOCK_SIZE (STREAM_FRAME_SAMPLES * NUMBER_OF_CHANNELS * sizeof(int16_t))
+#define BLOCK_COUNT 6
 
 K_MEM_SLAB_DEFINE_STATIC(mem_slab, MAX_BLOCK_SIZE, BLOCK_COUNT, 2);
 
 struct device *audio_speaker;
 
-static void* rx_buffer;
-static void* buzz_buffer;
-static int16_t *ptr2;
-static int16_t *clear_ptr;
+struct speaker_packet
+{
+    uint16_t len;
+    uint8_t data[STREAM_MAX_PACKET_SIZE];
+};
 
-static uint16_t current_length;
-static uint16_t offset;
+// Filled by speak() from the BLE RX thread, drained by the stream thread
+K_MSGQ_DEFINE(speaker_packets, sizeof(struct speaker_packet), CONFIG_OMI_SPEAKER_JITTER_BUFFER_FRAMES, 4);
+static K_SEM_DEFINE(speaker_wake, 0, 1);
+
+static int16_t speaker_pcm[STREAM_FRAME_SAMPLES];
+// Set by speaker_play_pattern, taken by the stream thread when it is idle
+static atomic_ptr_t speaker_pattern = ATOMIC_PTR_INIT(NULL);
+static void speaker_stream_thread(void *p1, void *p2, void *p3);
+
+K_THREAD_STACK_DEFINE(speaker_stream_stack, 16000);
+static struct k_thread speaker_stream_thread_data;
+
+#ifdef CONFIG_OMI_SPEAKER_OPUS
+// opus_decoder_get_size(1) on a 64-bit host, an upper bound for the target:
+// 9228 bytes CELT only, 13540 with the SILK layer. Checked at init.
+#ifdef CONFIG_OMI_CODEC_OPUS_HYBRID
+#define SPEAKER_DECODER_SIZE 13568
+#else
+#define SPEAKER_DECODER_SIZE 9248
+#endif
+static uint8_t speaker_decoder_mem[SPEAKER_DECODER_SIZE] __aligned(8);
+static OpusDecoder *const speaker_decoder = (OpusDecoder *)speaker_decoder_mem;
+#else
+// Samples of the last packet that didn't fill a whole frame
+static int16_t speaker_pending[STREAM_FRAME_SAMPLES + STREAM_MAX_PACKET_SIZE / 2];
+static size_t speaker_pending_count;
+#endif
 
 struct gpio_dt_spec speaker_gpio_pin = {.port = DEVICE_DT_GET(DT_NODELABEL(gpio0)), .pin=4, .dt_flags = GPIO_INT_DISABLE};
 
@@ -79,9 +120,9 @@ int speaker_init()
     LOG_INF("Speaker init");
     audio_speaker = device_get_binding("I2S_0");
     
-    if (!device_is_ready(audio_speaker)) 
+    if (audio_speaker == NULL || !device_is_ready(audio_speaker)) 
     {
-        LOG_ERR("Speaker device is not supported : %s", audio_speaker->name);
+        LOG_ERR("Speaker device is not supported");
         return -1;
     }
 
@@ -119,149 +160,324 @@ int speaker_init()
 		LOG_ERR("Failed to configure Speaker (%d)", err);
         return -1;
 	}
-    err = k_mem_slab_alloc(&mem_slab, &rx_buffer, K_MSEC(200));
-	if (err)
-    {
-		LOG_INF("Failed to allocate memory for speaker%d)", err);
-        return -1;
-	}
 
-	err = k_mem_slab_alloc(&mem_slab, &buzz_buffer, K_MSEC(200));
-	if (err) 
+#ifdef CONFIG_OMI_SPEAKER_OPUS
+    // Decode straight to the I2S rate, Opus resamples internally
+    if (opus_decoder_get_size(1) > sizeof(speaker_decoder_mem))
+    {
+        LOG_ERR("The Opus decoder needs %d bytes", opus_decoder_get_size(1));
+        return -ENOMEM;
+    }
+    err = opus_decoder_init(speaker_decoder, SAMPLE_FREQUENCY, 1);
+    if (err != OPUS_OK)
     {
-		LOG_INF("Failed to allocate for chime (%d)", err);
+        LOG_ERR("Failed to initialize the Opus decoder (%d)", err);
         return -1;
-	}
-      
-    memset(rx_buffer, 0, MAX_BLOCK_SIZE);
-    memset(buzz_buffer, 0, MAX_BLOCK_SIZE);
+    }
+#endif
 
-    
+    k_thread_create(&speaker_stream_thread_data, speaker_stream_stack, K_THREAD_STACK_SIZEOF(speaker_stream_stack),
+                    speaker_stream_thread, NULL, NULL, NULL, K_PRIO_PREEMPT(5), 0, K_NO_WAIT);
     return 0;
 }
 
-uint16_t speak(uint16_t len, const void *buf) //direct from bt
+//
+// Stream sources, each call yields one frame of mono PCM
+//
+
+#ifdef CONFIG_OMI_SPEAKER_OPUS
+
+static void speaker_source_reset(void)
 {
-	uint16_t amount = 0;
-    amount = len;
-	if (len == 4)  //if stage 1 
-	{
-        current_length = ((uint32_t *)buf)[0];
-	    LOG_INF("About to write %u bytes", current_length);
-        ptr2 = (int16_t *)rx_buffer;
-        clear_ptr = (int16_t *)rx_buffer;
-	}
-    else 
-    { //if not stage 1
-        if (current_length > PACKET_SIZE) 
-        {
-            LOG_INF("Data length: %u", len);
-            current_length = current_length - PACKET_SIZE;
-            LOG_INF("remaining data: %u", current_length);
+    opus_decoder_ctl(speaker_decoder, OPUS_RESET_STATE);
+}
 
-            for (int i = 0; i < (int)(len/2); i++) 
-            {
-                *ptr2++ = ((int16_t *)buf)[i];  
-                *ptr2++ = ((int16_t *)buf)[i]; 
-            }
-            offset = offset + len;
-        }
-        else if (current_length < PACKET_SIZE) 
+// One packet per frame, a missing packet is concealed by the decoder's PLC
+static bool speaker_source_frame(int16_t *pcm, k_timeout_t timeout)
+{
+    struct speaker_packet packet;
+    bool received = k_msgq_get(&speaker_packets, &packet, timeout) == 0;
+
+    int samples = opus_decode(speaker_decoder, received ? packet.data : NULL, received ? packet.len : 0,
+                              pcm, STREAM_FRAME_SAMPLES, 0);
+    if (samples < 0)
+    {
+        LOG_WRN("Opus decoding failed: %d", samples);
+        samples = 0;
+    }
+    memset(&pcm[samples], 0, (STREAM_FRAME_SAMPLES - samples) * sizeof(int16_t));
+    return received;
+}
+
+#else
+
+static void speaker_source_reset(void)
+{
+    speaker_pending_count = 0;
+}
+
+// Raw PCM packets don't line up with frames, so they are gathered until one is full.
+// On an underrun the frame is finished by decaying the last sample, rather than
+// cutting to silence with a click.
+static bool speaker_source_frame(int16_t *pcm, k_timeout_t timeout)
+{
+    struct speaker_packet packet;
+    k_timepoint_t end = sys_timepoint_calc(timeout);
+
+    while (speaker_pending_count < STREAM_FRAME_SAMPLES)
+    {
+        if (k_msgq_get(&speaker_packets, &packet, sys_timepoint_timeout(end)))
         {
-            LOG_INF("entered the final stretch");
-            LOG_INF("Data length: %u", len);
-            current_length = current_length - len;
-            LOG_INF("remaining data: %u", current_length);
-            // memcpy(rx_buffer+offset, buf, len);
-            for (int i = 0; i < len/2; i++) 
-            {
-                *ptr2++ = ((int16_t *)buf)[i];  
-                *ptr2++ = ((int16_t *)buf)[i];  
-            }
-            offset = offset + len;
-            LOG_INF("offset: %u", offset);
-            offset = 0;
-            int res= i2s_write(audio_speaker, rx_buffer,  MAX_BLOCK_SIZE);
-            if (res < 0)
+            size_t count = speaker_pending_count;
+            memcpy(pcm, speaker_pending, count * sizeof(int16_t));
+            int32_t tail = count ? pcm[count - 1] : 0;
+            for (size_t i = count; i < STREAM_FRAME_SAMPLES; i++)
             {
-                LOG_PRINTK("Failed to write I2S data: %d\n", res);
+                tail = tail * 7 / 8;
+                pcm[i] = tail;
             }
-            i2s_trigger(audio_speaker, I2S_DIR_TX, I2S_TRIGGER_START);// calls are probably non blocking   
-            if (res != 0) 
-            {
-                LOG_PRINTK("Failed to drain I2S transmission: %d\n", res);
-            }    
-	        res =  i2s_trigger(audio_speaker, I2S_DIR_TX, I2S_TRIGGER_DRAIN);
-            if (res != 0) 
-            {
-                LOG_PRINTK("Failed to drain I2S transmission: %d\n", res);
-            }
-            //clear the buffer
-            k_sleep(K_MSEC(4000));
+            speaker_pending_count = 0;
+            return false;
+        }
+        memcpy(&speaker_pending[speaker_pending_count], packet.data, packet.len);
+        speaker_pending_count += packet.len / 2;
+    }
+
+    memcpy(pcm, speaker_pending, STREAM_FRAME_SAMPLES * sizeof(int16_t));
+    speaker_pending_count -= STREAM_FRAME_SAMPLES;
+    memmove(speaker_pending, &speaker_pending[STREAM_FRAME_SAMPLES], speaker_pending_count * sizeof(int16_t));
+    return true;
+}
+
+#endif
 
-            memset(clear_ptr, 0, MAX_BLOCK_SIZE);
+//
+// Playback
+//
+
+// Expands a mono frame into a stereo I2S block and queues it
+static int speaker_queue_frame(const int16_t *pcm)
+{
+    void *block;
+    int err = k_mem_slab_alloc(&mem_slab, &block, K_MSEC(4 * STREAM_FRAME_MS * BLOCK_COUNT));
+    if (err)
+    {
+        LOG_ERR("No free speaker block (%d)", err);
+        return err;
+    }
 
+    int16_t *out = (int16_t *)block;
+    for (int i = 0; i < STREAM_FRAME_SAMPLES; i++)
+    {
+        *out++ = pcm[i];
+        *out++ = pcm[i];
+    }
+
+    err = i2s_write(audio_speaker, block, MAX_BLOCK_SIZE);
+    if (err)
+    {
+        k_mem_slab_free(&mem_slab, block);
+    }
+    return err;
+}
+
+// One playback, from the first queued block to the drain
+typedef struct
+{
+    bool started;
+    int queued; // Blocks queued so far
+#ifdef CONFIG_OMI_ECHO_CANCELLER
+    int64_t start_tick; // Echo clock time at which the first block started playing
+#endif
+} speaker_output_t;
+
+#ifdef CONFIG_OMI_ECHO_CANCELLER
+BUILD_ASSERT(SAMPLE_FREQUENCY == ECHO_REFERENCE_RATE, "The echo reference runs at the speaker rate");
+// Frames queued before the start trigger, their playout time isn't known yet
+static int16_t speaker_echo_prestart[STREAM_START_BLOCKS][STREAM_FRAME_SAMPLES];
+#endif
+
+// Starts the transfer once enough blocks are queued, so one is always in flight
+static int speaker_output_frame(speaker_output_t *output, const int16_t *pcm)
+{
+    int err = speaker_queue_frame(pcm);
+    if (err)
+    {
+        LOG_ERR("Failed to queue speaker frame (%d)", err);
+        return err;
+    }
+
+#ifdef CONFIG_OMI_ECHO_CANCELLER
+    // The I2S clock never stalls during a playback, so block n plays n frames after the start
+    if (output->started)
+    {
+        echo_reference_write(pcm, STREAM_FRAME_SAMPLES, output->start_tick + output->queued * STREAM_FRAME_SAMPLES);
+    }
+    else
+    {
+        memcpy(speaker_echo_prestart[output->queued], pcm, sizeof(speaker_echo_prestart[0]));
+    }
+#endif
+    output->queued++;
+
+    if (!output->started && output->queued >= STREAM_START_BLOCKS)
+    {
+        err = i2s_trigger(audio_speaker, I2S_DIR_TX, I2S_TRIGGER_START);
+        if (err)
+        {
+            LOG_ERR("Failed to start I2S transmission: %d", err);
+            return err;
         }
+        output->started = true;
 
+#ifdef CONFIG_OMI_ECHO_CANCELLER
+        output->start_tick = echo_clock_now();
+        for (int i = 0; i < output->queued; i++)
+        {
+            echo_reference_write(speaker_echo_prestart[i], STREAM_FRAME_SAMPLES, output->start_tick + i * STREAM_FRAME_SAMPLES);
+        }
+#endif
     }
-    return amount;
+    return 0;
 }
 
+static void speaker_output_end(const speaker_output_t *output)
+{
+    int err = i2s_trigger(audio_speaker, I2S_DIR_TX, output->started ? I2S_TRIGGER_DRAIN : I2S_TRIGGER_DROP);
+    if (err)
+    {
+        // Recover from an underrun so the next stream can start
+        i2s_trigger(audio_speaker, I2S_DIR_TX, I2S_TRIGGER_PREPARE);
+    }
+}
 
-void generate_gentle_chime(int16_t *buffer, int num_samples)
+static void speaker_play_stream(void)
 {
-    LOG_INF("Generating gentle chime");//2500
-    const float frequencies[] = {523.25, 659.25, 783.99, 1046.50}; // C5, E5, G5, C6
-    const int num_freqs = sizeof(frequencies) / sizeof(frequencies[0]);//4
-
-    for (int i = 0; i < num_samples; i++) 
-    { 
-        float t = (float)i / SAMPLE_FREQUENCY;//0.000125
-        float sample = 0;
-        for (int j = 0; j < num_freqs; j++) 
+    // Prefill, so the radio can fall behind by this much without an audible gap
+    int64_t deadline = k_uptime_get() + 2 * STREAM_FRAME_MS * CONFIG_OMI_SPEAKER_PREFILL_FRAMES;
+    while (k_msgq_num_used_get(&speaker_packets) < CONFIG_OMI_SPEAKER_PREFILL_FRAMES && k_uptime_get() < deadline)
+    {
+        k_msleep(STREAM_FRAME_MS / 2);
+    }
+
+    speaker_source_reset();
+
+    speaker_output_t output = {0};
+    int concealed = 0;
+    int underruns = 0;
+    while (concealed <= STREAM_PLC_FRAMES)
+    {
+        // The I2S queue paces this loop, so a packet is due within one frame
+        if (speaker_source_frame(speaker_pcm, K_MSEC(STREAM_FRAME_MS)))
         {
-           sample += sinf(2 * PI * frequencies[j] * t) * (1.0 - t);
+            concealed = 0;
+        }
+        else
+        {
+            concealed++;
+            underruns++;
+        }
+
+        if (speaker_output_frame(&output, speaker_pcm))
+        {
+            break;
         }
-        int16_t int_sample = (int16_t)(sample / num_freqs * 32767 * 0.5);
-        buffer[i * NUM_CHANNELS] = int_sample;
-        buffer[i * NUM_CHANNELS + 1] = int_sample;
     }
-    LOG_INF("Done generating gentle chime");
+
+    speaker_output_end(&output);
+    // The trailing concealed frames only detect the end of the stream
+    LOG_INF("Speaker stream ended, %d frames concealed", underruns - concealed);
 }
 
-int play_boot_sound(void)
+static void speaker_play_tones(const tone_pattern_t *pattern)
+{
+    static tone_player_t player;
+    speaker_output_t output = {0};
+
+    tone_start(&player, pattern, SAMPLE_FREQUENCY);
+    while (tone_render(&player, speaker_pcm, STREAM_FRAME_SAMPLES))
+    {
+        if (speaker_output_frame(&output, speaker_pcm))
+        {
+            break;
+        }
+    }
+    speaker_output_end(&output);
+}
+
+static void speaker_stream_thread(void *p1, void *p2, void *p3)
 {
-    int ret;
-    int16_t *buffer = (int16_t *) buzz_buffer;
-    const int samples_per_block = MAX_BLOCK_SIZE / (NUM_CHANNELS * sizeof(int16_t));
-
-    generate_gentle_chime(buffer, samples_per_block);
-    LOG_INF("Writing to speaker");
-    k_sleep(K_MSEC(100));
-    ret = i2s_write(audio_speaker, buffer, MAX_BLOCK_SIZE);
-    if (ret) 
+    while (1)
     {
-        LOG_ERR("Failed to write initial I2S data: %d", ret);
-        return ret;
+        // Idle until the app starts sending or a tone pattern is requested
+        const tone_pattern_t *pattern = NULL;
+        while (k_msgq_num_used_get(&speaker_packets) == 0 &&
+               (pattern = atomic_ptr_clear(&speaker_pattern)) == NULL)
+        {
+            k_sem_take(&speaker_wake, K_FOREVER);
+        }
+
+        gpio_pin_set_dt(&speaker_gpio_pin, 1);
+        if (pattern)
+        {
+            speaker_play_tones(pattern);
+        }
+        else
+        {
+            speaker_play_stream();
+        }
     }
+}
 
-    ret = i2s_trigger(audio_speaker, I2S_DIR_TX, I2S_TRIGGER_START);
-    if (ret) 
+int speaker_play_pattern(const tone_pattern_t *pattern)
+{
+    if (pattern == NULL || pattern->count == 0)
     {
-        LOG_ERR("Failed to start I2S transmission: %d", ret);
-        return ret;
-    }  
+        return -EINVAL;
+    }
+    // A pattern requested while another one is pending replaces it
+    atomic_ptr_set(&speaker_pattern, (void *)pattern);
+    k_sem_give(&speaker_wake);
+    return 0;
+}
 
+int speak(uint16_t len, const void *buf) //direct from bt
+{
+    struct speaker_packet packet;
+#ifdef CONFIG_OMI_SPEAKER_OPUS
+    if (len == 0 || len > sizeof(packet.data))
+    {
+        LOG_WRN("Invalid Opus packet size: %u", len);
+        return -EINVAL;
+    }
+#else
+    if (len == 4)
+    {
+        // Size header of the old one-shot protocol, a stream needs no length
+        return len;
+    }
+    if (len == 0 || len > sizeof(packet.data) || len % 2)
+    {
+        LOG_WRN("Invalid PCM packet size: %u", len);
+        return -EINVAL;
+    }
+#endif
 
-    ret = i2s_trigger(audio_speaker, I2S_DIR_TX, I2S_TRIGGER_DRAIN);
-    if (ret != 0) 
+    packet.len = len;
+    memcpy(packet.data, buf, len);
+    if (k_msgq_put(&speaker_packets, &packet, K_NO_WAIT))
     {
-        LOG_ERR("Failed to drain I2S transmission: %d", ret);
-        return ret;
+        LOG_WRN("Speaker jitter buffer full, dropping packet");
+        return -ENOMEM;
     }
-    k_sleep(K_MSEC(3000));  
+    k_sem_give(&speaker_wake);
+    return len;
+}
 
-    return 0;
+int play_boot_sound(void)
+{
+    // Rendered by the stream thread, so boot carries on while it plays
+    return speaker_play_pattern(&tone_boot_chime);
 }
 
 void speaker_off()
@@ -2,6 +2,7 @@
 #define SPEAKER_H
 
 #include <zephyr/kernel.h>
+#include "tone.h"
 /**
  * @brief Initialize the Speaker
  *
@@ -14,25 +15,46 @@ int speaker_init();
 /**
  * @brief Endpoint function for streaming audio
  *
- * Call this function in the following way (Via ble)
- * 1. Send a 2 byte packet containing the audio data size
- * 2. Send to the ble notify id 400 byte packets (with notify), with each 2 bytes being the audio data
- * 3. Repeat step 2 until the audio data is sent. Then the speaker will automatically play the sound
- * when the audio data sent is equal to the audio data size sent in step 1
- * 
- * @return The amount of data successfully sent in bytes.
+ * Every BLE write is queued in a jitter buffer and played by a stream thread.
+ * Playback starts once CONFIG_OMI_SPEAKER_PREFILL_FRAMES writes are buffered
+ * and ends after the stream has been silent for a few concealed frames, so
+ * prompts of any length play back to back.
+ *
+ * With CONFIG_OMI_SPEAKER_OPUS every write is one 20ms Opus packet (any
+ * encoder sample rate, mono), decoded on-device. The CELT-only profile decodes
+ * CELT packets only, SILK and hybrid packets need CONFIG_OMI_CODEC_OPUS_HYBRID.
+ *
+ * Otherwise every write is 16-bit little-endian mono PCM at 8 kHz, an even
+ * number of bytes up to 400. A 4 byte write, the size header of the older
+ * one-shot protocol, is accepted and ignored.
+ *
+ * @return The amount of data queued in bytes, -EINVAL for a write of the wrong
+ *         size, -ENOMEM while the jitter buffer is full
  */
-uint16_t speak(uint16_t len, const void *buf);
+int speak(uint16_t len, const void *buf);
 
 /**
  * @brief Play a chime effect
  *
- * This function plays a chime effect. Use this to check if the speaker works correctly
+ * This function plays a chime effect. Use this to check if the speaker works correctly.
+ * Returns right away, the chime is rendered while it plays.
  *
  * @return 0 if successful, negative errno code if error
  */
 int play_boot_sound();
 
+/**
+ * @brief Play a tone pattern, such as a notification sound
+ *
+ * The speaker's stream thread renders the pattern as it plays, after any
+ * stream in progress. A pattern requested while another is still waiting replaces it.
+ *
+ * @param pattern Pattern to play, must stay valid until it has been played
+ *
+ * @return 0 if successful, -EINVAL for an empty pattern
+ */
+int speaker_play_pattern(const tone_pattern_t *pattern);
+
 void speaker_off();
 
 void register_speaker_service();
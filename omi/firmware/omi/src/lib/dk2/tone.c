@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include "tone.h"
+
+// One sine period in Q15, plus the first entry again so interpolation never wraps.
+// python3 -c "import math; print([round(32767 * math.sin(2 * math.pi * i / 256)) for i in range(257)])"
+#define SINE_TABLE_BITS 8
+static const int16_t sine_table[(1 << SINE_TABLE_BITS) + 1] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739,
+    9512, 10278, 11039, 11793, 12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594, 23170, 23731, 24279, 24811,
+    25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521,
+    32609, 32678, 32728, 32757, 32767, 32757, 32728, 32678, 32609, 32521, 32412, 32285,
+    32137, 31971, 31785, 31580, 31356, 31113, 30852, 30571, 30273, 29956, 29621, 29268,
+    28898, 28510, 28105, 27683, 27245, 26790, 26319, 25832, 25329, 24811, 24279, 23731,
+    23170, 22594, 22005, 21403, 20787, 20159, 19519, 18868, 18204, 17530, 16846, 16151,
+    15446, 14732, 14010, 13279, 12539, 11793, 11039, 10278, 9512, 8739, 7962, 7179,
+    6393, 5602, 4808, 4011, 3212, 2410, 1608, 804, 0, -804, -1608, -2410,
+    -3212, -4011, -4808, -5602, -6393, -7179, -7962, -8739, -9512, -10278, -11039, -11793,
+    -12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530, -18204, -18868, -19519, -20159,
+    -20787, -21403, -22005, -22594, -23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790,
+    -27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956, -30273, -30571, -30852, -31113,
+    -31356, -31580, -31785, -31971, -32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+    -32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285, -32137, -31971, -31785, -31580,
+    -31356, -31113, -30852, -30571, -30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683,
+    -27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731, -23170, -22594, -22005, -21403,
+    -20787, -20159, -19519, -18868, -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+    -12539, -11793, -11039, -10278, -9512, -8739, -7962, -7179, -6393, -5602, -4808, -4011,
+    -3212, -2410, -1608, -804, 0,
+};
+
+enum
+{
+    TONE_IDLE,
+    TONE_ATTACK,
+    TONE_DECAY,
+    TONE_SUSTAIN,
+    TONE_RELEASE,
+};
+
+static inline int16_t sine_q15(uint32_t phase)
+{
+    // Top bits index the table, the next 16 interpolate between neighbours
+    uint32_t index = phase >> (32 - SINE_TABLE_BITS);
+    int32_t fraction = (phase >> (16 - SINE_TABLE_BITS)) & 0xFFFF;
+    int32_t a = sine_table[index];
+    int32_t b = sine_table[index + 1];
+    return a + (((b - a) * fraction) >> 16);
+}
+
+static uint32_t ms_to_samples(const tone_player_t *player, uint32_t ms)
+{
+    return ms * player->sample_rate / 1000;
+}
+
+// Linear ramp from the current level to target over samples, at least one
+static void voice_ramp(tone_voice_t *voice, uint8_t stage, int32_t target, uint32_t samples)
+{
+    samples = MAX(samples, 1);
+    voice->stage = stage;
+    voice->target = target;
+    voice->remaining = samples;
+    voice->step = ((int64_t)target - voice->level) / samples;
+}
+
+static void voice_start(tone_player_t *player, tone_voice_t *voice, const tone_note_t *note)
+{
+    const tone_envelope_t *envelope = &player->pattern->envelope;
+    int32_t peak = (int32_t)note->level << 15;
+
+    voice->phase = 0;
+    voice->increment = ((uint64_t)note->hz << 32) / player->sample_rate;
+    voice->level = 0;
+    voice->sustain = ((int64_t)peak * envelope->sustain) >> 15;
+    voice->gate_end = player->position + ms_to_samples(player, note->length_ms);
+    voice_ramp(voice, TONE_ATTACK, peak, ms_to_samples(player, envelope->attack_ms));
+}
+
+// Advances the envelope by one sample
+static void voice_envelope(tone_player_t *player, tone_voice_t *voice)
+{
+    if (voice->stage != TONE_RELEASE && player->position >= voice->gate_end)
+    {
+        voice_ramp(voice, TONE_RELEASE, 0, ms_to_samples(player, player->pattern->envelope.release_ms));
+    }
+
+    if (voice->remaining == 0)
+    {
+        return;
+    }
+    voice->level += voice->step;
+    if (--voice->remaining > 0)
+    {
+        return;
+    }
+
+    // Land exactly on the target, the step is rounded
+    voice->level = voice->target;
+    switch (voice->stage)
+    {
+    case TONE_ATTACK:
+        voice_ramp(voice, TONE_DECAY, voice->sustain, ms_to_samples(player, player->pattern->envelope.decay_ms));
+        break;
+    case TONE_DECAY:
+        voice->stage = TONE_SUSTAIN;
+        break;
+    case TONE_RELEASE:
+        voice->stage = TONE_IDLE;
+        break;
+    }
+}
+
+static tone_voice_t *voice_allocate(tone_player_t *player)
+{
+    // A free voice, otherwise the quietest one is cut short
+    tone_voice_t *quietest = &player->voices[0];
+    for (int i = 0; i < TONE_VOICES; i++)
+    {
+        tone_voice_t *voice = &player->voices[i];
+        if (voice->stage == TONE_IDLE)
+        {
+            return voice;
+        }
+        if (abs(voice->level) < abs(quietest->level))
+        {
+            quietest = voice;
+        }
+    }
+    return quietest;
+}
+
+void tone_start(tone_player_t *player, const tone_pattern_t *pattern, uint32_t sample_rate)
+{
+    memset(player, 0, sizeof(*player));
+    player->pattern = pattern;
+    player->sample_rate = sample_rate;
+}
+
+bool tone_render(tone_player_t *player, int16_t *pcm, size_t count)
+{
+    const tone_pattern_t *pattern = player->pattern;
+    bool sounding = false;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        while (player->next_note < pattern->count &&
+               ms_to_samples(player, pattern->notes[player->next_note].start_ms) <= player->position)
+        {
+            voice_start(player, voice_allocate(player), &pattern->notes[player->next_note++]);
+        }
+
+        int32_t mix = 0;
+        for (int v = 0; v < TONE_VOICES; v++)
+        {
+            tone_voice_t *voice = &player->voices[v];
+            if (voice->stage == TONE_IDLE)
+            {
+                continue;
+            }
+            mix += ((voice->level >> 15) * sine_q15(voice->phase)) >> 15;
+            voice->phase += voice->increment;
+            voice_envelope(player, voice);
+            sounding = true;
+        }
+
+        pcm[i] = CLAMP(mix, INT16_MIN, INT16_MAX);
+        player->position++;
+    }
+
+    return sounding || player->next_note < pattern->count;
+}
+
+//
+// Patterns
+//
+
+// C5, E5, G5 and C6 together, the chord the boot chime always played
+static const tone_note_t boot_chime_notes[] = {
+    {.start_ms = 0, .length_ms = 150, .hz = 523, .level = 4096},
+    {.start_ms = 0, .length_ms = 150, .hz = 659, .level = 4096},
+    {.start_ms = 0, .length_ms = 150, .hz = 784, .level = 4096},
+    {.start_ms = 0, .length_ms = 150, .hz = 1047, .level = 4096},
+};
+
+const tone_pattern_t tone_boot_chime = {
+    .notes = boot_chime_notes,
+    .count = ARRAY_SIZE(boot_chime_notes),
+    .envelope = {.attack_ms = 5, .decay_ms = 100, .sustain = 19661, .release_ms = 200}, // Sustain at 0.6
+};
+
+static const tone_note_t notification_notes[] = {
+    {.start_ms = 0, .length_ms = 80, .hz = 880, .level = 12000},
+    {.start_ms = 120, .length_ms = 120, .hz = 1319, .level = 12000},
+};
+
+const tone_pattern_t tone_notification = {
+    .notes = notification_notes,
+    .count = ARRAY_SIZE(notification_notes),
+    .envelope = {.attack_ms = 5, .decay_ms = 40, .sustain = 16384, .release_ms = 80},
+};
@@ -0,0 +1,79 @@
+#ifndef TONE_H
+#define TONE_H
+#include <zephyr/kernel.h>
+
+// Wavetable tone synthesizer for notification sounds. Integer only: a Q15 sine
+// table read by phase accumulators, each voice shaped by an ADSR envelope.
+
+#define TONE_VOICES 4 // Notes that can sound at once
+
+typedef struct
+{
+    uint16_t attack_ms;
+    uint16_t decay_ms;
+    uint16_t sustain;    // Q15 fraction of the note level
+    uint16_t release_ms;
+} tone_envelope_t;
+
+typedef struct
+{
+    uint16_t start_ms;  // From the start of the pattern
+    uint16_t length_ms; // Until the release starts
+    uint16_t hz;
+    int16_t level;      // Q15 peak amplitude
+} tone_note_t;
+
+typedef struct
+{
+    const tone_note_t *notes; // Sorted by start_ms
+    uint8_t count;
+    tone_envelope_t envelope;
+} tone_pattern_t;
+
+typedef struct
+{
+    uint32_t phase;
+    uint32_t increment;
+    int32_t level;      // Q30
+    int32_t step;       // Added to level every sample
+    int32_t target;     // Q30, where the current stage ends
+    uint32_t remaining; // Samples of the current stage
+    uint32_t gate_end;  // Sample at which the release starts
+    int32_t sustain;    // Q30
+    uint8_t stage;
+} tone_voice_t;
+
+typedef struct
+{
+    const tone_pattern_t *pattern;
+    uint32_t sample_rate;
+    uint32_t position; // Samples rendered so far
+    uint8_t next_note;
+    tone_voice_t voices[TONE_VOICES];
+} tone_player_t;
+
+/**
+ * @brief Start rendering a pattern
+ *
+ * @param player Player state, owned by the caller
+ * @param pattern Pattern to play, must stay valid until tone_render returns false
+ * @param sample_rate Output sample rate in Hz
+ */
+void tone_start(tone_player_t *player, const tone_pattern_t *pattern, uint32_t sample_rate);
+
+/**
+ * @brief Render the next block of mono PCM
+ *
+ * @param player Player started with tone_start
+ * @param pcm Receives the samples, silence once the pattern is over
+ * @param count Number of samples
+ *
+ * @return true while the pattern still sounds, false once it has finished
+ */
+bool tone_render(tone_player_t *player, int16_t *pcm, size_t count);
+
+// Built-in patterns
+extern const tone_pattern_t tone_boot_chime;   // C major chord, fading out
+extern const tone_pattern_t tone_notification; // Two rising notes
+
+#endif
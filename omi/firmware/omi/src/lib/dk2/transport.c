@@ -11,11 +11,13 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/sys/atomic.h>
 #include <zephyr/sys/ring_buffer.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/dt-bindings/gpio/nordic-nrf-gpio.h>
 #include <hal/nrf_power.h>
 #include "transport.h"
 #include "config.h"
+#include "codec.h"
 #include "speaker.h"
 #include "sdcard.h"
 #include "storage.h"
@@ -23,6 +25,14 @@
 #include "mic.h"
 #include "accel.h"
 #include "haptic.h"
+#include "latency_probe.h"
+#include "energy.h"
+#include "beamformer.h"
+#include "audio_diag.h"
+#include "audio_stats.h"
+#include "device_clock.h"
+#include "lib/battery/battery.h"
+#include "power.h"
 #include <math.h> // For float conversion in logs
 LOG_MODULE_REGISTER(transport, CONFIG_LOG_DEFAULT_LEVEL);
 
@@ -46,6 +56,7 @@ extern bool is_connected;
 
 struct bt_conn *current_connection = NULL;
 uint16_t current_mtu = 0;
+static uint8_t current_tx_phy = BT_GAP_LE_PHY_1M; // Prices the airtime in the energy ledger
 uint16_t current_package_index = 0;
 //
 // Internal
@@ -57,8 +68,26 @@ static ssize_t audio_data_write_handler(struct bt_conn *conn, const struct bt_ga
 
 static struct bt_conn_cb _callback_references;
 static void audio_ccc_config_changed_handler(const struct bt_gatt_attr *attr, uint16_t value);
+static void audio_data_ccc_config_changed_handler(const struct bt_gatt_attr *attr, uint16_t value);
 static ssize_t audio_data_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+// The app decodes at 16 kHz unless it reads the rate byte
+BUILD_ASSERT(CODEC_SAMPLE_RATE == 16000 || IS_ENABLED(CONFIG_OMI_CODEC_APP_READS_RATE),
+             "Codec rates other than 16 kHz need an app that reads the rate byte");
+
 static ssize_t audio_codec_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+static ssize_t audio_codec_write_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
+static ssize_t audio_control_write_handler(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
+static ssize_t audio_diag_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+static ssize_t audio_diag_write_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
+static ssize_t clock_sync_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+static ssize_t clock_sync_write_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
+#ifdef CONFIG_OMI_AUDIO_STATS
+static ssize_t audio_stats_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+#endif
+#ifdef CONFIG_OMI_ENERGY_LEDGER
+static ssize_t energy_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+static ssize_t energy_write_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
+#endif
 
 // Forward declarations for update functions and callbacks
 static void update_phy(struct bt_conn *conn);
@@ -76,23 +105,61 @@ static struct bt_gatt_exchange_params exchange_params;
 // Audio service with UUID 19B10000-E8F2-537E-4F6C-D104768A1214
 // exposes following characteristics:
 // - Audio data (UUID 19B10001-E8F2-537E-4F6C-D104768A1214) to send audio data (read/notify)
-// - Audio codec (UUID 19B10002-E8F2-537E-4F6C-D104768A1214) to send audio codec type (read)
+//   [packet id (le16), fragment index, payload]. With timestamps enabled, the first fragment of every frame
+//   carries [packet id (le16), 0, capture time (le32, low bits of the device clock in us), payload]
+// - Audio codec (UUID 19B10002-E8F2-537E-4F6C-D104768A1214) to send audio codec type (read [codec id, sample rate in kHz])
+//   and to switch to another compiled-in codec (write [codec id]), effective from the next frame
+// - Audio control (UUID 19B10004-E8F2-537E-4F6C-D104768A1214) to receive link feedback from the app (write)
+//   [0x01, loss%] reports the packet loss the app observed from the packet ids
+//   [0x02, angle] steers the microphone beam, signed degrees from broadside (dual-microphone boards)
+//   [0x03, policy] sets what is dropped when the encoder falls behind, 0 = newest block, 1 = oldest audio
+//   [0x04, enable] adds capture timestamps to the audio data packets
+//   [0x05, sound] plays a built-in sound on the speaker, 0 = boot chime, 1 = notification
+// - Audio diagnostics (UUID 19B10007-E8F2-537E-4F6C-D104768A1214) to read where audio was lost (read)
+//   [policy, then little-endian u32 counters in audio_diag_counter_t order], write [0x01] to zero the counters
+// - Audio level (UUID 19B10008-E8F2-537E-4F6C-D104768A1214) to follow the captured level without decoding (read/notify)
+//   [flags (bit 0 voice), then little-endian u16 rms, peak, clipped samples and the 8 band levels of audio_stats_t],
+//   notified every CONFIG_OMI_AUDIO_STATS_INTERVAL_MS
+// - Clock sync (UUID 19B10009-E8F2-537E-4F6C-D104768A1214) to map the device clock onto the app's (read/write/notify)
+//   write [0x01, seq] is answered by the notification [0x01, seq, receive time (le64), send time (le64)] in device us,
+//   the app computes offset and round trip from its own send and receive times as NTP does.
+//   write [0x02, offset (le64, app minus device us), round trip (le32 us)] stores the result.
+//   read [device time (le64)], followed by [offset (le64), round trip (le32), device time of that sync (le64)] once synced
+// - Energy (UUID 19B1000A-E8F2-537E-4F6C-D104768A1214) to read where the battery went (read/write, CONFIG_OMI_ENERGY_LEDGER)
+//   [seconds since reset (le32)], then [active ms, events, charge uAh] as le32 for the pdm, hfxo, codec, radio,
+//   sd and led subsystems, write [0x01] to zero it
 // TODO: The current audio service UUID seems to come from old Intel sample code,
 // we should change it to UUID 814b9b7c-25fd-4acd-8604-d28877beee6d
 static struct bt_uuid_128 audio_service_uuid = BT_UUID_INIT_128(BT_UUID_128_ENCODE(0x19B10000, 0xE8F2, 0x537E, 0x4F6C, 0xD104768A1214));
 static struct bt_uuid_128 audio_characteristic_data_uuid = BT_UUID_INIT_128(BT_UUID_128_ENCODE(0x19B10001, 0xE8F2, 0x537E, 0x4F6C, 0xD104768A1214));
 static struct bt_uuid_128 audio_characteristic_format_uuid = BT_UUID_INIT_128(BT_UUID_128_ENCODE(0x19B10002, 0xE8F2, 0x537E, 0x4F6C, 0xD104768A1214));
 static struct bt_uuid_128 audio_characteristic_speaker_uuid = BT_UUID_INIT_128(BT_UUID_128_ENCODE(0x19B10003, 0xE8F2, 0x537E, 0x4F6C, 0xD104768A1214));
+static struct bt_uuid_128 audio_characteristic_control_uuid = BT_UUID_INIT_128(BT_UUID_128_ENCODE(0x19B10004, 0xE8F2, 0x537E, 0x4F6C, 0xD104768A1214));
+static struct bt_uuid_128 audio_characteristic_diag_uuid = BT_UUID_INIT_128(BT_UUID_128_ENCODE(0x19B10007, 0xE8F2, 0x537E, 0x4F6C, 0xD104768A1214));
+static struct bt_uuid_128 audio_characteristic_stats_uuid = BT_UUID_INIT_128(BT_UUID_128_ENCODE(0x19B10008, 0xE8F2, 0x537E, 0x4F6C, 0xD104768A1214));
+static struct bt_uuid_128 audio_characteristic_clock_uuid = BT_UUID_INIT_128(BT_UUID_128_ENCODE(0x19B10009, 0xE8F2, 0x537E, 0x4F6C, 0xD104768A1214));
+static struct bt_uuid_128 audio_characteristic_energy_uuid = BT_UUID_INIT_128(BT_UUID_128_ENCODE(0x19B1000A, 0xE8F2, 0x537E, 0x4F6C, 0xD104768A1214));
 
 static struct bt_gatt_attr audio_service_attr[] = {
     BT_GATT_PRIMARY_SERVICE(&audio_service_uuid),
     BT_GATT_CHARACTERISTIC(&audio_characteristic_data_uuid.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_READ, audio_data_read_characteristic, NULL, NULL),
+    BT_GATT_CCC(audio_data_ccc_config_changed_handler, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(&audio_characteristic_format_uuid.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, audio_codec_read_characteristic, audio_codec_write_characteristic, NULL),
+    BT_GATT_CHARACTERISTIC(&audio_characteristic_control_uuid.uuid, BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP, BT_GATT_PERM_WRITE, NULL, audio_control_write_handler, NULL),
+    BT_GATT_CHARACTERISTIC(&audio_characteristic_diag_uuid.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, audio_diag_read_characteristic, audio_diag_write_characteristic, NULL),
+#ifdef CONFIG_OMI_AUDIO_STATS
+    BT_GATT_CHARACTERISTIC(&audio_characteristic_stats_uuid.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_READ, audio_stats_read_characteristic, NULL, NULL),
+    BT_GATT_CCC(audio_ccc_config_changed_handler, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+#endif
+    BT_GATT_CHARACTERISTIC(&audio_characteristic_clock_uuid.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, clock_sync_read_characteristic, clock_sync_write_characteristic, NULL),
     BT_GATT_CCC(audio_ccc_config_changed_handler, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
-    BT_GATT_CHARACTERISTIC(&audio_characteristic_format_uuid.uuid, BT_GATT_CHRC_READ, BT_GATT_PERM_READ, audio_codec_read_characteristic, NULL, NULL),
 #ifdef CONFIG_OMI_ENABLE_SPEAKER
     BT_GATT_CHARACTERISTIC(&audio_characteristic_speaker_uuid.uuid, BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_WRITE, NULL, audio_data_write_handler, NULL),
     BT_GATT_CCC(audio_ccc_config_changed_handler, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE), //
 #endif
+#ifdef CONFIG_OMI_ENERGY_LEDGER
+    BT_GATT_CHARACTERISTIC(&audio_characteristic_energy_uuid.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, energy_read_characteristic, energy_write_characteristic, NULL),
+#endif
 
 };
 
@@ -131,6 +198,13 @@ static void audio_ccc_config_changed_handler(const struct bt_gatt_attr *attr, ui
     }
 }
 
+// The microphone only runs while the app listens to the audio
+static void audio_data_ccc_config_changed_handler(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    audio_ccc_config_changed_handler(attr, value);
+    power_set_input(POWER_INPUT_SUBSCRIBED, value == BT_GATT_CCC_NOTIFY);
+}
+
 static ssize_t audio_data_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
 {
     LOG_DBG("audio_data_read_characteristic");
@@ -139,18 +213,308 @@ static ssize_t audio_data_read_characteristic(struct bt_conn *conn, const struct
 
 static ssize_t audio_codec_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
 {
-    uint8_t value[1] = {CODEC_ID};
-    LOG_DBG("audio_codec_read_characteristic %d", CODEC_ID);
+    uint8_t value[2] = {codec_get_id(), CODEC_SAMPLE_RATE / 1000};
+    LOG_DBG("audio_codec_read_characteristic %d", value[0]);
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+static ssize_t audio_codec_write_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    if (len != 1 || offset != 0)
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    uint8_t id = ((const uint8_t *)buf)[0];
+    if (codec_select(id) < 0)
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+    LOG_INF("App selected codec %u", id);
+    return len;
+}
+
+#define AUDIO_CONTROL_LOSS_REPORT 0x01
+#define AUDIO_CONTROL_BEAM_DIRECTION 0x02
+#define AUDIO_CONTROL_OVERRUN_POLICY 0x03
+#define AUDIO_CONTROL_TIMESTAMPS 0x04
+#define AUDIO_CONTROL_PLAY_SOUND 0x05
+
+// Set by the app, read by the pusher
+static atomic_t audio_timestamps = ATOMIC_INIT(0);
+
+static ssize_t audio_control_write_handler(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    const uint8_t *data = (const uint8_t *)buf;
+    if (len < 1)
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    switch (data[0])
+    {
+    case AUDIO_CONTROL_LOSS_REPORT:
+        if (len < 2)
+        {
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+        }
+        LOG_DBG("App reported %u%% packet loss", data[1]);
+        codec_set_packet_loss(data[1]);
+        break;
+    case AUDIO_CONTROL_OVERRUN_POLICY:
+        if (len < 2)
+        {
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+        }
+        if (codec_set_overrun_policy(data[1]))
+        {
+            return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+        }
+        break;
+    case AUDIO_CONTROL_TIMESTAMPS:
+        if (len < 2)
+        {
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+        }
+        atomic_set(&audio_timestamps, data[1] != 0);
+        LOG_INF("Audio timestamps %s", data[1] ? "on" : "off");
+        break;
+#ifdef CONFIG_OMI_ENABLE_SPEAKER
+    case AUDIO_CONTROL_PLAY_SOUND: {
+        static const tone_pattern_t *const sounds[] = {&tone_boot_chime, &tone_notification};
+        if (len < 2)
+        {
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+        }
+        if (data[1] >= ARRAY_SIZE(sounds))
+        {
+            return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+        }
+        speaker_play_pattern(sounds[data[1]]);
+        break;
+    }
+#endif
+#ifdef CONFIG_OMI_MIC_BEAMFORMER
+    case AUDIO_CONTROL_BEAM_DIRECTION:
+        if (len < 2)
+        {
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+        }
+        if (beamformer_set_direction((int8_t)data[1]))
+        {
+            return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+        }
+        break;
+#endif
+    default:
+        LOG_WRN("Unknown audio control command: %u", data[0]);
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+
+    return len;
+}
+
+#define AUDIO_DIAG_RESET 0x01
+
+static ssize_t audio_diag_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+    uint8_t value[1 + AUDIO_DIAG_COUNT * sizeof(uint32_t)];
+    value[0] = codec_get_overrun_policy();
+    for (int i = 0; i < AUDIO_DIAG_COUNT; i++)
+    {
+        sys_put_le32(audio_diag_get(i), &value[1 + i * sizeof(uint32_t)]);
+    }
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+static ssize_t audio_diag_write_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    if (len != 1 || offset != 0)
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+    if (((const uint8_t *)buf)[0] != AUDIO_DIAG_RESET)
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+    audio_diag_reset();
+    LOG_INF("Audio diagnostics reset");
+    return len;
+}
+
+#ifdef CONFIG_OMI_ENERGY_LEDGER
+#define ENERGY_RESET 0x01
+
+static ssize_t energy_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+    uint8_t value[ENERGY_LEDGER_PACKED_SIZE];
+    size_t size = energy_pack(value, sizeof(value));
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, value, size);
+}
+
+static ssize_t energy_write_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    if (len != 1 || offset != 0)
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+    if (((const uint8_t *)buf)[0] != ENERGY_RESET)
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+    energy_reset();
+    LOG_INF("Energy ledger reset");
+    return len;
+}
+#endif
+
+#define CLOCK_SYNC_REQUEST 0x01
+#define CLOCK_SYNC_RESULT 0x02
+
+static ssize_t clock_sync_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+    uint8_t value[8 + 8 + 4 + 8];
+    size_t size = 8;
+    sys_put_le64(device_clock_us(), &value[0]);
+
+    device_clock_sync_t sync;
+    if (device_clock_get_sync(&sync) == 0)
+    {
+        sys_put_le64(sync.offset_us, &value[8]);
+        sys_put_le32(sync.delay_us, &value[16]);
+        sys_put_le64(sync.device_us, &value[20]);
+        size = sizeof(value);
+    }
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, value, size);
+}
+
+static ssize_t clock_sync_write_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    // As early as possible, everything until the reply goes into the device's processing time
+    int64_t received_us = device_clock_us();
+    const uint8_t *data = (const uint8_t *)buf;
+    if (len < 1 || offset != 0)
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    switch (data[0])
+    {
+    case CLOCK_SYNC_REQUEST:
+    {
+        if (len != 2)
+        {
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+        }
+        uint8_t reply[2 + 8 + 8];
+        reply[0] = CLOCK_SYNC_REQUEST;
+        reply[1] = data[1];
+        sys_put_le64(received_us, &reply[2]);
+        sys_put_le64(device_clock_us(), &reply[10]);
+        int err = bt_gatt_notify(conn, attr, reply, sizeof(reply));
+        if (err)
+        {
+            LOG_WRN("Clock sync reply failed: %d", err);
+        }
+        break;
+    }
+    case CLOCK_SYNC_RESULT:
+    {
+        if (len != 1 + 8 + 4)
+        {
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+        }
+        device_clock_sync_t sync = {
+            .offset_us = (int64_t)sys_get_le64(&data[1]),
+            .delay_us = sys_get_le32(&data[9]),
+            .device_us = received_us,
+        };
+        device_clock_set_sync(&sync);
+        LOG_INF("Clock synced, round trip %u us", sync.delay_us);
+        break;
+    }
+    default:
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+    return len;
+}
+
+#ifdef CONFIG_OMI_AUDIO_STATS
+
+#define AUDIO_STATS_VOICE 0x01
+#define AUDIO_STATS_VALUE_SIZE (1 + (3 + AUDIO_STATS_BANDS) * sizeof(uint16_t))
+
+static audio_stats_t audio_stats_latest;
+static struct k_spinlock audio_stats_lock;
+
+static void audio_stats_encode(uint8_t *value)
+{
+    k_spinlock_key_t key = k_spin_lock(&audio_stats_lock);
+    audio_stats_t stats = audio_stats_latest;
+    k_spin_unlock(&audio_stats_lock, key);
+
+    value[0] = stats.voice ? AUDIO_STATS_VOICE : 0;
+    sys_put_le16(stats.rms, &value[1]);
+    sys_put_le16(stats.peak, &value[3]);
+    sys_put_le16(stats.clipped, &value[5]);
+    for (int i = 0; i < AUDIO_STATS_BANDS; i++)
+    {
+        sys_put_le16(stats.bands[i], &value[7 + i * sizeof(uint16_t)]);
+    }
+}
+
+static ssize_t audio_stats_read_characteristic(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+    uint8_t value[AUDIO_STATS_VALUE_SIZE];
+    audio_stats_encode(value);
     return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
 }
 
+static void audio_stats_notify(struct k_work *work)
+{
+    struct bt_conn *conn = current_connection;
+    if (!conn)
+    {
+        return;
+    }
+    const struct bt_gatt_attr *attr = bt_gatt_find_by_uuid(audio_service.attrs, audio_service.attr_count, &audio_characteristic_stats_uuid.uuid);
+    if (!attr || !bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_NOTIFY))
+    {
+        return;
+    }
+
+    uint8_t value[AUDIO_STATS_VALUE_SIZE];
+    audio_stats_encode(value);
+    bt_gatt_notify(conn, attr, value, sizeof(value));
+}
+
+K_WORK_DEFINE(audio_stats_work, audio_stats_notify);
+
+// On the microphone thread, the notification goes out from the system workqueue
+static void audio_stats_handler(const audio_stats_t *stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&audio_stats_lock);
+    audio_stats_latest = *stats;
+    k_spin_unlock(&audio_stats_lock, key);
+    k_work_submit(&audio_stats_work);
+}
+
+#endif
+
 static ssize_t audio_data_write_handler(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
 {
+    int err = speak(len, buf);
+    if (err == -ENOMEM)
+    {
+        // Fail the write rather than pace the app for audio that was dropped
+        return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+    }
+    if (err < 0)
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
     uint16_t amount = 400;
-    int16_t *int16_buf = (int16_t *)buf;
-    uint8_t *data = (uint8_t *)buf;
     bt_gatt_notify(conn, attr, &amount, sizeof(amount));
-    amount = speak(len, buf);
     return len;
 }
 
@@ -174,35 +538,83 @@ static void exchange_func(struct bt_conn *conn, uint8_t att_err, struct bt_gatt_
 // Battery Service Handlers
 //
 
-#define BATTERY_REFRESH_INTERVAL 15000 // 15 seconds
-
 #ifdef CONFIG_OMI_ENABLE_BATTERY
 void broadcast_battery_level(struct k_work *work_item);
 
 K_WORK_DELAYABLE_DEFINE(battery_work, broadcast_battery_level);
 
 void broadcast_battery_level(struct k_work *work_item) {
-    uint16_t battery_millivolt;
-    uint8_t battery_percentage;
-    if (battery_get_millivolt(&battery_millivolt) == 0 &&
-        battery_get_percentage(&battery_percentage, battery_millivolt) == 0) {
-
-
-        LOG_PRINTK("Battery at %d mV (capacity %d%%)\n", battery_millivolt, battery_percentage);
-
-        // Use the Zephyr BAS function to set (and notify) the battery level
-        int err = bt_bas_set_battery_level(battery_percentage);
-        if (err) {
-            LOG_ERR("Error updating battery level: %d", err);
+    uint32_t load_ua = power_load_ua();
+    bool changed;
+    if (battery_update(load_ua, &changed) == 0) {
+        uint8_t battery_percentage;
+        uint16_t battery_millivolt;
+        battery_get_level(&battery_percentage, &battery_millivolt);
+
+        // Use the Zephyr BAS function to set (and notify) the battery level, only when it moved
+        if (changed) {
+            LOG_PRINTK("Battery at %d mV (capacity %d%%)\n", battery_millivolt, battery_percentage);
+            int err = bt_bas_set_battery_level(battery_percentage);
+            if (err) {
+                LOG_ERR("Error updating battery level: %d", err);
+            }
         }
     } else {
         LOG_ERR("Failed to read battery level");
     }
 
-    k_work_reschedule(&battery_work, K_MSEC(BATTERY_REFRESH_INTERVAL));
+    k_work_reschedule(&battery_work, K_MSEC(battery_update_interval_ms(load_ua)));
 }
 #endif
 
+//
+// Connection interval
+//
+
+// 7.5 ms, the shortest, while on external power: offline audio syncs at full speed
+#define TRANSPORT_FAST_INTERVAL 6
+#ifdef CONFIG_BT_GAP_AUTO_UPDATE_CONN_PARAMS
+// After the stack's own update to the preferred parameters, which would undo ours
+#define TRANSPORT_FAST_DELAY_MS (CONFIG_BT_CONN_PARAM_UPDATE_TIMEOUT + 1000)
+#else
+#define TRANSPORT_FAST_DELAY_MS 0
+#endif
+
+static atomic_t transport_fast = ATOMIC_INIT(0);
+
+static void conn_param_work_handler(struct k_work *work)
+{
+    struct bt_conn *conn = current_connection;
+    if (conn == NULL)
+    {
+        return;
+    }
+
+    struct bt_le_conn_param param = BT_LE_CONN_PARAM_INIT(CONFIG_BT_PERIPHERAL_PREF_MIN_INT, CONFIG_BT_PERIPHERAL_PREF_MAX_INT,
+                                                          CONFIG_BT_PERIPHERAL_PREF_LATENCY, CONFIG_BT_PERIPHERAL_PREF_TIMEOUT);
+    if (atomic_get(&transport_fast))
+    {
+        param.interval_min = TRANSPORT_FAST_INTERVAL;
+        param.interval_max = TRANSPORT_FAST_INTERVAL;
+        param.latency = 0;
+    }
+    int err = bt_conn_le_param_update(conn, &param);
+    if (err && err != -EALREADY)
+    {
+        LOG_ERR("Failed to request connection interval %u (err %d)", param.interval_max, err);
+    }
+}
+
+static K_WORK_DELAYABLE_DEFINE(conn_param_work, conn_param_work_handler);
+
+void transport_set_high_throughput(bool enable)
+{
+    if (atomic_set(&transport_fast, enable) != enable && current_connection != NULL)
+    {
+        k_work_reschedule(&conn_param_work, K_NO_WAIT);
+    }
+}
+
 //
 // Connection Callbacks
 //
@@ -226,6 +638,7 @@ static void _transport_connected(struct bt_conn *conn, uint8_t err)
     current_connection = bt_conn_ref(conn);
     uint16_t mtu = bt_gatt_get_mtu(conn);
     current_mtu = MAX(mtu, CONFIG_BT_L2CAP_TX_MTU);
+    current_tx_phy = BT_GAP_LE_PHY_1M;
 
     LOG_INF("Transport connected");
 
@@ -242,17 +655,27 @@ static void _transport_connected(struct bt_conn *conn, uint8_t err)
     k_sleep(K_MSEC(1000));
     update_data_length(current_connection);
     update_mtu(current_connection);
+    if (atomic_get(&transport_fast))
+    {
+        k_work_reschedule(&conn_param_work, K_MSEC(TRANSPORT_FAST_DELAY_MS));
+    }
 
 #ifdef CONFIG_OMI_ENABLE_BATTERY
-    k_work_schedule(&battery_work, K_MSEC(100)); // run immediately
+    // BAS already holds the cached level, a reading is only due if there is none yet
+    uint8_t battery_percentage;
+    if (battery_get_level(&battery_percentage, NULL) != 0) {
+        k_work_reschedule(&battery_work, K_MSEC(100));
+    }
 #endif
 
     is_connected = true;
+    power_set_input(POWER_INPUT_CONNECTED, true);
 }
 
 static void _transport_disconnected(struct bt_conn *conn, uint8_t err)
 {
     is_connected = false;
+    power_set_input(POWER_INPUT_CONNECTED | POWER_INPUT_SUBSCRIBED, false);
 #ifdef CONFIG_OMI_ENABLE_OFFLINE_STORAGE
     storage_is_on = false;
 #endif
@@ -286,6 +709,7 @@ static void _le_param_updated(struct bt_conn *conn, uint16_t interval, uint16_t
 static void _le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
 {
     LOG_INF("PHY updated: TX PHY %u, RX PHY %u", param->tx_phy, param->rx_phy);
+    current_tx_phy = param->tx_phy;
     // Detailed logging based on PHY type
     if (param->tx_phy == BT_CONN_LE_TX_POWER_PHY_1M) {
         LOG_INF("PHY updated. New PHY: 1M");
@@ -368,14 +792,16 @@ static void update_mtu(struct bt_conn *conn)
 //
 
 #define NET_BUFFER_HEADER_SIZE 3
-#define RING_BUFFER_HEADER_SIZE 2
+#define NET_BUFFER_TIMESTAMP_SIZE 4
+#define RING_BUFFER_HEADER_SIZE 6 // Size (le16) and capture time (le32)
 static uint8_t tx_queue[NETWORK_RING_BUF_SIZE * (CODEC_OUTPUT_MAX_BYTES + RING_BUFFER_HEADER_SIZE)];
 static uint8_t tx_buffer[CODEC_OUTPUT_MAX_BYTES + RING_BUFFER_HEADER_SIZE];
 static uint8_t tx_buffer_2[CODEC_OUTPUT_MAX_BYTES + RING_BUFFER_HEADER_SIZE];
 static uint32_t tx_buffer_size = 0;
+static uint32_t tx_buffer_capture_us = 0;
 static struct ring_buf ring_buf;
 
-static bool write_to_tx_queue(uint8_t *data, size_t size)
+static bool write_to_tx_queue(uint8_t *data, size_t size, uint32_t capture_us)
 {
     // Increment the counter
     write_to_tx_queue_count++;
@@ -388,6 +814,7 @@ static bool write_to_tx_queue(uint8_t *data, size_t size)
     // Copy data (TODO: Avoid this copy)
     tx_buffer_2[0] = size & 0xFF;
     tx_buffer_2[1] = (size >> 8) & 0xFF;
+    sys_put_le32(capture_us, &tx_buffer_2[2]);
     memcpy(tx_buffer_2 + RING_BUFFER_HEADER_SIZE, data, size);
 
     // Write to ring buffer
@@ -398,6 +825,7 @@ static bool write_to_tx_queue(uint8_t *data, size_t size)
     }
     else
     {
+        latency_probe_queued();
         return true;
     }
 }
@@ -417,6 +845,7 @@ static bool read_from_tx_queue()
 
     // Adjust size
     tx_buffer_size = tx_buffer[0] + (tx_buffer[1] << 8);
+    tx_buffer_capture_us = sys_get_le32(&tx_buffer[2]);
 
     return true;
 }
@@ -446,31 +875,39 @@ static bool push_to_gatt(struct bt_conn *conn)
     uint8_t index = 0;
     int retry_count = 0;
     const int max_retries = 3;
+    bool timestamps = atomic_get(&audio_timestamps);
 
     while (offset < tx_buffer_size)
     {
         uint32_t id = packet_next_index++;
-        uint32_t packet_size = MIN(current_mtu - NET_BUFFER_HEADER_SIZE, tx_buffer_size - offset);
+        uint32_t header_size = NET_BUFFER_HEADER_SIZE;
         pusher_temp_data[0] = id & 0xFF;
         pusher_temp_data[1] = (id >> 8) & 0xFF;
         pusher_temp_data[2] = index;
-        memcpy(pusher_temp_data + NET_BUFFER_HEADER_SIZE, buffer + offset, packet_size);
+        if (timestamps && index == 0)
+        {
+            sys_put_le32(tx_buffer_capture_us, &pusher_temp_data[header_size]);
+            header_size += NET_BUFFER_TIMESTAMP_SIZE;
+        }
+        uint32_t payload_size = MIN(current_mtu - header_size, tx_buffer_size - offset);
+        memcpy(pusher_temp_data + header_size, buffer + offset, payload_size);
+        uint32_t packet_size = header_size + payload_size;
 
-        offset += packet_size;
+        offset += payload_size;
         index++;
 
         retry_count = 0;
         while (retry_count < max_retries)
         {
             // Try send notification
-            int err = bt_gatt_notify(conn, &audio_service.attrs[1], pusher_temp_data, packet_size + NET_BUFFER_HEADER_SIZE);
+            int err = bt_gatt_notify(conn, &audio_service.attrs[1], pusher_temp_data, packet_size);
             gatt_notify_count++;
 
             // Log failure
             if (err)
             {
                 LOG_DBG("bt_gatt_notify failed (err %d)", err);
-                LOG_DBG("MTU: %d, packet_size: %d", current_mtu, packet_size + NET_BUFFER_HEADER_SIZE);
+                LOG_DBG("MTU: %d, packet_size: %d", current_mtu, packet_size);
                 k_sleep(K_MSEC(1));
                 retry_count++;
                 continue;
@@ -483,16 +920,20 @@ static bool push_to_gatt(struct bt_conn *conn)
                 continue;
             }
 
+            energy_radio_tx(packet_size, current_tx_phy);
+
             // Break if success
             break;
         }
 
         if (retry_count >= max_retries) {
             LOG_ERR("Failed to send packet after %d retries", max_retries);
+            latency_probe_sent(false);
             return false;
         }
     }
 
+    latency_probe_sent(true);
     return true;
 }
 
@@ -533,7 +974,7 @@ bool write_to_storage(void) {//max possible packing
         return false;
     }
 
-    uint8_t *buffer = tx_buffer+2;
+    uint8_t *buffer = tx_buffer + RING_BUFFER_HEADER_SIZE;
     uint8_t packet_size = (uint8_t)(tx_buffer_size + OPUS_PREFIX_LENGTH);
 
     // buffer_offset = buffer_offset+amount_to_fill;
@@ -851,6 +1292,10 @@ int transport_start()
     bt_gatt_service_register(&storage_service);
 #endif
 
+#ifdef CONFIG_OMI_AUDIO_STATS
+    audio_stats_set_callback(audio_stats_handler);
+#endif
+
     // Start advertising
     bt_gatt_service_register(&audio_service);
     err = bt_le_adv_start(BT_LE_ADV_CONN, bt_ad, ARRAY_SIZE(bt_ad), bt_sd, ARRAY_SIZE(bt_sd));
@@ -875,6 +1320,7 @@ int transport_start()
     else
     {
         LOG_INF("Battery initialized");
+        k_work_schedule(&battery_work, K_NO_WAIT);
     }
 #endif
 
@@ -905,11 +1351,25 @@ struct bt_conn *get_current_connection()
     return current_connection;
 }
 
-int broadcast_audio_packets(uint8_t *buffer, size_t size)
+int broadcast_audio_packets(uint8_t *buffer, size_t size, int64_t capture_us)
 {
-    if (!write_to_tx_queue(buffer, size))
+    // The app unwraps the low 32 bits against the clock sync, a frame every few ms never skips a wrap
+    if (!write_to_tx_queue(buffer, size, (uint32_t)capture_us))
     {
+        audio_diag_add(AUDIO_DIAG_TX_DROPS, 1);
         return -1;
     }
     return 0;
 }
+
+void transport_get_stream_state(uint16_t *packet_index, bool *timestamps)
+{
+    *packet_index = packet_next_index;
+    *timestamps = atomic_get(&audio_timestamps);
+}
+
+void transport_set_stream_state(uint16_t packet_index, bool timestamps)
+{
+    packet_next_index = packet_index;
+    atomic_set(&audio_timestamps, timestamps);
+}
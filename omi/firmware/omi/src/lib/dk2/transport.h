@@ -11,6 +11,23 @@
  */
 int transport_start();
 int transport_off();
-int broadcast_audio_packets(uint8_t *buffer, size_t size);
+// capture_us is the device_clock_us time of the frame's first sample
+int broadcast_audio_packets(uint8_t *buffer, size_t size, int64_t capture_us);
 struct bt_conn *get_current_connection();
+
+/**
+ * @brief Ask for the shortest connection interval, for the fastest transfers
+ *
+ * Meant for while the device is on external power. Safe from any context,
+ * applied to the current connection and every later one.
+ */
+void transport_set_high_throughput(bool enable);
+
+/**
+ * @brief The audio packet counter and the timestamps setting, kept across auto-off
+ *
+ * Set before the app connects, the stream then carries on where it stopped.
+ */
+void transport_get_stream_state(uint16_t *packet_index, bool *timestamps);
+void transport_set_stream_state(uint16_t packet_index, bool timestamps);
 #endif
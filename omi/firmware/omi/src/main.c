@@ -4,12 +4,19 @@
 #include <zephyr/pm/device_runtime.h>
 #include "lib/dk2/mic.h"
 #include "lib/dk2/codec.h"
+#include "lib/dk2/audio_frontend.h"
+#include "lib/dk2/echo_canceller.h"
+#include "lib/dk2/audio_stats.h"
 #include "lib/dk2/config.h"
 #include "lib/dk2/transport.h"
 #include "lib/dk2/lib/battery/battery.h"
 #include "lib/dk2/led.h"
 #include "lib/dk2/button.h"
 #include "lib/dk2/haptic.h"
+#include "lib/dk2/motion.h"
+#include "lib/dk2/power.h"
+#include "lib/dk2/auto_off.h"
+#include "lib/dk2/resume_state.h"
 #include "spi_flash.h"
 #include "sd_card.h"
 
@@ -25,28 +32,72 @@ uint32_t total_mic_buffer_bytes = 0;
 uint32_t broadcast_audio_count = 0;
 uint32_t write_to_tx_queue_count = 0;
 
-static void codec_handler(uint8_t *data, size_t len)
+static void codec_handler(uint8_t *data, size_t len, int64_t capture_us)
 {
     broadcast_audio_count++;
-    int err = broadcast_audio_packets(data, len);
+    int err = broadcast_audio_packets(data, len, capture_us);
     if (err)
     {
         LOG_ERR("Failed to broadcast audio packets: %d", err);
     }
 }
 
-static void mic_handler(int16_t *buffer)
+static void mic_handler(int16_t *buffer, size_t samples, int64_t capture_us)
 {
     // Track total bytes processed (each sample is 2 bytes)
-    total_mic_buffer_bytes += 1;
+    total_mic_buffer_bytes += samples * 2;
 
-    int err = codec_receive_pcm(buffer, MIC_BUFFER_SAMPLES);
-    if (err)
+#ifdef CONFIG_OMI_ECHO_CANCELLER
+    // Both run on device_clock_us
+    echo_canceller_process(buffer, samples, capture_us * ECHO_REFERENCE_RATE / 1000000);
+#endif
+#ifdef CONFIG_OMI_AUDIO_STATS
+    // Ahead of the AGC, which asks it for voice activity
+    audio_stats_process(buffer, samples);
+    if (audio_stats_voice_active())
+    {
+        auto_off_activity();
+    }
+#endif
+#ifdef CONFIG_OMI_AUDIO_FRONTEND
+    audio_frontend_process(buffer, samples);
+#endif
+
+    int err = codec_receive_pcm(buffer, samples, capture_us);
+    // Overruns are counted on the audio diagnostics characteristic, logging each one would only add to them
+    if (err && err != -ENOBUFS)
     {
         LOG_ERR("Failed to process PCM data: %d", err);
     }
 }
 
+// Filter history, gains and noise floors from before a capture gap don't fit
+// what comes after it
+static void mic_restart_handler(void)
+{
+#ifdef CONFIG_OMI_ECHO_CANCELLER
+    echo_canceller_init();
+#endif
+#ifdef CONFIG_OMI_AUDIO_STATS
+    audio_stats_init();
+#endif
+#ifdef CONFIG_OMI_AUDIO_FRONTEND
+    audio_frontend_init();
+#endif
+}
+
+#ifdef CONFIG_OMI_MOTION_DETECTION
+static void motion_handler(motion_state_t state)
+{
+#ifdef CONFIG_OMI_MOTION_MIC_OFF
+    // Nobody wears it: an empty room would only fill the battery and the SD card
+    power_set_input(POWER_INPUT_WORN, state != MOTION_REMOVED);
+#endif
+    // Put down starts the idle countdown, not yet knowing holds it
+    auto_off_set_moving(state != MOTION_ON_TABLE && state != MOTION_REMOVED);
+}
+#endif
+
 static void boot_led_sequence(void)
 {
     // Red blink
@@ -75,41 +126,41 @@ static void boot_led_sequence(void)
     set_led_blue(false);
 }
 
-void set_led_state()
+// Red while waiting for the app, blue once connected, green on the charger and
+// a short green flash once the battery is full. The connection layer is cleared
+// when turned off, the charger still shows.
+static const led_pattern_t led_advertising = {.claim = LED_RED | LED_BLUE, .color = LED_RED};
+static const led_pattern_t led_connected = {.claim = LED_RED | LED_BLUE, .color = LED_BLUE};
+static const led_pattern_t led_charging = {.claim = LED_GREEN, .color = LED_GREEN};
+static const led_pattern_t led_charged = {.claim = LED_GREEN, .color = LED_GREEN, .on_ms = 100, .off_ms = 2900};
+static const led_pattern_t led_error = {.claim = LED_ALL, .color = LED_RED, .on_ms = 100, .off_ms = 100};
+
+// LEDs follow the connection state, updated on each change instead of polled
+static void power_state_handler(power_state_t state)
 {
-    // Set LED state based on connection and charging status
-    if (is_charging)
+    const led_pattern_t *connection = NULL;
+    if (state != POWER_OFF)
     {
-        set_led_green(true);
-    }
-    else
-    {
-        set_led_green(false);
-    }
-
-    // If device is off, turn off all status LEDs except charging indicator
-    if (is_off)
-    {
-        set_led_red(false);
-        set_led_blue(false);
-        return;
-    }
-
-    if (is_connected)
-    {
-        set_led_blue(true);
-        set_led_red(false);
-        return;
+        connection = is_connected ? &led_connected : &led_advertising;
     }
+    led_set_pattern(LED_LAYER_CONNECTION, connection);
+}
 
-    // Not connected - RED
-    if (!is_connected)
-    {
-        set_led_red(true);
-        set_led_blue(false);
-        return;
-    }
+#ifdef CONFIG_OMI_ENABLE_BATTERY
+// From the charger debounce timer, the power state follows on its own
+static void charger_handler(charger_state_t state)
+{
+    static const led_pattern_t *const patterns[] = {
+        [CHARGER_UNPLUGGED] = NULL,
+        [CHARGER_CHARGING] = &led_charging,
+        [CHARGER_COMPLETE] = &led_charged,
+    };
+    led_set_pattern(LED_LAYER_CHARGING, patterns[state]);
+    // Nothing to save on the charger, sync as fast as the link goes
+    transport_set_high_throughput(state != CHARGER_UNPLUGGED);
+    auto_off_set_charging(state != CHARGER_UNPLUGGED);
 }
+#endif
 
 static int suspend_unused_modules(void)
 {
@@ -129,7 +180,7 @@ static int suspend_unused_modules(void)
 }
 
 
-int main(void)
+static int omi_init(void)
 {
     int ret;
 
@@ -155,8 +206,12 @@ int main(void)
         return ret;
     }
 
-    // Run the boot LED sequence
-    boot_led_sequence();
+    // Run the boot LED sequence, unless waking up from an auto-off the user never saw
+    bool resuming = resume_state_pending();
+    if (!resuming)
+    {
+        boot_led_sequence();
+    }
 
     // Initialize battery
 #ifdef CONFIG_OMI_ENABLE_BATTERY
@@ -173,6 +228,7 @@ int main(void)
         LOG_ERR("Battery failed to start (err %d)", ret);
         return ret;
     }
+    battery_set_charger_callback(charger_handler);
     LOG_INF("Battery initialized");
 #endif
 
@@ -200,6 +256,11 @@ int main(void)
     }
 #endif
 
+#ifdef CONFIG_OMI_MOTION_DETECTION
+    // Ahead of the transport, which starts the accelerometer
+    motion_set_callback(motion_handler);
+#endif
+
     // Indicate transport initialization
     LOG_PRINTK("\n");
     LOG_INF("Initializing transport...\n");
@@ -224,10 +285,16 @@ int main(void)
         LOG_ERR("Failed to start codec: %d", ret);
         return ret;
     }
+    if (resuming)
+    {
+        resume_state_restore();
+    }
 
     // Initialize microphone
     LOG_INF("Initializing microphone...\n");
+    mic_restart_handler();
     set_mic_callback(mic_handler);
+    set_mic_restart_callback(mic_restart_handler);
     ret = mic_start();
     if (ret)
     {
@@ -235,19 +302,29 @@ int main(void)
         return ret;
     }
 
-    LOG_INF("Device initialized successfully\n");
-
-    while (1) {
-        // Log total mic buffer bytes processed, GATT notify count, broadcast count, and write_to_tx_queue count
-        LOG_INF("Total mic buffer bytes: %u, GATT notify count: %u, Broadcast count: %u, TX queue writes: %u",
-                total_mic_buffer_bytes, gatt_notify_count, broadcast_audio_count, write_to_tx_queue_count);
+    // Start in the power state for the current connection and charger
+    power_set_callback(power_state_handler);
+    ret = power_start();
+    if (ret)
+    {
+        LOG_ERR("Failed to start power management: %d", ret);
+        return ret;
+    }
+    auto_off_start();
 
-        // Update LED state based on connection and charging status
-        set_led_state();
+    LOG_INF("Device initialized successfully\n");
+    return 0;
+}
 
-        k_msleep(1000);
+int main(void)
+{
+    int ret = omi_init();
+    if (ret)
+    {
+        // Fast red blink over everything else
+        led_set_pattern(LED_LAYER_ERROR, &led_error);
     }
 
-    printk("Exiting omi...");
-    return 0;
+    // Everything from here on runs from events, main has nothing left to poll
+    return ret;
 }
@@ -4,10 +4,16 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <stdlib.h>
 #include <zephyr/kernel.h>
 #include <zephyr/audio/dmic.h>
+#include <zephyr/drivers/gpio.h>
 #include <zephyr/logging/log.h>
 #include "lib/dk2/mic.h"
+#include "lib/dk2/beamformer.h"
+#include "lib/dk2/audio_diag.h"
+#include "lib/dk2/device_clock.h"
+#include "lib/dk2/energy.h"
 
 LOG_MODULE_REGISTER(mic, CONFIG_LOG_DEFAULT_LEVEL);
 
@@ -15,52 +21,317 @@ LOG_MODULE_REGISTER(mic, CONFIG_LOG_DEFAULT_LEVEL);
 #define SAMPLE_BIT_WIDTH 16
 #define BYTES_PER_SAMPLE sizeof(int16_t)
 
+/* Both microphones are captured when the beamformer combines them on-device. */
+#ifdef CONFIG_OMI_MIC_BEAMFORMER
+#define MIC_CHANNELS 2
+#else
+#define MIC_CHANNELS 1
+#endif
+
 /* Milliseconds to wait for a block to be read. */
 #define READ_TIMEOUT 1000
 
-/* Size of a block for 100 ms of audio data. */
+/* Size of a block for CONFIG_OMI_MIC_BLOCK_MS of audio data. */
+#define BLOCK_DURATION_MS CONFIG_OMI_MIC_BLOCK_MS
 #define BLOCK_SIZE(sample_rate, number_of_channels) \
-    (BYTES_PER_SAMPLE * (sample_rate / 10) * number_of_channels)
+    (BYTES_PER_SAMPLE * (sample_rate * BLOCK_DURATION_MS / 1000) * number_of_channels)
+
+/* Blocks captured after an acoustic wake, held back until the wake is confirmed. */
+#ifdef CONFIG_OMI_ENABLE_MIC_AAD
+#define WAKE_HOLD_BLOCKS DIV_ROUND_UP(CONFIG_OMI_MIC_AAD_CONFIRM_MS, BLOCK_DURATION_MS)
+#else
+#define WAKE_HOLD_BLOCKS 0
+#endif
+
+/* Audio the slab can hold while the capture thread is held up. Smaller blocks
+ * need more of them to ride out the same stall.
+ */
+#define QUEUE_DURATION_MS 200
+#define QUEUE_BLOCKS MAX(4, DIV_ROUND_UP(QUEUE_DURATION_MS, BLOCK_DURATION_MS))
 
 /* Driver will allocate blocks from this slab to receive audio data into them.
  * Application, after getting a given block from the driver and processing its
  * data, needs to free that block.
  */
-#define MAX_BLOCK_SIZE BLOCK_SIZE(MAX_SAMPLE_RATE, 2)
-#define BLOCK_COUNT 4
+#define MAX_BLOCK_SIZE BLOCK_SIZE(MAX_SAMPLE_RATE, MIC_CHANNELS)
+#define BLOCK_COUNT (QUEUE_BLOCKS + WAKE_HOLD_BLOCKS)
 
 K_MEM_SLAB_DEFINE_STATIC(mem_slab, MAX_BLOCK_SIZE, BLOCK_COUNT, 4);
 
 static const struct device *dmic_dev;
 static volatile mix_handler callback_func = NULL;
+static volatile mic_restart_handler restart_func = NULL;
 static volatile bool mic_running = false;
 
-static void process_audio_buffer(void *buffer, uint32_t size)
+/* Follows every DMIC START and STOP, for the energy ledger */
+static void mic_set_running(bool running)
+{
+    mic_running = running;
+    energy_set_active(ENERGY_PDM, running);
+}
+
+/* Given whenever the capture thread has to re-evaluate mic_running */
+static K_SEM_DEFINE(mic_run_sem, 0, 1);
+
+/* Serializes mic_on() and mic_off() with the capture thread's handling of a
+ * block, which owns the AAD state and the held wake blocks in between. Never
+ * held across dmic_read().
+ */
+static K_MUTEX_DEFINE(mic_lock);
+
+/* Capture times of the blocks, owned by the capture thread. Restarted with
+ * every DMIC START, since the sample clock stops in between.
+ */
+static capture_timeline_t capture_timeline;
+static volatile bool capture_restarted = true;
+
+#ifdef CONFIG_OMI_ENABLE_MIC_AAD
+static const struct gpio_dt_spec mic_thsel = GPIO_DT_SPEC_GET_OR(DT_NODELABEL(pdm_thsel_pin), gpios, {0});
+static const struct gpio_dt_spec mic_wake = GPIO_DT_SPEC_GET_OR(DT_NODELABEL(pdm_wake_pin), gpios, {0});
+static struct gpio_callback mic_wake_cb;
+static bool aad_available = false; // THSEL driven and the WAKE interrupt set up
+
+typedef enum {
+    MIC_AAD_ACTIVE,    // PDM running, blocks go to the codec
+    MIC_AAD_LISTENING, // PDM and HFXO stopped, waiting for the WAKE line
+    MIC_AAD_ARMING,    // PDM restarted by a wake, blocks held until activity is confirmed
+} mic_aad_state_t;
+
+static volatile mic_aad_state_t aad_state = MIC_AAD_ACTIVE;
+static volatile bool aad_wake_pending = false;
+static uint32_t aad_silent_ms = 0;
+static void *wake_hold_blocks[WAKE_HOLD_BLOCKS];
+static int64_t wake_hold_times[WAKE_HOLD_BLOCKS];
+static uint8_t wake_hold_count = 0;
+#endif
+
+static void process_audio_buffer(void *buffer, uint32_t size, int64_t capture_us)
 {
+    size_t frames = size / (BYTES_PER_SAMPLE * MIC_CHANNELS);
+
+#ifdef CONFIG_OMI_MIC_BEAMFORMER
+    // Collapse the interleaved pair into one channel in place
+    beamformer_process((int16_t *)buffer, (int16_t *)buffer, frames);
+#endif
+
     if (callback_func) {
-        callback_func((int16_t *)buffer);
+        callback_func((int16_t *)buffer, frames, capture_us);
     }
     k_mem_slab_free(&mem_slab, buffer);
 }
 
+#ifdef CONFIG_OMI_ENABLE_MIC_AAD
+
+static uint32_t block_level(const int16_t *samples, uint32_t count)
+{
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        sum += abs(samples[i]);
+    }
+    return count ? sum / count : 0;
+}
+
+static void mic_wake_handler(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+    // One shot: the line is re-armed the next time the pipeline goes idle
+    gpio_pin_interrupt_configure_dt(&mic_wake, GPIO_INT_DISABLE);
+    aad_wake_pending = true;
+    k_sem_give(&mic_run_sem);
+}
+
+static void wake_hold_release(bool deliver)
+{
+    for (uint8_t i = 0; i < wake_hold_count; i++) {
+        if (deliver) {
+            process_audio_buffer(wake_hold_blocks[i], BLOCK_SIZE(MAX_SAMPLE_RATE, MIC_CHANNELS), wake_hold_times[i]);
+        } else {
+            k_mem_slab_free(&mem_slab, wake_hold_blocks[i]);
+        }
+    }
+    wake_hold_count = 0;
+}
+
+/* Back to plain capture, dropping a pending wake and any held blocks */
+static void aad_disarm(void)
+{
+    if (mic_wake.port) {
+        gpio_pin_interrupt_configure_dt(&mic_wake, GPIO_INT_DISABLE);
+    }
+    aad_wake_pending = false;
+    wake_hold_release(false);
+    aad_state = MIC_AAD_ACTIVE;
+    aad_silent_ms = 0;
+}
+
+static void aad_enter_listening(void)
+{
+    int ret = dmic_trigger(dmic_dev, DMIC_TRIGGER_STOP);
+    if (ret < 0) {
+        LOG_ERR("STOP trigger failed: %d", ret);
+        return;
+    }
+
+    // The PDM driver drops its HFXO request on STOP, so nothing but the
+    // microphone's own AAD block stays powered in this state.
+    aad_state = MIC_AAD_LISTENING;
+    aad_silent_ms = 0;
+    aad_wake_pending = false;
+    mic_set_running(false);
+
+    if (mic_wake.port) {
+        gpio_pin_interrupt_configure_dt(&mic_wake, GPIO_INT_EDGE_TO_ACTIVE);
+    }
+    LOG_INF("Microphone idle, listening for acoustic activity");
+}
+
+static void aad_wake(void)
+{
+    int ret = dmic_trigger(dmic_dev, DMIC_TRIGGER_START);
+    if (ret < 0) {
+        LOG_ERR("START trigger failed: %d", ret);
+        aad_enter_listening();
+        return;
+    }
+
+    aad_state = MIC_AAD_ARMING;
+    capture_restarted = true;
+    mic_set_running(true);
+    LOG_INF("Acoustic activity wake");
+}
+
+static void aad_process_block(void *buffer, uint32_t size, int64_t capture_us)
+{
+    uint32_t level = block_level((int16_t *)buffer, size / BYTES_PER_SAMPLE);
+    bool active = level >= CONFIG_OMI_MIC_AAD_LEVEL_THRESHOLD;
+
+    if (aad_state == MIC_AAD_ARMING) {
+        wake_hold_times[wake_hold_count] = capture_us;
+        wake_hold_blocks[wake_hold_count++] = buffer;
+        if (active) {
+            // Confirmed: hand the codec everything captured since the wake
+            LOG_INF("Wake confirmed, resuming audio pipeline");
+            wake_hold_release(true);
+            aad_state = MIC_AAD_ACTIVE;
+            aad_silent_ms = 0;
+        } else if (wake_hold_count >= WAKE_HOLD_BLOCKS) {
+            LOG_DBG("False acoustic wake (level %u)", level);
+            wake_hold_release(false);
+            aad_enter_listening();
+        }
+        return;
+    }
+
+    aad_silent_ms = active ? 0 : aad_silent_ms + BLOCK_DURATION_MS;
+    process_audio_buffer(buffer, size, capture_us);
+
+    if (aad_available && aad_silent_ms >= CONFIG_OMI_MIC_AAD_IDLE_TIMEOUT_MS) {
+        aad_enter_listening();
+    }
+}
+
+/* Ahead of the first DMIC START */
+static int aad_init(void)
+{
+    if (!mic_wake.port || !mic_thsel.port) {
+        LOG_WRN("No pdm_wake_pin or pdm_thsel_pin, acoustic wake disabled");
+        return -ENODEV;
+    }
+
+    // THSEL high enables the T5838's AAD thresholds, as lib/evt/mic.c and
+    // lib/dk2/mic.c drive it with the microphone on. It stays high from here,
+    // so the microphone has it with the PDM clock running and the AAD takes
+    // over at every STOP.
+    int ret = gpio_pin_configure_dt(&mic_thsel, GPIO_OUTPUT_ACTIVE);
+    if (ret < 0) {
+        LOG_ERR("Failed to drive THSEL: %d", ret);
+        return ret;
+    }
+
+    ret = gpio_pin_configure_dt(&mic_wake, GPIO_INPUT);
+    if (ret < 0) {
+        LOG_ERR("Failed to configure the wake pin: %d", ret);
+        return ret;
+    }
+
+    gpio_init_callback(&mic_wake_cb, mic_wake_handler, BIT(mic_wake.pin));
+    ret = gpio_add_callback(mic_wake.port, &mic_wake_cb);
+    if (ret < 0) {
+        return ret;
+    }
+    aad_available = true;
+    return 0;
+}
+
+#endif
+
 static void mic_thread_function(void *p1, void *p2, void *p3)
 {
     ARG_UNUSED(p1);
     ARG_UNUSED(p2);
     ARG_UNUSED(p3);
 
-    while (mic_running) {
+    while (1) {
         void *buffer;
         uint32_t size;
 
+        k_mutex_lock(&mic_lock, K_FOREVER);
+#ifdef CONFIG_OMI_ENABLE_MIC_AAD
+        if (aad_wake_pending) {
+            aad_wake_pending = false;
+            if (aad_state == MIC_AAD_LISTENING) {
+                aad_wake();
+            }
+        }
+#endif
+        bool running = mic_running;
+        k_mutex_unlock(&mic_lock);
+
+        if (!running) {
+            // Nothing to capture, sleep until mic_on() or a wake interrupt
+            k_sem_take(&mic_run_sem, K_FOREVER);
+            continue;
+        }
+
         int ret = dmic_read(dmic_dev, 0, &buffer, &size, READ_TIMEOUT);
+        int64_t completed_us = device_clock_us();
         if (ret < 0) {
+            audio_diag_add(AUDIO_DIAG_MIC_UNDERRUNS, 1);
             LOG_ERR("Read failed: %d", ret);
+            capture_timeline_reset(&capture_timeline);
             continue;
         }
 
+        k_mutex_lock(&mic_lock, K_FOREVER);
+        if (!mic_running) {
+            // Stopped while this block was being read
+            k_mem_slab_free(&mem_slab, buffer);
+            k_mutex_unlock(&mic_lock);
+            continue;
+        }
+
+        if (capture_restarted) {
+            capture_restarted = false;
+            capture_timeline_reset(&capture_timeline);
+            if (restart_func) {
+                restart_func();
+            }
+        }
+        int64_t capture_us = capture_timeline_update(&capture_timeline, completed_us, BLOCK_DURATION_MS * 1000);
+
+        audio_diag_add(AUDIO_DIAG_MIC_BLOCKS, 1);
+        if (k_mem_slab_num_free_get(&mem_slab) == 0) {
+            // The driver has nowhere to put the next capture until this block is freed
+            audio_diag_add(AUDIO_DIAG_MIC_OVERRUNS, 1);
+            capture_timeline_reset(&capture_timeline);
+        }
+
         LOG_DBG("Got buffer %p of %u bytes", buffer, size);
-        process_audio_buffer(buffer, size);
+#ifdef CONFIG_OMI_ENABLE_MIC_AAD
+        aad_process_block(buffer, size, capture_us);
+#else
+        process_audio_buffer(buffer, size, capture_us);
+#endif
+        k_mutex_unlock(&mic_lock);
     }
 }
 
@@ -101,9 +372,21 @@ int mic_start()
         },
     };
 
+    cfg.channel.req_num_chan = MIC_CHANNELS;
+#ifdef CONFIG_OMI_MIC_BEAMFORMER
+    /* Both microphones share DIN, one on each clock edge */
+    cfg.channel.req_chan_map_lo = dmic_build_channel_map(0, 0, PDM_CHAN_LEFT) |
+                                  dmic_build_channel_map(1, 0, PDM_CHAN_RIGHT);
+
+    ret = beamformer_init();
+    if (ret < 0) {
+        LOG_ERR("Failed to initialize the beamformer: %d", ret);
+        return ret;
+    }
+#else
     /* Configure for mono audio */
-    cfg.channel.req_num_chan = 1;
     cfg.channel.req_chan_map_lo = dmic_build_channel_map(0, 0, PDM_CHAN_LEFT);
+#endif
     cfg.streams[0].pcm_rate = MAX_SAMPLE_RATE;
     cfg.streams[0].block_size = BLOCK_SIZE(cfg.streams[0].pcm_rate, cfg.channel.req_num_chan);
 
@@ -116,15 +399,22 @@ int mic_start()
         return ret;
     }
 
+#ifdef CONFIG_OMI_ENABLE_MIC_AAD
+    ret = aad_init();
+    if (ret < 0) {
+        LOG_ERR("Failed to initialize acoustic wake: %d", ret);
+    }
+#endif
+
     ret = dmic_trigger(dmic_dev, DMIC_TRIGGER_START);
     if (ret < 0) {
         LOG_ERR("START trigger failed: %d", ret);
         return ret;
     }
 
-    mic_running = true;
+    mic_set_running(true);
     k_thread_start(mic_thread_id);
-    
+
     LOG_INF("Microphone started");
     return 0;
 }
@@ -134,33 +424,67 @@ void set_mic_callback(mix_handler callback)
     callback_func = callback;
 }
 
+void set_mic_restart_callback(mic_restart_handler callback)
+{
+    restart_func = callback;
+}
+
 void mic_off()
 {
+    k_mutex_lock(&mic_lock, K_FOREVER);
+#ifdef CONFIG_OMI_ENABLE_MIC_AAD
+    // While listening the PDM is already stopped and nothing is held
+    aad_disarm();
+#endif
+
     if (mic_running) {
-        mic_running = false;
-        k_thread_abort(mic_thread_id);
-        
+        mic_set_running(false);
+
         int ret = dmic_trigger(dmic_dev, DMIC_TRIGGER_STOP);
         if (ret < 0) {
             LOG_ERR("STOP trigger failed: %d", ret);
         }
-        
+
         LOG_INF("Microphone stopped");
     }
+    k_mutex_unlock(&mic_lock);
+}
+
+int mic_arm_wakeup(void)
+{
+#ifdef CONFIG_OMI_ENABLE_MIC_AAD
+    if (!aad_available) {
+        return -ENODEV;
+    }
+    // With the PDM clock stopped the microphone's AAD block keeps listening,
+    // its WAKE line brings the system back from off
+    return gpio_pin_interrupt_configure_dt(&mic_wake, GPIO_INT_LEVEL_ACTIVE);
+#else
+    return -ENOTSUP;
+#endif
 }
 
 void mic_on()
 {
+    k_mutex_lock(&mic_lock, K_FOREVER);
+#ifdef CONFIG_OMI_ENABLE_MIC_AAD
+    // Started here, a later wake must not start the running stream again
+    if (aad_state == MIC_AAD_LISTENING) {
+        aad_disarm();
+    }
+#endif
+
     if (!mic_running) {
         int ret = dmic_trigger(dmic_dev, DMIC_TRIGGER_START);
         if (ret < 0) {
             LOG_ERR("START trigger failed: %d", ret);
-            return;
+        } else {
+            capture_restarted = true;
+            mic_set_running(true);
+            k_sem_give(&mic_run_sem);
+
+            LOG_INF("Microphone restarted");
         }
-        
-        mic_running = true;
-        k_thread_start(mic_thread_id);
-        
-        LOG_INF("Microphone restarted");
     }
+    k_mutex_unlock(&mic_lock);
 }
@@ -0,0 +1,168 @@
+// Host unit test for the battery state of charge estimator (omi/src/lib/dk2/battery_estimator.c)
+//
+// Simulates a cell following the same discharge profile: the terminal voltage is
+// the open circuit voltage for the true charge, minus the drop across the internal
+// resistance under load, plus ADC noise. Readings are taken at the intervals the
+// estimator asks for, the way transport.c schedules them.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "battery_estimator.h"
+#include "bench_check.h"
+
+#define CAPACITY_MAH 150
+#define RESISTANCE_MOHM 400
+#define NOISE_MV 20
+
+// Inverse of battery_ocv_percent, by bisection over the voltage
+static float ocv_millivolt(float percent)
+{
+    float low = 3300, high = 4200;
+    for (int i = 0; i < 30; i++)
+    {
+        float mid = (low + high) / 2;
+        if (battery_ocv_percent((uint16_t)mid) < percent)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return high;
+}
+
+static uint16_t terminal_millivolt(float percent, uint32_t load_ua, bool charging)
+{
+    float noise = (float)(rand() % (2 * NOISE_MV + 1) - NOISE_MV);
+    float drop = charging ? 0 : (float)load_ua * RESISTANCE_MOHM / 1000000.0f;
+    return (uint16_t)(ocv_millivolt(percent) - drop + noise);
+}
+
+static void test_ocv_curve(void)
+{
+    CHECK(battery_ocv_percent(4300) == 100, "above full is %f", battery_ocv_percent(4300));
+    CHECK(battery_ocv_percent(3000) == 0, "below empty is %f", battery_ocv_percent(3000));
+    CHECK(fabsf(battery_ocv_percent(3860) - 58) < 0.01f, "3860 mV is %f, expected 58", battery_ocv_percent(3860));
+    CHECK(battery_ocv_percent(4090) == 91, "profile point is %f", battery_ocv_percent(4090));
+
+    float previous = 0;
+    for (uint16_t mv = 3300; mv <= 4200; mv += 5)
+    {
+        float percent = battery_ocv_percent(mv);
+        CHECK(percent >= previous, "curve falls at %u mV", mv);
+        previous = percent;
+    }
+}
+
+static void test_discharge_tracks_and_stays_monotonic(void)
+{
+    battery_estimator_t estimator;
+    battery_estimator_init(&estimator, CAPACITY_MAH, RESISTANCE_MOHM);
+    srand(1);
+
+    const uint32_t load_ua = 10000;
+    float truth = 90;
+    int64_t now = 0;
+    int notifications = 0;
+    float worst = 0;
+    uint8_t reported = 100;
+    bool increased = false;
+
+    // Four hours, about 27 %
+    while (now < 4 * 3600000LL)
+    {
+        if (battery_estimator_update(&estimator, terminal_millivolt(truth, load_ua, false), load_ua, false, now))
+        {
+            notifications++;
+        }
+        uint8_t percent = battery_estimator_percent(&estimator);
+        increased |= percent > reported;
+        reported = percent;
+        if (now > 600000)
+        {
+            worst = fmaxf(worst, fabsf(percent - truth));
+        }
+
+        uint32_t interval = battery_estimator_interval_ms(&estimator, load_ua);
+        truth -= 100.0f * load_ua / 1000.0f * interval / 3600000.0f / CAPACITY_MAH;
+        now += interval;
+    }
+
+    CHECK(worst < 4, "estimate off by %.1f %%", worst);
+    CHECK(!increased, "percentage rose while discharging");
+    // One per percent and the first reading, noise causes none
+    CHECK(notifications <= 30, "%d notifications for a 27 %% drop", notifications);
+}
+
+static void test_load_compensation(void)
+{
+    battery_estimator_t estimator;
+    battery_estimator_init(&estimator, CAPACITY_MAH, RESISTANCE_MOHM);
+
+    // A heavy load drops the voltage of a 60 % cell by 60 mV
+    const uint32_t load_ua = 150000;
+    uint16_t millivolt = (uint16_t)(ocv_millivolt(60) - 60);
+    battery_estimator_update(&estimator, millivolt, load_ua, false, 0);
+    uint8_t percent = battery_estimator_percent(&estimator);
+    CHECK(abs(percent - 60) <= 1, "compensated estimate %u %%", percent);
+    CHECK(battery_ocv_percent(millivolt) < 55, "the raw reading should have looked lower");
+}
+
+static void test_charging(void)
+{
+    battery_estimator_t estimator;
+    battery_estimator_init(&estimator, CAPACITY_MAH, RESISTANCE_MOHM);
+    srand(2);
+
+    float truth = 40;
+    int64_t now = 0;
+    battery_estimator_update(&estimator, terminal_millivolt(truth, 5000, false), 5000, false, now);
+
+    uint8_t reported = 0;
+    bool decreased = false;
+    for (int i = 0; i < 120; i++)
+    {
+        uint32_t interval = battery_estimator_interval_ms(&estimator, 5000);
+        CHECK(i == 0 || interval == BATTERY_INTERVAL_MIN_MS, "charging sampled every %u ms", interval);
+        now += interval;
+        truth = fminf(truth + 0.5f, 100); // 2 %/min
+        battery_estimator_update(&estimator, terminal_millivolt(truth, 0, true), 5000, true, now);
+        uint8_t percent = battery_estimator_percent(&estimator);
+        decreased |= i > 0 && percent < reported;
+        reported = percent;
+    }
+    CHECK(!decreased, "percentage fell while charging");
+    CHECK(reported >= 90, "only %u %% after charging to %.0f %%", reported, truth);
+}
+
+static void test_interval(void)
+{
+    battery_estimator_t estimator;
+    battery_estimator_init(&estimator, CAPACITY_MAH, RESISTANCE_MOHM);
+    CHECK(battery_estimator_interval_ms(&estimator, 5000) == BATTERY_INTERVAL_MIN_MS, "no reading yet");
+
+    battery_estimator_update(&estimator, (uint16_t)ocv_millivolt(80), 0, false, 0);
+    CHECK(battery_estimator_interval_ms(&estimator, 1000) == BATTERY_INTERVAL_MAX_MS, "light load not at the longest");
+    // 1 % of 150 mAh is 1.5 mAh, 135 s at 40 mA
+    uint32_t heavy = battery_estimator_interval_ms(&estimator, 40000);
+    CHECK(heavy == 67500, "heavy load sampled every %u ms", heavy);
+
+    battery_estimator_init(&estimator, CAPACITY_MAH, RESISTANCE_MOHM);
+    battery_estimator_update(&estimator, (uint16_t)ocv_millivolt(8), 0, false, 0);
+    CHECK(battery_estimator_interval_ms(&estimator, 1000) == BATTERY_INTERVAL_MIN_MS, "low battery not watched closely");
+}
+
+int main(void)
+{
+    test_ocv_curve();
+    test_discharge_tracks_and_stays_monotonic();
+    test_load_compensation();
+    test_charging();
+    test_interval();
+
+    return bench_check_result();
+}
@@ -0,0 +1,240 @@
+// Host unit test for the dual-microphone beamformer (omi/src/lib/dk2/beamformer.c)
+//
+// Far-field sources are simulated as sums of sinusoids, so every microphone gets an exact
+// fractional delay. Built twice by CMakeLists.txt: delay-and-sum only, and with the adaptive
+// sidelobe canceller (CONFIG_OMI_MIC_BEAMFORMER_ADAPTIVE).
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "beamformer.h"
+#include "bench_check.h"
+
+#define RATE 16000
+#define BLOCK 320
+#define SECONDS 6
+#define FRAMES (RATE * SECONDS)
+#define SPACING_MM 20.0 // CONFIG_OMI_MIC_SPACING_MM
+#define STEER 90        // CONFIG_OMI_MIC_BEAM_ANGLE
+#define COMPONENTS 24
+
+// Fractional-delay centre, plus the canceller's look-ahead
+#ifdef CONFIG_OMI_MIC_BEAMFORMER_ADAPTIVE
+#define LATENCY_SAMPLES (1.5 + 8)
+#else
+#define LATENCY_SAMPLES 1.5
+#endif
+
+typedef struct
+{
+    double hz[COMPONENTS];
+    double phase[COMPONENTS];
+    double amplitude; // Per component
+    int count;
+} source_t;
+
+static double lcg_uniform(uint32_t *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return (*state >> 8) / (double)(1 << 24);
+}
+
+static void noise_source(source_t *source, double low_hz, double high_hz, double amplitude, uint32_t seed)
+{
+    source->count = COMPONENTS;
+    source->amplitude = amplitude;
+    for (int i = 0; i < COMPONENTS; i++)
+    {
+        source->hz[i] = low_hz + (high_hz - low_hz) * lcg_uniform(&seed);
+        source->phase[i] = 2 * M_PI * lcg_uniform(&seed);
+    }
+}
+
+static double source_at(const source_t *source, double t)
+{
+    double value = 0;
+    for (int i = 0; i < source->count; i++)
+    {
+        value += source->amplitude * sin(2 * M_PI * source->hz[i] * t + source->phase[i]);
+    }
+    return value;
+}
+
+// Arrival offset in seconds, the left microphone sits at +spacing/2 on the axis
+static double arrival(int angle_deg, int left)
+{
+    double half = SPACING_MM / 2 / 343000.0 * sin(angle_deg * M_PI / 180);
+    return left ? -half : half;
+}
+
+static int16_t mic_sample(const source_t *target, int target_angle, const source_t *interferer, int interferer_angle,
+                          int left, size_t n, int target_on)
+{
+    double t = (double)n / RATE;
+    double value = 0;
+    if (target && target_on)
+    {
+        value += source_at(target, t - arrival(target_angle, left));
+    }
+    if (interferer)
+    {
+        value += source_at(interferer, t - arrival(interferer_angle, left));
+    }
+    return (int16_t)lrint(value);
+}
+
+static int burst_on(size_t n, double burst_s)
+{
+    return burst_s <= 0 || ((size_t)(n / (burst_s * RATE)) % 2) == 0;
+}
+
+#ifdef CONFIG_OMI_MIC_BEAMFORMER_ADAPTIVE
+
+// Amplitude of the hz component while the target burst is on, by projection
+static double tone_amplitude(const int16_t *samples, size_t from, size_t to, double hz, double burst_s)
+{
+    double re = 0, im = 0;
+    size_t count = 0;
+    for (size_t n = from; n < to; n++)
+    {
+        if (burst_on(n, burst_s))
+        {
+            re += samples[n] * cos(2 * M_PI * hz * n / RATE);
+            im += samples[n] * sin(2 * M_PI * hz * n / RATE);
+            count++;
+        }
+    }
+    return 2 * sqrt(re * re + im * im) / count;
+}
+
+// Power between the target bursts, i.e. what is left of the interferer
+static double pause_power(const int16_t *samples, size_t from, size_t to, double burst_s)
+{
+    double total = 0;
+    size_t count = 0;
+    for (size_t n = from; n < to; n++)
+    {
+        if (!burst_on(n, burst_s))
+        {
+            total += (double)samples[n] * samples[n];
+            count++;
+        }
+    }
+    return total / count;
+}
+
+#endif
+
+static int16_t stereo[2 * FRAMES];
+static int16_t left_only[FRAMES];
+static int16_t output[FRAMES];
+
+static void run(const source_t *target, int target_angle, const source_t *interferer, int interferer_angle,
+                double burst_s)
+{
+    for (size_t n = 0; n < FRAMES; n++)
+    {
+        // Target in bursts, so the canceller sees interference-only stretches like speech pauses
+        int on = burst_on(n, burst_s);
+        stereo[2 * n] = mic_sample(target, target_angle, interferer, interferer_angle, 1, n, on);
+        stereo[2 * n + 1] = mic_sample(target, target_angle, interferer, interferer_angle, 0, n, on);
+        left_only[n] = stereo[2 * n];
+    }
+
+    beamformer_init();
+    for (size_t offset = 0; offset < FRAMES; offset += BLOCK)
+    {
+        // In place, as omi/src/mic.c calls it
+        beamformer_process(&stereo[2 * offset], &stereo[2 * offset], BLOCK);
+        memcpy(&output[offset], &stereo[2 * offset], BLOCK * sizeof(int16_t));
+    }
+}
+
+static void test_direction_range(void)
+{
+    CHECK(beamformer_set_direction(91) == -EINVAL, "accepted 91 degrees");
+    CHECK(beamformer_set_direction(-91) == -EINVAL, "accepted -91 degrees");
+    CHECK(beamformer_set_direction(-45) == 0 && beamformer_get_direction() == -45, "did not steer to -45");
+}
+
+static void test_steer_waits_for_block(void)
+{
+    // Steers between blocks only take effect at the next one, the last one wins
+    int16_t input[2 * BLOCK], once[BLOCK], twice[BLOCK];
+    uint32_t seed = 3;
+    for (size_t i = 0; i < 2 * BLOCK; i++)
+    {
+        input[i] = (int16_t)(8000 * (lcg_uniform(&seed) - 0.5));
+    }
+
+    beamformer_init();
+    beamformer_set_direction(-30);
+    beamformer_process(input, once, BLOCK);
+
+    beamformer_init();
+    beamformer_set_direction(60);
+    beamformer_set_direction(-30);
+    CHECK(beamformer_get_direction() == -30, "reported %d degrees", beamformer_get_direction());
+    beamformer_process(input, twice, BLOCK);
+
+    CHECK(memcmp(once, twice, sizeof(once)) == 0, "block differs from a single steer to the last angle");
+}
+
+static void test_beam_direction_passes(void)
+{
+    // Broadband source in the beam: the output is the source, late but undistorted
+    source_t target;
+    noise_source(&target, 100, 3000, 400, 1);
+    run(&target, STEER, NULL, 0, 0);
+
+    double error = 0, power = 0;
+    for (size_t n = RATE; n < FRAMES; n++)
+    {
+        double expected = source_at(&target, (n - LATENCY_SAMPLES) / RATE);
+        error += (output[n] - expected) * (output[n] - expected);
+        power += expected * expected;
+    }
+    double snr = 10 * log10(power / error);
+    CHECK(snr > 25, "beam-direction source reconstructed at %.1f dB SNR", snr);
+}
+
+#ifdef CONFIG_OMI_MIC_BEAMFORMER_ADAPTIVE
+
+static void test_interferer_cancelled(void)
+{
+    // Wearer's voice as a 500 Hz tone in the beam, a talker at the opposite end of the axis
+    source_t target = {.hz = {500}, .phase = {0}, .amplitude = 4000, .count = 1};
+    source_t interferer;
+    noise_source(&interferer, 150, 3500, 250, 2);
+    const double burst_s = 0.2;
+    run(&target, STEER, &interferer, -STEER, burst_s);
+
+    // Last two seconds, well after convergence. The output lags by 1.5 + 8 samples,
+    // which only shaves the edges of the bursts.
+    size_t from = (SECONDS - 2) * RATE;
+    double in_amplitude = tone_amplitude(left_only, from, FRAMES, 500, burst_s);
+    double out_amplitude = tone_amplitude(output, from, FRAMES, 500, burst_s);
+    double sir_in = 10 * log10(in_amplitude * in_amplitude / 2 / pause_power(left_only, from, FRAMES, burst_s));
+    double sir_out = 10 * log10(out_amplitude * out_amplitude / 2 / pause_power(output, from, FRAMES, burst_s));
+    double target_gain = 20 * log10(out_amplitude / in_amplitude);
+
+    // Two microphones 20 mm apart can't null much below a few hundred Hz, where the
+    // difference branch has almost no energy, so this is about what a converged canceller gets
+    printf("SIR %.1f dB -> %.1f dB, target %.2f dB\n", sir_in, sir_out, target_gain);
+    CHECK(sir_out - sir_in > 8, "SIR only improved by %.1f dB", sir_out - sir_in);
+    CHECK(fabs(target_gain) < 1.0, "beam-direction tone changed by %.2f dB", target_gain);
+}
+
+#endif
+
+int main(void)
+{
+    test_direction_range();
+    test_steer_waits_for_block();
+    test_beam_direction_passes();
+#ifdef CONFIG_OMI_MIC_BEAMFORMER_ADAPTIVE
+    test_interferer_cancelled();
+#endif
+
+    return bench_check_result();
+}
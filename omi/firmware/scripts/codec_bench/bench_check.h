@@ -0,0 +1,34 @@
+#ifndef BENCH_CHECK_H
+#define BENCH_CHECK_H
+
+// Checks shared by the host unit tests: CHECK reports a failed condition and
+// carries on, main returns bench_check_result() at the end.
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                     \
+    do                                       \
+    {                                        \
+        if (!(cond))                         \
+        {                                    \
+            printf("FAIL %s: ", __func__);   \
+            printf(__VA_ARGS__);             \
+            printf("\n");                    \
+            failures++;                      \
+        }                                    \
+    } while (0)
+
+static inline int bench_check_result(void)
+{
+    if (failures)
+    {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,131 @@
+// Host unit test for the button gesture state machine (omi/src/lib/dk2/button_fsm.c)
+//
+// Plays edge sequences the way button.c drives the machine: edges in order, and the
+// timeout whenever the clock passes the deadline. Every gesture is reported with the
+// time it was decided at.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "button_fsm.h"
+#include "bench_check.h"
+
+#define MAX_GESTURES 8
+
+static button_gesture_t gestures[MAX_GESTURES];
+static int64_t gesture_times[MAX_GESTURES];
+static int gesture_count;
+static int wakeups;
+
+static void record(button_gesture_t gesture, int64_t now_ms)
+{
+    if (gesture != BUTTON_GESTURE_NONE && gesture_count < MAX_GESTURES)
+    {
+        gestures[gesture_count] = gesture;
+        gesture_times[gesture_count++] = now_ms;
+    }
+}
+
+// Alternating press and release times, starting with a press; then runs out the clock
+static void play(const int64_t *edges, int count)
+{
+    button_fsm_t fsm;
+    button_fsm_init(&fsm);
+    gesture_count = 0;
+    wakeups = 0;
+
+    for (int i = 0; i <= count; i++)
+    {
+        int64_t next = i < count ? edges[i] : INT64_MAX;
+        int64_t deadline;
+        while ((deadline = button_fsm_deadline(&fsm)) >= 0 && deadline <= next)
+        {
+            wakeups++;
+            record(button_fsm_timeout(&fsm, deadline), deadline);
+        }
+        if (i < count)
+        {
+            wakeups++;
+            record(button_fsm_input(&fsm, i % 2 == 0, edges[i]), edges[i]);
+        }
+    }
+    CHECK(button_fsm_deadline(&fsm) < 0, "a timeout still pending after the sequence");
+}
+
+static void test_single_tap(void)
+{
+    const int64_t edges[] = {1000, 1120};
+    play(edges, 2);
+    CHECK(gesture_count == 1 && gestures[0] == BUTTON_GESTURE_SINGLE_TAP, "%d gestures, first %d", gesture_count,
+          gestures[0]);
+    CHECK(gesture_times[0] == 1120 + BUTTON_DOUBLE_TAP_GAP_MS, "single tap decided at %lld",
+          (long long)gesture_times[0]);
+    // Press, release and the one deadline, nothing polls
+    CHECK(wakeups == 3, "%d wakeups for a tap", wakeups);
+}
+
+static void test_double_tap(void)
+{
+    const int64_t edges[] = {1000, 1100, 1250, 1350};
+    play(edges, 4);
+    CHECK(gesture_count == 1 && gestures[0] == BUTTON_GESTURE_DOUBLE_TAP, "%d gestures, first %d", gesture_count,
+          gestures[0]);
+    CHECK(gesture_times[0] == 1350, "double tap decided at %lld", (long long)gesture_times[0]);
+}
+
+static void test_taps_too_far_apart(void)
+{
+    const int64_t edges[] = {1000, 1100, 1100 + BUTTON_DOUBLE_TAP_GAP_MS + 50, 1100 + BUTTON_DOUBLE_TAP_GAP_MS + 150};
+    play(edges, 4);
+    CHECK(gesture_count == 2 && gestures[0] == BUTTON_GESTURE_SINGLE_TAP && gestures[1] == BUTTON_GESTURE_SINGLE_TAP,
+          "%d gestures instead of two single taps", gesture_count);
+}
+
+static void test_long_press(void)
+{
+    const int64_t edges[] = {1000, 3000};
+    play(edges, 2);
+    CHECK(gesture_count == 2 && gestures[0] == BUTTON_GESTURE_LONG_PRESS && gestures[1] == BUTTON_GESTURE_RELEASE,
+          "%d gestures instead of long press and release", gesture_count);
+    CHECK(gesture_times[0] == 1000 + BUTTON_LONG_PRESS_MS, "long press reported at %lld, while still held",
+          (long long)gesture_times[0]);
+}
+
+static void test_medium_press_is_release(void)
+{
+    const int64_t edges[] = {1000, 1600};
+    play(edges, 2);
+    CHECK(gesture_count == 1 && gestures[0] == BUTTON_GESTURE_RELEASE, "%d gestures, first %d", gesture_count,
+          gestures[0]);
+}
+
+static void test_tap_then_hold(void)
+{
+    const int64_t edges[] = {1000, 1100, 1200, 4000};
+    play(edges, 4);
+    CHECK(gesture_count == 2 && gestures[0] == BUTTON_GESTURE_LONG_PRESS && gestures[1] == BUTTON_GESTURE_RELEASE,
+          "%d gestures instead of long press and release", gesture_count);
+}
+
+static void test_idle_has_no_deadline(void)
+{
+    button_fsm_t fsm;
+    button_fsm_init(&fsm);
+    CHECK(button_fsm_deadline(&fsm) < 0, "idle button asks for a wakeup");
+    CHECK(button_fsm_timeout(&fsm, 100000) == BUTTON_GESTURE_NONE, "idle timeout produced a gesture");
+    // A stray release, e.g. held through boot
+    CHECK(button_fsm_input(&fsm, false, 10) == BUTTON_GESTURE_NONE && button_fsm_deadline(&fsm) < 0,
+          "release without a press changed state");
+}
+
+int main(void)
+{
+    test_single_tap();
+    test_double_tap();
+    test_taps_too_far_apart();
+    test_long_press();
+    test_medium_press_is_release();
+    test_tap_then_hold();
+    test_idle_has_no_deadline();
+
+    return bench_check_result();
+}
@@ -0,0 +1,792 @@
+// Host benchmark for the firmware audio codecs.
+//
+// Runs 16 kHz mono speech through every codec backend with the same framing as
+// codec_entry (backend->frame_samples per encode call), decodes it again and
+// reports throughput, packet sizes and quality. With --check it compares the
+// results against a baseline file and exits non-zero on a regression.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zephyr/sys/byteorder.h>
+
+#include "config.h"
+#include "codec.h"
+#include "lib/opus-1.2.1/opus.h"
+
+#define SAMPLE_RATE 16000
+#define MAX_FRAME_SAMPLES CODEC_PACKAGE_SAMPLES
+#define MAX_DELAY_SAMPLES 960 // Search window for the codec delay, 60ms
+#define SEGMENT_SAMPLES 320   // Segmental SNR window, 20ms
+#define SPECTRUM_BINS (SEGMENT_SAMPLES / 2 + 1)
+#define SYNTHETIC_SECONDS 12
+
+#ifdef CONFIG_OMI_CODEC_OPUS_HYBRID
+#define OPUS_LABEL "opus-hybrid"
+#else
+#define OPUS_LABEL "opus"
+#endif
+
+//
+// Input
+//
+
+typedef struct
+{
+    int16_t *samples;
+    size_t count;
+} pcm_t;
+
+static uint32_t lcg_state;
+
+static uint32_t lcg_next(void)
+{
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return lcg_state;
+}
+
+// [-1, 1)
+static double lcg_noise(void)
+{
+    return (double)(lcg_next() >> 8) / (double)(1 << 23) - 1.0;
+}
+
+typedef struct
+{
+    double f1, f2, f3;
+} vowel_t;
+
+static const vowel_t vowels[] = {
+    {730, 1090, 2440}, // a
+    {270, 2290, 3010}, // i
+    {300, 870, 2240},  // u
+    {530, 1840, 2480}, // e
+    {570, 840, 2410},  // o
+};
+
+typedef struct
+{
+    double y1, y2;
+} resonator_t;
+
+static double resonate(resonator_t *r, double x, double freq, double bandwidth)
+{
+    double radius = exp(-M_PI * bandwidth / SAMPLE_RATE);
+    double a1 = 2.0 * radius * cos(2.0 * M_PI * freq / SAMPLE_RATE);
+    double a2 = -radius * radius;
+    double y = (1.0 - radius) * x + a1 * r->y1 + a2 * r->y2;
+    r->y2 = r->y1;
+    r->y1 = y;
+    return y;
+}
+
+// Deterministic speech-like test signal: voiced vowels with gliding pitch,
+// fricative noise bursts and pauses, so the bench runs without a corpus.
+static pcm_t synthesize_speech(void)
+{
+    pcm_t pcm = {.count = SYNTHETIC_SECONDS * SAMPLE_RATE};
+    pcm.samples = calloc(pcm.count, sizeof(int16_t));
+    lcg_state = 0x5EED;
+
+    resonator_t formants[3] = {0};
+    double phase = 0;
+    double fricative_hp = 0;
+    size_t i = 0;
+    while (i < pcm.count)
+    {
+        uint32_t kind = lcg_next() % 8;
+        size_t length = SAMPLE_RATE / 10 + lcg_next() % (SAMPLE_RATE / 4);
+        const vowel_t *vowel = &vowels[lcg_next() % ARRAY_SIZE(vowels)];
+        double f0_start = 90 + lcg_next() % 130;
+        double f0_end = f0_start * (0.8 + (lcg_next() % 40) / 100.0);
+        double gain = 0.2 + (lcg_next() % 60) / 100.0;
+
+        for (size_t n = 0; n < length && i < pcm.count; n++, i++)
+        {
+            double progress = (double)n / length;
+            double envelope = sin(M_PI * progress);
+            double sample = 0;
+            if (kind < 5)
+            {
+                // Voiced: band limited glottal pulse train through three formants
+                double f0 = f0_start + (f0_end - f0_start) * progress;
+                phase += f0 / SAMPLE_RATE;
+                if (phase >= 1.0)
+                {
+                    phase -= 1.0;
+                }
+                double source = phase < 0.4 ? sin(M_PI * phase / 0.4) : 0;
+                source += 0.02 * lcg_noise();
+                sample = resonate(&formants[0], source, vowel->f1, 80) +
+                         0.5 * resonate(&formants[1], source, vowel->f2, 120) +
+                         0.25 * resonate(&formants[2], source, vowel->f3, 160);
+                sample *= 3.0;
+            }
+            else if (kind < 7)
+            {
+                // Fricative: high passed noise
+                double noise = lcg_noise();
+                sample = 0.3 * (noise - fricative_hp);
+                fricative_hp = noise;
+            }
+            else
+            {
+                // Pause with a little room noise
+                sample = 0.002 * lcg_noise();
+                envelope = 1.0;
+            }
+            pcm.samples[i] = (int16_t)lrint(CLAMP(sample * gain * envelope * 32767.0, -32768.0, 32767.0));
+        }
+    }
+    return pcm;
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+// 16 kHz mono 16-bit PCM only, the rate and format the microphone delivers
+static int read_wav(const char *path, pcm_t *pcm)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return -ENOENT;
+    }
+
+    uint8_t header[12];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4))
+    {
+        fprintf(stderr, "%s: not a WAV file\n", path);
+        fclose(file);
+        return -EINVAL;
+    }
+
+    bool format_ok = false;
+    uint8_t chunk[8];
+    while (fread(chunk, 1, sizeof(chunk), file) == sizeof(chunk))
+    {
+        uint32_t size = read_le32(chunk + 4);
+        if (!memcmp(chunk, "fmt ", 4))
+        {
+            uint8_t fmt[16];
+            if (size < sizeof(fmt) || fread(fmt, 1, sizeof(fmt), file) != sizeof(fmt))
+            {
+                break;
+            }
+            format_ok = read_le16(fmt) == 1 && read_le16(fmt + 2) == 1 && read_le32(fmt + 4) == SAMPLE_RATE && read_le16(fmt + 14) == 16;
+            fseek(file, size - sizeof(fmt) + (size & 1), SEEK_CUR);
+        }
+        else if (!memcmp(chunk, "data", 4))
+        {
+            if (!format_ok)
+            {
+                break;
+            }
+            pcm->count = size / sizeof(int16_t);
+            pcm->samples = malloc(size);
+            pcm->count = fread(pcm->samples, sizeof(int16_t), pcm->count, file);
+            fclose(file);
+            return 0;
+        }
+        else
+        {
+            fseek(file, size + (size & 1), SEEK_CUR);
+        }
+    }
+
+    fprintf(stderr, "%s: expected 16 kHz mono 16-bit PCM\n", path);
+    fclose(file);
+    return -EINVAL;
+}
+
+//
+// Reference decoders, the receiving side of each backend
+//
+
+typedef struct
+{
+    const codec_backend_t *backend;
+    const char *label;
+    int (*decoder_init)(void);
+    // NULL packet means lost, next is the following packet if it arrived (for FEC)
+    int (*decode)(const uint8_t *packet, size_t len, const uint8_t *next, size_t next_len, int16_t *output, size_t samples);
+} bench_codec_t;
+
+static OpusDecoder *opus_decoder;
+static OpusDecoder *opus_plc_decoder; // Scratch copy of opus_decoder
+static size_t fec_recovered;          // Lost frames rebuilt from the next packet's LBRR data
+
+static int opus_ref_init(void)
+{
+    int err;
+    if (opus_decoder)
+    {
+        opus_decoder_destroy(opus_decoder);
+    }
+    if (!opus_plc_decoder)
+    {
+        opus_plc_decoder = malloc(opus_decoder_get_size(1));
+    }
+    opus_decoder = opus_decoder_create(SAMPLE_RATE, 1, &err);
+    return err == OPUS_OK ? 0 : -EINVAL;
+}
+
+static int opus_ref_decode(const uint8_t *packet, size_t len, const uint8_t *next, size_t next_len, int16_t *output, size_t samples)
+{
+    int decoded;
+    if (packet)
+    {
+        decoded = opus_decode(opus_decoder, packet, len, output, samples, 0);
+    }
+    else if (next)
+    {
+        // Recover from the LBRR copy in the next packet. Without one Opus falls back to PLC, so the
+        // same step is concealed on a copy of the state to tell the two apart.
+        int16_t concealed[MAX_FRAME_SAMPLES];
+        memcpy(opus_plc_decoder, opus_decoder, opus_decoder_get_size(1));
+        int plc = opus_decode(opus_plc_decoder, NULL, 0, concealed, samples, 0);
+        decoded = opus_decode(opus_decoder, next, next_len, output, samples, 1);
+        if (decoded > 0 && (decoded != plc || memcmp(output, concealed, decoded * sizeof(int16_t))))
+        {
+            fec_recovered++;
+        }
+    }
+    else
+    {
+        decoded = opus_decode(opus_decoder, NULL, 0, output, samples, 0);
+    }
+    return decoded < 0 ? -EIO : decoded;
+}
+
+static int16_t mulaw_decode_sample(uint8_t value)
+{
+    value = ~value;
+    int32_t magnitude = ((((value & 0x0F) << 3) + 0x84) << ((value >> 4) & 0x07)) - 0x84;
+    return (value & 0x80) ? -magnitude : magnitude;
+}
+
+static int stateless_init(void)
+{
+    return 0;
+}
+
+static int mulaw_ref_decode(const uint8_t *packet, size_t len, const uint8_t *next, size_t next_len, int16_t *output, size_t samples)
+{
+    for (size_t i = 0; i < samples; i++)
+    {
+        output[i] = packet && i < len ? mulaw_decode_sample(packet[i]) : 0;
+    }
+    return samples;
+}
+
+static const int8_t adpcm_index_table[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+static const int16_t adpcm_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static int adpcm_ref_decode(const uint8_t *packet, size_t len, const uint8_t *next, size_t next_len, int16_t *output, size_t samples)
+{
+    if (!packet || len < CODEC_ADPCM_HEADER_SIZE + samples / 2)
+    {
+        memset(output, 0, samples * sizeof(int16_t));
+        return samples;
+    }
+
+    // Every packet carries the state, so a loss never propagates
+    int32_t predictor = (int16_t)sys_get_le16(packet);
+    int32_t index = packet[2];
+    for (size_t i = 0; i < samples; i++)
+    {
+        uint8_t byte = packet[CODEC_ADPCM_HEADER_SIZE + i / 2];
+        uint8_t nibble = (i & 1) ? byte >> 4 : byte & 0x0F;
+        int32_t step = adpcm_step_table[index];
+        int32_t delta = step >> 3;
+        if (nibble & 4)
+        {
+            delta += step;
+        }
+        if (nibble & 2)
+        {
+            delta += step >> 1;
+        }
+        if (nibble & 1)
+        {
+            delta += step >> 2;
+        }
+        predictor += (nibble & 8) ? -delta : delta;
+        predictor = CLAMP(predictor, INT16_MIN, INT16_MAX);
+        index = CLAMP(index + adpcm_index_table[nibble], 0, 88);
+        output[i] = predictor;
+    }
+    return samples;
+}
+
+static const bench_codec_t bench_codecs[] = {
+    {&codec_opus_backend, OPUS_LABEL, opus_ref_init, opus_ref_decode},
+    {&codec_mulaw_backend, "mulaw", stateless_init, mulaw_ref_decode},
+    {&codec_adpcm_backend, "adpcm", stateless_init, adpcm_ref_decode},
+};
+
+//
+// Run
+//
+
+typedef struct
+{
+    char key[32];
+    size_t frames;
+    size_t lost;
+    size_t recovered; // Lost frames decoded from FEC data rather than concealed
+    double encode_seconds;
+    int bytes_min, bytes_max, bytes_p50, bytes_p95;
+    double bytes_mean;
+    double kbps;
+    int delay;
+    double snr_db;
+    double segsnr_db;
+    double specsnr_db;
+    double plc_segsnr_db; // Segmental SNR with every lost frame concealed, FEC ignored
+} bench_result_t;
+
+static int compare_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Delay with the best normalized cross correlation, over at most the first 4 seconds
+static int find_delay(const int16_t *reference, const int16_t *decoded, size_t count)
+{
+    size_t window = MIN(count, (size_t)SAMPLE_RATE * 4);
+    if (window <= MAX_DELAY_SAMPLES)
+    {
+        return 0;
+    }
+    window -= MAX_DELAY_SAMPLES;
+
+    int best = 0;
+    double best_score = -1;
+    for (int delay = 0; delay < MAX_DELAY_SAMPLES; delay++)
+    {
+        double cross = 0, energy = 0;
+        for (size_t i = 0; i < window; i++)
+        {
+            cross += (double)reference[i] * decoded[i + delay];
+            energy += (double)decoded[i + delay] * decoded[i + delay];
+        }
+        double score = energy > 0 ? cross / sqrt(energy) : 0;
+        if (score > best_score)
+        {
+            best_score = score;
+            best = delay;
+        }
+    }
+    return best;
+}
+
+// Windowed DFT magnitudes of one segment
+static void segment_spectrum(const int16_t *samples, double *magnitude)
+{
+    static double window[SEGMENT_SAMPLES];
+    static double cosines[SEGMENT_SAMPLES];
+    if (window[SEGMENT_SAMPLES / 2] == 0)
+    {
+        for (int i = 0; i < SEGMENT_SAMPLES; i++)
+        {
+            window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / SEGMENT_SAMPLES);
+            cosines[i] = cos(2 * M_PI * i / SEGMENT_SAMPLES);
+        }
+    }
+
+    for (int k = 0; k < SPECTRUM_BINS; k++)
+    {
+        double re = 0, im = 0;
+        for (int i = 0; i < SEGMENT_SAMPLES; i++)
+        {
+            double x = samples[i] * window[i];
+            int phase = (k * i) % SEGMENT_SAMPLES;
+            re += x * cosines[phase];
+            im -= x * cosines[(phase + SEGMENT_SAMPLES * 3 / 4) % SEGMENT_SAMPLES];
+        }
+        magnitude[k] = sqrt(re * re + im * im);
+    }
+}
+
+static void measure_quality(const pcm_t *input, const int16_t *decoded, size_t decoded_count, bench_result_t *result)
+{
+    result->delay = find_delay(input->samples, decoded, decoded_count);
+    size_t count = MIN(input->count, decoded_count - result->delay);
+
+    double signal = 0, noise = 0, segsnr = 0, specsnr = 0;
+    size_t segments = 0;
+    for (size_t start = 0; start + SEGMENT_SAMPLES <= count; start += SEGMENT_SAMPLES)
+    {
+        double seg_signal = 0, seg_noise = 0;
+        for (size_t i = start; i < start + SEGMENT_SAMPLES; i++)
+        {
+            double s = input->samples[i];
+            double e = s - decoded[i + result->delay];
+            seg_signal += s * s;
+            seg_noise += e * e;
+        }
+        signal += seg_signal;
+        noise += seg_noise;
+
+        // Only segments with speech in them, clamped like the usual segmental SNR
+        if (seg_signal / SEGMENT_SAMPLES > 100.0 * 100.0)
+        {
+            double snr = 10 * log10(seg_signal / MAX(seg_noise, 1.0));
+            segsnr += CLAMP(snr, -10.0, 35.0);
+            segments++;
+
+            // Magnitude only, so phase changes a perceptual codec is free to make don't count as noise
+            double reference[SPECTRUM_BINS], coded[SPECTRUM_BINS];
+            double spec_signal = 0, spec_noise = 0;
+            segment_spectrum(&input->samples[start], reference);
+            segment_spectrum(&decoded[start + result->delay], coded);
+            for (int k = 0; k < SPECTRUM_BINS; k++)
+            {
+                double e = reference[k] - coded[k];
+                spec_signal += reference[k] * reference[k];
+                spec_noise += e * e;
+            }
+            snr = 10 * log10(spec_signal / MAX(spec_noise, 1.0));
+            specsnr += CLAMP(snr, -10.0, 35.0);
+        }
+    }
+    result->snr_db = 10 * log10(signal / MAX(noise, 1.0));
+    result->segsnr_db = segments ? segsnr / segments : 0;
+    result->specsnr_db = segments ? specsnr / segments : 0;
+}
+
+// With fec, a lost frame is decoded from the next packet if that one arrived
+static void decode_stream(const bench_codec_t *codec, uint8_t (*packets)[CODEC_OUTPUT_MAX_BYTES], const int *sizes,
+                          const bool *lost, size_t frames, size_t frame, bool fec, int16_t *decoded)
+{
+    for (size_t f = 0; f < frames; f++)
+    {
+        bool next_ok = fec && f + 1 < frames && !lost[f + 1];
+        int samples = codec->decode(lost[f] ? NULL : packets[f], sizes[f],
+                                    next_ok ? packets[f + 1] : NULL, next_ok ? sizes[f + 1] : 0,
+                                    &decoded[f * frame], frame);
+        if (samples < 0)
+        {
+            memset(&decoded[f * frame], 0, frame * sizeof(int16_t));
+        }
+    }
+}
+
+static int run_codec(const bench_codec_t *codec, const pcm_t *input, int loss_percent, bench_result_t *result)
+{
+    const codec_backend_t *backend = codec->backend;
+    size_t frame = backend->frame_samples;
+    size_t frames = input->count / frame;
+
+    memset(result, 0, sizeof(*result));
+    if (loss_percent)
+    {
+        snprintf(result->key, sizeof(result->key), "%s@%d", codec->label, loss_percent);
+    }
+    else
+    {
+        snprintf(result->key, sizeof(result->key), "%s", codec->label);
+    }
+    result->frames = frames;
+
+    if (backend->init() < 0 || codec->decoder_init() < 0)
+    {
+        fprintf(stderr, "%s: init failed\n", codec->label);
+        return -EINVAL;
+    }
+    if (backend->set_packet_loss)
+    {
+        // As if the app had reported this loss rate, see codec_set_packet_loss
+        backend->set_packet_loss(loss_percent);
+    }
+
+    uint8_t (*packets)[CODEC_OUTPUT_MAX_BYTES] = malloc(frames * CODEC_OUTPUT_MAX_BYTES);
+    int *sizes = malloc(frames * sizeof(int));
+
+    // Encode, timed on its own
+    double start = now_seconds();
+    for (size_t f = 0; f < frames; f++)
+    {
+        sizes[f] = backend->encode(&input->samples[f * frame], packets[f], CODEC_OUTPUT_MAX_BYTES);
+        if (sizes[f] < 0)
+        {
+            fprintf(stderr, "%s: encode failed at frame %zu: %d\n", codec->label, f, sizes[f]);
+            free(packets);
+            free(sizes);
+            return sizes[f];
+        }
+    }
+    result->encode_seconds = now_seconds() - start;
+
+    // Deterministic loss pattern, independent of the codec
+    lcg_state = 0xC0DEC + loss_percent;
+    bool *lost = calloc(frames, sizeof(bool));
+    for (size_t f = 0; f < frames; f++)
+    {
+        lost[f] = (lcg_next() >> 8) % 100 < (uint32_t)loss_percent;
+        result->lost += lost[f];
+    }
+
+    // Decode
+    int16_t *decoded = calloc(frames * frame, sizeof(int16_t));
+    fec_recovered = 0;
+    decode_stream(codec, packets, sizes, lost, frames, frame, true, decoded);
+    result->recovered = fec_recovered;
+    measure_quality(input, decoded, frames * frame, result);
+    result->plc_segsnr_db = result->segsnr_db;
+
+    if (result->lost)
+    {
+        // Again with concealment alone, what FEC is measured against
+        bench_result_t plc;
+        codec->decoder_init();
+        decode_stream(codec, packets, sizes, lost, frames, frame, false, decoded);
+        measure_quality(input, decoded, frames * frame, &plc);
+        result->plc_segsnr_db = plc.segsnr_db;
+    }
+
+    // Packet sizes
+    long total = 0;
+    for (size_t f = 0; f < frames; f++)
+    {
+        total += sizes[f];
+    }
+    qsort(sizes, frames, sizeof(int), compare_int);
+    result->bytes_min = sizes[0];
+    result->bytes_max = sizes[frames - 1];
+    result->bytes_p50 = sizes[frames / 2];
+    result->bytes_p95 = sizes[frames * 95 / 100];
+    result->bytes_mean = (double)total / frames;
+    result->kbps = result->bytes_mean * 8 * SAMPLE_RATE / frame / 1000.0;
+
+    free(decoded);
+    free(lost);
+    free(sizes);
+    free(packets);
+    return 0;
+}
+
+static void print_result(const bench_codec_t *codec, const bench_result_t *result)
+{
+    double audio_seconds = (double)result->frames * codec->backend->frame_samples / SAMPLE_RATE;
+    double fps = result->encode_seconds > 0 ? result->frames / result->encode_seconds : 0;
+    printf("%-16s %6zu %5zu %5zu %10.0f %7.0fx %4d %4d %4d %4d %7.1f %6.1f %5d %7.2f %7.2f %7.2f %7.2f\n",
+           result->key, result->frames, result->lost, result->recovered, fps,
+           fps > 0 ? audio_seconds / result->encode_seconds : 0, result->bytes_min, result->bytes_p50,
+           result->bytes_p95, result->bytes_max, result->bytes_mean, result->kbps, result->delay, result->snr_db,
+           result->segsnr_db, result->specsnr_db, result->plc_segsnr_db);
+}
+
+//
+// Baseline
+//
+
+typedef struct
+{
+    char key[32];
+    double min_snr_db;
+    double min_segsnr_db;
+    double min_specsnr_db;
+    int max_bytes;
+} baseline_t;
+
+static int check_baseline(const char *path, const bench_result_t *results, size_t count)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        fprintf(stderr, "%s: cannot open baseline\n", path);
+        return -ENOENT;
+    }
+
+    int failures = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        baseline_t baseline;
+        if (line[0] == '#' || sscanf(line, "%31s %lf %lf %lf %d", baseline.key, &baseline.min_snr_db, &baseline.min_segsnr_db, &baseline.min_specsnr_db, &baseline.max_bytes) != 5)
+        {
+            continue;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            const bench_result_t *result = &results[i];
+            if (strcmp(result->key, baseline.key))
+            {
+                continue;
+            }
+            if (result->snr_db < baseline.min_snr_db)
+            {
+                printf("REGRESSION %s: SNR %.2f dB < %.2f dB\n", result->key, result->snr_db, baseline.min_snr_db);
+                failures++;
+            }
+            if (result->segsnr_db < baseline.min_segsnr_db)
+            {
+                printf("REGRESSION %s: segmental SNR %.2f dB < %.2f dB\n", result->key, result->segsnr_db, baseline.min_segsnr_db);
+                failures++;
+            }
+            if (result->specsnr_db < baseline.min_specsnr_db)
+            {
+                printf("REGRESSION %s: spectral SNR %.2f dB < %.2f dB\n", result->key, result->specsnr_db, baseline.min_specsnr_db);
+                failures++;
+            }
+            if (result->bytes_max > baseline.max_bytes)
+            {
+                printf("REGRESSION %s: %d bytes per frame > %d\n", result->key, result->bytes_max, baseline.max_bytes);
+                failures++;
+            }
+        }
+    }
+    fclose(file);
+    return failures;
+}
+
+// Whether FEC did its job for one codec: lost frames recovered, and better than concealment alone
+static int check_fec(const char *label, const bench_codec_t *codecs, const bench_result_t *results, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const bench_result_t *result = &results[i];
+        if (strcmp(codecs[i].label, label))
+        {
+            continue;
+        }
+        printf("FEC %s: %zu of %zu lost frames recovered, segmental SNR %.2f dB, %.2f dB with PLC alone\n",
+               result->key, result->recovered, result->lost, result->segsnr_db, result->plc_segsnr_db);
+        if (result->recovered == 0 || result->segsnr_db <= result->plc_segsnr_db)
+        {
+            printf("REGRESSION %s: FEC did not improve on PLC\n", result->key);
+            return 1;
+        }
+        return 0;
+    }
+    fprintf(stderr, "%s: no such codec\n", label);
+    return -ENOENT;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [--loss PERCENT] [--check BASELINE] [--check-fec CODEC] [file.wav ...]\n"
+            "  Without WAV files a deterministic synthetic speech signal is used.\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    int loss_percent = 0;
+    const char *baseline = NULL;
+    const char *fec_label = NULL;
+    const char **wavs = calloc(argc, sizeof(char *));
+    int wav_count = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--loss") && i + 1 < argc)
+        {
+            loss_percent = atoi(argv[++i]);
+            loss_percent = CLAMP(loss_percent, 0, 100);
+        }
+        else if (!strcmp(argv[i], "--check") && i + 1 < argc)
+        {
+            baseline = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--check-fec") && i + 1 < argc)
+        {
+            fec_label = argv[++i];
+        }
+        else if (argv[i][0] == '-')
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        else
+        {
+            wavs[wav_count++] = argv[i];
+        }
+    }
+
+    // One input, the corpus files back to back
+    pcm_t input = {0};
+    if (wav_count == 0)
+    {
+        input = synthesize_speech();
+    }
+    for (int i = 0; i < wav_count; i++)
+    {
+        pcm_t file = {0};
+        if (read_wav(wavs[i], &file))
+        {
+            return 2;
+        }
+        input.samples = realloc(input.samples, (input.count + file.count) * sizeof(int16_t));
+        memcpy(&input.samples[input.count], file.samples, file.count * sizeof(int16_t));
+        input.count += file.count;
+        free(file.samples);
+    }
+
+    printf("input: %s, %.1f s, loss %d%%, opus encoder %d bytes, decoder %d bytes\n",
+           wav_count ? "corpus" : "synthetic speech", (double)input.count / SAMPLE_RATE, loss_percent,
+           opus_encoder_get_size(1), opus_decoder_get_size(1));
+    printf("%-16s %6s %5s %5s %10s %8s %4s %4s %4s %4s %7s %6s %5s %7s %7s %7s %7s\n",
+           "codec", "frames", "lost", "fec", "frames/s", "rt", "min", "p50", "p95", "max", "mean", "kbps", "delay", "snr",
+           "segsnr", "specsnr", "plcseg");
+
+    bench_result_t results[ARRAY_SIZE(bench_codecs)];
+    int failed = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(bench_codecs); i++)
+    {
+        if (run_codec(&bench_codecs[i], &input, loss_percent, &results[i]))
+        {
+            return 1;
+        }
+        print_result(&bench_codecs[i], &results[i]);
+    }
+
+    if (baseline)
+    {
+        failed = check_baseline(baseline, results, ARRAY_SIZE(results));
+        if (failed < 0)
+        {
+            return 2;
+        }
+        printf("%s\n", failed ? "FAILED" : "baseline OK");
+    }
+    if (fec_label)
+    {
+        int fec_failed = check_fec(fec_label, bench_codecs, results, ARRAY_SIZE(results));
+        if (fec_failed < 0)
+        {
+            return 2;
+        }
+        failed += fec_failed;
+    }
+
+    free(input.samples);
+    free(wavs);
+    return failed ? 1 : 0;
+}
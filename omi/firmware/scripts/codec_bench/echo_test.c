@@ -0,0 +1,175 @@
+// Host unit test for the acoustic echo canceller (omi/src/lib/dk2/echo_canceller.c)
+//
+// The speaker plays 8 kHz noise, the microphone hears it through a short decaying room
+// response 1.5ms later. Built twice by CMakeLists.txt: with the NLMS canceller, and with
+// ducking alone (CONFIG_OMI_ECHO_CANCELLER_DUCKING_ONLY).
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "echo_canceller.h"
+#include "bench_check.h"
+
+#define MIC_RATE 16000
+#define UPSAMPLE (MIC_RATE / ECHO_REFERENCE_RATE)
+#define SPEAKER_FRAME 160             // 20ms, STREAM_FRAME_SAMPLES in dk2/speaker.c
+#define MIC_BLOCK 160                 // 10ms microphone blocks
+#define AHEAD_FRAMES 2                // STREAM_START_BLOCKS, the speaker queues this far ahead
+#define SECONDS 4
+#define REF_SAMPLES (ECHO_REFERENCE_RATE * SECONDS)
+#define MIC_SAMPLES (MIC_RATE * SECONDS)
+#define PATH_DELAY 24                 // Microphone samples from the speaker to the microphone
+#define PATH_TAPS 24
+#define TIMESTAMP_LATE 3              // Reference ticks the capture timestamp lags the real capture
+#define TAIL_MS 200                   // ECHO_TAIL_TICKS in echo_canceller.c
+
+static int16_t reference[REF_SAMPLES];
+static int16_t input[MIC_SAMPLES];
+static int16_t output[MIC_SAMPLES];
+
+static uint32_t lcg_state = 1;
+
+static int lcg_noise(int amplitude)
+{
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return (int)((lcg_state >> 8) % (2 * amplitude + 1)) - amplitude;
+}
+
+// Speaker noise over [from, to) in reference samples, echo plus a little near-end noise at the microphone
+static void simulate(size_t from, size_t to, int speaker_amplitude, int noise_amplitude)
+{
+    memset(reference, 0, sizeof(reference));
+    for (size_t n = from; n < to; n++)
+    {
+        reference[n] = lcg_noise(speaker_amplitude);
+    }
+
+    for (size_t n = 0; n < MIC_SAMPLES; n++)
+    {
+        // The speaker holds each sample for two microphone samples
+        double echo = 0, h = 0.6;
+        for (int k = 0; k < PATH_TAPS && (size_t)(PATH_DELAY + k) <= n; k++, h *= -0.7)
+        {
+            echo += h * reference[(n - PATH_DELAY - k) / UPSAMPLE];
+        }
+        input[n] = (int16_t)lrint(echo) + lcg_noise(noise_amplitude);
+    }
+}
+
+// Plays the simulation through the canceller the way speaker.c and main.c drive it.
+// The microphone block at dropped never reaches it, like a capture lost to an overrun.
+static void run(int64_t base_tick, size_t dropped)
+{
+    echo_canceller_init();
+    size_t written = 0;
+    for (size_t block = 0; block * MIC_BLOCK < MIC_SAMPLES; block++)
+    {
+        size_t offset = block * MIC_BLOCK;
+        size_t ref_now = offset / UPSAMPLE;
+        while (written < REF_SAMPLES && written < ref_now + AHEAD_FRAMES * SPEAKER_FRAME)
+        {
+            echo_reference_write(&reference[written], SPEAKER_FRAME, base_tick + written);
+            written += SPEAKER_FRAME;
+        }
+
+        memcpy(&output[offset], &input[offset], MIC_BLOCK * sizeof(int16_t));
+        if (block != dropped)
+        {
+            echo_canceller_process(&output[offset], MIC_BLOCK, base_tick + ref_now + TIMESTAMP_LATE);
+        }
+    }
+}
+
+static double power(const int16_t *samples, size_t from, size_t to)
+{
+    double total = 0;
+    for (size_t n = from; n < to; n++)
+    {
+        total += (double)samples[n] * samples[n];
+    }
+    return total / (to - from);
+}
+
+static double erle_db(size_t from, size_t to)
+{
+    return 10 * log10(power(input, from, to) / power(output, from, to));
+}
+
+// Each test plays on its own stretch of the echo clock, so earlier references don't leak in
+static int64_t next_base = 0;
+
+static int64_t fresh_timeline(void)
+{
+    next_base += 10 * REF_SAMPLES;
+    return next_base;
+}
+
+static void test_passthrough_without_playback(void)
+{
+    simulate(0, 0, 0, 300);
+    run(fresh_timeline(), SIZE_MAX);
+    CHECK(memcmp(input, output, sizeof(input)) == 0, "microphone changed while the speaker was silent");
+}
+
+#ifndef CONFIG_OMI_ECHO_CANCELLER_DUCKING_ONLY
+
+static void test_echo_cancelled(void)
+{
+    simulate(0, REF_SAMPLES, 3000, 10);
+    run(fresh_timeline(), SIZE_MAX);
+
+    double early = erle_db(0, MIC_RATE / 4);
+    double converged = erle_db(MIC_SAMPLES - MIC_RATE, MIC_SAMPLES);
+    printf("ERLE %.1f dB in the first 250ms, %.1f dB converged\n", early, converged);
+    CHECK(converged > 20, "ERLE only %.1f dB after convergence", converged);
+    // Ducking covers the first blocks, before the filter has learned anything
+    CHECK(early > 10, "ERLE only %.1f dB while converging", early);
+}
+
+static void test_dropped_block_resyncs(void)
+{
+    // A lost 10ms capture at 3s: the next timestamp jumps, the reference lookup has
+    // to follow it and the learned echo path stays valid
+    const size_t dropped = 3 * MIC_RATE / MIC_BLOCK;
+    simulate(0, REF_SAMPLES, 3000, 10);
+    run(fresh_timeline(), dropped);
+
+    size_t from = (dropped + 1) * MIC_BLOCK;
+    double after = erle_db(from, from + MIC_RATE / 10);
+    printf("ERLE %.1f dB in the 100ms after a dropped block\n", after);
+    CHECK(after > 20, "ERLE only %.1f dB after a dropped block", after);
+}
+
+#else
+
+static void test_ducked_during_playback(void)
+{
+    // Speaker plays the first second only
+    simulate(0, ECHO_REFERENCE_RATE, 3000, 300);
+    run(fresh_timeline(), SIZE_MAX);
+
+    double ducked = erle_db(MIC_RATE / 10, MIC_RATE);
+    printf("Ducked by %.1f dB\n", ducked);
+    CHECK(fabs(ducked - 30) < 1, "ducked by %.1f dB instead of 30", ducked);
+
+    // Back to unity once the tail has passed, plus the ramp chunk
+    size_t released = MIC_RATE + (TAIL_MS + 20 + 20) * MIC_RATE / 1000;
+    CHECK(memcmp(&input[released], &output[released], (MIC_SAMPLES - released) * sizeof(int16_t)) == 0,
+          "microphone still attenuated %d ms after playback", TAIL_MS + 40);
+}
+
+#endif
+
+int main(void)
+{
+    test_passthrough_without_playback();
+#ifndef CONFIG_OMI_ECHO_CANCELLER_DUCKING_ONLY
+    test_echo_cancelled();
+    test_dropped_block_resyncs();
+#else
+    test_ducked_during_playback();
+#endif
+
+    return bench_check_result();
+}
@@ -0,0 +1,130 @@
+// Host unit test for the energy ledger (omi/src/lib/dk2/energy_ledger.c)
+//
+// Checks active time accounting for switched and counted subsystems, the
+// charge computed from it and the packed layout of the energy characteristic.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <zephyr/sys/byteorder.h>
+#include "energy_ledger.h"
+#include "bench_check.h"
+
+#define SECOND_US 1000000LL
+#define HOUR_US (3600 * SECOND_US)
+
+static void test_switched(void)
+{
+    energy_ledger_t ledger;
+    energy_ledger_init(&ledger, 0);
+
+    energy_ledger_set_active(&ledger, ENERGY_PDM, true, 1 * SECOND_US);
+    // Repeating the state neither restarts the period nor counts again
+    energy_ledger_set_active(&ledger, ENERGY_PDM, true, 2 * SECOND_US);
+    CHECK(energy_ledger_active_us(&ledger, ENERGY_PDM, 4 * SECOND_US) == 3 * SECOND_US, "open period %llu us",
+          (unsigned long long)energy_ledger_active_us(&ledger, ENERGY_PDM, 4 * SECOND_US));
+    energy_ledger_set_active(&ledger, ENERGY_PDM, false, 5 * SECOND_US);
+    energy_ledger_set_active(&ledger, ENERGY_PDM, false, 6 * SECOND_US);
+    energy_ledger_set_active(&ledger, ENERGY_PDM, true, 10 * SECOND_US);
+    energy_ledger_set_active(&ledger, ENERGY_PDM, false, 12 * SECOND_US);
+
+    uint64_t active_us = energy_ledger_active_us(&ledger, ENERGY_PDM, 20 * SECOND_US);
+    CHECK(active_us == 6 * SECOND_US, "active %llu us instead of 6 s", (unsigned long long)active_us);
+    CHECK(ledger.events[ENERGY_PDM] == 2, "%u activations instead of 2", ledger.events[ENERGY_PDM]);
+    CHECK(energy_ledger_active_us(&ledger, ENERGY_SD, 20 * SECOND_US) == 0, "SD active without being switched on");
+}
+
+static void test_counted(void)
+{
+    energy_ledger_t ledger;
+    energy_ledger_init(&ledger, 0);
+
+    for (int i = 0; i < 500; i++)
+    {
+        energy_ledger_add(&ledger, ENERGY_CODEC, 1200);
+    }
+    CHECK(energy_ledger_active_us(&ledger, ENERGY_CODEC, SECOND_US) == 600000, "codec busy %llu us",
+          (unsigned long long)energy_ledger_active_us(&ledger, ENERGY_CODEC, SECOND_US));
+    CHECK(ledger.events[ENERGY_CODEC] == 500, "%u frames instead of 500", ledger.events[ENERGY_CODEC]);
+}
+
+static void test_charge(void)
+{
+    energy_ledger_t ledger;
+    energy_ledger_init(&ledger, 0);
+
+    // An hour at 1 mA is 1000 uAh, an open period counts up to now
+    energy_ledger_set_active(&ledger, ENERGY_LED, true, 0);
+    uint32_t uah = energy_ledger_charge_uah(&ledger, ENERGY_LED, 1000, HOUR_US);
+    CHECK(uah == 1000, "%u uAh after an hour at 1 mA", uah);
+
+    // Sub-second busy periods still add up
+    for (int i = 0; i < 3600; i++)
+    {
+        energy_ledger_add(&ledger, ENERGY_RADIO, 500000);
+    }
+    uah = energy_ledger_charge_uah(&ledger, ENERGY_RADIO, 3000, HOUR_US);
+    CHECK(uah == 1500, "%u uAh for half an hour at 3 mA", uah);
+
+    // A week at 20 mA
+    energy_ledger_set_active(&ledger, ENERGY_SD, true, 0);
+    uah = energy_ledger_charge_uah(&ledger, ENERGY_SD, 20000, 168 * HOUR_US);
+    CHECK(uah == 3360000, "%u uAh for a week at 20 mA", uah);
+}
+
+static void test_reset(void)
+{
+    energy_ledger_t ledger;
+    energy_ledger_init(&ledger, 0);
+
+    energy_ledger_set_active(&ledger, ENERGY_HFXO, true, 0);
+    energy_ledger_add(&ledger, ENERGY_CODEC, 1000);
+    energy_ledger_reset(&ledger, 10 * SECOND_US);
+
+    // Still on, counted from the reset
+    CHECK(energy_ledger_active_us(&ledger, ENERGY_HFXO, 12 * SECOND_US) == 2 * SECOND_US, "HFXO %llu us after reset",
+          (unsigned long long)energy_ledger_active_us(&ledger, ENERGY_HFXO, 12 * SECOND_US));
+    CHECK(energy_ledger_active_us(&ledger, ENERGY_CODEC, 12 * SECOND_US) == 0, "codec time kept over reset");
+    CHECK(ledger.events[ENERGY_CODEC] == 0, "codec frames kept over reset");
+    energy_ledger_set_active(&ledger, ENERGY_HFXO, false, 13 * SECOND_US);
+    CHECK(ledger.events[ENERGY_HFXO] == 0, "switching off counted as an activation");
+}
+
+static void test_pack(void)
+{
+    energy_ledger_t ledger;
+    energy_ledger_init(&ledger, 5 * SECOND_US);
+    energy_ledger_set_active(&ledger, ENERGY_SD, true, 5 * SECOND_US);
+    energy_ledger_add(&ledger, ENERGY_RADIO, 2500);
+    energy_ledger_add(&ledger, ENERGY_RADIO, 2500);
+
+    uint32_t current_ua[ENERGY_SUBSYSTEM_COUNT] = {0};
+    current_ua[ENERGY_SD] = 3600;
+    uint8_t buf[ENERGY_LEDGER_PACKED_SIZE];
+
+    CHECK(energy_ledger_pack(&ledger, current_ua, 0, buf, sizeof(buf) - 1) == 0, "packed into a short buffer");
+
+    int64_t now_us = 5 * SECOND_US + HOUR_US;
+    size_t size = energy_ledger_pack(&ledger, current_ua, now_us, buf, sizeof(buf));
+    CHECK(size == ENERGY_LEDGER_PACKED_SIZE, "packed %zu bytes", size);
+    CHECK(sys_get_le32(buf) == 3600, "elapsed %u s", sys_get_le32(buf));
+
+    const uint8_t *sd = buf + 4 + ENERGY_SD * 12;
+    CHECK(sys_get_le32(sd) == 3600000, "SD active %u ms", sys_get_le32(sd));
+    CHECK(sys_get_le32(sd + 4) == 1, "SD %u activations", sys_get_le32(sd + 4));
+    CHECK(sys_get_le32(sd + 8) == 3600, "SD %u uAh", sys_get_le32(sd + 8));
+
+    const uint8_t *radio = buf + 4 + ENERGY_RADIO * 12;
+    CHECK(sys_get_le32(radio) == 5, "radio active %u ms", sys_get_le32(radio));
+    CHECK(sys_get_le32(radio + 4) == 2, "%u packets", sys_get_le32(radio + 4));
+}
+
+int main(void)
+{
+    test_switched();
+    test_counted();
+    test_charge();
+    test_reset();
+    test_pack();
+
+    return bench_check_result();
+}
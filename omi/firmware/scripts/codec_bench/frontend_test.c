@@ -0,0 +1,244 @@
+// Host unit test for the microphone front-end (omi/src/lib/dk2/audio_frontend.c)
+//
+// Built twice by CMakeLists.txt: without CONFIG_OMI_AUDIO_AGC to check the filters alone,
+// and with it to check the AGC and limiter.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "audio_frontend.h"
+#include "bench_check.h"
+
+#define RATE 16000
+#define BLOCK 320 // 20ms, CONFIG_OMI_MIC_BLOCK_MS default
+
+static void tone(int16_t *out, size_t count, size_t offset, double hz, double amplitude)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = (int16_t)lrint(amplitude * sin(2.0 * M_PI * hz * (offset + i) / RATE));
+    }
+}
+
+static double rms(const int16_t *samples, size_t count)
+{
+    double sum = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        sum += (double)samples[i] * samples[i];
+    }
+    return sqrt(sum / count);
+}
+
+static double mean_abs(const int16_t *samples, size_t count)
+{
+    double sum = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        sum += abs(samples[i]);
+    }
+    return sum / count;
+}
+
+// Runs a tone through the front-end for `seconds` and returns the output RMS of the last 200ms
+static double tone_response(double hz, double amplitude, double seconds)
+{
+    int16_t block[BLOCK];
+    size_t blocks = (size_t)(seconds * RATE / BLOCK);
+    size_t tail = 200 * RATE / 1000 / BLOCK;
+    double sum = 0;
+
+    audio_frontend_init();
+    for (size_t b = 0; b < blocks; b++)
+    {
+        tone(block, BLOCK, b * BLOCK, hz, amplitude);
+        audio_frontend_process(block, BLOCK);
+        if (b >= blocks - tail)
+        {
+            double r = rms(block, BLOCK);
+            sum += r * r;
+        }
+    }
+    return sqrt(sum / tail);
+}
+
+#ifndef CONFIG_OMI_AUDIO_AGC
+
+static double gain_db(double hz)
+{
+    const double amplitude = 8000;
+    return 20 * log10(tone_response(hz, amplitude, 1.0) / (amplitude / sqrt(2)));
+}
+
+static void test_dc_removed(void)
+{
+    int16_t block[BLOCK];
+    audio_frontend_init();
+    for (int b = 0; b < RATE / BLOCK; b++)
+    {
+        for (int i = 0; i < BLOCK; i++)
+        {
+            block[i] = 5000;
+        }
+        audio_frontend_process(block, BLOCK);
+    }
+    CHECK(mean_abs(block, BLOCK) < 16, "DC residue %.1f after 1s", mean_abs(block, BLOCK));
+}
+
+static void test_passband(void)
+{
+    double g = gain_db(1000);
+    CHECK(fabs(g) < 0.5, "1 kHz gain %.2f dB", g);
+    g = gain_db(300);
+    CHECK(fabs(g) < 1.0, "300 Hz gain %.2f dB", g);
+}
+
+static void test_stopband(void)
+{
+    // Corner at CONFIG_OMI_AUDIO_HPF_CUTOFF_HZ = 100
+    double g = gain_db(100);
+    CHECK(g < -2.0 && g > -4.5, "100 Hz gain %.2f dB, expected about -3", g);
+    g = gain_db(50);
+    CHECK(g < -10.0, "50 Hz gain %.2f dB", g);
+    g = gain_db(25);
+    CHECK(g < -20.0, "25 Hz gain %.2f dB", g);
+}
+
+static void test_block_length_invariant(void)
+{
+    static int16_t reference[RATE];
+    static int16_t ragged[RATE];
+    tone(reference, RATE, 0, 440, 12000);
+    for (size_t i = 0; i < RATE; i++)
+    {
+        reference[i] += (int16_t)(3000 + (i * 7919 % 401) - 200); // DC and a bit of noise
+    }
+    memcpy(ragged, reference, sizeof(ragged));
+
+    audio_frontend_init();
+    for (size_t offset = 0; offset < RATE; offset += BLOCK)
+    {
+        audio_frontend_process(reference + offset, BLOCK);
+    }
+
+    audio_frontend_init();
+    size_t offset = 0;
+    for (size_t step = 1; offset < RATE; step = step * 3 % 257 + 1)
+    {
+        size_t count = MIN(step, RATE - offset);
+        audio_frontend_process(ragged + offset, count);
+        offset += count;
+    }
+
+    CHECK(memcmp(reference, ragged, sizeof(ragged)) == 0, "output depends on the block length");
+}
+
+static void test_full_scale(void)
+{
+    // A full-scale square wave overshoots in the filters, it has to saturate, not wrap
+    int16_t block[BLOCK];
+    audio_frontend_init();
+    int wrapped = 0;
+    for (int b = 0; b < 50; b++)
+    {
+        for (int i = 0; i < BLOCK; i++)
+        {
+            block[i] = ((b * BLOCK + i) / 8) % 2 ? 32767 : -32768;
+        }
+        int16_t input[BLOCK];
+        memcpy(input, block, sizeof(input));
+        audio_frontend_process(block, BLOCK);
+        for (int i = 1; i < BLOCK; i++)
+        {
+            // Right after an edge the output must follow the input's sign
+            if (input[i] != input[i - 1] && (input[i] > 0) != (block[i] > 0))
+            {
+                wrapped++;
+            }
+        }
+    }
+    CHECK(wrapped == 0, "%d edges wrapped around", wrapped);
+}
+
+#else
+
+static void test_quiet_speaker_raised(void)
+{
+    // Mean absolute 318, needs 6.3x to reach the target of 2000
+    double out = tone_response(1000, 500, 4.0) * 2 * M_SQRT2 / M_PI; // RMS to mean absolute of a sine
+    CHECK(out > 1800 && out < 2200, "quiet tone ends at mean level %.0f", out);
+}
+
+static void test_max_gain(void)
+{
+    // Would need 16x, CONFIG_OMI_AUDIO_AGC_MAX_GAIN is 8
+    tone_response(1000, 200, 4.0);
+    uint16_t gain = audio_frontend_get_gain();
+    CHECK(gain <= 8 * 4096 && gain > 7 * 4096, "gain %u (Q12) for a very quiet tone", gain);
+}
+
+static void test_limiter(void)
+{
+    int16_t block[BLOCK];
+    int peak = 0;
+    audio_frontend_init();
+
+    // Quiet first, so the gain is up when the loud part starts
+    for (int b = 0; b < 200; b++)
+    {
+        tone(block, BLOCK, b * BLOCK, 1000, 400);
+        audio_frontend_process(block, BLOCK);
+    }
+    for (int b = 200; b < 250; b++)
+    {
+        tone(block, BLOCK, b * BLOCK, 1000, 32000);
+        audio_frontend_process(block, BLOCK);
+        for (int i = 0; i < BLOCK; i++)
+        {
+            peak = MAX(peak, abs(block[i]));
+        }
+    }
+    CHECK(peak <= 29205, "peak %d above -1 dBFS", peak);
+    CHECK(mean_abs(block, BLOCK) < 2500, "loud tone still at mean level %.0f", mean_abs(block, BLOCK));
+}
+
+static void test_noise_gate_holds(void)
+{
+    int16_t block[BLOCK];
+    audio_frontend_init();
+    for (int b = 0; b < 200; b++)
+    {
+        tone(block, BLOCK, b * BLOCK, 1000, 800);
+        audio_frontend_process(block, BLOCK);
+    }
+    uint16_t speech_gain = audio_frontend_get_gain();
+
+    // Room noise well below CONFIG_OMI_AUDIO_AGC_NOISE_GATE
+    for (int b = 0; b < 200; b++)
+    {
+        tone(block, BLOCK, b * BLOCK, 1000, 40);
+        audio_frontend_process(block, BLOCK);
+    }
+    uint16_t pause_gain = audio_frontend_get_gain();
+    CHECK(pause_gain == speech_gain, "gain moved from %u to %u during a pause", speech_gain, pause_gain);
+}
+
+#endif
+
+int main(void)
+{
+#ifndef CONFIG_OMI_AUDIO_AGC
+    test_dc_removed();
+    test_passband();
+    test_stopband();
+    test_block_length_invariant();
+    test_full_scale();
+#else
+    test_quiet_speaker_raised();
+    test_max_gain();
+    test_limiter();
+    test_noise_gate_holds();
+#endif
+
+    return bench_check_result();
+}
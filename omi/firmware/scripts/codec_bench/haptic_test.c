@@ -0,0 +1,153 @@
+// Host unit test for the haptic pattern engine (omi/src/lib/dk2/haptic_pattern.c)
+//
+// Runs the engine the way src/haptic.c steps it: one step at a time, each held for
+// its duration, with requests submitted at given times.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "haptic_pattern.h"
+#include "bench_check.h"
+
+#define MAX_STEPS 64
+
+static haptic_sequence_t sequence_of(uint8_t intensity, uint16_t duration_ms, uint8_t steps, uint8_t priority)
+{
+    haptic_sequence_t sequence = {.count = steps, .priority = priority};
+    for (uint8_t i = 0; i < steps; i++)
+    {
+        sequence.steps[i].intensity = intensity;
+        sequence.steps[i].duration_ms = duration_ms;
+    }
+    return sequence;
+}
+
+// Intensities in the order they were driven
+static uint8_t driven[MAX_STEPS];
+static int driven_count;
+
+static void drain(haptic_engine_t *engine)
+{
+    haptic_step_t step;
+    while (driven_count < MAX_STEPS && haptic_engine_next(engine, &step))
+    {
+        driven[driven_count++] = step.intensity;
+    }
+}
+
+static void test_blob(void)
+{
+    haptic_sequence_t sequence;
+    const uint8_t blob[] = {255, 10, 0, 5, 128, 30};
+    CHECK(haptic_sequence_from_blob(&sequence, blob, sizeof(blob), HAPTIC_PRIORITY_NORMAL) == 0, "valid blob rejected");
+    CHECK(sequence.count == 3 && sequence.priority == HAPTIC_PRIORITY_NORMAL, "%u steps, priority %u", sequence.count,
+          sequence.priority);
+    CHECK(sequence.steps[0].intensity == 255 && sequence.steps[0].duration_ms == 100, "first step %u for %u ms",
+          sequence.steps[0].intensity, sequence.steps[0].duration_ms);
+    CHECK(sequence.steps[2].intensity == 128 && sequence.steps[2].duration_ms == 300, "last step %u for %u ms",
+          sequence.steps[2].intensity, sequence.steps[2].duration_ms);
+
+    uint8_t long_blob[2 * HAPTIC_MAX_STEPS + 2] = {0};
+    CHECK(haptic_sequence_from_blob(&sequence, blob, 0, 0) == -EINVAL, "empty blob accepted");
+    CHECK(haptic_sequence_from_blob(&sequence, blob, 5, 0) == -EINVAL, "odd blob accepted");
+    CHECK(haptic_sequence_from_blob(&sequence, long_blob, sizeof(long_blob), 0) == -EINVAL, "too long blob accepted");
+    CHECK(haptic_sequence_from_blob(&sequence, long_blob, 2 * HAPTIC_MAX_STEPS, 0) == 0, "full length blob rejected");
+}
+
+static void test_plays_in_order(void)
+{
+    haptic_engine_t engine;
+    haptic_engine_init(&engine);
+    driven_count = 0;
+
+    haptic_sequence_t first = sequence_of(10, 50, 2, HAPTIC_PRIORITY_NORMAL);
+    haptic_sequence_t second = sequence_of(20, 50, 1, HAPTIC_PRIORITY_NORMAL);
+    CHECK(haptic_engine_submit(&engine, &first) == 1, "idle engine did not start");
+    CHECK(haptic_engine_submit(&engine, &second) == 0, "same priority did not queue");
+    drain(&engine);
+    CHECK(driven_count == 3 && driven[0] == 10 && driven[1] == 10 && driven[2] == 20, "%d steps, last %u",
+          driven_count, driven[driven_count - 1]);
+
+    haptic_step_t step;
+    CHECK(!haptic_engine_next(&engine, &step), "engine still playing after the queue ran out");
+}
+
+static void test_preemption(void)
+{
+    haptic_engine_t engine;
+    haptic_engine_init(&engine);
+    driven_count = 0;
+
+    haptic_sequence_t ambient = sequence_of(10, 50, 4, HAPTIC_PRIORITY_LOW);
+    haptic_sequence_t press = sequence_of(255, 100, 1, HAPTIC_PRIORITY_HIGH);
+    haptic_engine_submit(&engine, &ambient);
+    haptic_step_t step;
+    haptic_engine_next(&engine, &step);
+    driven[driven_count++] = step.intensity;
+
+    CHECK(haptic_engine_submit(&engine, &press) == 1, "higher priority did not preempt");
+    drain(&engine);
+    // The interrupted sequence is dropped, not resumed
+    CHECK(driven_count == 2 && driven[1] == 255, "%d steps after preemption", driven_count);
+
+    haptic_engine_submit(&engine, &press);
+    CHECK(haptic_engine_submit(&engine, &ambient) == 0, "lower priority preempted");
+}
+
+static void test_queue_order_and_eviction(void)
+{
+    haptic_engine_t engine;
+    haptic_engine_init(&engine);
+    driven_count = 0;
+
+    haptic_sequence_t playing = sequence_of(1, 50, 1, HAPTIC_PRIORITY_HIGH);
+    haptic_sequence_t low_a = sequence_of(2, 50, 1, HAPTIC_PRIORITY_LOW);
+    haptic_sequence_t normal = sequence_of(3, 50, 1, HAPTIC_PRIORITY_NORMAL);
+    haptic_sequence_t low_b = sequence_of(4, 50, 1, HAPTIC_PRIORITY_LOW);
+    haptic_sequence_t high = sequence_of(5, 50, 1, HAPTIC_PRIORITY_HIGH);
+    haptic_sequence_t normal_b = sequence_of(6, 50, 1, HAPTIC_PRIORITY_NORMAL);
+
+    haptic_engine_submit(&engine, &playing);
+    CHECK(haptic_engine_submit(&engine, &low_a) == 0, "low not queued");
+    CHECK(haptic_engine_submit(&engine, &normal) == 0, "normal not queued");
+    CHECK(haptic_engine_submit(&engine, &low_b) == 0, "second low not queued");
+    CHECK(haptic_engine_submit(&engine, &high) == 0, "high not queued behind the high playing");
+    // Full: the newest low request makes room
+    CHECK(haptic_engine_submit(&engine, &normal_b) == 0, "normal rejected from a queue holding low requests");
+    haptic_sequence_t low_c = sequence_of(7, 50, 1, HAPTIC_PRIORITY_LOW);
+    CHECK(haptic_engine_submit(&engine, &low_c) == -ENOBUFS, "low accepted into a full queue");
+
+    drain(&engine);
+    const uint8_t expected[] = {1, 5, 3, 6, 2};
+    CHECK(driven_count == 5, "%d sequences played", driven_count);
+    for (int i = 0; i < driven_count && i < 5; i++)
+    {
+        CHECK(driven[i] == expected[i], "sequence %d was %u, expected %u", i, driven[i], expected[i]);
+    }
+}
+
+static void test_stop(void)
+{
+    haptic_engine_t engine;
+    haptic_engine_init(&engine);
+
+    haptic_sequence_t sequence = sequence_of(100, 50, 3, HAPTIC_PRIORITY_NORMAL);
+    haptic_engine_submit(&engine, &sequence);
+    haptic_engine_submit(&engine, &sequence);
+    haptic_engine_stop(&engine);
+
+    haptic_step_t step;
+    CHECK(!haptic_engine_next(&engine, &step), "steps left after stop");
+    CHECK(haptic_engine_submit(&engine, &sequence) == 1, "stopped engine did not start a new request");
+}
+
+int main(void)
+{
+    test_blob();
+    test_plays_in_order();
+    test_preemption();
+    test_queue_order_and_eviction();
+    test_stop();
+
+    return bench_check_result();
+}
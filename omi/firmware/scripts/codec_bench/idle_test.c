@@ -0,0 +1,76 @@
+// Host unit test for the auto-off idle policy (omi/src/lib/dk2/idle_policy.c)
+//
+// Checks that the countdown starts when the device lies still, starts over with
+// activity, and waits for as long as it is moved or on the charger.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "idle_policy.h"
+#include "bench_check.h"
+
+#define TIMEOUT_MS 60000
+
+static void test_countdown(void)
+{
+    idle_policy_t policy;
+    idle_policy_init(&policy, TIMEOUT_MS, 1000);
+
+    int64_t remaining = idle_policy_remaining_ms(&policy, 1000);
+    CHECK(remaining == TIMEOUT_MS, "%lld ms left at boot", (long long)remaining);
+    remaining = idle_policy_remaining_ms(&policy, 31000);
+    CHECK(remaining == 30000, "%lld ms left halfway", (long long)remaining);
+
+    // Voice starts over, an older event doesn't take time back
+    idle_policy_activity(&policy, 41000);
+    idle_policy_activity(&policy, 40000);
+    remaining = idle_policy_remaining_ms(&policy, 41000);
+    CHECK(remaining == TIMEOUT_MS, "%lld ms left after voice", (long long)remaining);
+
+    CHECK(idle_policy_remaining_ms(&policy, 101000) == 0, "not due at the timeout");
+    CHECK(idle_policy_remaining_ms(&policy, 500000) == 0, "not due long after the timeout");
+}
+
+static void test_moving(void)
+{
+    idle_policy_t policy;
+    idle_policy_init(&policy, TIMEOUT_MS, 0);
+
+    idle_policy_set_moving(&policy, true, 10000);
+    CHECK(idle_policy_remaining_ms(&policy, 200000) == -1, "counting down while moved");
+
+    // The countdown starts when the device is put down, not at the last activity
+    idle_policy_set_moving(&policy, false, 300000);
+    int64_t remaining = idle_policy_remaining_ms(&policy, 300000);
+    CHECK(remaining == TIMEOUT_MS, "%lld ms left once put down", (long long)remaining);
+
+    // Still again without having moved keeps the countdown
+    idle_policy_set_moving(&policy, false, 330000);
+    remaining = idle_policy_remaining_ms(&policy, 330000);
+    CHECK(remaining == 30000, "%lld ms left after a repeated still", (long long)remaining);
+}
+
+static void test_blocked(void)
+{
+    idle_policy_t policy;
+    idle_policy_init(&policy, TIMEOUT_MS, 0);
+
+    idle_policy_set_blocked(&policy, true, 70000);
+    CHECK(idle_policy_remaining_ms(&policy, 70000) == -1, "due while on the charger");
+
+    // Moving and unplugging in any order, the countdown starts with the last one
+    idle_policy_set_moving(&policy, true, 80000);
+    idle_policy_set_blocked(&policy, false, 90000);
+    CHECK(idle_policy_remaining_ms(&policy, 90000) == -1, "counting down while moved");
+    idle_policy_set_moving(&policy, false, 95000);
+    int64_t remaining = idle_policy_remaining_ms(&policy, 95000);
+    CHECK(remaining == TIMEOUT_MS, "%lld ms left once unplugged and put down", (long long)remaining);
+}
+
+int main(void)
+{
+    test_countdown();
+    test_moving();
+    test_blocked();
+
+    return bench_check_result();
+}
@@ -0,0 +1,182 @@
+// Host unit test for the IMU FIFO decoder and motion packets (omi/src/lib/dk2/imu_fifo.c)
+//
+// A simulated LSM6DSL FIFO holds a pattern of gyro X, Y, Z and accel X, Y, Z words per
+// sample (accel alone without the gyroscope). accel.c drains it in bursts that may end
+// mid-pattern, and after an overrun the FIFO resumes mid-pattern.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <zephyr/sys/byteorder.h>
+#include "imu_fifo.h"
+#include "bench_check.h"
+
+#define SAMPLES 500
+#define PERIOD_US 38461               // 26 Hz
+
+// Distinct values per sample and axis, so a misaligned decode shows
+static int16_t axis_value(size_t sample, int axis, bool gyro)
+{
+    return (int16_t)(sample * 16 + axis + (gyro ? 8 : 0) - 4000);
+}
+
+static uint8_t fifo[SAMPLES * 6 * 2];
+static size_t fifo_words;
+
+static void fill_fifo(bool gyro)
+{
+    fifo_words = 0;
+    for (size_t n = 0; n < SAMPLES; n++)
+    {
+        if (gyro)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                sys_put_le16(axis_value(n, axis, true), &fifo[2 * fifo_words++]);
+            }
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            sys_put_le16(axis_value(n, axis, false), &fifo[2 * fifo_words++]);
+        }
+    }
+}
+
+static bool sample_matches(const imu_sample_t *sample, size_t n, bool gyro)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (sample->accel[axis] != axis_value(n, axis, false) ||
+            sample->gyro[axis] != (gyro ? axis_value(n, axis, true) : 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static imu_sample_t decoded[SAMPLES + 1];
+
+// Drains the whole FIFO in bursts of varying length, each starting at the pattern the sensor reports
+static size_t drain_in_bursts(imu_fifo_decoder_t *decoder, size_t from_word)
+{
+    const size_t pattern_words = IMU_FIFO_PATTERN_WORDS(decoder->gyro);
+    static const size_t bursts[] = {7, 1, 13, 6, 100, 2, 35};
+    size_t count = 0;
+    for (size_t word = from_word, i = 0; word < fifo_words; i++)
+    {
+        size_t take = bursts[i % ARRAY_SIZE(bursts)];
+        take = MIN(take, fifo_words - word);
+        count += imu_fifo_decode(decoder, word % pattern_words, &fifo[2 * word], take, &decoded[count]);
+        word += take;
+    }
+    return count;
+}
+
+static void test_bursts_split_mid_sample(void)
+{
+    for (int gyro = 0; gyro <= 1; gyro++)
+    {
+        imu_fifo_decoder_t decoder;
+        imu_fifo_decoder_init(&decoder, gyro);
+        fill_fifo(gyro);
+
+        size_t count = drain_in_bursts(&decoder, 0);
+        CHECK(count == SAMPLES, "%zu samples decoded instead of %d (gyro %d)", count, SAMPLES, gyro);
+        size_t wrong = 0;
+        for (size_t n = 0; n < count; n++)
+        {
+            wrong += !sample_matches(&decoded[n], n, gyro);
+        }
+        CHECK(wrong == 0, "%zu samples decoded wrong (gyro %d)", wrong, gyro);
+        CHECK(decoder.dropped == 0, "%u samples dropped without a gap (gyro %d)", decoder.dropped, gyro);
+    }
+}
+
+static void test_resyncs_mid_pattern(void)
+{
+    // The first read starts at pattern index 4, inside sample 0: that sample is unusable
+    imu_fifo_decoder_t decoder;
+    imu_fifo_decoder_init(&decoder, true);
+    fill_fifo(true);
+
+    size_t count = drain_in_bursts(&decoder, 4);
+    CHECK(count == SAMPLES - 1, "%zu samples decoded instead of %d", count, SAMPLES - 1);
+    CHECK(count > 0 && sample_matches(&decoded[0], 1, true), "first sample after the resync decoded wrong");
+    CHECK(decoder.dropped == 1, "%u samples dropped instead of 1", decoder.dropped);
+
+    // An overrun moves the pattern under a half-read sample: it is dropped, and so is the one resumed into
+    imu_fifo_decoder_init(&decoder, true);
+    count = imu_fifo_decode(&decoder, 0, fifo, 8, decoded);
+    CHECK(count == 1, "%zu samples before the overrun instead of 1", count);
+    count = imu_fifo_decode(&decoder, 3, &fifo[2 * (6 * 10 + 3)], 3 + 12, decoded);
+    CHECK(count == 2 && sample_matches(&decoded[0], 11, true), "%zu samples after the overrun, expected 11 and 12",
+          count);
+    CHECK(decoder.dropped == 2, "%u samples dropped instead of 2", decoder.dropped);
+}
+
+static void test_packets(void)
+{
+    fill_fifo(true);
+    imu_fifo_decoder_t decoder;
+    imu_fifo_decoder_init(&decoder, true);
+    size_t count = imu_fifo_decode(&decoder, 0, fifo, 6 * 40, decoded);
+
+    // A 244-byte payload holds 19 samples with the gyroscope, 39 without
+    static const size_t expected_fit[2] = {39, 19};
+    for (int gyro = 0; gyro <= 1; gyro++)
+    {
+        uint8_t packet[244];
+        size_t sent = 0, packets = 0;
+        uint32_t first_us = 1000000;
+        while (sent < count)
+        {
+            size_t packed;
+            size_t len = imu_pack(packet, sizeof(packet), packets, gyro, PERIOD_US, first_us + sent * PERIOD_US,
+                                  &decoded[sent], count - sent, &packed);
+            CHECK(len == IMU_PACKET_HEADER_SIZE + packed * IMU_SAMPLE_SIZE(gyro), "packet of %zu bytes for %zu samples",
+                  len, packed);
+            CHECK(packed == MIN(expected_fit[gyro], count - sent), "%zu samples in a packet (gyro %d)", packed, gyro);
+            CHECK(packet[0] == packets && packet[1] == (gyro ? IMU_PACKET_GYRO : 0), "header %02x %02x", packet[0],
+                  packet[1]);
+            CHECK(sys_get_le16(&packet[2]) == PERIOD_US, "period %u", sys_get_le16(&packet[2]));
+            CHECK(sys_get_le32(&packet[4]) == first_us + sent * PERIOD_US, "packet time %u",
+                  sys_get_le32(&packet[4]));
+
+            // Samples round-trip through the packet
+            const uint8_t *payload = &packet[IMU_PACKET_HEADER_SIZE];
+            for (size_t i = 0; i < packed; i++)
+            {
+                const uint8_t *at = &payload[i * IMU_SAMPLE_SIZE(gyro)];
+                CHECK((int16_t)sys_get_le16(&at[0]) == decoded[sent + i].accel[0] &&
+                          (int16_t)sys_get_le16(&at[4]) == decoded[sent + i].accel[2],
+                      "accelerometer of sample %zu", sent + i);
+                if (gyro)
+                {
+                    CHECK((int16_t)sys_get_le16(&at[10]) == decoded[sent + i].gyro[2], "gyroscope of sample %zu",
+                          sent + i);
+                }
+            }
+            sent += packed;
+            packets++;
+        }
+    }
+
+    // The minimum MTU still fits a sample, a header alone doesn't
+    size_t packed;
+    uint8_t small[20];
+    CHECK(imu_pack(small, sizeof(small), 0, true, PERIOD_US, 0, decoded, count, &packed) == 20 && packed == 1,
+          "%zu samples in a 20-byte packet", packed);
+    CHECK(imu_pack(small, IMU_PACKET_HEADER_SIZE, 0, false, PERIOD_US, 0, decoded, count, &packed) == 0 &&
+              packed == 0,
+          "packed %zu samples into a header", packed);
+}
+
+int main(void)
+{
+    test_bursts_split_mid_sample();
+    test_resyncs_mid_pattern();
+    test_packets();
+
+    return bench_check_result();
+}
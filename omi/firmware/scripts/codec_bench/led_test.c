@@ -0,0 +1,91 @@
+// Host unit test for the LED pattern layers (omi/src/lib/dk2/led_pattern.c)
+//
+// Checks steady and blinking patterns, how higher layers hide lower ones only
+// on the LEDs they claim, and when the driver has to wake up next.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "led_pattern.h"
+#include "bench_check.h"
+
+static const led_pattern_t connected = {.claim = LED_RED | LED_BLUE, .color = LED_BLUE};
+static const led_pattern_t advertising = {.claim = LED_RED | LED_BLUE, .color = LED_RED};
+static const led_pattern_t charging = {.claim = LED_GREEN, .color = LED_GREEN};
+static const led_pattern_t charging_blink = {.claim = LED_GREEN, .color = LED_GREEN, .on_ms = 200, .off_ms = 800};
+static const led_pattern_t error = {.claim = LED_ALL, .color = LED_RED, .on_ms = 100, .off_ms = 100};
+
+static void test_steady(void)
+{
+    led_engine_t engine;
+    led_engine_init(&engine);
+    uint32_t next_ms;
+
+    CHECK(led_engine_eval(&engine, 0, &next_ms) == 0, "lit without a pattern");
+    CHECK(next_ms == LED_NEVER, "wakes up in %u ms without a pattern", next_ms);
+
+    CHECK(led_engine_set(&engine, LED_LAYER_CONNECTION, &advertising, 0), "setting a pattern changed nothing");
+    CHECK(led_engine_set(&engine, LED_LAYER_CHARGING, &charging, 0), "setting a pattern changed nothing");
+    uint8_t lit = led_engine_eval(&engine, 12345, &next_ms);
+    CHECK(lit == (LED_RED | LED_GREEN), "advertising while charging lit 0x%x", lit);
+    CHECK(next_ms == LED_NEVER, "steady patterns wake up in %u ms", next_ms);
+
+    led_engine_set(&engine, LED_LAYER_CONNECTION, &connected, 20000);
+    led_engine_set(&engine, LED_LAYER_CHARGING, NULL, 20000);
+    lit = led_engine_eval(&engine, 20000, &next_ms);
+    CHECK(lit == LED_BLUE, "connected lit 0x%x", lit);
+}
+
+static void test_blink(void)
+{
+    led_engine_t engine;
+    led_engine_init(&engine);
+    uint32_t next_ms;
+
+    led_engine_set(&engine, LED_LAYER_CHARGING, &charging_blink, 1000);
+    CHECK(led_engine_eval(&engine, 1000, &next_ms) == LED_GREEN, "blink doesn't start on");
+    CHECK(next_ms == 200, "first edge in %u ms instead of 200", next_ms);
+    CHECK(led_engine_eval(&engine, 1250, &next_ms) == 0, "on in the off phase");
+    CHECK(next_ms == 750, "next edge in %u ms instead of 750", next_ms);
+    CHECK(led_engine_eval(&engine, 3100, &next_ms) == LED_GREEN, "off in the third on phase");
+    CHECK(next_ms == 100, "next edge in %u ms instead of 100", next_ms);
+
+    // The same pattern again keeps the phase
+    CHECK(!led_engine_set(&engine, LED_LAYER_CHARGING, &charging_blink, 1250), "same pattern reported as a change");
+    CHECK(led_engine_eval(&engine, 1250, &next_ms) == 0, "same pattern restarted the blink");
+
+    // Across the wrap of the millisecond counter
+    led_engine_set(&engine, LED_LAYER_CHARGING, NULL, 0);
+    led_engine_set(&engine, LED_LAYER_CHARGING, &charging_blink, UINT32_MAX - 99);
+    CHECK(led_engine_eval(&engine, 150, &next_ms) == 0, "on after the counter wrapped");
+    CHECK(next_ms == 750, "next edge in %u ms after the wrap", next_ms);
+}
+
+static void test_layers(void)
+{
+    led_engine_t engine;
+    led_engine_init(&engine);
+    uint32_t next_ms;
+
+    led_engine_set(&engine, LED_LAYER_CONNECTION, &connected, 0);
+    led_engine_set(&engine, LED_LAYER_CHARGING, &charging_blink, 0);
+    led_engine_set(&engine, LED_LAYER_ERROR, &error, 0);
+
+    // The error claims all LEDs, the blinking charger below it never wakes the driver
+    CHECK(led_engine_eval(&engine, 0, &next_ms) == LED_RED, "error on phase lit more than red");
+    CHECK(next_ms == 100, "error edge in %u ms", next_ms);
+    CHECK(led_engine_eval(&engine, 150, &next_ms) == 0, "error off phase lit the layers below");
+    CHECK(next_ms == 50, "error edge in %u ms", next_ms);
+
+    led_engine_set(&engine, LED_LAYER_ERROR, NULL, 300);
+    CHECK(led_engine_eval(&engine, 300, &next_ms) == LED_BLUE, "layers below not back after the error");
+    CHECK(next_ms == 700, "charger edge in %u ms", next_ms);
+}
+
+int main(void)
+{
+    test_steady();
+    test_blink();
+    test_layers();
+
+    return bench_check_result();
+}
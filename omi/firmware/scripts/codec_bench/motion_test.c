@@ -0,0 +1,178 @@
+// Host unit test for the motion classifier (omi/src/lib/dk2/motion.c)
+//
+// Synthetic accelerometer traces at 26 Hz and +-4 g: a device lying on a desk, worn by
+// someone sitting (breathing sway and fidgeting), and worn while walking (1.8 steps a
+// second, a vertical bounce with a lateral sway at half the cadence).
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "motion.h"
+#include "bench_check.h"
+
+#define RATE 26
+#define LSB_PER_G 8192
+#define BATCH 26                      // CONFIG_OMI_ACCEL_BATCH_MS 1000
+#define REMOVED_S 60                  // CONFIG_OMI_MOTION_REMOVED_S
+#define MAX_EVENTS 16
+
+static motion_state_t events[MAX_EVENTS];
+static double event_times[MAX_EVENTS];
+static int event_count;
+static double now_s;
+
+static void collect(motion_state_t state)
+{
+    if (event_count < MAX_EVENTS)
+    {
+        events[event_count] = state;
+        event_times[event_count] = now_s;
+    }
+    event_count++;
+}
+
+static uint32_t lcg_state = 1;
+
+// Roughly Gaussian, unit variance
+static double lcg_gauss(void)
+{
+    double sum = 0;
+    for (int i = 0; i < 12; i++)
+    {
+        lcg_state = lcg_state * 1664525u + 1013904223u;
+        sum += (lcg_state >> 8) / (double)(1 << 24);
+    }
+    return sum - 6;
+}
+
+typedef enum
+{
+    DESK,
+    SITTING,
+    WALKING,
+} activity_t;
+
+// Acceleration in g at time t, gravity mostly along -Y for a hanging pendant
+static void accel_at(activity_t activity, double t, double g[3])
+{
+    g[0] = 0.05;
+    g[1] = -0.99;
+    g[2] = 0.10;
+    if (activity == DESK)
+    {
+        // Lying flat, sensor noise alone
+        g[0] = 0.01;
+        g[1] = 0.02;
+        g[2] = 1.0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            g[axis] += 0.0012 * lcg_gauss();
+        }
+        return;
+    }
+    if (activity == SITTING)
+    {
+        g[2] += 0.012 * sin(2 * M_PI * 0.25 * t);               // Breathing
+        g[0] += 0.02 * sin(2 * M_PI * 0.07 * t) * sin(t * 0.3); // Slow fidgeting
+        for (int axis = 0; axis < 3; axis++)
+        {
+            g[axis] += 0.004 * lcg_gauss();
+        }
+        return;
+    }
+    double cadence = 1.8;
+    g[1] -= 0.25 * sin(2 * M_PI * cadence * t) + 0.08 * sin(4 * M_PI * cadence * t);
+    g[0] += 0.10 * sin(M_PI * cadence * t);
+    g[2] += 0.06 * sin(2 * M_PI * cadence * t + 1);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        g[axis] += 0.02 * lcg_gauss();
+    }
+}
+
+static imu_sample_t batch[BATCH];
+static double clock_s;
+
+// Feeds seconds of the activity in accel.c's batches
+static void play(activity_t activity, double seconds)
+{
+    for (double end = clock_s + seconds; clock_s < end;)
+    {
+        for (int i = 0; i < BATCH; i++, clock_s += 1.0 / RATE)
+        {
+            double g[3];
+            accel_at(activity, clock_s, g);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                batch[i].accel[axis] = lrint(g[axis] * LSB_PER_G);
+                batch[i].gyro[axis] = 0;
+            }
+        }
+        now_s = clock_s;
+        motion_process(batch, BATCH);
+    }
+}
+
+static void start(void)
+{
+    motion_init(RATE, LSB_PER_G);
+    motion_set_callback(collect);
+    event_count = 0;
+    clock_s = 0;
+}
+
+static void test_sitting_is_still(void)
+{
+    start();
+    play(SITTING, 120);
+    CHECK(motion_get_state() == MOTION_STILL, "sitting classified %s", motion_state_name(motion_get_state()));
+    CHECK(event_count == 1, "%d state changes while sitting", event_count);
+}
+
+static void test_walking(void)
+{
+    start();
+    play(SITTING, 10);
+    play(WALKING, 30);
+    CHECK(motion_get_state() == MOTION_WALKING, "walking classified %s", motion_state_name(motion_get_state()));
+    CHECK(event_count == 2 && event_times[1] < 10 + 6, "walking detected at %.0f s, 10 s in",
+          event_count > 1 ? event_times[1] : -1.0);
+
+    play(SITTING, 20);
+    CHECK(motion_get_state() == MOTION_STILL, "sat down, classified %s", motion_state_name(motion_get_state()));
+    CHECK(event_count == 3, "%d state changes instead of 3", event_count);
+}
+
+static void test_put_down_and_removed(void)
+{
+    start();
+    play(SITTING, 10);
+    play(DESK, REMOVED_S + 20);
+    CHECK(event_count == 3, "%d state changes instead of 3", event_count);
+    CHECK(event_count >= 3 && events[1] == MOTION_ON_TABLE && event_times[1] < 10 + 10,
+          "not on the table within 10 s of being put down");
+    CHECK(event_count >= 3 && events[2] == MOTION_REMOVED && fabs(event_times[2] - (10 + REMOVED_S)) < 6,
+          "removed at %.0f s instead of %d", event_count >= 3 ? event_times[2] : -1.0, 10 + REMOVED_S);
+
+    // Picked up: back to still at the next window
+    double picked_up = clock_s;
+    play(SITTING, 10);
+    CHECK(motion_get_state() == MOTION_STILL, "picked up, classified %s", motion_state_name(motion_get_state()));
+    CHECK(event_count == 4 && event_times[3] - picked_up <= 3, "back to still %.0f s after the pickup",
+          event_count == 4 ? event_times[3] - picked_up : -1.0);
+}
+
+static void test_low_rate_rejected(void)
+{
+    CHECK(motion_init(12, LSB_PER_G) == -EINVAL, "12 Hz accepted, too slow to count steps");
+}
+
+int main(void)
+{
+    test_sitting_is_still();
+    test_walking();
+    test_put_down_and_removed();
+    test_low_rate_rejected();
+
+    return bench_check_result();
+}
@@ -0,0 +1,63 @@
+// Host unit test for the power state policy (omi/src/lib/dk2/power_policy.c)
+//
+// Checks the state each combination of inputs leads to, and what every state
+// keeps powered.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "power_policy.h"
+#include "bench_check.h"
+
+#define ON_WORN (POWER_INPUT_ON | POWER_INPUT_WORN)
+#define STREAMING_INPUTS (ON_WORN | POWER_INPUT_CONNECTED | POWER_INPUT_SUBSCRIBED)
+
+static void expect(uint32_t inputs, power_state_t expected)
+{
+    power_state_t state = power_policy_state(inputs);
+    CHECK(state == expected, "inputs 0x%02x gave %s instead of %s", inputs, power_state_name(state),
+          power_state_name(expected));
+}
+
+static void test_states(void)
+{
+    expect(ON_WORN, POWER_ADVERTISING);
+    expect(ON_WORN | POWER_INPUT_CONNECTED, POWER_IDLE_CONNECTED);
+    expect(STREAMING_INPUTS, POWER_STREAMING);
+    // Nobody wears it, nothing worth streaming
+    expect(STREAMING_INPUTS & ~POWER_INPUT_WORN, POWER_IDLE_CONNECTED);
+    // Charging while connected keeps serving the app
+    expect(STREAMING_INPUTS | POWER_INPUT_CHARGING, POWER_STREAMING);
+    expect(ON_WORN | POWER_INPUT_CHARGING, POWER_CHARGING);
+    expect(ON_WORN | POWER_INPUT_CHARGING | POWER_INPUT_STORAGE, POWER_CHARGING);
+    expect(ON_WORN | POWER_INPUT_STORAGE, POWER_OFFLINE_RECORDING);
+    expect(POWER_INPUT_ON | POWER_INPUT_STORAGE, POWER_ADVERTISING);
+    // A subscription left over from a past connection doesn't count
+    expect(ON_WORN | POWER_INPUT_SUBSCRIBED, POWER_ADVERTISING);
+    // Off wins over everything
+    expect((STREAMING_INPUTS | POWER_INPUT_CHARGING | POWER_INPUT_STORAGE) & ~POWER_INPUT_ON, POWER_OFF);
+}
+
+static void test_needs(void)
+{
+    CHECK(power_policy_needs(POWER_OFF) == 0, "off keeps 0x%x on", power_policy_needs(POWER_OFF));
+    CHECK(power_policy_needs(POWER_CHARGING) == 0, "charging keeps 0x%x on", power_policy_needs(POWER_CHARGING));
+    CHECK(!(power_policy_needs(POWER_ADVERTISING) & POWER_NEED_MIC), "microphone on while advertising");
+    CHECK(!(power_policy_needs(POWER_IDLE_CONNECTED) & POWER_NEED_MIC), "microphone on while nobody listens");
+    CHECK(power_policy_needs(POWER_STREAMING) == (POWER_NEED_MIC | POWER_NEED_ACCEL), "streaming keeps 0x%x on",
+          power_policy_needs(POWER_STREAMING));
+    CHECK(power_policy_needs(POWER_OFFLINE_RECORDING) & POWER_NEED_SD, "offline recording without the SD card");
+    // Only recording offline powers the card
+    for (int state = 0; state < POWER_STATE_COUNT; state++)
+    {
+        CHECK(state == POWER_OFFLINE_RECORDING || !(power_policy_needs(state) & POWER_NEED_SD), "%s keeps the SD on",
+              power_state_name(state));
+    }
+}
+
+int main(void)
+{
+    test_states();
+    test_needs();
+
+    return bench_check_result();
+}
@@ -0,0 +1,132 @@
+// Host unit test for the codec-rate resampler (omi/src/lib/dk2/audio_resampler.c)
+//
+// Built once per CONFIG_OMI_CODEC_SAMPLE_RATE choice by CMakeLists.txt.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "audio_resampler.h"
+#include "bench_check.h"
+
+#define SECONDS 2
+#define IN_SAMPLES (MIC_SAMPLE_RATE * SECONDS)
+#define OUT_SAMPLES AUDIO_RESAMPLER_OUTPUT_SAMPLES(IN_SAMPLES)
+#define BLOCK 320 // 20ms, CONFIG_OMI_MIC_BLOCK_MS default
+
+static int16_t input[IN_SAMPLES];
+static int16_t output[OUT_SAMPLES];
+
+// Resamples a tone in BLOCK-sized pieces, split as codec_receive_pcm splits them
+static void run_tone(double hz, double amplitude)
+{
+    for (size_t n = 0; n < IN_SAMPLES; n++)
+    {
+        input[n] = (int16_t)lrint(amplitude * sin(2 * M_PI * hz * n / MIC_SAMPLE_RATE));
+    }
+
+    audio_resampler_init();
+    size_t produced = 0;
+    for (size_t offset = 0; offset < IN_SAMPLES; offset += BLOCK)
+    {
+        for (size_t chunk = 0; chunk < BLOCK; chunk += AUDIO_RESAMPLER_MAX_INPUT)
+        {
+            size_t count = MIN(BLOCK - chunk, AUDIO_RESAMPLER_MAX_INPUT);
+            int written = audio_resampler_process(&input[offset + chunk], count, &output[produced]);
+            CHECK(written == (int)AUDIO_RESAMPLER_OUTPUT_SAMPLES(count), "%zu samples gave %d", count, written);
+            produced += written;
+        }
+    }
+}
+
+// Fits hz to the output after the filters have settled, returns the amplitude and
+// the power of everything else
+static double fit_tone(double hz, double *residual_power)
+{
+    size_t from = OUT_SAMPLES / 4;
+    size_t count = OUT_SAMPLES - from;
+    double re = 0, im = 0;
+    for (size_t n = from; n < OUT_SAMPLES; n++)
+    {
+        re += output[n] * cos(2 * M_PI * hz * n / CODEC_SAMPLE_RATE);
+        im += output[n] * sin(2 * M_PI * hz * n / CODEC_SAMPLE_RATE);
+    }
+    re = 2 * re / count;
+    im = 2 * im / count;
+
+    double residual = 0;
+    for (size_t n = from; n < OUT_SAMPLES; n++)
+    {
+        double fitted = re * cos(2 * M_PI * hz * n / CODEC_SAMPLE_RATE) + im * sin(2 * M_PI * hz * n / CODEC_SAMPLE_RATE);
+        residual += (output[n] - fitted) * (output[n] - fitted);
+    }
+    *residual_power = residual / count;
+    return sqrt(re * re + im * im);
+}
+
+#if CODEC_SAMPLE_RATE < MIC_SAMPLE_RATE
+static double output_power(void)
+{
+    double total = 0;
+    for (size_t n = OUT_SAMPLES / 4; n < OUT_SAMPLES; n++)
+    {
+        total += (double)output[n] * output[n];
+    }
+    return total / (OUT_SAMPLES - OUT_SAMPLES / 4);
+}
+#endif
+
+static void test_invalid_lengths(void)
+{
+    audio_resampler_init();
+    CHECK(audio_resampler_process(input, 0, output) == -EINVAL, "accepted an empty block");
+    CHECK(audio_resampler_process(input, MIC_SAMPLE_RATE / 1000 + 1, output) == -EINVAL, "accepted a partial millisecond");
+    CHECK(audio_resampler_process(input, AUDIO_RESAMPLER_MAX_INPUT + MIC_SAMPLE_RATE / 1000, output) == -EINVAL,
+          "accepted more than AUDIO_RESAMPLER_MAX_INPUT");
+}
+
+static void test_passband(void)
+{
+    // Speech band tones come out at the same level and clean
+    const double tones[] = {300, 1000, 3000};
+    for (size_t i = 0; i < ARRAY_SIZE(tones); i++)
+    {
+        double residual;
+        run_tone(tones[i], 8000);
+        double amplitude = fit_tone(tones[i], &residual);
+        double gain = 20 * log10(amplitude / 8000);
+        double snr = 10 * log10(amplitude * amplitude / 2 / residual);
+        printf("%4.0f Hz: gain %.2f dB, SNR %.1f dB\n", tones[i], gain, snr);
+        CHECK(fabs(gain) < 0.5, "%.0f Hz changed by %.2f dB", tones[i], gain);
+        CHECK(snr > 40, "%.0f Hz only at %.1f dB SNR", tones[i], snr);
+    }
+}
+
+static void test_aliasing(void)
+{
+#if CODEC_SAMPLE_RATE < MIC_SAMPLE_RATE
+    // Above the codec Nyquist frequency, a tone must be filtered rather than folded back
+    double hz = CODEC_SAMPLE_RATE / 2 + 1500;
+    run_tone(hz, 8000);
+    double level = 10 * log10(output_power() / (8000.0 * 8000 / 2));
+    printf("%4.0f Hz: %.1f dB after downsampling\n", hz, level);
+    CHECK(level < -30, "%.0f Hz leaks through at %.1f dB", hz, level);
+#else
+    // Upsampling must not create images above the microphone's Nyquist frequency
+    double residual;
+    run_tone(6000, 8000);
+    double amplitude = fit_tone(6000, &residual);
+    double images = 10 * log10(residual / (amplitude * amplitude / 2));
+    printf("6000 Hz: images at %.1f dB\n", images);
+    CHECK(images < -30, "images at %.1f dB", images);
+#endif
+}
+
+int main(void)
+{
+    printf("Resampling %d to %d Hz\n", MIC_SAMPLE_RATE, CODEC_SAMPLE_RATE);
+    test_invalid_lengths();
+    test_passband();
+    test_aliasing();
+
+    return bench_check_result();
+}
@@ -0,0 +1,2 @@
+// Host stand-in, config.h only uses the pin mapping macro
+#define NRF_GPIO_PIN_MAP(port, pin) (((port) << 5) | ((pin) & 0x1F))
@@ -0,0 +1 @@
+// Empty host stand-in, pulled in by utils.h only
@@ -0,0 +1,51 @@
+// Host stand-in for the parts of <zephyr/kernel.h> the codec backends use
+#ifndef BENCH_SHIM_KERNEL_H
+#define BENCH_SHIM_KERNEL_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define CLAMP(val, low, high) (((val) <= (low)) ? (low) : MIN(val, high))
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+#define __ALIGN(x) __attribute__((__aligned__(x)))
+#define BUILD_ASSERT(cond, msg) _Static_assert(cond, msg)
+#define ARG_UNUSED(x) (void)(x)
+
+// Same expansion trick as <zephyr/sys/util_macro.h>
+#define Z_IS_ENABLED_PROBE_1 _,
+#define IS_ENABLED(config) Z_IS_ENABLED1(config)
+#define Z_IS_ENABLED1(config) Z_IS_ENABLED2(Z_IS_ENABLED_PROBE_##config)
+#define Z_IS_ENABLED2(one_or_two_args) Z_IS_ENABLED3(one_or_two_args 1, 0)
+#define Z_IS_ENABLED3(ignore_this, val, ...) val
+
+// The tests are single threaded and pass their own timestamps
+struct k_spinlock
+{
+    int unused;
+};
+typedef int k_spinlock_key_t;
+static inline k_spinlock_key_t k_spin_lock(struct k_spinlock *lock)
+{
+    (void)lock;
+    return 0;
+}
+static inline void k_spin_unlock(struct k_spinlock *lock, k_spinlock_key_t key)
+{
+    (void)lock;
+    (void)key;
+}
+static inline int64_t k_uptime_ticks(void)
+{
+    return 0;
+}
+static inline int64_t k_ticks_to_us_floor64(int64_t ticks)
+{
+    return ticks;
+}
+
+#endif
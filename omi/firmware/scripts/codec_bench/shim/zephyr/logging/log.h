@@ -0,0 +1,13 @@
+// Host stand-in for <zephyr/logging/log.h>, errors and warnings go to stderr
+#ifndef BENCH_SHIM_LOG_H
+#define BENCH_SHIM_LOG_H
+
+#include <stdio.h>
+
+#define LOG_MODULE_REGISTER(...)
+#define LOG_ERR(fmt, ...) fprintf(stderr, "E: " fmt "\n", ##__VA_ARGS__)
+#define LOG_WRN(fmt, ...) fprintf(stderr, "W: " fmt "\n", ##__VA_ARGS__)
+#define LOG_INF(fmt, ...) ((void)0)
+#define LOG_DBG(fmt, ...) ((void)0)
+
+#endif
@@ -0,0 +1,26 @@
+// Host stand-in for <zephyr/sys/atomic.h>, the tests are single threaded
+#ifndef BENCH_SHIM_ATOMIC_H
+#define BENCH_SHIM_ATOMIC_H
+
+typedef long atomic_t;
+
+static inline long atomic_add(atomic_t *target, long value)
+{
+    long old = *target;
+    *target += value;
+    return old;
+}
+
+static inline long atomic_get(const atomic_t *target)
+{
+    return *target;
+}
+
+static inline long atomic_clear(atomic_t *target)
+{
+    long old = *target;
+    *target = 0;
+    return old;
+}
+
+#endif
@@ -0,0 +1,29 @@
+// Host stand-in for <zephyr/sys/byteorder.h>
+#ifndef BENCH_SHIM_BYTEORDER_H
+#define BENCH_SHIM_BYTEORDER_H
+
+#include <stdint.h>
+
+static inline void sys_put_le16(uint16_t val, uint8_t dst[2])
+{
+    dst[0] = val & 0xFF;
+    dst[1] = val >> 8;
+}
+
+static inline uint16_t sys_get_le16(const uint8_t src[2])
+{
+    return src[0] | (src[1] << 8);
+}
+
+static inline void sys_put_le32(uint32_t val, uint8_t dst[4])
+{
+    sys_put_le16(val, dst);
+    sys_put_le16(val >> 16, &dst[2]);
+}
+
+static inline uint32_t sys_get_le32(const uint8_t src[4])
+{
+    return sys_get_le16(src) | ((uint32_t)sys_get_le16(&src[2]) << 16);
+}
+
+#endif
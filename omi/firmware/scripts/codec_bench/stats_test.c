@@ -0,0 +1,211 @@
+// Host unit test for the audio level and spectrum statistics (omi/src/lib/dk2/audio_stats.c)
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "audio_diag.h"
+#include "audio_stats.h"
+#include "bench_check.h"
+
+#define RATE 16000
+#define BLOCK 320                   // CONFIG_OMI_MIC_BLOCK_MS default, 20ms
+#define INTERVAL_MS 200             // CONFIG_OMI_AUDIO_STATS_INTERVAL_MS
+#define MAX_REPORTS 64
+
+static audio_stats_t reports[MAX_REPORTS];
+static int report_count;
+
+static void collect(const audio_stats_t *stats)
+{
+    if (report_count < MAX_REPORTS)
+    {
+        reports[report_count] = *stats;
+    }
+    report_count++;
+}
+
+static uint32_t lcg_state = 1;
+
+static double lcg_uniform(void)
+{
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return (lcg_state >> 8) / (double)(1 << 24) - 0.5;
+}
+
+typedef double (*signal_fn)(size_t n);
+
+static double tone_hz;
+static double tone_amplitude;
+
+static double tone(size_t n)
+{
+    return tone_amplitude * sin(2 * M_PI * tone_hz * n / RATE);
+}
+
+// Flat noise, sqrt(12) * amplitude peak to peak so amplitude is its RMS
+static double noise_rms;
+
+static double noise(size_t n)
+{
+    return noise_rms * sqrt(12) * lcg_uniform();
+}
+
+// Room noise, then a "talker" of 12 harmonics of 180 Hz in 0.5s syllables from 2s to 4s
+static double talk(size_t n)
+{
+    double value = 30 * sqrt(12) * lcg_uniform();
+    double t = (double)n / RATE;
+    if (t >= 2 && t < 4 && fmod(t, 0.5) < 0.35)
+    {
+        for (int h = 1; h <= 12; h++)
+        {
+            value += 1500.0 / h * sin(2 * M_PI * 180 * h * t);
+        }
+    }
+    return value;
+}
+
+static int16_t block_buffer[BLOCK];
+
+// Feeds seconds of the signal in microphone blocks, the reports land in reports[]
+static void run(signal_fn signal, double seconds, bool *voice_at_blocks)
+{
+    audio_stats_init();
+    audio_stats_set_callback(collect);
+    report_count = 0;
+
+    size_t total = seconds * RATE;
+    for (size_t offset = 0; offset < total; offset += BLOCK)
+    {
+        for (size_t i = 0; i < BLOCK; i++)
+        {
+            double value = lrint(signal(offset + i));
+            block_buffer[i] = value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : value;
+        }
+        audio_stats_process(block_buffer, BLOCK);
+        if (voice_at_blocks)
+        {
+            voice_at_blocks[offset / BLOCK] = audio_stats_voice_active();
+        }
+    }
+}
+
+static void test_level_and_peak(void)
+{
+    tone_hz = 1000;
+    tone_amplitude = 10000;
+    run(tone, 1, NULL);
+
+    CHECK(report_count == 1000 / INTERVAL_MS, "%d reports in a second", report_count);
+    const audio_stats_t *last = &reports[report_count - 1];
+    CHECK(abs(last->rms - 7071) < 20, "sine RMS %u instead of 7071", last->rms);
+    CHECK(abs(last->peak - 10000) <= 1, "sine peak %u instead of 10000", last->peak);
+    CHECK(last->clipped == 0, "%u clipped samples in a clean sine", last->clipped);
+}
+
+static void test_clipping_counted(void)
+{
+    // Twice full scale: about two thirds of every cycle sits at the rails
+    tone_hz = 500;
+    tone_amplitude = 65536;
+    audio_diag_reset();
+    run(tone, 1, NULL);
+
+    uint32_t clipped = 0, expected = 0;
+    for (int i = 0; i < report_count; i++)
+    {
+        clipped += reports[i].clipped;
+    }
+    for (size_t n = 0; n < RATE; n++)
+    {
+        expected += fabs(tone(n)) >= INT16_MAX;
+    }
+    CHECK(clipped == expected, "%u samples clipped instead of %u", clipped, expected);
+    CHECK(audio_diag_get(AUDIO_DIAG_MIC_CLIPPED_SAMPLES) == clipped, "diagnostics counted %u, reports %u",
+          audio_diag_get(AUDIO_DIAG_MIC_CLIPPED_SAMPLES), clipped);
+}
+
+static void test_tone_in_its_band(void)
+{
+    // 1 kHz falls in the 750-1250 Hz band
+    tone_hz = 1000;
+    tone_amplitude = 8000;
+    run(tone, 1, NULL);
+
+    const audio_stats_t *last = &reports[report_count - 1];
+    CHECK(abs(last->bands[3] - last->rms) < last->rms / 50, "band level %u for a tone at RMS %u", last->bands[3],
+          last->rms);
+    for (int band = 0; band < AUDIO_STATS_BANDS; band++)
+    {
+        if (band != 3)
+        {
+            double leak = 20 * log10((last->bands[band] + 0.5) / last->bands[3]);
+            CHECK(leak < -40, "band %d only %.1f dB below the tone's", band, leak);
+        }
+    }
+}
+
+static void test_bands_add_up(void)
+{
+    // White noise: the bands' powers cover 125-8000 Hz, i.e. all but 1/64 of it
+    noise_rms = 3000;
+    run(noise, 2, NULL);
+
+    const audio_stats_t *last = &reports[report_count - 1];
+    double band_power = 0;
+    for (int band = 0; band < AUDIO_STATS_BANDS; band++)
+    {
+        band_power += (double)last->bands[band] * last->bands[band];
+    }
+    double ratio_db = 10 * log10(band_power / ((double)last->rms * last->rms));
+    printf("White noise: RMS %u, band sum %.2f dB off\n", last->rms, ratio_db);
+    CHECK(fabs(ratio_db) < 0.5, "band powers add up to %.2f dB of the RMS", ratio_db);
+    // 3000 Hz of 8000 sits in the 3000-5000 and 5000-8000 bands, twice the width of 2000-3000
+    CHECK(last->bands[7] > last->bands[5], "5-8 kHz band %u below the 2-3 kHz band %u", last->bands[7],
+          last->bands[5]);
+}
+
+static bool voice[5 * RATE / BLOCK];
+
+static void test_voice_activity(void)
+{
+    run(talk, 5, voice);
+
+    // Syllables at 2.0, 2.5, 3.0 and 3.5s, 350ms each, plus the 300ms hangover
+    int false_alarms = 0, misses = 0;
+    for (size_t block = 0; block < 5 * RATE / BLOCK; block++)
+    {
+        double t = (double)(block + 1) * BLOCK / RATE;
+        bool expected = t >= 2.05 && t < 4.0;
+        bool silent = t < 2.0 || t >= 4.4;
+        if (silent && voice[block])
+        {
+            false_alarms++;
+        }
+        if (expected && !voice[block])
+        {
+            misses++;
+        }
+    }
+    CHECK(false_alarms == 0, "voice reported in %d noise-only blocks", false_alarms);
+    CHECK(misses == 0, "voice missed in %d blocks of speech", misses);
+
+    int voiced_reports = 0;
+    for (int i = 0; i < report_count && i < MAX_REPORTS; i++)
+    {
+        voiced_reports += reports[i].voice;
+    }
+    // Voice from 2.0s to the end of the hangover at about 4.15s spans reports 10 to 20
+    CHECK(voiced_reports == 11, "%d reports flagged voice instead of 11", voiced_reports);
+}
+
+int main(void)
+{
+    test_level_and_peak();
+    test_clipping_counted();
+    test_tone_in_its_band();
+    test_bands_add_up();
+    test_voice_activity();
+
+    return bench_check_result();
+}
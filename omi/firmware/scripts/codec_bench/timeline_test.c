@@ -0,0 +1,118 @@
+// Host unit test for the capture timeline (omi/src/lib/dk2/device_clock.c)
+//
+// The microphone thread picks its 20ms blocks up some time after their DMA completes:
+// usually within a few hundred microseconds, sometimes milliseconds late, and after a
+// stall several blocks at once. The sample clock runs 50 ppm off the device clock.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "device_clock.h"
+#include "bench_check.h"
+
+#define BLOCK_US 20000                // CONFIG_OMI_MIC_BLOCK_MS default
+#define DRIFT_PPM 50
+#define SETTLE_BLOCKS 50              // One second to find the earliest pickups
+#define MAX_ERROR_US 300
+
+static uint32_t lcg_state = 1;
+
+static uint32_t lcg_range(uint32_t from, uint32_t to)
+{
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return from + (lcg_state >> 8) % (to - from);
+}
+
+// True capture time of a block's first sample
+static double block_start_us(double start_us, int block, int drift_ppm)
+{
+    return start_us + block * BLOCK_US * (1 + drift_ppm / 1e6);
+}
+
+// Scheduling latency: mostly short, now and then late, and a 70ms stall every 100 blocks
+static int64_t pickup_us(double completed_us, int block, int64_t *stalled_until)
+{
+    if (block % 100 == 37)
+    {
+        *stalled_until = (int64_t)completed_us + 70000;
+    }
+    int64_t latency = lcg_range(0, 100) < 85 ? lcg_range(20, 300) : lcg_range(1000, 4000);
+    return MAX((int64_t)completed_us + latency, *stalled_until);
+}
+
+// Runs blocks through the timeline, returns the largest error after settling
+static double run(capture_timeline_t *timeline, double start_us, int blocks, int drift_ppm)
+{
+    int64_t stalled_until = 0;
+    double worst = 0;
+    for (int block = 0; block < blocks; block++)
+    {
+        double start = block_start_us(start_us, block, drift_ppm);
+        int64_t completed = pickup_us(start + BLOCK_US * (1 + drift_ppm / 1e6), block, &stalled_until);
+        int64_t estimate = capture_timeline_update(timeline, completed, BLOCK_US);
+        if (block >= SETTLE_BLOCKS)
+        {
+            worst = MAX(worst, fabs(estimate - start));
+        }
+    }
+    return worst;
+}
+
+static void test_tracks_jitter_and_stalls(void)
+{
+    capture_timeline_t timeline;
+    capture_timeline_reset(&timeline);
+    double worst = run(&timeline, 1e6, 3000, 0);
+    printf("Largest capture time error %.0f us\n", worst);
+    CHECK(worst < MAX_ERROR_US, "capture time off by %.0f us", worst);
+}
+
+static void test_follows_drift(void)
+{
+    // A minute each way, long enough for 50 ppm to add up to 3ms
+    for (int sign = -1; sign <= 1; sign += 2)
+    {
+        capture_timeline_t timeline;
+        capture_timeline_reset(&timeline);
+        double worst = run(&timeline, 1e6, 3000, sign * DRIFT_PPM);
+        printf("Largest capture time error %.0f us at %+d ppm\n", worst, sign * DRIFT_PPM);
+        CHECK(worst < MAX_ERROR_US, "capture time off by %.0f us at %+d ppm", worst, sign * DRIFT_PPM);
+    }
+}
+
+static void test_resyncs_after_gap(void)
+{
+    capture_timeline_t timeline;
+    capture_timeline_reset(&timeline);
+    run(&timeline, 1e6, 200, 0);
+
+    // The microphone restarts 10s later without a reset, the first pickup is far off the timeline
+    double start = 1e6 + 200 * BLOCK_US + 10e6;
+    int64_t estimate = capture_timeline_update(&timeline, start + BLOCK_US + 100, BLOCK_US);
+    CHECK(fabs(estimate - start) <= 100, "first block after a gap off by %.0f us", fabs(estimate - start));
+
+    // A restart in less than the resync threshold needs the reset
+    capture_timeline_reset(&timeline);
+    double worst = run(&timeline, start + 100000, 200, 0);
+    CHECK(worst < MAX_ERROR_US, "capture time off by %.0f us after a reset", worst);
+}
+
+static void test_first_block_snaps(void)
+{
+    capture_timeline_t timeline;
+    capture_timeline_reset(&timeline);
+    int64_t estimate = capture_timeline_update(&timeline, 5000000, BLOCK_US);
+    CHECK(estimate == 5000000 - BLOCK_US, "first block at %lld us instead of %d", (long long)estimate,
+          5000000 - BLOCK_US);
+}
+
+int main(void)
+{
+    test_first_block_snaps();
+    test_tracks_jitter_and_stalls();
+    test_follows_drift();
+    test_resyncs_after_gap();
+
+    return bench_check_result();
+}
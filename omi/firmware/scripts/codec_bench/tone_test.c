@@ -0,0 +1,132 @@
+// Host unit test for the notification tone synthesizer (omi/src/lib/dk2/tone.c)
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "tone.h"
+#include "bench_check.h"
+
+#define RATE 8000  // SAMPLE_FREQUENCY in dk2/speaker.c
+#define BLOCK 160  // One 20ms speaker frame
+#define MAX_SAMPLES (RATE * 2)
+
+static tone_player_t player;
+static int16_t output[MAX_SAMPLES];
+
+// Renders a pattern in speaker-sized blocks, returns the samples up to the end of the pattern
+static size_t render(const tone_pattern_t *pattern)
+{
+    size_t total = 0;
+    tone_start(&player, pattern, RATE);
+    while (total + BLOCK <= MAX_SAMPLES && tone_render(&player, &output[total], BLOCK))
+    {
+        total += BLOCK;
+    }
+    return total;
+}
+
+static int peak(size_t from, size_t to)
+{
+    int value = 0;
+    for (size_t n = from; n < to; n++)
+    {
+        value = MAX(value, abs(output[n]));
+    }
+    return value;
+}
+
+static void test_pure_tone(void)
+{
+    // Long sustain at full scale, the table and interpolation error is all that's left
+    const tone_note_t note = {.start_ms = 0, .length_ms = 1000, .hz = 1000, .level = 32767};
+    const tone_pattern_t pattern = {.notes = &note, .count = 1,
+                                    .envelope = {.attack_ms = 1, .decay_ms = 1, .sustain = 32767, .release_ms = 1}};
+    render(&pattern);
+
+    size_t from = RATE / 10, to = RATE * 9 / 10;
+    double re = 0, im = 0;
+    for (size_t n = from; n < to; n++)
+    {
+        re += output[n] * cos(2 * M_PI * 1000 * n / RATE);
+        im += output[n] * sin(2 * M_PI * 1000 * n / RATE);
+    }
+    re = 2 * re / (to - from);
+    im = 2 * im / (to - from);
+    double amplitude = sqrt(re * re + im * im);
+    double residual = 0;
+    for (size_t n = from; n < to; n++)
+    {
+        double fitted = re * cos(2 * M_PI * 1000 * n / RATE) + im * sin(2 * M_PI * 1000 * n / RATE);
+        residual += (output[n] - fitted) * (output[n] - fitted);
+    }
+    double snr = 10 * log10(amplitude * amplitude / 2 / (residual / (to - from)));
+    printf("1000 Hz: amplitude %.0f, SNR %.1f dB\n", amplitude, snr);
+    CHECK(fabs(amplitude - 32767) < 100, "amplitude %.0f", amplitude);
+    CHECK(snr > 60, "SNR %.1f dB", snr);
+}
+
+static void test_envelope(void)
+{
+    const tone_note_t note = {.start_ms = 100, .length_ms = 200, .hz = 500, .level = 16000};
+    const tone_pattern_t pattern = {.notes = &note, .count = 1,
+                                    .envelope = {.attack_ms = 20, .decay_ms = 50, .sustain = 16384, .release_ms = 100}};
+    size_t total = render(&pattern);
+
+    // Silent before the note, at the peak after the attack, at half in sustain, silent after the release
+    CHECK(peak(0, RATE / 10) == 0, "sound before the note started");
+    int attack = peak(RATE / 10 + RATE * 15 / 1000, RATE / 10 + RATE * 25 / 1000);
+    int sustain = peak(RATE / 10 + RATE * 150 / 1000, RATE / 10 + RATE * 200 / 1000);
+    CHECK(abs(attack - 16000) < 400, "attack peaked at %d", attack);
+    CHECK(abs(sustain - 8000) < 200, "sustain at %d", sustain);
+    size_t end = RATE / 10 + RATE * 300 / 1000;
+    CHECK(total >= end && total <= end + BLOCK, "pattern ended after %zu samples, expected %zu", total, end);
+    CHECK(peak(end, MIN(end + BLOCK, MAX_SAMPLES)) == 0, "sound after the release");
+}
+
+static void test_boot_chime(void)
+{
+    size_t total = render(&tone_boot_chime);
+    int loudest = peak(0, total);
+    printf("Boot chime: %zu ms, peak %d\n", total * 1000 / RATE, loudest);
+    CHECK(total > 0 && total <= RATE / 2, "boot chime lasted %zu samples", total);
+    CHECK(loudest > 8000 && loudest <= 4 * 4096, "boot chime peak %d", loudest);
+}
+
+static void test_voice_stealing(void)
+{
+    // More notes than voices, loud enough to need the saturation
+    tone_note_t notes[TONE_VOICES + 2];
+    for (size_t i = 0; i < ARRAY_SIZE(notes); i++)
+    {
+        notes[i] = (tone_note_t){.start_ms = i * 10, .length_ms = 100, .hz = 400 + 100 * i, .level = 20000};
+    }
+    const tone_pattern_t pattern = {.notes = notes, .count = ARRAY_SIZE(notes),
+                                    .envelope = {.attack_ms = 5, .decay_ms = 5, .sustain = 32767, .release_ms = 20}};
+    size_t total = render(&pattern);
+    CHECK(total > 0 && total < RATE, "stolen voices kept sounding for %zu samples", total);
+}
+
+static void test_throughput(void)
+{
+    const int repeats = 200;
+    clock_t begin = clock();
+    for (int i = 0; i < repeats; i++)
+    {
+        render(&tone_boot_chime);
+    }
+    double seconds = (double)(clock() - begin) / CLOCKS_PER_SEC;
+    size_t samples = render(&tone_boot_chime);
+    printf("Boot chime renders %.0fx faster than realtime\n", repeats * (double)samples / RATE / seconds);
+}
+
+int main(void)
+{
+    test_pure_tone();
+    test_envelope();
+    test_boot_chime();
+    test_voice_stealing();
+    test_throughput();
+
+    return bench_check_result();
+}